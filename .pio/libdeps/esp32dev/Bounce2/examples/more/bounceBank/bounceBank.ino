@@ -0,0 +1,55 @@
+
+/* 
+ DESCRIPTION
+ ====================
+ Example of the DebouncerBank class: eight buttons debounced together
+ with a single read of the input source per update. The debug LED is
+ on while any button is held and every press is printed.
+ */
+ 
+// Include the Bounce2 library found here :
+// https://github.com/thomasfredericks/Bounce2
+#include <DebouncerBank.h>
+
+#define BUTTON_COUNT 8
+
+const uint8_t BUTTON_PINS[BUTTON_COUNT] = {2, 3, 4, 5, 6, 7, 8, 9};
+
+#define LED_PIN 13
+
+// Instantiate a bank of eight inputs read from pins
+DebouncerBank<BUTTON_COUNT, GpioRegisterSource> buttons;
+
+void setup() {
+
+  Serial.begin(115200);
+
+  // Setup the buttons with an internal pull-up :
+  buttons.source().attach(BUTTON_PINS, INPUT_PULLUP);
+  // Choose the method and the interval, then take the initial state :
+  buttons.setMode(DebouncerUs::PROMPT_DETECTION);
+  buttons.interval(5000); // interval in us
+  buttons.begin();
+
+  //Setup the LED :
+  pinMode(LED_PIN,OUTPUT);
+
+}
+
+void loop() {
+  // Update every button at once :
+  DebouncerBank<BUTTON_COUNT, GpioRegisterSource>::Changes changes = buttons.update();
+
+  // A press pulls the pin LOW :
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    if ( changes.fell & (1UL << i) ) {
+      Serial.print("Pressed button ");
+      Serial.println(i);
+    }
+  }
+
+  // Turn on the LED if any button is pressed :
+  const uint32_t allReleased = (1UL << BUTTON_COUNT) - 1;
+  digitalWrite(LED_PIN, buttons.read() != allReleased ? HIGH : LOW );
+
+}
@@ -0,0 +1,52 @@
+
+/* 
+ DESCRIPTION
+ ====================
+ Example of the EdgeBounce class (ESP32/ESP8266): the button is read
+ from a pin interrupt instead of polling digitalRead(). Every press is
+ printed with how long the button was released before it, measured from
+ the interrupt timestamps.
+ */
+ 
+// Include the Bounce2 library found here :
+// https://github.com/thomasfredericks/Bounce2
+#include <Bounce2.h>
+
+#define BUTTON_PIN 4
+
+#define LED_PIN 2
+
+// Instantiate an EdgeBounce object
+EdgeBounce debouncer = EdgeBounce(); 
+
+void setup() {
+
+  Serial.begin(115200);
+
+  // Choose the method and the interval :
+  debouncer.setMode(DebouncerUs::PROMPT_DETECTION);
+  debouncer.interval(5000); // interval in us
+  // Setup the button with an internal pull-up and its CHANGE interrupt :
+  debouncer.attach(BUTTON_PIN, INPUT_PULLUP);
+
+  //Setup the LED :
+  pinMode(LED_PIN,OUTPUT);
+
+}
+
+void loop() {
+  // Replay the edges the interrupt has queued :
+  debouncer.update();
+
+  if ( debouncer.fell() ) {
+    Serial.print("Pressed after ");
+    Serial.print(debouncer.previousDuration());
+    Serial.println(" us released");
+  }
+
+  // Turn on the LED while the button is pressed :
+  digitalWrite(LED_PIN, debouncer.read() == LOW ? HIGH : LOW );
+
+  delay(1);
+
+}
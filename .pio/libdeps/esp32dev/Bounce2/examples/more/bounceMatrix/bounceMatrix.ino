@@ -0,0 +1,65 @@
+
+/* 
+ DESCRIPTION
+ ====================
+ Example of a DebouncerBank read from a switch matrix: 4 rows by 6
+ columns give 24 buttons on 10 pins. Every press is printed, and once
+ per second the measured scan time of the whole matrix and the scans
+ that found ghosting.
+ */
+ 
+// Include the Bounce2 library found here :
+// https://github.com/thomasfredericks/Bounce2
+#include <DebouncerBank.h>
+
+#define ROW_COUNT 4
+#define COLUMN_COUNT 6
+#define BUTTON_COUNT (ROW_COUNT * COLUMN_COUNT)
+
+const uint8_t ROW_PINS[ROW_COUNT] = {13, 12, 14, 27};
+const uint8_t COLUMN_PINS[COLUMN_COUNT] = {26, 25, 33, 32, 4, 15};
+
+// Instantiate a bank of 24 inputs read from the matrix
+DebouncerBank<BUTTON_COUNT, MatrixSource> buttons;
+
+unsigned long lastReport = 0;
+
+void setup() {
+
+  Serial.begin(115200);
+
+  // The switches have no diodes, so ghosting is held off :
+  buttons.source().attach(ROW_PINS, ROW_COUNT, COLUMN_PINS, COLUMN_COUNT, false);
+  // The last row has long wires and needs more time to settle :
+  buttons.source().setSettleTime(3, 8);
+  buttons.setMode(DebouncerUs::PROMPT_DETECTION);
+  buttons.interval(5000); // interval in us
+  buttons.begin();
+
+}
+
+void loop() {
+  // Scan the whole matrix once :
+  DebouncerBank<BUTTON_COUNT, MatrixSource>::Changes changes = buttons.update();
+
+  // A press reads LOW, as with INPUT_PULLUP pins :
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    if ( changes.fell & (1UL << i) ) {
+      Serial.print("Pressed row ");
+      Serial.print(i / COLUMN_COUNT);
+      Serial.print(" column ");
+      Serial.println(i % COLUMN_COUNT);
+    }
+  }
+
+  if ( millis() - lastReport >= 1000 ) {
+    lastReport = millis();
+    Serial.print("Scan time (us): ");
+    Serial.print(buttons.source().scanTime());
+    Serial.print(" max ");
+    Serial.print(buttons.source().maxScanTime());
+    Serial.print(", ghosted scans: ");
+    Serial.println(buttons.source().ghostedScans());
+  }
+
+}
@@ -151,5 +151,202 @@ void Bounce::attach(int pin, int mode){
     this->attach(pin);
 }
 
+/////////////////
+// DEBOUNCE US //
+/////////////////
+
+DebouncerUs::DebouncerUs():previous_micros(0)
+    , interval_micros(10000)
+    , lastUpdateTime(0)
+    , stateChangeLastTime(0)
+    , durationOfPreviousState(0)
+    , state(0)
+    , mode(STABLE_INTERVAL) {}
+
+// In IRAM with update(): an adaptive debouncer changes its interval from within a scan.
+void BOUNCE2_UPDATE_ATTR DebouncerUs::interval(uint32_t interval_micros)
+{
+    this->interval_micros = interval_micros;
+}
+
+void DebouncerUs::begin(uint32_t now) {
+    lastUpdateTime = now;
+    state = 0;
+    if (readCurrentState()) {
+        setStateFlag(DEBOUNCED_STATE | UNSTABLE_STATE);
+    }
+    stateChangeLastTime = now;
+    // In lock-out mode the first edge must not be locked out.
+    previous_micros = (mode == LOCK_OUT) ? now - interval_micros : now;
+}
+
+bool BOUNCE2_UPDATE_ATTR DebouncerUs::update(uint32_t now)
+{
+    lastUpdateTime = now;
+    unsetStateFlag(CHANGED_STATE);
+
+    switch (mode) {
+    case LOCK_OUT:
+        // Ignore everything if we are locked out
+        if (now - previous_micros >= interval_micros) {
+            bool currentState = readCurrentState();
+            if ( currentState != getStateFlag(DEBOUNCED_STATE) ) {
+                previous_micros = now;
+                changeState(now);
+            }
+        }
+        break;
+
+    case PROMPT_DETECTION: {
+        bool readState = readCurrentState();
+
+        // A change is reported at once as long as the input was stable for
+        // the whole interval before it.
+        if ( readState != getStateFlag(DEBOUNCED_STATE) && now - previous_micros >= interval_micros ) {
+            changeState(now);
+        }
+
+        // Any edge restarts the timer: the input is still unstable.
+        if ( readState != getStateFlag(UNSTABLE_STATE) ) {
+            toggleStateFlag(UNSTABLE_STATE);
+            previous_micros = now;
+        }
+        break;
+    }
 
+    case STABLE_INTERVAL:
+    default: {
+        bool currentState = readCurrentState();
+
+        // If the reading is different from last reading, reset the debounce counter
+        if ( currentState != getStateFlag(UNSTABLE_STATE) ) {
+            previous_micros = now;
+            toggleStateFlag(UNSTABLE_STATE);
+        } else if ( now - previous_micros >= interval_micros ) {
+            // We have passed the threshold time, so the input is now stable
+            if (currentState != getStateFlag(DEBOUNCED_STATE) ) {
+                previous_micros = now;
+                changeState(now);
+            }
+        }
+        break;
+    }
+    }
+
+    return changed();
+}
 
+inline void BOUNCE2_UPDATE_ATTR DebouncerUs::changeState(uint32_t now) {
+    toggleStateFlag(DEBOUNCED_STATE);
+    setStateFlag(CHANGED_STATE);
+    durationOfPreviousState = now - stateChangeLastTime;
+    stateChangeLastTime = now;
+}
+
+//////////////
+// BOUNCE US //
+//////////////
+
+BounceUs::BounceUs()
+    : pin(0)
+{}
+
+void BounceUs::attach(int pin) {
+    this->pin = pin;
+
+    // SET INITIAL STATE
+    begin(micros());
+}
+
+void BounceUs::attach(int pin, int mode){
+    setPinMode(pin, mode);
+    this->attach(pin);
+}
+
+////////////////
+// EDGE BOUNCE //
+////////////////
+
+EdgeBounce::EdgeBounce()
+    : pin(0)
+    , replayLevel(false)
+    , head(0)
+    , tail(0)
+    , latestLevel(false)
+    , overflowed(false)
+    , droppedEdges(0)
+{}
+
+void EdgeBounce::attach(int pin) {
+    this->pin = pin;
+    replayLevel = latestLevel = digitalRead(pin);
+
+    // SET INITIAL STATE
+    begin(micros());
+}
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP8266)
+void EdgeBounce::attach(int pin, int mode) {
+    pinMode(pin, mode);
+    this->attach(pin);
+    attachInterruptArg(digitalPinToInterrupt(pin), handleInterrupt, this, CHANGE);
+}
+
+void BOUNCE2_ISR_ATTR EdgeBounce::handleInterrupt(void* arg) {
+    EdgeBounce* self = static_cast<EdgeBounce*>(arg);
+    self->ingest(micros(), digitalRead(self->pin));
+}
+#endif
+
+void BOUNCE2_ISR_ATTR EdgeBounce::ingest(uint32_t timestampUs, bool level) {
+    latestLevel = level;
+    const uint8_t h = head;
+    const uint8_t next = (h + 1) & (QUEUE_SIZE - 1);
+    if (next == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) {
+        overflowed = true;
+        droppedEdges = droppedEdges + 1;
+        return;
+    }
+    queue[h].timestampUs = timestampUs;
+    queue[h].level = level;
+    // Publish the edge only once it is written
+    __atomic_store_n(&head, next, __ATOMIC_RELEASE);
+}
+
+void EdgeBounce::replay(uint32_t timestampUs) {
+    // The interrupt and the task read the clock independently, so an edge
+    // can be stamped just before the previous update(now). Time never runs
+    // backwards for the state machine.
+    if ((int32_t)(timestampUs - lastUpdateTime) < 0) {
+        timestampUs = lastUpdateTime;
+    }
+    DebouncerUs::update(timestampUs);
+}
+
+bool EdgeBounce::update(uint32_t now) {
+    const bool before = getStateFlag(DEBOUNCED_STATE);
+
+    uint8_t t = tail;
+    const uint8_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    while (t != h) {
+        replayLevel = queue[t].level;
+        replay(queue[t].timestampUs);
+        t = (t + 1) & (QUEUE_SIZE - 1);
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+
+    // Edges were lost: trust the pin level the interrupt saw last
+    if (overflowed) {
+        overflowed = false;
+        replayLevel = latestLevel;
+    }
+
+    replay(now);
+
+    if (getStateFlag(DEBOUNCED_STATE) != before) {
+        setStateFlag(CHANGED_STATE);
+    } else {
+        unsetStateFlag(CHANGED_STATE);
+    }
+    return changed();
+}
@@ -267,6 +267,255 @@ protected:
 
 };
 
+/**
+     @brief  Microsecond-resolution debouncer with a debounce method selectable per instance at run time.
+
+     Unlike Debouncer, the clock is read at most once per update(), or not at all when the caller
+     passes the timestamp with update(now). This lets a whole bank of inputs share a single clock read.
+*/
+class DebouncerUs
+{
+ // Note : this is protected (for EdgeBounce) as it migh change in the future
+protected:
+  static const uint8_t DEBOUNCED_STATE = 0b00000001; // Final returned calculated debounced state
+  static const uint8_t UNSTABLE_STATE  = 0b00000010; // Actual last state value behind the scene
+  static const uint8_t CHANGED_STATE   = 0b00000100; // The DEBOUNCED_STATE has changed since last update()
+
+  inline void changeState(uint32_t now);
+  inline void setStateFlag(const uint8_t flag)       {state |= flag;}
+  inline void unsetStateFlag(const uint8_t flag)     {state &= ~flag;}
+  inline void toggleStateFlag(const uint8_t flag)    {state ^= flag;}
+  inline bool getStateFlag(const uint8_t flag) const {return((state & flag) != 0);}
+
+public:
+  /**
+    @brief The debounce method. These are the same algorithms that Debouncer selects with #define, see the README.
+  */
+  enum Mode : uint8_t {
+    STABLE_INTERVAL = 0,  ///< Report a change once the input has been stable for the interval (default).
+    LOCK_OUT,             ///< Report the first edge immediately, then ignore the input for the interval.
+    PROMPT_DETECTION      ///< Report the first edge immediately if the input was stable for the interval before it, otherwise as soon as it settles.
+  };
+
+	/*!
+    @brief  Create an instance of the DebouncerUs class.
+*/
+	DebouncerUs();
+
+    /**
+    @brief  Sets the debounce interval in microseconds.
+
+    @param    interval_micros
+    		The interval time in microseconds.
+     */
+	void interval(uint32_t interval_micros);
+
+    /**
+    @brief  Returns the debounce interval in microseconds.
+     */
+	uint32_t getInterval() const { return interval_micros; }
+
+    /**
+    @brief  Selects the debounce method. Can be changed at any time.
+     */
+	void setMode(Mode mode) { this->mode = mode; }
+
+    /**
+    @brief  Returns the debounce method.
+     */
+	Mode getMode() const { return mode; }
+
+	/*!
+    @brief   Updates the state, reading micros() once.
+
+    @return True if the state changed.
+*/
+	bool update() { return update(micros()); }
+
+	/*!
+    @brief   Updates the state using a timestamp supplied by the caller. Does not read the clock.
+
+    @param    now
+              The current time in microseconds.
+
+    @return True if the state changed.
+*/
+	bool update(uint32_t now);
+
+    /**
+     @brief Returns the debounced state (HIGH or LOW).
+     */
+	bool read() const { return getStateFlag(DEBOUNCED_STATE); }
+
+    /**
+    @brief Returns true if the state transitioned from high to low on the last update.
+    */
+	bool fell() const { return !getStateFlag(DEBOUNCED_STATE) && getStateFlag(CHANGED_STATE); }
+
+    /**
+    @brief Returns true if the state transitioned from low to high on the last update.
+    */
+	bool rose() const { return getStateFlag(DEBOUNCED_STATE) && getStateFlag(CHANGED_STATE); }
+
+    /**
+     @brief Returns true if the state changed on last update.
+     */
+	bool changed() const { return getStateFlag(CHANGED_STATE); }
+
+    /**
+     @brief Returns the duration in microseconds of the current state, as of the last update().
+     */
+	uint32_t currentDuration() const { return lastUpdateTime - stateChangeLastTime; }
+
+    /**
+     @brief Returns the duration in microseconds of the previous state.
+     */
+	uint32_t previousDuration() const { return durationOfPreviousState; }
+
+protected:
+  void begin(uint32_t now);
+  virtual bool readCurrentState() =0;
+  uint32_t previous_micros;
+  uint32_t interval_micros;
+  uint32_t lastUpdateTime;   // Timestamp of the running (or last) update(); readCurrentState() may use it
+  uint32_t stateChangeLastTime;
+  uint32_t durationOfPreviousState;
+  uint8_t state;
+  Mode mode;
+};
+
+/**
+@brief The DebouncerUs:BounceUs class. Links the DebouncerUs class to a hardware pin.
+*/
+class BounceUs : public DebouncerUs
+{
+public:
+	BounceUs();
+
+/*!
+    @brief  Attach to a pin and sets that pin's mode (INPUT, INPUT_PULLUP or OUTPUT).
+*/
+	void attach(int pin, int mode);
+
+    /**
+    Attach to a pin for advanced users. Only attach the pin this way once you have previously set it up. Otherwise use attach(int pin, int mode).
+    */
+	void attach(int pin);
+
+ /**
+  @brief Return pin that this BounceUs is attached to
+  */
+  inline int getPin() const {
+      return this->pin;
+  };
+
+protected:
+	uint8_t pin;
+
+	virtual bool readCurrentState() { return digitalRead(pin); }
+	virtual void setPinMode(int pin, int mode) {
+#if defined(ARDUINO_ARCH_STM32F1)
+		pinMode(pin, (WiringPinMode)mode);
+#else
+		pinMode(pin, mode);
+#endif
+	}
+};
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP8266)
+#define BOUNCE2_ISR_ATTR IRAM_ATTR
+#else
+#define BOUNCE2_ISR_ATTR
+#endif
+
+// Define BOUNCE2_UPDATE_IN_IRAM (as a build flag) to place DebouncerUs::update() in IRAM as well, for scan
+// loops that must never wait for the flash cache.
+#if (defined(ARDUINO_ARCH_ESP32) || defined(ESP8266)) && defined(BOUNCE2_UPDATE_IN_IRAM)
+#define BOUNCE2_UPDATE_ATTR IRAM_ATTR
+#else
+#define BOUNCE2_UPDATE_ATTR
+#endif
+
+/**
+@brief The DebouncerUs:EdgeBounce class. Runs the DebouncerUs state machine on edges timestamped by an interrupt.
+
+The interrupt side only calls ingest(), which stores the edge in a lock-free queue and is safe in an ISR
+(placed in IRAM on the ESP32). The task side calls update(), which replays the queued edges at their own
+timestamps, so durations are exact to the interrupt and not to the polling period. Query read(), fell(),
+rose(), changed() and the durations from the task, after update().
+
+Call update() at least once per debounce interval: the debounced state changes at most once per interval,
+so no change is then merged with another one.
+*/
+class EdgeBounce : public DebouncerUs
+{
+public:
+  static const uint8_t QUEUE_SIZE = 16; // Edges kept between two update(), a power of two
+
+	EdgeBounce();
+
+/*!
+    @brief  Attach to a pin, sets its mode and installs a CHANGE interrupt that feeds ingest().
+    Only on boards with attachInterruptArg() (ESP32, ESP8266); elsewhere call ingest() from your own ISR
+    and attach(pin) to take the initial state.
+*/
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP8266)
+	void attach(int pin, int mode);
+#endif
+
+/*!
+    @brief  Takes the current level of the pin as the initial state. Does not install an interrupt.
+*/
+	void attach(int pin);
+
+/*!
+    @brief  Queues one edge. Safe to call from an interrupt; never blocks.
+
+    @param    timestampUs
+              The time of the edge in microseconds (micros() in the ISR).
+    @param    level
+              The level of the pin after the edge.
+*/
+	void ingest(uint32_t timestampUs, bool level);
+
+	/*!
+    @brief   Replays the queued edges and completes any interval that has elapsed by now. Call it from a task.
+
+    @return True if the state changed since the previous update.
+*/
+	bool update() { return update(micros()); }
+
+	bool update(uint32_t now);
+
+    /**
+    @brief Returns the number of edges dropped because the queue was full. The state is resynchronized
+    with the pin on the next update().
+    */
+	uint32_t getDroppedEdges() const { return droppedEdges; }
+
+	inline int getPin() const { return this->pin; }
+
+protected:
+	virtual bool readCurrentState() { return replayLevel; }
+
+	static void handleInterrupt(void* arg);
+	void replay(uint32_t timestampUs);
+
+	struct Edge {
+		uint32_t timestampUs;
+		bool level;
+	};
+
+	uint8_t pin;
+	bool replayLevel;             // Level the state machine sees while replaying
+	Edge queue[QUEUE_SIZE];
+	uint8_t head;                 // Written by ingest() only
+	uint8_t tail;                 // Written by update() only
+	volatile bool latestLevel;    // Level of the newest edge, queued or not
+	volatile bool overflowed;
+	volatile uint32_t droppedEdges;
+};
+
 /**
      @brief The Debouncer:Bounce:Button class. The Button class matches an electrical state to a physical action.
      */
@@ -0,0 +1,560 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2013 thomasfredericks
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of
+  this software and associated documentation files (the "Software"), to deal in
+  the Software without restriction, including without limitation the rights to
+  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+  the Software, and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DebouncerBank_h
+#define DebouncerBank_h
+
+#include "Bounce2.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+#endif
+
+/**
+    @example bounceBank.ino
+    Debouncing many buttons at once with the DebouncerBank class.
+*/
+
+/**
+     @brief  The unsigned integer type holding one bit per input of a bank of N inputs.
+*/
+template <bool Wide>
+struct BankMaskType { typedef uint32_t type; };
+
+template <>
+struct BankMaskType<true> { typedef uint64_t type; };
+
+template <uint8_t N>
+struct BankMask {
+  typedef typename BankMaskType<(N > 32)>::type type;
+};
+
+/**
+     @brief  Input source that reads pins. On the ESP32 every input register is read once per update,
+     on other boards each pin is read with digitalRead().
+*/
+template <uint8_t N>
+class GpioRegisterSource
+{
+public:
+  typedef typename BankMask<N>::type Mask;
+
+	GpioRegisterSource() : pins{} {}
+
+/*!
+    @brief  Attach to N pins and sets their mode (INPUT, INPUT_PULLUP). Input i of the bank is pins[i].
+*/
+	void attach(const uint8_t (&pins)[N], int mode) {
+		for (uint8_t i = 0; i < N; i++) {
+			this->pins[i] = pins[i];
+			pinMode(pins[i], mode);
+		}
+	}
+
+	Mask read() const {
+		Mask value = 0;
+#if defined(ARDUINO_ARCH_ESP32)
+		const uint32_t in[2] = { REG_READ(GPIO_IN_REG), REG_READ(GPIO_IN1_REG) };
+		for (uint8_t i = 0; i < N; i++) {
+			value |= (Mask)((in[pins[i] >> 5] >> (pins[i] & 31)) & 1) << i;
+		}
+#else
+		for (uint8_t i = 0; i < N; i++) {
+			value |= (Mask)(digitalRead(pins[i]) ? 1 : 0) << i;
+		}
+#endif
+		return value;
+	}
+
+protected:
+	uint8_t pins[N];
+};
+
+/**
+     @brief  Input source that reads a chain of 74HC165 parallel-in/serial-out shift registers.
+     Input i of the bank is the i-th bit shifted out after the parallel load.
+*/
+template <uint8_t N>
+class ShiftRegisterSource
+{
+public:
+  typedef typename BankMask<N>::type Mask;
+
+	ShiftRegisterSource() : loadPin(0), clockPin(0), dataPin(0) {}
+
+/*!
+    @brief  Attach to the load (SH/LD), clock (CLK) and serial data (QH) pins of the chain.
+*/
+	void attach(uint8_t loadPin, uint8_t clockPin, uint8_t dataPin) {
+		this->loadPin = loadPin;
+		this->clockPin = clockPin;
+		this->dataPin = dataPin;
+		pinMode(loadPin, OUTPUT);
+		pinMode(clockPin, OUTPUT);
+		pinMode(dataPin, INPUT);
+		digitalWrite(loadPin, HIGH);
+		digitalWrite(clockPin, LOW);
+	}
+
+	Mask read() const {
+		// Latch all inputs at once, then shift them out one bit per clock.
+		digitalWrite(loadPin, LOW);
+		digitalWrite(loadPin, HIGH);
+		Mask value = 0;
+		for (uint8_t i = 0; i < N; i++) {
+			value |= (Mask)(digitalRead(dataPin) ? 1 : 0) << i;
+			digitalWrite(clockPin, HIGH);
+			digitalWrite(clockPin, LOW);
+		}
+		return value;
+	}
+
+protected:
+	uint8_t loadPin;
+	uint8_t clockPin;
+	uint8_t dataPin;
+};
+
+/**
+     @brief  Input source that scans a row/column switch matrix. Rows are driven LOW one at a time and
+     left floating otherwise, and the columns are read with pull-ups, so a pressed switch reads LOW, as
+     a GpioRegisterSource pin with INPUT_PULLUP does. On the ESP32 the rows are switched through the
+     GPIO enable registers and every row costs one input register read.
+
+     Input i of the bank is row i / columns, column i % columns. Inputs beyond rows * columns read HIGH.
+
+     After a row is selected, its settle time is waited before the columns are read. It covers the
+     columns of the previous row recovering through their pull-ups, so rows with long wires or weak
+     pull-ups need more. A full scan takes the sum of the settle times plus a few microseconds per row;
+     scanTime() and maxScanTime() give the measured figures.
+
+     Without a diode per switch, three switches pressed on the corners of a rectangle make the fourth
+     read pressed as well ("ghosting"). For such matrices, pass diodes = false to attach(): every
+     input of a rectangle of pressed switches then keeps the level it had before the rectangle formed.
+*/
+template <uint8_t N>
+class MatrixSource
+{
+public:
+  typedef typename BankMask<N>::type Mask;
+
+  static const uint16_t DEFAULT_SETTLE_US = 3;
+
+	MatrixSource()
+	: rows(0), columns(0), diodes(true), rowPins{}, columnPins{}, settleTime{}, rowLow{},
+	  lastValue(~(Mask)0), ghostMask(0), ghostScans(0), lastScanTime(0), maxScanUs(0) {}
+
+/*!
+    @brief  Attach to the row and column pins. rows * columns must not exceed N. Row pins must be able
+    to drive an output.
+    @param  diodes  false if the switches have no diodes; ghosting is then detected and held off.
+*/
+	void attach(const uint8_t* rowPins, uint8_t rows, const uint8_t* columnPins, uint8_t columns,
+	            bool diodes = true) {
+		if (rows * columns > N) columns = N / rows;
+		this->rows = rows;
+		this->columns = columns;
+		this->diodes = diodes;
+		for (uint8_t c = 0; c < columns; c++) {
+			this->columnPins[c] = columnPins[c];
+			pinMode(columnPins[c], INPUT_PULLUP);
+		}
+		for (uint8_t r = 0; r < rows; r++) {
+			this->rowPins[r] = rowPins[r];
+			settleTime[r] = DEFAULT_SETTLE_US;
+			pinMode(rowPins[r], OUTPUT);
+			digitalWrite(rowPins[r], LOW); // Only the output enable changes from here on
+			releaseRow(r);
+		}
+	}
+
+/*!
+    @brief  Sets the settle time of every row, in microseconds.
+*/
+	void setSettleTime(uint16_t settle_micros) {
+		for (uint8_t r = 0; r < rows; r++) settleTime[r] = settle_micros;
+	}
+
+/*!
+    @brief  Sets the settle time of one row, in microseconds.
+*/
+	void setSettleTime(uint8_t row, uint16_t settle_micros) { settleTime[row] = settle_micros; }
+
+	uint16_t getSettleTime(uint8_t row) const { return settleTime[row]; }
+
+	Mask read() const {
+		const uint32_t start = micros();
+		for (uint8_t r = 0; r < rows; r++) {
+			selectRow(r);
+			if (settleTime[r]) delayMicroseconds(settleTime[r]);
+			rowLow[r] = readLowColumns();
+			releaseRow(r);
+		}
+
+		ghostMask = diodes ? 0 : findGhosts();
+		Mask value = ~(Mask)0;
+		for (uint8_t r = 0; r < rows; r++) {
+			Mask low = rowLow[r];
+			while (low) {
+				const uint8_t c = lowest(low);
+				low &= low - 1;
+				value &= ~((Mask)1 << (r * columns + c));
+			}
+		}
+		value = (value & ~ghostMask) | (lastValue & ghostMask);
+		lastValue = value;
+		if (ghostMask) ghostScans++;
+
+		lastScanTime = micros() - start;
+		if (lastScanTime > maxScanUs) maxScanUs = lastScanTime;
+		return value;
+	}
+
+/*!
+    @brief  The inputs held at their previous level on the last scan because of ghosting.
+*/
+	Mask ghosted() const { return ghostMask; }
+
+/*!
+    @brief  How many scans found ghosting.
+*/
+	uint32_t ghostedScans() const { return ghostScans; }
+
+/*!
+    @brief  The duration of the last full scan, and the longest one, in microseconds.
+*/
+	uint32_t scanTime() const { return lastScanTime; }
+	uint32_t maxScanTime() const { return maxScanUs; }
+	void resetScanTime() { maxScanUs = 0; }
+
+protected:
+	void selectRow(uint8_t r) const {
+#if defined(ARDUINO_ARCH_ESP32)
+		if (rowPins[r] < 32) REG_WRITE(GPIO_ENABLE_W1TS_REG, 1UL << rowPins[r]);
+		else REG_WRITE(GPIO_ENABLE1_W1TS_REG, 1UL << (rowPins[r] - 32));
+#else
+		pinMode(rowPins[r], OUTPUT);
+		digitalWrite(rowPins[r], LOW);
+#endif
+	}
+
+	void releaseRow(uint8_t r) const {
+#if defined(ARDUINO_ARCH_ESP32)
+		if (rowPins[r] < 32) REG_WRITE(GPIO_ENABLE_W1TC_REG, 1UL << rowPins[r]);
+		else REG_WRITE(GPIO_ENABLE1_W1TC_REG, 1UL << (rowPins[r] - 32));
+#else
+		pinMode(rowPins[r], INPUT);
+#endif
+	}
+
+	// One bit per column, set while the column reads LOW.
+	Mask readLowColumns() const {
+		Mask low = 0;
+#if defined(ARDUINO_ARCH_ESP32)
+		const uint32_t in[2] = { REG_READ(GPIO_IN_REG), REG_READ(GPIO_IN1_REG) };
+		for (uint8_t c = 0; c < columns; c++) {
+			low |= (Mask)(((in[columnPins[c] >> 5] >> (columnPins[c] & 31)) & 1) ^ 1) << c;
+		}
+#else
+		for (uint8_t c = 0; c < columns; c++) {
+			low |= (Mask)(digitalRead(columnPins[c]) ? 0 : 1) << c;
+		}
+#endif
+		return low;
+	}
+
+	// Two rows sharing two or more pressed columns form a rectangle: any one of its corners may be a
+	// ghost of the other three.
+	Mask findGhosts() const {
+		Mask ghosts = 0;
+		for (uint8_t a = 0; a + 1 < rows; a++) {
+			if (count(rowLow[a]) < 2) continue;
+			for (uint8_t b = a + 1; b < rows; b++) {
+				const Mask shared = rowLow[a] & rowLow[b];
+				if (count(shared) < 2) continue;
+				ghosts |= shared << (a * columns);
+				ghosts |= shared << (b * columns);
+			}
+		}
+		return ghosts;
+	}
+
+	static uint8_t lowest(Mask m) {
+		return (sizeof(Mask) > 4) ? (uint8_t)__builtin_ctzll((unsigned long long)m) : (uint8_t)__builtin_ctz((unsigned int)m);
+	}
+
+	static uint8_t count(Mask m) {
+		return (sizeof(Mask) > 4) ? (uint8_t)__builtin_popcountll((unsigned long long)m) : (uint8_t)__builtin_popcount((unsigned int)m);
+	}
+
+	uint8_t rows;
+	uint8_t columns;
+	bool diodes;
+	uint8_t rowPins[N];
+	uint8_t columnPins[N];
+	uint16_t settleTime[N];
+	mutable Mask rowLow[N];     // Columns read LOW on each row, last scan
+	mutable Mask lastValue;     // Levels of the last scan, kept for ghosted inputs
+	mutable Mask ghostMask;
+	mutable uint32_t ghostScans;
+	mutable uint32_t lastScanTime;
+	mutable uint32_t maxScanUs;
+};
+
+/**
+     @brief  Input source backed by a value in memory, for simulated inputs or inputs read elsewhere.
+*/
+template <uint8_t N>
+class BufferSource
+{
+public:
+  typedef typename BankMask<N>::type Mask;
+
+	BufferSource() : value(0) {}
+
+	void set(Mask value) { this->value = value; }
+
+	void set(uint8_t input, bool level) {
+		if (level) value |= (Mask)1 << input;
+		else value &= ~((Mask)1 << input);
+	}
+
+	Mask read() const { return value; }
+
+protected:
+	Mask value;
+};
+
+/**
+     @brief  Debounces N inputs (up to 64) read together from one Source.
+
+     The per-input state is stored as bit masks and arrays instead of one object per input, and the
+     source is a template parameter instead of a virtual readCurrentState(). update() reads the source
+     once and only visits the inputs whose raw or debounced level is moving, so an idle bank costs about
+     as much as a single Bounce. Each input has its own interval and DebouncerUs::Mode, with the same
+     semantics as DebouncerUs.
+
+     @code
+     DebouncerBank<12, GpioRegisterSource> buttons;
+     @endcode
+*/
+template <uint8_t N, template <uint8_t> class Source>
+class DebouncerBank
+{
+  static_assert(N > 0 && N <= 64, "DebouncerBank supports 1 to 64 inputs");
+
+public:
+  typedef typename BankMask<N>::type Mask;
+
+  /**
+    @brief The inputs that changed on one update(), one bit per input.
+  */
+  struct Changes {
+    Mask changed;
+    Mask rose;
+    Mask fell;
+  };
+
+	DebouncerBank()
+	: debounced(0), unstable(0), lockOutInputs(0), promptInputs(0), changes{0, 0, 0}, lastUpdateTime(0) {
+		for (uint8_t i = 0; i < N; i++) {
+			previousTime[i] = 0;
+			intervalTime[i] = 10000;
+			stateChangeLastTime[i] = 0;
+			durationOfPreviousState[i] = 0;
+		}
+	}
+
+    /**
+    @brief  The input source, to attach it to its pins.
+     */
+	Source<N>& source() { return src; }
+
+    /**
+    @brief  Takes the current level of every input as its debounced state. Call it once the source is
+    attached and the intervals and modes are set.
+     */
+	void begin(uint32_t now) {
+		lastUpdateTime = now;
+		debounced = unstable = src.read() & ALL_INPUTS;
+		for (uint8_t i = 0; i < N; i++) {
+			stateChangeLastTime[i] = now;
+			// In lock-out mode the first edge must not be locked out.
+			previousTime[i] = (lockOutInputs & bit(i)) ? now - intervalTime[i] : now;
+		}
+	}
+
+	void begin() { begin(micros()); }
+
+    /**
+    @brief  Sets the debounce interval of every input, in microseconds.
+     */
+	void interval(uint32_t interval_micros) {
+		for (uint8_t i = 0; i < N; i++) intervalTime[i] = interval_micros;
+	}
+
+    /**
+    @brief  Sets the debounce interval of one input, in microseconds.
+     */
+	void interval(uint8_t input, uint32_t interval_micros) { intervalTime[input] = interval_micros; }
+
+	uint32_t getInterval(uint8_t input) const { return intervalTime[input]; }
+
+    /**
+    @brief  Selects the debounce method of every input.
+     */
+	void setMode(DebouncerUs::Mode mode) {
+		for (uint8_t i = 0; i < N; i++) setMode(i, mode);
+	}
+
+    /**
+    @brief  Selects the debounce method of one input.
+     */
+	void setMode(uint8_t input, DebouncerUs::Mode mode) {
+		const Mask b = bit(input);
+		lockOutInputs = (mode == DebouncerUs::LOCK_OUT) ? (lockOutInputs | b) : (lockOutInputs & ~b);
+		promptInputs = (mode == DebouncerUs::PROMPT_DETECTION) ? (promptInputs | b) : (promptInputs & ~b);
+	}
+
+	DebouncerUs::Mode getMode(uint8_t input) const {
+		if (lockOutInputs & bit(input)) return DebouncerUs::LOCK_OUT;
+		if (promptInputs & bit(input)) return DebouncerUs::PROMPT_DETECTION;
+		return DebouncerUs::STABLE_INTERVAL;
+	}
+
+	/*!
+    @brief   Reads the source once and updates every input.
+
+    @param    now
+              The current time in microseconds.
+
+    @return The inputs that changed, rose and fell on this update.
+*/
+	const Changes& update(uint32_t now) {
+		lastUpdateTime = now;
+		const Mask raw = src.read() & ALL_INPUTS;
+		const Mask edges = raw ^ unstable;   // Moved since the last update
+		const Mask pending = raw ^ debounced; // Differs from the debounced level
+
+		// Inputs that are neither moving nor pending cannot change in any mode.
+		Mask visit = edges | pending;
+		Mask changed = 0;
+		while (visit) {
+			const uint8_t i = lowestInput(visit);
+			const Mask b = bit(i);
+			visit &= ~b;
+
+			const bool elapsed = now - previousTime[i] >= intervalTime[i];
+			if (lockOutInputs & b) {
+				// Ignore everything if we are locked out
+				if ((pending & b) && elapsed) {
+					previousTime[i] = now;
+					changed |= b;
+				}
+			} else if (promptInputs & b) {
+				// Report at once if the input was stable for the whole interval before it
+				if ((pending & b) && elapsed) changed |= b;
+				if (edges & b) previousTime[i] = now;
+			} else {
+				// Report once the input has been stable for the interval
+				if (edges & b) {
+					previousTime[i] = now;
+				} else if ((pending & b) && elapsed) {
+					previousTime[i] = now;
+					changed |= b;
+				}
+			}
+
+			if (changed & b) {
+				durationOfPreviousState[i] = now - stateChangeLastTime[i];
+				stateChangeLastTime[i] = now;
+			}
+		}
+
+		unstable = raw;
+		debounced ^= changed;
+		changes.changed = changed;
+		changes.rose = changed & debounced;
+		changes.fell = changed & ~debounced;
+		return changes;
+	}
+
+	const Changes& update() { return update(micros()); }
+
+    /**
+     @brief Returns the debounced state of every input, one bit per input.
+     */
+	Mask read() const { return debounced; }
+
+	bool read(uint8_t input) const { return (debounced & bit(input)) != 0; }
+
+    /**
+     @brief Returns the undebounced level of every input as of the last update.
+     */
+	Mask raw() const { return unstable; }
+
+    /**
+     @brief Returns the inputs that changed, rose and fell on the last update.
+     */
+	const Changes& lastChanges() const { return changes; }
+
+	bool changed(uint8_t input) const { return (changes.changed & bit(input)) != 0; }
+	bool rose(uint8_t input) const { return (changes.rose & bit(input)) != 0; }
+	bool fell(uint8_t input) const { return (changes.fell & bit(input)) != 0; }
+
+    /**
+     @brief Returns the duration in microseconds of the current state of an input, as of the last update().
+     */
+	uint32_t currentDuration(uint8_t input) const { return lastUpdateTime - stateChangeLastTime[input]; }
+
+    /**
+     @brief Returns the duration in microseconds of the previous state of an input.
+     */
+	uint32_t previousDuration(uint8_t input) const { return durationOfPreviousState[input]; }
+
+private:
+  // A bank as wide as its mask uses every bit; the modulo only keeps the shift in the branch not taken
+  // within the mask's width.
+  static const Mask ALL_INPUTS = (N >= 8 * sizeof(Mask)) ? ~(Mask)0 : (((Mask)1 << (N % (8 * sizeof(Mask)))) - 1);
+
+  static Mask bit(uint8_t input) { return (Mask)1 << input; }
+
+  static uint8_t lowestInput(Mask m) {
+    return (sizeof(Mask) > 4) ? (uint8_t)__builtin_ctzll((unsigned long long)m) : (uint8_t)__builtin_ctz((unsigned int)m);
+  }
+
+  Source<N> src;
+  Mask debounced;      // Final returned calculated debounced state
+  Mask unstable;       // Actual last state value behind the scene
+  Mask lockOutInputs;  // Inputs in LOCK_OUT mode
+  Mask promptInputs;   // Inputs in PROMPT_DETECTION mode
+  Changes changes;
+  uint32_t lastUpdateTime;
+  uint32_t previousTime[N];
+  uint32_t intervalTime[N];
+  uint32_t stateChangeLastTime[N];
+  uint32_t durationOfPreviousState[N];
+};
+
+#endif
@@ -44,7 +44,11 @@
 
 # ifndef CONFIG_NIMBLE_CPP_IDF
 #  include "nimble/porting/nimble/include/nimble/nimble_port.h"
-#  include "nimble/porting/npl/freertos/include/nimble/nimble_port_freertos.h"
+#  ifdef __linux__
+#   include "nimble/porting/npl/linux/include/nimble/nimble_port_linux.h"
+#  else
+#   include "nimble/porting/npl/freertos/include/nimble/nimble_port_freertos.h"
+#  endif
 #  include "nimble/nimble/host/include/host/ble_hs.h"
 #  include "nimble/nimble/host/include/host/ble_hs_pvcy.h"
 #  include "nimble/nimble/host/util/include/host/util/util.h"
@@ -870,7 +874,9 @@ void NimBLEDevice::onSync(void) {
 void NimBLEDevice::host_task(void* param) {
     NIMBLE_LOGI(LOG_TAG, "BLE Host Task Started");
     nimble_port_run(); // This function will return only when nimble_port_stop() is executed
+# ifndef __linux__
     nimble_port_freertos_deinit();
+# endif
 } // host_task
 
 /**
@@ -987,7 +993,11 @@ bool NimBLEDevice::init(const std::string& deviceName) {
 
         setDeviceName(deviceName);
         ble_store_config_init();
+# ifdef __linux__
+        nimble_port_linux_init(NimBLEDevice::host_task);
+# else
         nimble_port_freertos_init(NimBLEDevice::host_task);
+# endif
     }
 
     // Wait for host and controller to sync before returning and accepting new tasks
@@ -16,7 +16,8 @@
  * specific language governing permissions and limitations
  * under the License.
  */
-#ifndef ESP_PLATFORM
+/* The nRF link layer; Linux builds the host only */
+#if !defined(ESP_PLATFORM) && !defined(__linux__)
 
 #include <stdint.h>
 #include <string.h>
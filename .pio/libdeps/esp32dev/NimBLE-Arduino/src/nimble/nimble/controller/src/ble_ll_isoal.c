@@ -17,7 +17,8 @@
  * under the License.
  */
 
-#ifndef ESP_PLATFORM
+/* The nRF link layer; Linux builds the host only */
+#if !defined(ESP_PLATFORM) && !defined(__linux__)
 
 #include <stdint.h>
 #include <nimble/porting/nimble/include/syscfg/syscfg.h>
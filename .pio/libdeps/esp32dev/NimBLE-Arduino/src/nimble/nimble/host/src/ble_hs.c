@@ -611,6 +611,9 @@ ble_hs_enqueue_hci_event(uint8_t *hci_evt)
     ev = os_memblock_get(&ble_hs_hci_ev_pool);
 #if CONFIG_BT_LE_CONTROLLER_NPL_OS_PORTING_SUPPORT
     if (ev && ble_hs_evq->eventq) {
+#elif defined(__linux__)
+    /* The Linux NPL's event queue is a list, set up by nimble_port_init() */
+    if (ev) {
 #else
     if (ev && ble_hs_evq->q) {
 #endif
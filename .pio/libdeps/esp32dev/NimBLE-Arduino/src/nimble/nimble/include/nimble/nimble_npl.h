@@ -49,8 +49,13 @@ enum ble_npl_error {
 
 typedef enum ble_npl_error ble_npl_error_t;
 
-/* Include OS-specific definitions */
+/* Include OS-specific definitions: FreeRTOS on the targets, POSIX threads
+ * for the host-only build on Linux */
+#ifdef __linux__
+#include "nimble/porting/npl/linux/include/nimble/nimble_npl_os.h"
+#else
 #include "nimble/porting/npl/freertos/include/nimble/nimble_npl_os.h"
+#endif
 
 /*
  * Generic
@@ -35,6 +35,31 @@
 
 /* The common BSD linked list queue macros are already defined here for ESP-IDF */
 #include <sys/queue.h>
+#include <stddef.h>
+
+/* glibc's sys/queue.h, for the host-only build on Linux, lacks a few of them */
+#ifndef SLIST_FOREACH_SAFE
+#define SLIST_FOREACH_SAFE(var, head, field, tvar)                      \
+    for ((var) = SLIST_FIRST((head));                                   \
+        (var) && ((tvar) = SLIST_NEXT((var), field), 1);                \
+        (var) = (tvar))
+#endif
+
+#ifndef STAILQ_LAST
+#define STAILQ_LAST(head, type, field)                                  \
+    (STAILQ_EMPTY((head)) ?                                             \
+        NULL :                                                          \
+        ((struct type *)(void *)                                        \
+        ((char *)((head)->stqh_last) - offsetof(struct type, field))))
+#endif
+
+#ifndef STAILQ_REMOVE_AFTER
+#define STAILQ_REMOVE_AFTER(head, elm, field) do {                      \
+    if ((STAILQ_NEXT(elm, field) =                                      \
+         STAILQ_NEXT(STAILQ_NEXT(elm, field), field)) == NULL)          \
+        (head)->stqh_last = &STAILQ_NEXT((elm), field);                 \
+} while (0)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -112,6 +137,8 @@ extern "C" {
  *
  */
 
+/* glibc's sys/queue.h has the circular queues already */
+#ifndef CIRCLEQ_HEAD
 /*
  * Circular queue declarations.
  */
@@ -210,6 +237,7 @@ struct {								\
 		CIRCLEQ_NEXT(CIRCLEQ_PREV((elm), field), field) =	\
 		    CIRCLEQ_NEXT((elm), field);				\
 } while (0)
+#endif /* !CIRCLEQ_HEAD */
 
 #ifdef __cplusplus
 }
@@ -5,7 +5,8 @@
 #ifndef H_SYSCFG_
 #define H_SYSCFG_
 
-#ifdef ESP_PLATFORM
+/* The host-only build on Linux takes the ESP-IDF mapping of the options too */
+#if defined(ESP_PLATFORM) || defined(__linux__)
 #include "nimble/esp_port/port/include/esp_nimble_cfg.h"
 #else
 #include "ext_nimble_config.h"
@@ -26,7 +26,9 @@
 #endif //CONFIG_BT_NIMBLE_ENABLED
 
 #include "nimble/porting/nimble/include/nimble/nimble_port.h"
+#ifndef __linux__
 #include "nimble/porting/npl/freertos/include/nimble/nimble_port_freertos.h"
+#endif
 #ifdef ESP_PLATFORM
 #include "esp_log.h"
 #include "soc/soc_caps.h"
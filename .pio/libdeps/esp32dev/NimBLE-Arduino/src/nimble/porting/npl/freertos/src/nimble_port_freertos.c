@@ -17,6 +17,9 @@
  * under the License.
  */
 
+/* On Linux the host thread is started by nimble_port_linux.c. */
+#ifndef __linux__
+
 #include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -171,3 +174,5 @@ nimble_port_freertos_get_ll_hwm(void)
 #endif
 
 #endif // ESP_PLATFORM
+
+#endif // __linux__
@@ -19,6 +19,9 @@
 
 #include "syscfg/syscfg.h"
 
+/* On Linux the NPL is npl/linux. */
+#ifndef __linux__
+
 #if !CONFIG_BT_LE_CONTROLLER_NPL_OS_PORTING_SUPPORT
 
 #include <assert.h>
@@ -818,3 +821,5 @@ na_npl_freertos_eventq_init(struct ble_npl_eventq *evq)
 }
 
 #endif
+
+#endif // __linux__
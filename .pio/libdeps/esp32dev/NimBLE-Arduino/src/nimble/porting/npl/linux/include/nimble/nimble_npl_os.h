@@ -0,0 +1,163 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * NPL for Linux, on POSIX threads. The host runs on a thread of its own
+ * (nimble_port_linux.h) against a controller in the same process, so there is
+ * no radio and no controller task: NIMBLE_CFG_CONTROLLER stays 0.
+ *
+ * One tick is one millisecond of CLOCK_MONOTONIC. A critical section is a
+ * process-wide recursive mutex, and callouts fire from one timer thread.
+ */
+
+#ifndef _NIMBLE_NPL_OS_H_
+#define _NIMBLE_NPL_OS_H_
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "nimble/porting/nimble/include/os/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(array) \
+        (sizeof(array) / sizeof((array)[0]))
+#endif
+
+#define BLE_NPL_OS_ALIGNMENT    8 /* sizeof(void *) on 64-bit Linux; #if needs a literal */
+#define BLE_NPL_TIME_FOREVER    UINT32_MAX
+#define BLE_NPL_TICKS_PER_SEC   1000
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+typedef uint32_t ble_npl_time_t;
+typedef int32_t ble_npl_stime_t;
+
+struct ble_npl_event {
+    bool queued;
+    ble_npl_event_fn *fn;
+    void *arg;
+    STAILQ_ENTRY(ble_npl_event) next;
+};
+
+struct ble_npl_eventq {
+    STAILQ_HEAD(, ble_npl_event) events;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+};
+
+struct ble_npl_callout {
+    struct ble_npl_event ev;
+    struct ble_npl_eventq *evq;
+    ble_npl_time_t expiry;
+    bool active;
+    TAILQ_ENTRY(ble_npl_callout) next;
+};
+
+struct ble_npl_mutex {
+    pthread_mutex_t lock;
+};
+
+struct ble_npl_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    uint16_t tokens;
+};
+
+/*
+ * The simple APIs are static inline below; the rest are in npl_os_linux.c
+ * and declared in nimble_npl.h.
+ */
+
+static inline bool
+ble_npl_os_started(void)
+{
+    return true;
+}
+
+static inline void
+ble_npl_event_init(struct ble_npl_event *ev, ble_npl_event_fn *fn,
+                   void *arg)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->fn = fn;
+    ev->arg = arg;
+}
+
+static inline void
+ble_npl_event_deinit(struct ble_npl_event *ev)
+{
+    (void)ev;
+}
+
+static inline bool
+ble_npl_event_is_queued(struct ble_npl_event *ev)
+{
+    return ev->queued;
+}
+
+static inline void *
+ble_npl_event_get_arg(struct ble_npl_event *ev)
+{
+    return ev->arg;
+}
+
+static inline void
+ble_npl_event_set_arg(struct ble_npl_event *ev, void *arg)
+{
+    ev->arg = arg;
+}
+
+static inline void
+ble_npl_event_run(struct ble_npl_event *ev)
+{
+    ev->fn(ev);
+}
+
+static inline void
+ble_npl_callout_set_arg(struct ble_npl_callout *co, void *arg)
+{
+    co->ev.arg = arg;
+}
+
+static inline ble_npl_time_t
+ble_npl_time_ms_to_ticks32(uint32_t ms)
+{
+    return ms;
+}
+
+static inline uint32_t
+ble_npl_time_ticks_to_ms32(ble_npl_time_t ticks)
+{
+    return ticks;
+}
+
+void ble_npl_callout_deinit(struct ble_npl_callout *co);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _NIMBLE_NPL_OS_H_ */
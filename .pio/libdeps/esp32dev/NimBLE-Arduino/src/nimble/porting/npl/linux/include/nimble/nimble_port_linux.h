@@ -0,0 +1,44 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef _NIMBLE_PORT_LINUX_H
+#define _NIMBLE_PORT_LINUX_H
+
+#include "nimble/nimble/include/nimble/nimble_npl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief nimble_port_linux_init - Start the NimBLE host on a thread of its own
+ *
+ * The Linux counterpart of nimble_port_freertos_init(): host_task_fn runs
+ * nimble_port_run() and returns only if the host is stopped.
+ *
+ * @param host_task_fn
+ */
+void nimble_port_linux_init(void (*host_task_fn)(void *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NIMBLE_PORT_LINUX_H */
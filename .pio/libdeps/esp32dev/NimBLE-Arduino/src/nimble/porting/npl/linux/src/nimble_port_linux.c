@@ -0,0 +1,60 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include "nimble/porting/nimble/include/nimble/nimble_port.h"
+#include "nimble/porting/npl/linux/include/nimble/nimble_port_linux.h"
+
+static pthread_t host_thread;
+
+static void *
+host_thread_fn(void *arg)
+{
+    ((void (*)(void *))arg)(NULL);
+
+    return NULL;
+}
+
+void
+nimble_port_linux_init(void (*host_task_fn)(void *))
+{
+    pthread_create(&host_thread, NULL, host_thread_fn, (void *)host_task_fn);
+    pthread_detach(host_thread);
+}
+
+/*
+ * nimble_port_run() does not return on Linux, as on other targets without
+ * ESP_PLATFORM: the host runs for the life of the process, so it cannot be
+ * stopped and deinit has nothing to do.
+ */
+int
+nimble_port_stop(void)
+{
+    return BLE_NPL_ERROR;
+}
+
+void
+nimble_port_deinit(void)
+{
+}
+
+#endif /* __linux__ */
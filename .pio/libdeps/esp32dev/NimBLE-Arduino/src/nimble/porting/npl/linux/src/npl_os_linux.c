@@ -0,0 +1,549 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifdef __linux__
+
+/* For PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "nimble/nimble/include/nimble/nimble_npl.h"
+
+/* Ticks are compared through their difference, so they may wrap. */
+#define TICKS_BEFORE(a, b)  ((int32_t)((a) - (b)) < 0)
+
+static struct timespec
+deadline_after(clockid_t clock, ble_npl_time_t ticks)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    ts.tv_sec += ticks / BLE_NPL_TICKS_PER_SEC;
+    ts.tv_nsec += (long)(ticks % BLE_NPL_TICKS_PER_SEC) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+static void
+cond_init_monotonic(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void
+mutex_init_recursive(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/*
+ * Waits on cond until woken or until deadline; no deadline waits forever.
+ * Returns ETIMEDOUT once the deadline has passed.
+ */
+static int
+cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        return pthread_cond_wait(cond, mutex);
+    }
+    return pthread_cond_timedwait(cond, mutex, deadline);
+}
+
+void *
+ble_npl_get_current_task_id(void)
+{
+    return (void *)(uintptr_t)pthread_self();
+}
+
+/* --- Event queues --- */
+
+void
+ble_npl_eventq_init(struct ble_npl_eventq *evq)
+{
+    STAILQ_INIT(&evq->events);
+    pthread_mutex_init(&evq->lock, NULL);
+    cond_init_monotonic(&evq->ready);
+}
+
+void
+ble_npl_eventq_deinit(struct ble_npl_eventq *evq)
+{
+    pthread_cond_destroy(&evq->ready);
+    pthread_mutex_destroy(&evq->lock);
+}
+
+struct ble_npl_event *
+ble_npl_eventq_get(struct ble_npl_eventq *evq, ble_npl_time_t tmo)
+{
+    struct ble_npl_event *ev;
+    struct timespec deadline;
+    int rc = 0;
+
+    if (tmo != BLE_NPL_TIME_FOREVER) {
+        deadline = deadline_after(CLOCK_MONOTONIC, tmo);
+    }
+
+    pthread_mutex_lock(&evq->lock);
+    while (STAILQ_EMPTY(&evq->events) && rc != ETIMEDOUT) {
+        rc = cond_wait_until(&evq->ready, &evq->lock,
+                             tmo == BLE_NPL_TIME_FOREVER ? NULL : &deadline);
+    }
+    ev = STAILQ_FIRST(&evq->events);
+    if (ev != NULL) {
+        STAILQ_REMOVE_HEAD(&evq->events, next);
+        ev->queued = false;
+    }
+    pthread_mutex_unlock(&evq->lock);
+
+    return ev;
+}
+
+void
+ble_npl_eventq_put(struct ble_npl_eventq *evq, struct ble_npl_event *ev)
+{
+    pthread_mutex_lock(&evq->lock);
+    if (!ev->queued) {
+        ev->queued = true;
+        STAILQ_INSERT_TAIL(&evq->events, ev, next);
+        pthread_cond_signal(&evq->ready);
+    }
+    pthread_mutex_unlock(&evq->lock);
+}
+
+void
+ble_npl_eventq_remove(struct ble_npl_eventq *evq, struct ble_npl_event *ev)
+{
+    pthread_mutex_lock(&evq->lock);
+    if (ev->queued) {
+        STAILQ_REMOVE(&evq->events, ev, ble_npl_event, next);
+        ev->queued = false;
+    }
+    pthread_mutex_unlock(&evq->lock);
+}
+
+bool
+ble_npl_eventq_is_empty(struct ble_npl_eventq *evq)
+{
+    bool empty;
+
+    pthread_mutex_lock(&evq->lock);
+    empty = STAILQ_EMPTY(&evq->events);
+    pthread_mutex_unlock(&evq->lock);
+
+    return empty;
+}
+
+/* --- Mutexes --- */
+
+ble_npl_error_t
+ble_npl_mutex_init(struct ble_npl_mutex *mu)
+{
+    if (!mu) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    mutex_init_recursive(&mu->lock);
+
+    return BLE_NPL_OK;
+}
+
+ble_npl_error_t
+ble_npl_mutex_deinit(struct ble_npl_mutex *mu)
+{
+    if (!mu) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    pthread_mutex_destroy(&mu->lock);
+
+    return BLE_NPL_OK;
+}
+
+ble_npl_error_t
+ble_npl_mutex_pend(struct ble_npl_mutex *mu, ble_npl_time_t timeout)
+{
+    struct timespec deadline;
+    int rc;
+
+    if (!mu) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    if (timeout == BLE_NPL_TIME_FOREVER) {
+        rc = pthread_mutex_lock(&mu->lock);
+    } else if (timeout == 0) {
+        rc = pthread_mutex_trylock(&mu->lock);
+    } else {
+        /* pthread_mutex_timedlock() only takes CLOCK_REALTIME. */
+        deadline = deadline_after(CLOCK_REALTIME, timeout);
+        rc = pthread_mutex_timedlock(&mu->lock, &deadline);
+    }
+
+    return rc == 0 ? BLE_NPL_OK : BLE_NPL_TIMEOUT;
+}
+
+ble_npl_error_t
+ble_npl_mutex_release(struct ble_npl_mutex *mu)
+{
+    if (!mu) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    if (pthread_mutex_unlock(&mu->lock) != 0) {
+        return BLE_NPL_BAD_MUTEX;
+    }
+
+    return BLE_NPL_OK;
+}
+
+/* --- Semaphores --- */
+
+ble_npl_error_t
+ble_npl_sem_init(struct ble_npl_sem *sem, uint16_t tokens)
+{
+    if (!sem) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    pthread_mutex_init(&sem->lock, NULL);
+    cond_init_monotonic(&sem->released);
+    sem->tokens = tokens;
+
+    return BLE_NPL_OK;
+}
+
+ble_npl_error_t
+ble_npl_sem_deinit(struct ble_npl_sem *sem)
+{
+    if (!sem) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    pthread_cond_destroy(&sem->released);
+    pthread_mutex_destroy(&sem->lock);
+
+    return BLE_NPL_OK;
+}
+
+ble_npl_error_t
+ble_npl_sem_pend(struct ble_npl_sem *sem, ble_npl_time_t timeout)
+{
+    struct timespec deadline;
+    ble_npl_error_t err;
+    int rc = 0;
+
+    if (!sem) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    if (timeout != BLE_NPL_TIME_FOREVER) {
+        deadline = deadline_after(CLOCK_MONOTONIC, timeout);
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->tokens == 0 && timeout != 0 && rc != ETIMEDOUT) {
+        rc = cond_wait_until(&sem->released, &sem->lock,
+                             timeout == BLE_NPL_TIME_FOREVER ? NULL : &deadline);
+    }
+    if (sem->tokens > 0) {
+        sem->tokens--;
+        err = BLE_NPL_OK;
+    } else {
+        err = BLE_NPL_TIMEOUT;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return err;
+}
+
+ble_npl_error_t
+ble_npl_sem_release(struct ble_npl_sem *sem)
+{
+    if (!sem) {
+        return BLE_NPL_INVALID_PARAM;
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    sem->tokens++;
+    pthread_cond_signal(&sem->released);
+    pthread_mutex_unlock(&sem->lock);
+
+    return BLE_NPL_OK;
+}
+
+uint16_t
+ble_npl_sem_get_count(struct ble_npl_sem *sem)
+{
+    uint16_t tokens;
+
+    pthread_mutex_lock(&sem->lock);
+    tokens = sem->tokens;
+    pthread_mutex_unlock(&sem->lock);
+
+    return tokens;
+}
+
+/* --- Callouts --- */
+
+/*
+ * The active callouts, soonest first. The timer thread sleeps until the
+ * first one is due, or until the list changes.
+ */
+static TAILQ_HEAD(, ble_npl_callout) callouts =
+    TAILQ_HEAD_INITIALIZER(callouts);
+static pthread_mutex_t callouts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t callouts_changed;
+static pthread_once_t callouts_once = PTHREAD_ONCE_INIT;
+
+static void
+callout_unlink(struct ble_npl_callout *co)
+{
+    if (co->active) {
+        TAILQ_REMOVE(&callouts, co, next);
+        co->active = false;
+    }
+}
+
+static void *
+callout_thread(void *arg)
+{
+    struct ble_npl_callout *co;
+    struct timespec deadline;
+    ble_npl_time_t now;
+
+    (void)arg;
+
+    pthread_mutex_lock(&callouts_lock);
+    while (1) {
+        co = TAILQ_FIRST(&callouts);
+        if (co == NULL) {
+            pthread_cond_wait(&callouts_changed, &callouts_lock);
+            continue;
+        }
+
+        now = ble_npl_time_get();
+        if (TICKS_BEFORE(now, co->expiry)) {
+            deadline = deadline_after(CLOCK_MONOTONIC, co->expiry - now);
+            pthread_cond_timedwait(&callouts_changed, &callouts_lock,
+                                   &deadline);
+            continue;
+        }
+
+        callout_unlink(co);
+        pthread_mutex_unlock(&callouts_lock);
+        if (co->evq) {
+            ble_npl_eventq_put(co->evq, &co->ev);
+        } else {
+            co->ev.fn(&co->ev);
+        }
+        pthread_mutex_lock(&callouts_lock);
+    }
+
+    return NULL;
+}
+
+static void
+callout_thread_start(void)
+{
+    pthread_t thread;
+
+    cond_init_monotonic(&callouts_changed);
+    pthread_create(&thread, NULL, callout_thread, NULL);
+    pthread_detach(thread);
+}
+
+int
+ble_npl_callout_init(struct ble_npl_callout *co, struct ble_npl_eventq *evq,
+                     ble_npl_event_fn *ev_cb, void *ev_arg)
+{
+    pthread_once(&callouts_once, callout_thread_start);
+
+    memset(co, 0, sizeof(*co));
+    ble_npl_event_init(&co->ev, ev_cb, ev_arg);
+    co->evq = evq;
+
+    return 0;
+}
+
+void
+ble_npl_callout_deinit(struct ble_npl_callout *co)
+{
+    ble_npl_callout_stop(co);
+}
+
+ble_npl_error_t
+ble_npl_callout_reset(struct ble_npl_callout *co, ble_npl_time_t ticks)
+{
+    struct ble_npl_callout *entry;
+
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    pthread_mutex_lock(&callouts_lock);
+    callout_unlink(co);
+    co->expiry = ble_npl_time_get() + ticks;
+    co->active = true;
+    TAILQ_FOREACH(entry, &callouts, next) {
+        if (TICKS_BEFORE(co->expiry, entry->expiry)) {
+            break;
+        }
+    }
+    if (entry != NULL) {
+        TAILQ_INSERT_BEFORE(entry, co, next);
+    } else {
+        TAILQ_INSERT_TAIL(&callouts, co, next);
+    }
+    pthread_cond_signal(&callouts_changed);
+    pthread_mutex_unlock(&callouts_lock);
+
+    return BLE_NPL_OK;
+}
+
+void
+ble_npl_callout_stop(struct ble_npl_callout *co)
+{
+    pthread_mutex_lock(&callouts_lock);
+    callout_unlink(co);
+    pthread_mutex_unlock(&callouts_lock);
+}
+
+bool
+ble_npl_callout_is_active(struct ble_npl_callout *co)
+{
+    bool active;
+
+    pthread_mutex_lock(&callouts_lock);
+    active = co->active;
+    pthread_mutex_unlock(&callouts_lock);
+
+    return active;
+}
+
+ble_npl_time_t
+ble_npl_callout_get_ticks(struct ble_npl_callout *co)
+{
+    return co->expiry;
+}
+
+ble_npl_time_t
+ble_npl_callout_remaining_ticks(struct ble_npl_callout *co,
+                                ble_npl_time_t now)
+{
+    ble_npl_time_t remaining = 0;
+
+    pthread_mutex_lock(&callouts_lock);
+    if (co->active && TICKS_BEFORE(now, co->expiry)) {
+        remaining = co->expiry - now;
+    }
+    pthread_mutex_unlock(&callouts_lock);
+
+    return remaining;
+}
+
+/* --- Time --- */
+
+ble_npl_time_t
+ble_npl_time_get(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ble_npl_time_t)((uint64_t)ts.tv_sec * BLE_NPL_TICKS_PER_SEC +
+                            ts.tv_nsec / (1000000000L / BLE_NPL_TICKS_PER_SEC));
+}
+
+ble_npl_error_t
+ble_npl_time_ms_to_ticks(uint32_t ms, ble_npl_time_t *out_ticks)
+{
+    *out_ticks = ms;
+
+    return BLE_NPL_OK;
+}
+
+ble_npl_error_t
+ble_npl_time_ticks_to_ms(ble_npl_time_t ticks, uint32_t *out_ms)
+{
+    *out_ms = ticks;
+
+    return BLE_NPL_OK;
+}
+
+void
+ble_npl_time_delay(ble_npl_time_t ticks)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ticks / BLE_NPL_TICKS_PER_SEC;
+    ts.tv_nsec = (long)(ticks % BLE_NPL_TICKS_PER_SEC) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/* --- Critical sections --- */
+
+static pthread_mutex_t critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread uint32_t critical_depth;
+
+uint32_t
+ble_npl_hw_enter_critical(void)
+{
+    pthread_mutex_lock(&critical_lock);
+    critical_depth++;
+
+    return 0;
+}
+
+void
+ble_npl_hw_exit_critical(uint32_t ctx)
+{
+    (void)ctx;
+
+    critical_depth--;
+    pthread_mutex_unlock(&critical_lock);
+}
+
+bool
+ble_npl_hw_is_in_critical(void)
+{
+    return critical_depth > 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,119 @@
+/*
+================================================================================
+= AdaptiveBounce.h                                                             =
+=                                                                              =
+= Per-switch debounce that measures how much each switch actually bounces and  =
+= adapts its own interval to the shortest value that is still safe.            =
+=                                                                              =
+= Every raw edge seen by the debouncer is timestamped. A press or release and  =
+= its bounce form one "burst", which ends once the pin has held one level for  =
+= SETTLE_US; the burst length goes into a histogram per switch. The debounce   =
+= interval is then set from the 99th percentile of that histogram, so fresh    =
+= buttons get a short interval and worn ones get a longer one, and the         =
+= statistics show which switches are wearing out.                              =
+================================================================================
+*/
+
+#ifndef ADAPTIVE_BOUNCE_H
+#define ADAPTIVE_BOUNCE_H
+
+#include <Arduino.h>
+#include <Bounce2.h>
+
+/**
+ * @brief Bounce statistics of one switch.
+ */
+class ChatterStats {
+public:
+    static const uint8_t BUCKET_COUNT = 8;
+    // Upper bound of each histogram bucket, in microseconds. Bucket 0 holds
+    // clean edges (no bounce at all); the last bucket is open-ended.
+    static const uint32_t BUCKET_LIMITS_US[BUCKET_COUNT];
+
+    // A burst ends once the pin has held one level this long. Longer than
+    // the gaps within a worn switch's chatter, and shorter than the quickest
+    // tap a player holds (about 10 ms), so the release of a fast tap starts a
+    // burst of its own instead of being counted as bounce of the press.
+    static const uint32_t SETTLE_US = 5000;
+    // Added on top of the measured bounce when choosing an interval.
+    static const uint32_t SAFETY_MARGIN_US = 1000;
+    // Bursts to collect before the interval starts adapting.
+    static const uint16_t MIN_SAMPLES = 16;
+    // A 99th-percentile bounce above this marks the switch as worn.
+    static const uint32_t WORN_BOUNCE_US = 4000;
+
+    ChatterStats();
+
+    /**
+     * @brief Feeds one raw reading of the switch.
+     * @return True if a burst just ended and the statistics changed.
+     */
+    bool sample(uint32_t nowUs, bool raw);
+
+    /**
+     * @brief The debounce interval this switch needs, in microseconds.
+     */
+    uint32_t recommendedIntervalUs(uint32_t minUs, uint32_t maxUs) const;
+
+    /**
+     * @brief The bounce length that 99% of bursts stay under, in microseconds.
+     */
+    uint32_t percentile99Us() const;
+
+    uint32_t getBursts() const { return bursts; } // Presses and releases
+    uint32_t getBouncedBursts() const { return bursts - histogram[0]; }
+    uint32_t getMaxBounceUs() const { return maxBounceUs; }
+    uint32_t getBucket(uint8_t index) const { return histogram[index]; }
+    bool isWorn() const { return bursts >= MIN_SAMPLES && percentile99Us() > WORN_BOUNCE_US; }
+
+private:
+    void endBurst();
+
+    uint32_t histogram[BUCKET_COUNT];
+    uint32_t bursts;
+    uint32_t maxBounceUs;
+
+    bool initialized;
+    bool lastRaw;
+    bool inBurst;
+    uint32_t burstStartUs;
+    uint32_t lastEdgeUs;
+};
+
+/**
+ * @brief A BounceUs that records the chatter of its pin and, when enabled,
+ * adapts its own debounce interval to it.
+ */
+class AdaptiveBounce : public BounceUs {
+public:
+    AdaptiveBounce();
+
+    /**
+     * @brief Lets the interval follow the measured bounce, within [minUs, maxUs].
+     * The interval set with interval() is kept until MIN_SAMPLES bursts are seen.
+     */
+    void enableAdaptive(uint32_t minUs, uint32_t maxUs);
+
+    using BounceUs::update;
+
+    /**
+     * @brief Updates from a level sampled elsewhere, such as one read of the
+     * input register shared by every switch, instead of reading the pin.
+     */
+    bool update(uint32_t nowUs, bool level);
+
+    const ChatterStats& getStats() const { return stats; }
+
+protected:
+    bool readCurrentState() override;
+
+private:
+    ChatterStats stats;
+    bool sampled;      // update(nowUs, level) is running
+    bool sampledLevel;
+    bool adaptive;
+    uint32_t minIntervalUs;
+    uint32_t maxIntervalUs;
+};
+
+#endif // ADAPTIVE_BOUNCE_H
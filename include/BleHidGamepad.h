@@ -0,0 +1,211 @@
+/*
+================================================================================
+= BleHidGamepad.h                                                              =
+=                                                                              =
+= A minimal BLE HID gamepad built directly on NimBLE. Unlike a generic gamepad =
+= library it takes its report map from the caller, so the descriptor can be   =
+= exactly as large as the stick needs (see HidDescriptor.h).                   =
+=                                                                              =
+= Host slots: the stick remembers up to HOST_SLOT_COUNT bonded hosts, one per  =
+= slot, and only talks to the host of the active slot. A paired slot is        =
+= reconnected with advertising directed at its host, so switching between a    =
+= practice PC and a match console needs no re-pairing and the other bonded     =
+= hosts cannot grab the stick in between.                                      =
+=                                                                              =
+= Mirroring: a second slot can be named as the mirror slot. Its host (e.g. an  =
+= input-display/overlay machine) stays connected alongside the active one and  =
+= receives every report as well. The active host is always served first, and   =
+= the mirror is skipped whenever the stack runs short of buffers, so the extra =
+= link never delays the primary one.                                           =
+=                                                                              =
+= Flash writes: the host slot table and the bonds (see BondStore.h) change     =
+= while the stick is in use, but are only written to flash when the firmware   =
+= calls flushPendingWrites(), since a flash write stalls both cores.           =
+================================================================================
+*/
+
+#ifndef BLE_HID_GAMEPAD_H
+#define BLE_HID_GAMEPAD_H
+
+#include <NimBLEDevice.h>
+#include <NimBLEHIDDevice.h>
+#include "FlashWrites.h"
+#include "LinkHealth.h"
+#include "ReportLinks.h"
+
+class BleHidGamepad : public NimBLEServerCallbacks, public NimBLECharacteristicCallbacks {
+public:
+    static const uint8_t HOST_SLOT_COUNT = 4;
+    // Concurrent host connections: the active slot's host and the mirror's.
+    static const uint8_t MAX_LINKS = ReportLinks::MAX_LINKS;
+    // How long to advertise directly to a slot's host before also accepting
+    // it through undirected advertising (for hosts using private addresses).
+    static const uint32_t DIRECTED_ADVERTISING_MS = 1280;
+
+    BleHidGamepad(const char* deviceName, const char* manufacturer, uint8_t batteryLevel);
+
+    /**
+     * @brief Starts the BLE stack and publishes the HID services. Other
+     * services can be added to NimBLEDevice::getServer() until
+     * startAdvertising() is called.
+     * @param reportMap The HID report descriptor. Must stay valid while running.
+     * @param reportMapSize Size of the descriptor in bytes.
+     * @param reportId The ID of the input report described by the map.
+     */
+    void begin(const uint8_t* reportMap, uint16_t reportMapSize, uint8_t reportId);
+
+    /**
+     * @brief Advertises for the hosts of the active and mirror slots. Call once
+     * after begin(), when every service has been added.
+     */
+    void startAdvertising();
+
+    /**
+     * @brief Disconnects every host and shuts the BLE stack down.
+     */
+    void end();
+
+    // Per-connection delivery statistics, reset when the host connects.
+    using LinkStats = ReportLinks::Stats;
+
+    /**
+     * @brief True while the host of the active slot or of the mirror slot is
+     * connected and encrypted.
+     */
+    bool isConnected() const { return connected; }
+
+    /**
+     * @brief Counts the hosts accepted since begin(). It changes whenever a
+     * host (re)connects, which then starts from an all-zero report.
+     */
+    uint32_t getLinksAdded() const { return linksAdded; }
+
+    /**
+     * @brief Sends an input report to every subscribed host, the active
+     * slot's host first.
+     * @param scanTimeUs Timestamp of the scan the report comes from; used for
+     * the per-connection delay statistics.
+     * @return False if the report reached no host.
+     */
+    bool sendReport(const uint8_t* report, size_t length, uint32_t scanTimeUs);
+
+    void setBatteryLevel(uint8_t level);
+
+    /**
+     * @brief Makes another host slot active: drops the current host and
+     * advertises for the slot's host only, or for a new host if the slot is
+     * empty. Selecting the slot that is already active forgets its host, so a
+     * new one can be paired in it. The choice is kept across restarts.
+     */
+    void selectHostSlot(uint8_t slot);
+
+    uint8_t getHostSlot() const { return activeSlot; }
+
+    bool isHostSlotPaired(uint8_t slot) const;
+
+    /**
+     * @brief Reports the duration of the last completed slot switch, from
+     * selectHostSlot() to the new host being connected and encrypted.
+     * @return True once per completed switch.
+     */
+    bool takeSlotSwitchLatency(uint32_t& latencyUs);
+
+    /**
+     * @brief Names the slot whose host stays connected next to the active
+     * one and receives the same reports; -1 disables mirroring. A mirror slot
+     * equal to the active slot has no effect. Call before begin().
+     */
+    void setMirrorSlot(int8_t slot);
+
+    int8_t getMirrorSlot() const { return mirrorSlot; }
+
+    /**
+     * @brief Copies the statistics of one of the current connections.
+     * @param index 0 to MAX_LINKS - 1.
+     * @return False if no host is connected at that index.
+     */
+    bool getLinkStats(uint8_t index, LinkStats& stats) const;
+
+    /**
+     * @brief Measures the RSSI of the host on one of the current connections.
+     * @return False if no host is connected at that index or the radio
+     * could not report it.
+     */
+    bool readLinkRssi(uint8_t index, int8_t& rssiDbm) const;
+
+    /**
+     * @brief Sets the transmit power of one of the current connections, in
+     * dBm from -12 to +9 in steps of 3.
+     * @return False if no host is connected at that index or the radio
+     * refused the level.
+     */
+    bool setLinkTxPower(uint8_t index, int8_t dbm);
+
+    /**
+     * @brief True while the host slot table or the bonds have changes that
+     * are not in flash yet.
+     */
+    bool hasPendingWrites() const;
+
+    /**
+     * @brief Writes the host slot table and the bonds to flash if they
+     * changed. Both cores, input task included, stall while the flash is
+     * written, so call it only when no input can be delayed by that. end()
+     * calls it too. Changes not written are lost on a power cut.
+     */
+    void flushPendingWrites();
+
+    /**
+     * @brief Reports connections, disconnect reasons, parameter changes and
+     * the result of every input report to a link health recorder. Optional.
+     */
+    void setHealthMonitor(LinkHealth* monitor) { health = monitor; }
+
+protected:
+    void onConnect(NimBLEServer* server, NimBLEConnInfo& connInfo) override;
+    void onDisconnect(NimBLEServer* server, NimBLEConnInfo& connInfo, int reason) override;
+    void onAuthenticationComplete(NimBLEConnInfo& connInfo) override;
+    void onConnParamsUpdate(NimBLEConnInfo& connInfo) override;
+    void onMTUChange(uint16_t mtu, NimBLEConnInfo& connInfo) override;
+    void onStatus(NimBLECharacteristic* characteristic, int code) override;
+    void onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) override;
+
+private:
+    bool isMirroring() const { return mirrorSlot >= 0 && mirrorSlot != activeSlot; }
+    bool isHostMissing() const;
+    void addLink(uint16_t connHandle, uint8_t slot);
+    void removeLink(uint16_t connHandle);
+    void advertiseForMissingHost();
+    void advertiseForSlot(uint8_t slot);
+    void finishSlotSwitch();
+    int findHostSlot(const NimBLEAddress& host) const;
+    void loadHostSlots();
+    void saveHostSlots();
+
+    const char* deviceName;
+    const char* manufacturer;
+    uint8_t batteryLevel;
+
+    NimBLEHIDDevice* hid;
+    NimBLECharacteristic* inputReport;
+    volatile bool connected;
+
+    // Identity address of each slot's host; all zero for an empty slot.
+    ble_addr_t slotHosts[HOST_SLOT_COUNT];
+    volatile uint8_t activeSlot;
+    volatile int8_t mirrorSlot;
+    volatile bool switching;
+    volatile bool switchCompleted;
+    uint32_t switchStartedUs;
+    uint32_t switchLatencyUs;
+    // Changes to the slot table not yet written to flash.
+    PendingWrites hostSlotWrites;
+
+    // Written by the BLE host task, read by the report task and the loop.
+    ReportLinks links;
+    volatile uint32_t linksAdded;
+
+    LinkHealth* health;
+};
+
+#endif // BLE_HID_GAMEPAD_H
@@ -0,0 +1,69 @@
+/*
+================================================================================
+= BondStore.h                                                                  =
+=                                                                              =
+= Keeps NimBLE's bond store (the keys and subscriptions of every bonded host)  =
+= in RAM while the stack runs, and writes it to NVS only when told to.         =
+=                                                                              =
+= Stock NimBLE writes the store to NVS from the BLE host task the moment a     =
+= host pairs or subscribes. A flash write disables the flash cache and stalls  =
+= both cores, input task included, so a host pairing into the mirror slot in   =
+= the middle of a match would delay scans. Built with                          =
+= MYNEWT_VAL_BLE_STORE_CONFIG_PERSIST=0 (see platformio.ini), NimBLE keeps its =
+= store in RAM only. BondStore loads it from NVS at start-up, counts every      =
+= change the stack makes to it and saves the whole store with flush(), which   =
+= the firmware calls when the stick is idle.                                   =
+================================================================================
+*/
+
+#ifndef BOND_STORE_H
+#define BOND_STORE_H
+
+#include <stdint.h>
+#include <NimBLEDevice.h>
+
+class BondStore {
+public:
+    /**
+     * @brief Loads the saved bonds into NimBLE's store and starts tracking
+     * changes. Call right after NimBLEDevice::init(), before advertising.
+     * Bonds NimBLE saved itself, before BondStore was used, are taken over
+     * and saved in BondStore's format by the next flush().
+     */
+    static void begin();
+
+    /**
+     * @brief Stops tracking. Call after a last flush(), before the stack is
+     * shut down.
+     */
+    static void end();
+
+    /**
+     * @brief True if the store changed since it was last saved.
+     */
+    static bool isDirty();
+
+    /**
+     * @brief Saves the store to NVS if it changed. Both cores are stalled
+     * while the flash is written.
+     * @return False if the store changed while it was being copied or could
+     * not be written; it then stays dirty for the next call.
+     */
+    static bool flush();
+
+    /**
+     * @brief Counts the saves done by flush().
+     */
+    static uint32_t getFlushes() { return flushes; }
+
+private:
+    static int onWrite(int objType, const union ble_store_value* value);
+    static int onDelete(int objType, const union ble_store_key* key);
+    static int collect(int objType, union ble_store_value* value, void* cookie);
+    static bool load();
+    static bool takeOverNimbleStore();
+
+    static uint32_t flushes;
+};
+
+#endif // BOND_STORE_H
@@ -0,0 +1,116 @@
+/*
+================================================================================
+= ButtonLighting.h                                                             =
+=                                                                              =
+= Reactive per-button lighting for a chain of WS2812 LEDs, one per button.     =
+= Each LED glows dimly in its profile colour, flashes white when its button is =
+= pressed, shows the full colour while it is held and fades back when it is    =
+= released.                                                                    =
+=                                                                              =
+= The lighting never touches the input pipeline: it reads the input state the  =
+= input task publishes, renders a frame at a fixed low rate and hands it to    =
+= the RMT peripheral, which clocks the bits out in hardware. Frames are double =
+= buffered: one is rendered while the RMT sends the other. The RMT driver      =
+= streams each frame through its channel memory in two halves, refilling one   =
+= half from its interrupt while the other is sent, so a frame of any length    =
+= needs no large item buffer. Call begin() from a task on the BLE core so that  =
+= interrupt stays off the input core.                                          =
+================================================================================
+*/
+
+#ifndef BUTTON_LIGHTING_H
+#define BUTTON_LIGHTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <driver/rmt.h>
+#include "GamepadReport.h"
+#include "SeqLock.h"
+
+class ButtonLighting {
+public:
+    static const uint8_t MAX_LEDS = 16;
+    static const uint32_t FLASH_MS = 60;  // White flash at the start of a press
+    static const uint32_t FADE_MS = 300;  // Back to the idle glow after a release
+
+    struct Color {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    /**
+     * @param snapshots The input state published by the input task.
+     */
+    explicit ButtonLighting(const SeqLock<InputSnapshot>& snapshots);
+
+    /**
+     * @brief Sets up the RMT channel and the LED chain.
+     * @param ledButtons For each LED in chain order, the index of the button
+     * (bit in InputSnapshot::physical.buttons) it lights; -1 for none.
+     * @return false if the RMT driver could not be installed.
+     */
+    bool begin(gpio_num_t pin, rmt_channel_t channel, const int8_t* ledButtons, uint8_t ledCount);
+
+    /**
+     * @brief The profile colour of one LED.
+     */
+    void setColor(uint8_t led, Color color);
+
+    /**
+     * @brief Overall brightness, 0-255; the idle glow is idleLevel/255 of it.
+     */
+    void setBrightness(uint8_t brightness, uint8_t idleLevel);
+
+    /**
+     * @brief Turns the lighting on or off. Off, the LEDs are blanked once and
+     * no more frames are sent.
+     */
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * @brief Renders the next frame from the latest input state and starts
+     * sending it. Returns at once; call at the frame rate from the lighting
+     * task. A frame is skipped if the previous one is still being sent.
+     */
+    void update(uint32_t nowMs);
+
+    uint32_t getFramesSent() const { return framesSent; }
+    uint32_t getFramesSkipped() const { return framesSkipped; }
+    uint32_t getMaxRenderUs() const { return maxRenderUs; }
+
+private:
+    struct LedState {
+        bool held;
+        uint32_t changedMs; // When the button was last pressed or released
+    };
+
+    void render(uint32_t nowMs, uint8_t* frame);
+    Color shade(uint8_t led, uint32_t nowMs) const;
+
+    const SeqLock<InputSnapshot>& snapshots;
+    rmt_channel_t channel;
+    bool ready;
+    std::atomic<bool> enabled;
+    bool blanked; // The LEDs were cleared after the lighting was turned off
+
+    int8_t ledButtons[MAX_LEDS];
+    uint8_t ledCount;
+    Color colors[MAX_LEDS];
+    uint8_t brightness;
+    uint8_t idleLevel;
+    LedState leds[MAX_LEDS];
+
+    // The RMT driver reads a frame while it is sent, so frames alternate
+    // between two buffers; GRB byte order, as the LEDs expect.
+    uint8_t frames[2][MAX_LEDS * 3];
+    uint8_t nextFrame;
+
+    volatile uint32_t framesSent;
+    volatile uint32_t framesSkipped;
+    volatile uint32_t maxRenderUs;
+};
+
+#endif // BUTTON_LIGHTING_H
@@ -0,0 +1,92 @@
+/*
+================================================================================
+= FlashWrites.h                                                                =
+=                                                                              =
+= When settings kept in RAM are written to flash. A flash write stalls both    =
+= cores, input task included, so the host slot table and the bond store only   =
+= count their changes (PendingWrites) and the loop writes them once the input  =
+= has been idle for a whole window (FlashWriteWindow). Neither reads the clock =
+= or touches the flash itself, so both run in the native tests.                =
+================================================================================
+*/
+
+#ifndef FLASH_WRITES_H
+#define FLASH_WRITES_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief Counts the changes made to a setting and the count last written,
+ * so a change made while the setting is being written stays pending.
+ */
+class PendingWrites {
+public:
+    PendingWrites() : changes(0), saved(0) {}
+
+    /**
+     * @brief Counts a change. Any task.
+     */
+    void markChanged() { changes.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief The changes so far. Take it before copying the setting and pass
+     * it to markSaved() once the copy is written.
+     */
+    uint32_t snapshot() const { return changes.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Records that the changes up to a snapshot() are in flash; later
+     * ones stay pending.
+     */
+    void markSaved(uint32_t changesSaved) { saved.store(changesSaved, std::memory_order_release); }
+
+    bool isDirty() const { return snapshot() != saved.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<uint32_t> changes;
+    std::atomic<uint32_t> saved;
+};
+
+/**
+ * @brief Opens once no input has been held or sent for idleMs. The input
+ * task records its activity; the loop asks whether to write.
+ */
+class FlashWriteWindow {
+public:
+    explicit FlashWriteWindow(uint32_t idleMs) : idleUs(idleMs * 1000), lastActivityUs(0) {}
+
+    /**
+     * @brief Records a scan with something held or sent. Input task only;
+     * inline, so it runs from the input task's IRAM.
+     */
+    inline __attribute__((always_inline)) void recordActivity(uint32_t scanTimeUs) {
+        lastActivityUs.store(scanTimeUs, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief True if the last activity is at least idleMs before nowUs. The
+     * input task reads the clock on its own, so a scan can be stamped after
+     * nowUs: a timestamp up to idleMs ahead of it counts as recent, not as
+     * one 71 minutes old.
+     */
+    bool isIdle(uint32_t nowUs) const {
+        const uint32_t ageUs = nowUs - lastActivityUs.load(std::memory_order_relaxed);
+        return ageUs >= idleUs && ageUs <= UINT32_MAX - idleUs;
+    }
+
+    /**
+     * @brief Whether the loop should write now: something is pending, nothing
+     * else forbids it (blocked, e.g. a running benchmark) and the input is
+     * idle.
+     */
+    bool shouldFlush(uint32_t nowUs, bool pending, bool blocked) const {
+        return pending && !blocked && isIdle(nowUs);
+    }
+
+private:
+    const uint32_t idleUs;
+    std::atomic<uint32_t> lastActivityUs;
+};
+
+#endif // FLASH_WRITES_H
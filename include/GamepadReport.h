@@ -0,0 +1,65 @@
+/*
+================================================================================
+= GamepadReport.h                                                              =
+=                                                                              =
+= The complete state of the stick for one scan: which buttons are held, where  =
+= the hat points and where the emulated sticks point. Every input source       =
+= (physical switches, turbo, macros) writes into this structure, and only the  =
+= final result is sent to the host.                                            =
+================================================================================
+*/
+
+#ifndef GAMEPAD_REPORT_H
+#define GAMEPAD_REPORT_H
+
+#include <stdint.h>
+
+// Hat switch values: 0 = centered, directions 1-8 clockwise from Up. This is
+// the encoding the HID hat switch uses, with 0 as its null state.
+enum HatDirection : uint8_t {
+    HAT_CENTERED = 0,
+    HAT_UP,
+    HAT_UP_RIGHT,
+    HAT_RIGHT,
+    HAT_DOWN_RIGHT,
+    HAT_DOWN,
+    HAT_DOWN_LEFT,
+    HAT_LEFT,
+    HAT_UP_LEFT
+};
+
+// Stick axes run from -REPORT_AXIS_MAX (left/up) to +AXIS_MAX (right/down).
+const int8_t REPORT_AXIS_MAX = 127;
+
+struct GamepadReport {
+    uint16_t buttons; // Bit N set = gamepad button N+1 is held
+    uint8_t hat;      // HatDirection
+    int8_t leftX;     // Left stick, 0 = centered
+    int8_t leftY;
+    int8_t rightX;    // Right stick, 0 = centered
+    int8_t rightY;
+
+    bool operator==(const GamepadReport& other) const {
+        return buttons == other.buttons && hat == other.hat &&
+               leftX == other.leftX && leftY == other.leftY &&
+               rightX == other.rightX && rightY == other.rightY;
+    }
+    bool operator!=(const GamepadReport& other) const {
+        return !(*this == other);
+    }
+};
+
+// Nothing pressed, hat and sticks centered.
+const GamepadReport EMPTY_GAMEPAD_REPORT = {0, HAT_CENTERED, 0, 0, 0, 0};
+
+// The outcome of one scan, as published by the input task for readers on
+// other tasks (telemetry, lighting, diagnostics). A reader can tell whether
+// it has already seen a scan by its sequence number.
+struct InputSnapshot {
+    uint32_t sequence;      // Scans published so far
+    uint32_t scanTimeUs;    // Timestamp of the scan
+    GamepadReport physical; // Debounced physical inputs, before hotkeys, turbo and macros
+    GamepadReport output;   // The state reported to the host
+};
+
+#endif // GAMEPAD_REPORT_H
@@ -0,0 +1,102 @@
+/*
+================================================================================
+= HeapGuard.h                                                                  =
+=                                                                              =
+= Catches heap allocations made after boot. Everything the stick needs is      =
+= allocated while it starts (NimBLE's server, services and characteristics,    =
+= the task stacks, the queues); an allocation once it is running costs time    =
+= the scan cannot plan for and, over a day of play, fragments the heap.        =
+=                                                                              =
+= Built with HEAP_GUARD (the esp32dev_zero_heap environment), malloc, calloc,  =
+= realloc and their heap_caps_ forms are wrapped at link time.                 =
+= Once arm() is called, each allocation is counted and its call stack is kept, =
+= one entry per distinct call site, so it can be printed in the form           =
+= esp32_exception_decoder turns into file and line. Allocations from the tasks =
+= passed to markHotTask() (the scan, report and notify path) are counted       =
+= apart from the rest.                                                         =
+=                                                                              =
+= Without HEAP_GUARD nothing is wrapped and every call here does nothing.      =
+================================================================================
+*/
+
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <Arduino.h>
+
+class HeapGuard {
+public:
+#ifdef HEAP_GUARD
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+    static const uint8_t MAX_SITES = 16;
+    static const uint8_t MAX_DEPTH = 8;
+    static const uint8_t MAX_HOT_TASKS = 4;
+
+    // One call site: the allocations made from the same call stack.
+    struct Site {
+        uint32_t pc[MAX_DEPTH]; // Return addresses, innermost first
+        uint32_t sp[MAX_DEPTH];
+        uint8_t depth;
+        bool hot;               // Made by a hot task
+        char task[configMAX_TASK_NAME_LEN]; // "ISR" if from an interrupt
+        uint32_t count;
+        uint32_t bytes;
+        uint32_t largest;
+    };
+
+    struct Totals {
+        uint32_t hotCount;   // Allocations made by hot tasks
+        uint32_t hotBytes;
+        uint32_t otherCount; // Allocations made by any other task
+        uint32_t otherBytes;
+        uint32_t unsited;    // Counted, but the site table was full or the
+                             // flash cache was off, so no stack was kept
+    };
+
+    /**
+     * @brief Counts the allocations of a task apart, as the hot path. Call
+     * once per task, after creating it.
+     */
+    static void markHotTask(TaskHandle_t task);
+
+    /**
+     * @brief Starts counting allocations. Call at the end of setup(), once
+     * everything has been allocated.
+     */
+    static void arm();
+
+    /**
+     * @brief Stops counting, for work that is allowed to allocate (starting
+     * or stopping Bluetooth).
+     * @return True if it was counting, to pass back to arm() afterwards.
+     */
+    static bool disarm();
+
+    static bool isArmed() { return armed; }
+
+    /**
+     * @brief Forgets every allocation counted so far.
+     */
+    static void clear();
+
+    static void getTotals(Totals& totals);
+
+    /**
+     * @brief Copies one call site.
+     * @return False if there is no site at that index.
+     */
+    static bool getSite(uint8_t index, Site& site);
+
+    /**
+     * @brief Counts one allocation. Called by the malloc wrappers only.
+     */
+    static void record(size_t bytes);
+
+private:
+    static volatile bool armed;
+};
+
+#endif // HEAP_GUARD_H
@@ -0,0 +1,262 @@
+/*
+================================================================================
+= HidDescriptor.h                                                              =
+=                                                                              =
+= Compile-time HID report descriptor generator.                                =
+=                                                                              =
+= A report is declared once, as a list of fields:                              =
+=                                                                              =
+=   using Layout = hid::ReportLayout<1, hid::Buttons<10>, hid::HatSwitch,      =
+=                                    hid::Padding<2>>;                         =
+=                                                                              =
+= From that single list the compiler produces both the descriptor bytes        =
+= (Layout::descriptor) and a packed report buffer (Layout::Report) whose size  =
+= is checked against the descriptor with a static_assert. Only the bits that   =
+= are declared are sent, so the report is as small as it can be.               =
+================================================================================
+*/
+
+#ifndef HID_DESCRIPTOR_H
+#define HID_DESCRIPTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+namespace hid {
+
+// Generic Desktop usages for axes.
+const uint8_t USAGE_X = 0x30;
+const uint8_t USAGE_Y = 0x31;
+const uint8_t USAGE_Z = 0x32;
+const uint8_t USAGE_RX = 0x33;
+const uint8_t USAGE_RY = 0x34;
+const uint8_t USAGE_RZ = 0x35;
+
+// --- Report Fields ---
+// Every field describes itself with:
+//   ELEMENT_BITS / ELEMENT_COUNT  the bits it occupies in the report
+//   descriptor()                  the descriptor items that declare it
+
+/**
+ * @brief N on/off buttons, numbered from 1. One bit each; bit 0 = button 1.
+ */
+template <uint8_t N>
+struct Buttons {
+    static_assert(N > 0 && N <= 24, "Buttons<N> supports 1 to 24 buttons");
+    static constexpr size_t ELEMENT_BITS = N;
+    static constexpr size_t ELEMENT_COUNT = 1;
+
+    static constexpr std::array<uint8_t, 16> descriptor() {
+        return {{
+            0x05, 0x09, // Usage Page (Button)
+            0x19, 0x01, // Usage Minimum (Button 1)
+            0x29, N,    // Usage Maximum (Button N)
+            0x15, 0x00, // Logical Minimum (0)
+            0x25, 0x01, // Logical Maximum (1)
+            0x75, 0x01, // Report Size (1)
+            0x95, N,    // Report Count (N)
+            0x81, 0x02, // Input (Data, Variable, Absolute)
+        }};
+    }
+};
+
+/**
+ * @brief An 8-way hat switch in 4 bits: 0 = centered, 1-8 = clockwise from Up.
+ */
+struct HatSwitch {
+    static constexpr size_t ELEMENT_BITS = 4;
+    static constexpr size_t ELEMENT_COUNT = 1;
+
+    static constexpr std::array<uint8_t, 23> descriptor() {
+        return {{
+            0x05, 0x01,       // Usage Page (Generic Desktop)
+            0x09, 0x39,       // Usage (Hat switch)
+            0x15, 0x01,       // Logical Minimum (1)
+            0x25, 0x08,       // Logical Maximum (8)
+            0x35, 0x00,       // Physical Minimum (0)
+            0x46, 0x3B, 0x01, // Physical Maximum (315)
+            0x65, 0x14,       // Unit (Degrees)
+            0x75, 0x04,       // Report Size (4)
+            0x95, 0x01,       // Report Count (1)
+            0x81, 0x42,       // Input (Data, Variable, Absolute, Null State)
+            0x65, 0x00,       // Unit (None)
+        }};
+    }
+};
+
+/**
+ * @brief Axes that are only ever centered or at full deflection, in 2 bits
+ * each (-1, 0, +1). This is all a digital lever can produce, and hosts scale
+ * it to their own stick range.
+ */
+template <uint8_t... Usages>
+struct DigitalAxes {
+    static_assert(sizeof...(Usages) > 0, "DigitalAxes needs at least one usage");
+    static constexpr size_t ELEMENT_BITS = 2;
+    static constexpr size_t ELEMENT_COUNT = sizeof...(Usages);
+
+    static constexpr std::array<uint8_t, 12 + 2 * sizeof...(Usages)> descriptor() {
+        const uint8_t usages[] = {Usages...};
+        std::array<uint8_t, 12 + 2 * sizeof...(Usages)> out{};
+        size_t o = 0;
+        out[o++] = 0x05; out[o++] = 0x01; // Usage Page (Generic Desktop)
+        for (uint8_t usage : usages) {
+            out[o++] = 0x09; out[o++] = usage; // Usage (X, Y, ...)
+        }
+        out[o++] = 0x15; out[o++] = 0xFF; // Logical Minimum (-1)
+        out[o++] = 0x25; out[o++] = 0x01; // Logical Maximum (1)
+        out[o++] = 0x75; out[o++] = 0x02; // Report Size (2)
+        out[o++] = 0x95; out[o++] = (uint8_t)sizeof...(Usages); // Report Count
+        out[o++] = 0x81; out[o++] = 0x02; // Input (Data, Variable, Absolute)
+        return out;
+    }
+};
+
+/**
+ * @brief Constant bits that pad the report to a whole number of bytes.
+ */
+template <uint8_t Bits>
+struct Padding {
+    static constexpr size_t ELEMENT_BITS = Bits;
+    static constexpr size_t ELEMENT_COUNT = 1;
+
+    static constexpr std::array<uint8_t, 6> descriptor() {
+        return {{
+            0x75, 0x01, // Report Size (1)
+            0x95, Bits, // Report Count (Bits)
+            0x81, 0x03, // Input (Constant, Variable, Absolute)
+        }};
+    }
+};
+
+// --- Layout ---
+
+namespace detail {
+
+template <size_t A, size_t B>
+constexpr std::array<uint8_t, A + B> concat(const std::array<uint8_t, A>& a, const std::array<uint8_t, B>& b) {
+    std::array<uint8_t, A + B> out{};
+    for (size_t i = 0; i < A; i++) out[i] = a[i];
+    for (size_t i = 0; i < B; i++) out[A + i] = b[i];
+    return out;
+}
+
+constexpr std::array<uint8_t, 0> concatAll() {
+    return {};
+}
+
+template <typename First, typename... Rest>
+constexpr auto concatAll(const First& first, const Rest&... rest) {
+    return concat(first, concatAll(rest...));
+}
+
+template <typename... Fields>
+struct BitOffsets;
+
+template <>
+struct BitOffsets<> {
+    static constexpr size_t TOTAL = 0;
+    static constexpr size_t of(size_t) { return 0; }
+};
+
+template <typename First, typename... Rest>
+struct BitOffsets<First, Rest...> {
+    static constexpr size_t SIZE = First::ELEMENT_BITS * First::ELEMENT_COUNT;
+    static constexpr size_t TOTAL = SIZE + BitOffsets<Rest...>::TOTAL;
+    static constexpr size_t of(size_t index) {
+        return index == 0 ? 0 : SIZE + BitOffsets<Rest...>::of(index - 1);
+    }
+};
+
+template <size_t Index, typename... Fields>
+struct FieldAt;
+
+template <typename First, typename... Rest>
+struct FieldAt<0, First, Rest...> {
+    using Type = First;
+};
+
+template <size_t Index, typename First, typename... Rest>
+struct FieldAt<Index, First, Rest...> {
+    using Type = typename FieldAt<Index - 1, Rest...>::Type;
+};
+
+} // namespace detail
+
+/**
+ * @brief A complete gamepad input report, declared as a list of fields.
+ * @tparam ReportId The HID report ID (1-255).
+ */
+template <uint8_t ReportId, typename... Fields>
+struct ReportLayout {
+    static constexpr uint8_t REPORT_ID = ReportId;
+    static constexpr size_t REPORT_BITS = detail::BitOffsets<Fields...>::TOTAL;
+    static constexpr size_t REPORT_SIZE = REPORT_BITS / 8;
+
+    static_assert(ReportId != 0, "Report ID 0 is reserved");
+    static_assert(REPORT_BITS % 8 == 0, "Report fields must add up to whole bytes; add hid::Padding<>");
+
+    static constexpr auto descriptor = detail::concatAll(
+        std::array<uint8_t, 8>{{
+            0x05, 0x01,     // Usage Page (Generic Desktop)
+            0x09, 0x05,     // Usage (Game Pad)
+            0xA1, 0x01,     // Collection (Application)
+            0x85, ReportId, // Report ID
+        }},
+        Fields::descriptor()...,
+        std::array<uint8_t, 1>{{
+            0xC0, // End Collection
+        }});
+
+    /**
+     * @brief The packed report, exactly as it is sent over the air.
+     */
+    struct Report {
+        uint8_t bytes[REPORT_SIZE];
+
+        Report() : bytes{} {}
+
+        /**
+         * @brief Writes one element of a field.
+         * @tparam Field Index of the field in the layout's field list.
+         * @param value The value; only the field's low ELEMENT_BITS are used.
+         * @param element Which element, for fields with more than one (axes).
+         */
+        template <size_t Field>
+        void set(uint32_t value, size_t element = 0) {
+            using Type = typename detail::FieldAt<Field, Fields...>::Type;
+            static_assert(Type::ELEMENT_BITS <= 25, "Field too wide for a single write");
+            const size_t offset = detail::BitOffsets<Fields...>::of(Field) + element * Type::ELEMENT_BITS;
+            writeBits(offset, Type::ELEMENT_BITS, value);
+        }
+
+        bool operator==(const Report& other) const {
+            for (size_t i = 0; i < REPORT_SIZE; i++) {
+                if (bytes[i] != other.bytes[i]) return false;
+            }
+            return true;
+        }
+        bool operator!=(const Report& other) const { return !(*this == other); }
+
+    private:
+        // HID packs fields little-endian, starting at bit 0 of byte 0.
+        void writeBits(size_t offset, size_t width, uint32_t value) {
+            const size_t first = offset / 8;
+            const size_t shift = offset % 8;
+            const size_t span = (shift + width + 7) / 8;
+            const uint32_t mask = ((1UL << width) - 1) << shift;
+
+            uint32_t window = 0;
+            for (size_t i = 0; i < span; i++) window |= (uint32_t)bytes[first + i] << (8 * i);
+            window = (window & ~mask) | ((value << shift) & mask);
+            for (size_t i = 0; i < span; i++) bytes[first + i] = (uint8_t)(window >> (8 * i));
+        }
+    };
+
+    static_assert(sizeof(Report) == REPORT_SIZE, "Packed report does not match the descriptor");
+};
+
+} // namespace hid
+
+#endif // HID_DESCRIPTOR_H
@@ -0,0 +1,62 @@
+/*
+================================================================================
+= InputPipeline.h                                                              =
+=                                                                              =
+= The input path as a list of stages chosen at compile time:                   =
+=                                                                              =
+=     using StickPipeline = Pipeline<ScanStage, DebounceStage, SocdStage, ...>; =
+=     stickPipeline.run(frame);                                                =
+=                                                                              =
+= A stage is any type with a process(Frame&) member. run() calls every stage's =
+= process() in order on the same frame, through a fold expression over the     =
+= stage tuple: there are no virtual calls, no function pointers and no buffers =
+= between stages, and with the stages marked PIPELINE_INLINE the whole scan    =
+= compiles into one function. Adding a stage only costs what the stage itself  =
+= does, and a pipeline without it costs nothing for it.                        =
+================================================================================
+*/
+
+#ifndef INPUT_PIPELINE_H
+#define INPUT_PIPELINE_H
+
+#include <stddef.h>
+#include <tuple>
+#include <utility>
+
+// Forces a stage's process() into the pipeline's run(), even at -Os.
+#define PIPELINE_INLINE inline __attribute__((always_inline))
+
+template <typename... Stages>
+class Pipeline {
+public:
+    static constexpr size_t STAGE_COUNT = sizeof...(Stages);
+
+    Pipeline() = default;
+    explicit Pipeline(const Stages&... stages) : stages(stages...) {}
+
+    /**
+     * @brief Runs every stage, in order, on the frame.
+     */
+    template <typename Frame>
+    PIPELINE_INLINE void run(Frame& frame) {
+        runStages(frame, std::index_sequence_for<Stages...>());
+    }
+
+    /**
+     * @brief The I-th stage, to configure it.
+     */
+    template <size_t I>
+    typename std::tuple_element<I, std::tuple<Stages...>>::type& stage() {
+        return std::get<I>(stages);
+    }
+
+private:
+    template <typename Frame, size_t... I>
+    PIPELINE_INLINE void runStages(Frame& frame, std::index_sequence<I...>) {
+        (std::get<I>(stages).process(frame), ...);
+    }
+
+    std::tuple<Stages...> stages;
+};
+
+#endif // INPUT_PIPELINE_H
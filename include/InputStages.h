@@ -0,0 +1,224 @@
+/*
+================================================================================
+= InputStages.h                                                                =
+=                                                                              =
+= The stick's report layout and the stages of its input pipeline that work on  =
+= the frame alone: debounce, SOCD, macros, button remap and report build. The  =
+= stages that read the hardware or the firmware's own state (the register      =
+= scan, hotkeys, direction mode, hand-off to the report task) are in main.cpp. =
+=                                                                              =
+= Kept apart so the native tests can run the same stages on the PC: the        =
+= pipeline benchmark (test/test_pipeline_benchmark) measures exactly the code  =
+= the firmware runs.                                                           =
+================================================================================
+*/
+
+#ifndef INPUT_STAGES_H
+#define INPUT_STAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_attr.h>
+#include "AdaptiveBounce.h"
+#include "GamepadReport.h"
+#include "HidDescriptor.h"
+#include "InputPipeline.h"
+#include "MacroEngine.h"
+
+// --- Stick Report ---
+// buttonPins and gamepadButtonMap in main.cpp list one entry per button.
+const int TOTAL_BUTTONS = 10; // 8 action + Start + Select
+
+// The report sent to the host, declared once. The HID descriptor and the
+// packed report are both generated from this list at compile time, so they
+// can never disagree. 10 buttons, a 4-bit hat and the two emulated sticks
+// (2 bits per axis) fit in 3 bytes.
+const uint8_t GAMEPAD_REPORT_ID = 1;
+using StickReportLayout = hid::ReportLayout<GAMEPAD_REPORT_ID,
+    hid::Buttons<TOTAL_BUTTONS>,
+    hid::HatSwitch,
+    hid::Padding<2>,
+    hid::DigitalAxes<hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ>>;
+// Field indexes in the list above.
+const size_t REPORT_FIELD_BUTTONS = 0;
+const size_t REPORT_FIELD_HAT = 1;
+const size_t REPORT_FIELD_STICKS = 3; // X, Y, Z, Rz
+static_assert(StickReportLayout::REPORT_SIZE == 3, "Stick report should pack into 3 bytes");
+
+// What opposing directions held together (left + right, up + down) report.
+// A lever cannot close both, but an all-button layout or a worn gate can.
+// The firmware's is SOCD_MODE in main.cpp.
+enum SocdMode : uint8_t {
+    SOCD_UP_LEFT_PRIORITY, // Up beats down, left beats right
+    SOCD_NEUTRAL,          // Opposing directions cancel out
+    SOCD_UP_PRIORITY,      // Up beats down, left + right cancel out
+    SOCD_LAST_WINS         // The direction pressed last wins
+};
+
+/**
+ * @brief Everything one scan knows, built up stage by stage.
+ */
+struct InputFrame {
+    uint32_t scanTimeUs;
+    uint64_t levels;                  // Scan: level of every GPIO, bit = GPIO number
+    uint8_t directions;               // Debounce: lever bits, LEVER_UP..LEVER_RIGHT
+    GamepadReport physical;           // Debounce, SOCD: the debounced inputs
+    GamepadReport report;             // Hotkeys onwards: what the host gets
+    uint32_t hidButtons;              // Remap: report.buttons as HID button bits
+    StickReportLayout::Report packed; // Report build: the packed HID report
+};
+
+// Lever bits in InputFrame::directions, in joystickPins order.
+const uint8_t LEVER_UP = 1 << 0;
+const uint8_t LEVER_DOWN = 1 << 1;
+const uint8_t LEVER_LEFT = 1 << 2;
+const uint8_t LEVER_RIGHT = 1 << 3;
+
+/**
+ * @brief Converts a report axis (-127..127) to the 2-bit field in the HID report.
+ * @return 0b01 for positive, 0b11 (-1) for negative, 0 for centered.
+ */
+PIPELINE_INLINE uint8_t toDigitalAxis(int8_t value) {
+    if (value > 0) return 0x01;
+    if (value < 0) return 0x03;
+    return 0x00;
+}
+
+/**
+ * @brief Debounces the scanned levels into button and lever bits.
+ */
+struct DebounceStage {
+    AdaptiveBounce* buttons; // TOTAL_BUTTONS, in buttonPins order
+    AdaptiveBounce* lever;   // 4, in joystickPins order
+
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        uint16_t pressed = 0;
+        for (int i = 0; i < TOTAL_BUTTONS; i++) {
+            buttons[i].update(frame.scanTimeUs, (frame.levels >> buttons[i].getPin()) & 1);
+            if (!buttons[i].read()) { // Pressed = LOW (pull-up)
+                pressed |= 1 << i;
+            }
+        }
+        uint8_t directions = 0;
+        for (int i = 0; i < 4; i++) {
+            lever[i].update(frame.scanTimeUs, (frame.levels >> lever[i].getPin()) & 1);
+            if (!lever[i].read()) {
+                directions |= 1 << i;
+            }
+        }
+        frame.physical = EMPTY_GAMEPAD_REPORT;
+        frame.physical.buttons = pressed;
+        frame.directions = directions;
+    }
+};
+
+/**
+ * @brief Resolves opposing lever directions (see SocdMode) into the hat.
+ */
+struct SocdStage {
+    SocdMode mode;
+    uint8_t previous;   // Lever bits of the previous scan
+    int8_t lastX;       // Last horizontal direction pressed, for SOCD_LAST_WINS
+    int8_t lastY;
+
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        DRAM_ATTR static const uint8_t hats[3][3] = {
+            {HAT_UP_LEFT, HAT_UP, HAT_UP_RIGHT},
+            {HAT_LEFT, HAT_CENTERED, HAT_RIGHT},
+            {HAT_DOWN_LEFT, HAT_DOWN, HAT_DOWN_RIGHT},
+        };
+        const uint8_t held = frame.directions;
+        const uint8_t pressed = held & ~previous;
+        previous = held;
+        if (pressed & LEVER_LEFT) lastX = -1;
+        if (pressed & LEVER_RIGHT) lastX = 1;
+        if (pressed & LEVER_UP) lastY = -1;
+        if (pressed & LEVER_DOWN) lastY = 1;
+
+        const int8_t x = resolve(held & LEVER_LEFT, held & LEVER_RIGHT, lastX, false);
+        const int8_t y = resolve(held & LEVER_UP, held & LEVER_DOWN, lastY, true);
+        frame.physical.hat = hats[y + 1][x + 1];
+    }
+
+    PIPELINE_INLINE int8_t resolve(bool negative, bool positive, int8_t last, bool vertical) const {
+        if (negative != positive) {
+            return negative ? -1 : 1;
+        }
+        if (!negative) {
+            return 0;
+        }
+        switch (mode) {
+            case SOCD_UP_LEFT_PRIORITY:
+                return -1;
+            case SOCD_UP_PRIORITY:
+                return vertical ? -1 : 0;
+            case SOCD_LAST_WINS:
+                return last;
+            default:
+                return 0;
+        }
+    }
+};
+
+/**
+ * @brief Merges turbo and macro playback into the report.
+ */
+struct MacroStage {
+    MacroEngine* engine;
+
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        frame.report = engine->process(frame.scanTimeUs, frame.report);
+    }
+};
+
+/**
+ * @brief Maps the buttons to the HID button numbers in buttonMap.
+ */
+struct RemapStage {
+    const int* buttonMap; // TOTAL_BUTTONS, 1-based; gamepadButtonMap in the firmware
+
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        uint32_t buttons = 0;
+        for (int i = 0; i < TOTAL_BUTTONS; i++) {
+            if (frame.report.buttons & (1 << i)) {
+                buttons |= 1UL << (buttonMap[i] - 1);
+            }
+        }
+        frame.hidButtons = buttons;
+    }
+};
+
+/**
+ * @brief Packs the report into the compact HID layout.
+ */
+struct ReportBuildStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        StickReportLayout::Report& packed = frame.packed;
+        packed.set<REPORT_FIELD_BUTTONS>(frame.hidButtons);
+        packed.set<REPORT_FIELD_HAT>(frame.report.hat);
+        packed.set<REPORT_FIELD_STICKS>(toDigitalAxis(frame.report.leftX), 0);
+        packed.set<REPORT_FIELD_STICKS>(toDigitalAxis(frame.report.leftY), 1);
+        packed.set<REPORT_FIELD_STICKS>(toDigitalAxis(frame.report.rightX), 2);
+        packed.set<REPORT_FIELD_STICKS>(toDigitalAxis(frame.report.rightY), 3);
+    }
+};
+
+/**
+ * @brief Stands in for the register scan in the pipeline benchmark: every
+ * switch released, except the one on pin, which is pressed with some bounce
+ * for half of every 50 scans, so the debounce and later stages have work to do.
+ */
+struct PatternScanStage {
+    uint8_t pin;
+    uint32_t scans;
+
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        const uint32_t phase = scans++ % 50;
+        frame.levels = ~0ULL;
+        if (phase < 25 && phase != 1 && phase != 3) {
+            frame.levels &= ~(1ULL << pin);
+        }
+    }
+};
+
+#endif // INPUT_STAGES_H
@@ -0,0 +1,118 @@
+/*
+================================================================================
+= LinkHealth.h                                                                 =
+=                                                                              =
+= A flight recorder for the Bluetooth link, for when a player reports that an  =
+= input was dropped. It counts input report notifications by the result the    =
+= stack returned, how close the stack came to running out of buffers and how   =
+= deep the report queue got, and keeps the last connections, disconnect        =
+= reasons and connection parameter changes in a ring of timestamped events.    =
+=                                                                              =
+= The record lives in RTC memory that is not cleared on a soft reset, so after =
+= a crash, watchdog or brownout reset the events leading up to it can still be =
+= dumped over Serial. It is only initialised on power-on or when cleared.      =
+================================================================================
+*/
+
+#ifndef LINK_HEALTH_H
+#define LINK_HEALTH_H
+
+#include <Arduino.h>
+
+class LinkHealth {
+public:
+    static const uint8_t EVENT_COUNT = 64;
+    static const uint8_t RESULT_CODE_COUNT = 8;
+
+    enum EventType : uint8_t {
+        EVENT_BOOT,        // a = reset reason (esp_reset_reason_t)
+        EVENT_CONNECT,     // a = interval (1.25 ms), b = latency, c = timeout (10 ms)
+        EVENT_ACCEPTED,    // The host was encrypted and accepted for its slot
+        EVENT_DISCONNECT,  // a = reason (NimBLE code, 0x2xx = HCI error xx)
+        EVENT_CONN_PARAMS, // a = interval (1.25 ms), b = latency, c = timeout (10 ms)
+        EVENT_MTU          // a = negotiated ATT MTU
+    };
+
+    struct Event {
+        uint32_t timeMs;     // millis() when it happened
+        uint16_t boot;       // Boot number, tells events of different resets apart
+        uint8_t type;        // EventType
+        uint8_t slot;        // Host slot, 0xFF if not known
+        uint16_t connHandle; // 0xFFFF if not about a connection
+        uint16_t a;
+        uint16_t b;
+        uint16_t c;
+    };
+
+    struct ResultCount {
+        int16_t code; // NimBLE return code of a notification
+        uint32_t count;
+    };
+
+    // Everything in the record, as copied by snapshot().
+    struct Record {
+        uint32_t magic;
+        uint16_t boot;
+        uint16_t minFreeMbufs;     // Fewest free mbufs seen when submitting a report
+        uint32_t notifySent;       // Input reports the stack sent (result 0)
+        ResultCount notifyErrors[RESULT_CODE_COUNT];
+        uint32_t notifyOtherErrors; // Errors with a code not in the table
+        uint32_t mbufExhausted;     // Reports submitted with no free mbuf left
+        uint32_t queueOverflows;    // Reports the input task could not queue
+        uint16_t maxQueueDepth;     // Deepest the report queue got
+        uint8_t eventNext;          // Where the next event goes
+        uint8_t eventCount;
+        Event events[EVENT_COUNT];  // Ring, oldest at eventNext once full
+    };
+
+    /**
+     * @brief Keeps the record from before a soft reset, or starts a new one
+     * after power-on, and logs the boot with its reset reason. Call once.
+     */
+    void begin();
+
+    /**
+     * @brief Starts a new, empty record.
+     */
+    void clear();
+
+    /**
+     * @brief Counts the result of one input report notification. From the
+     * stack's notification status callback.
+     */
+    void recordNotifyResult(int code);
+
+    /**
+     * @brief Notes the free mbufs when a report is submitted and whether the
+     * submission failed for lack of one.
+     */
+    void recordSubmission(int freeMbufs, bool failed);
+
+    /**
+     * @brief Notes the depth of the report queue when the report task wakes.
+     */
+    void recordQueueDepth(size_t depth);
+
+    /**
+     * @brief Counts a report the input task could not queue. Lock-free, for
+     * the scan.
+     */
+    void recordQueueOverflow();
+
+    void recordEvent(EventType type, uint16_t connHandle, uint8_t slot,
+                     uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+
+    /**
+     * @brief Copies the whole record, consistent at one point in time.
+     */
+    void snapshot(Record& out) const;
+
+    static const char* eventName(uint8_t type);
+
+    /**
+     * @brief Names the usual disconnect reasons, nullptr for other codes.
+     */
+    static const char* disconnectReasonName(uint16_t reason);
+};
+
+#endif // LINK_HEALTH_H
@@ -0,0 +1,113 @@
+/*
+================================================================================
+= MacroEngine.h                                                                =
+=                                                                              =
+= Turbo and macro playback for training-mode setups.                           =
+=                                                                              =
+= The engine is a pure function of the scan timestamps it is given: it never   =
+= reads the clock itself and never blocks. Every deadline is derived from the  =
+= previous deadline (not from "now"), so step timing does not drift, and the   =
+= engine only touches the button bits it owns, so it cannot add jitter to any  =
+= other input.                                                                 =
+================================================================================
+*/
+
+#ifndef MACRO_ENGINE_H
+#define MACRO_ENGINE_H
+
+#include <stdint.h>
+#include "GamepadReport.h"
+
+/**
+ * @brief One step of a recorded sequence: a report held for a fixed time.
+ */
+struct MacroStep {
+    uint16_t buttons;
+    uint8_t hat;
+    uint32_t durationUs;
+};
+
+class MacroEngine {
+public:
+    static const uint8_t MAX_BUTTONS = 16;
+    static const uint8_t MAX_STEPS = 64;
+
+    MacroEngine();
+
+    /**
+     * @brief Enables turbo on a button at the given rate (presses per second).
+     * A rate of 0 disables turbo for that button.
+     */
+    void setTurbo(uint8_t button, uint16_t rateHz);
+
+    /**
+     * @brief Returns the turbo rate of a button in presses per second, 0 if off.
+     */
+    uint16_t getTurbo(uint8_t button) const;
+
+    /**
+     * @brief Starts capturing the reports given to process() as a new sequence.
+     * Any sequence stored so far is discarded.
+     */
+    void startRecording(uint32_t nowUs);
+
+    /**
+     * @brief Closes the sequence being recorded. Trailing idle time is dropped.
+     */
+    void stopRecording(uint32_t nowUs);
+
+    bool isRecording() const { return recording; }
+
+    /**
+     * @brief Replaces the stored sequence with a pre-built one.
+     * @return False if the sequence is longer than MAX_STEPS.
+     */
+    bool loadSequence(const MacroStep* sequence, uint8_t count);
+
+    uint8_t getStepCount() const { return stepCount; }
+    const MacroStep& getStep(uint8_t index) const { return steps[index]; }
+
+    /**
+     * @brief Starts playing the stored sequence on the scan at nowUs.
+     */
+    void play(uint32_t nowUs);
+
+    void stop() { playing = false; }
+
+    bool isPlaying() const { return playing; }
+
+    /**
+     * @brief Runs one scan of the engine.
+     * @param nowUs Timestamp of this scan, in microseconds.
+     * @param physical The debounced physical inputs for this scan.
+     * @return The physical inputs merged with turbo and macro output.
+     */
+    GamepadReport process(uint32_t nowUs, const GamepadReport& physical);
+
+private:
+    void recordReport(uint32_t nowUs, const GamepadReport& report);
+    void closeRecordedStep(uint32_t nowUs);
+
+    // Turbo
+    uint16_t turboMask;
+    uint16_t turboRateHz[MAX_BUTTONS];
+    uint32_t turboHalfPeriodUs[MAX_BUTTONS];
+    uint32_t turboPressedAtUs[MAX_BUTTONS];
+    uint16_t previousButtons;
+
+    // Stored sequence
+    MacroStep steps[MAX_STEPS];
+    uint8_t stepCount;
+
+    // Recording
+    bool recording;
+    GamepadReport recordedReport;
+    uint32_t recordedSinceUs;
+
+    // Playback
+    bool playing;
+    uint8_t playIndex;
+    uint32_t stepDeadlineUs;
+};
+
+#endif // MACRO_ENGINE_H
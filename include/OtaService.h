@@ -0,0 +1,172 @@
+/*
+================================================================================
+= OtaService.h                                                                 =
+=                                                                              =
+= Firmware update over BLE. A client streams the new image in CRC-checked      =
+= chunks; the stick writes them into the inactive OTA partition and switches   =
+= to it only once the whole image has been received, checked and validated.    =
+=                                                                              =
+= Receiving and flashing are pipelined: the BLE host task only checks each     =
+= chunk and queues it, while the OTA task erases and writes the partition one  =
+= 4 KB sector at a time, so the radio keeps receiving while the flash is busy. =
+= The client keeps at most the advertised window of chunks beyond the last     =
+= progress report in flight.                                                   =
+=                                                                              =
+= An interrupted upload resumes: after a disconnect, a client that begins the  =
+= same image (same size and CRC) again is told where to continue.             =
+=                                                                              =
+= Protocol (little endian, all CRCs are CRC-32 as in zlib):                    =
+=   Control, write:  0x01 BEGIN u32 size, u32 CRC of the whole image           =
+=                    0x02 COMMIT    0x03 ABORT    0x04 STATUS                  =
+=   Data, write without response: u32 offset, data, u32 CRC of the data        =
+=   Control, notify: u8 status, u8 window (chunks), u16 largest chunk data     =
+=                    size, u32 offset                                          =
+=     READY     BEGIN accepted; send from offset                               =
+=     PROGRESS  everything below offset is in flash                            =
+=     RESEND    a chunk was out of order, corrupt or did not fit; resend from  =
+=               offset                                                         =
+=     DONE      image checked and made the boot image; the stick restarts      =
+=     ERROR     the update failed; offset holds the error code                 =
+=     IDLE      no update in progress (reply to STATUS)                        =
+= The characteristics require an encrypted link, so only a bonded host can    =
+= update the stick. See tools/ble_ota.py for a client.                         =
+================================================================================
+*/
+
+#ifndef OTA_SERVICE_H
+#define OTA_SERVICE_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <atomic>
+#include <esp_partition.h>
+#include "SpscQueue.h"
+
+class OtaService : public NimBLECharacteristicCallbacks {
+public:
+    static const char* const SERVICE_UUID;
+    static const char* const CONTROL_UUID;
+    static const char* const DATA_UUID;
+
+    // Largest chunk payload: a 247-byte ATT MTU leaves 244 bytes per write,
+    // minus the offset and CRC.
+    static const uint16_t MAX_CHUNK_DATA = 236;
+    static const size_t QUEUE_SIZE = 32;
+    static const size_t SECTOR_SIZE = 4096;
+
+    enum Command : uint8_t {
+        CMD_BEGIN = 0x01,
+        CMD_COMMIT = 0x02,
+        CMD_ABORT = 0x03,
+        CMD_STATUS = 0x04
+    };
+
+    enum Status : uint8_t {
+        STATUS_READY = 0x01,
+        STATUS_PROGRESS = 0x02,
+        STATUS_RESEND = 0x03,
+        STATUS_DONE = 0x04,
+        STATUS_ERROR = 0x05,
+        STATUS_IDLE = 0x06
+    };
+
+    enum Error : uint32_t {
+        ERROR_NONE = 0,
+        ERROR_TOO_LARGE = 1,   // The image does not fit the OTA partition
+        ERROR_INCOMPLETE = 2,  // COMMIT before the whole image was received
+        ERROR_CRC = 3,         // The image CRC does not match BEGIN
+        ERROR_FLASH = 4,       // Erasing or writing the partition failed
+        ERROR_INVALID = 5,     // The bootloader would not accept the image
+        ERROR_BUSY = 6,        // The command could not be queued; retry
+        ERROR_NO_PARTITION = 7 // No OTA partition in the partition table
+    };
+
+    OtaService();
+
+    /**
+     * @brief Adds the service to the server. Call between BleHidGamepad::begin()
+     * and BleHidGamepad::startAdvertising().
+     */
+    void begin(NimBLEServer* server);
+
+    /**
+     * @brief Stops accepting chunks; call before the BLE stack is shut down.
+     * An upload in progress can be resumed after the next begin().
+     */
+    void end();
+
+    /**
+     * @brief The task that calls process(); notified whenever there is work.
+     */
+    void setWriterTask(TaskHandle_t task) { writerTask = task; }
+
+    /**
+     * @brief Writes the queued chunks to flash and carries out queued commits.
+     * Call from the OTA task whenever it is notified. Restarts the chip after
+     * a successful commit.
+     */
+    void process();
+
+    bool isActive() const { return active; }
+
+    /**
+     * @brief Progress of the current or last upload.
+     */
+    uint32_t getImageSize() const { return imageSize; }
+    uint32_t getWrittenBytes() const { return written; }
+    uint32_t getElapsedMs() const;
+    Error getLastError() const { return lastError; }
+
+protected:
+    void onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) override;
+
+private:
+    enum Op : uint8_t { OP_BEGIN, OP_DATA, OP_COMMIT, OP_ABORT };
+
+    // One unit of work for the OTA task. For OP_BEGIN, offset holds the image
+    // size and length is unused.
+    struct Chunk {
+        Op op;
+        uint16_t length;
+        uint32_t offset;
+        uint8_t data[MAX_CHUNK_DATA];
+    };
+
+    void handleControl(const uint8_t* value, size_t length);
+    void handleData(const uint8_t* value, size_t length);
+    bool queue(const Chunk& chunk);
+    void notifyStatus(Status status, uint32_t offset);
+    void fail(Error error);
+    bool flushSector();
+    void commit();
+
+    NimBLECharacteristic* control;
+    NimBLECharacteristic* data;
+    std::atomic<bool> open;
+    // Notifications in progress, from the BLE host and OTA tasks; end() waits
+    // for none to be left before control is freed.
+    std::atomic<uint8_t> notifying;
+    TaskHandle_t writerTask;
+    SpscQueue<Chunk, QUEUE_SIZE> chunks; // BLE host task -> OTA task
+
+    // Receiving side, BLE host task only.
+    volatile bool active;
+    volatile uint32_t imageSize;
+    uint32_t imageCrc;
+    uint32_t expectedOffset;
+    bool resendSent; // One RESEND per gap, not one per chunk in flight
+
+    // Writing side, OTA task only.
+    const esp_partition_t* partition;
+    uint8_t sector[SECTOR_SIZE];
+    size_t sectorFill;
+    volatile uint32_t written;
+    uint32_t writtenCrc;
+    uint32_t expectedSize;
+    uint32_t expectedCrc;
+    volatile uint32_t startedMs;
+    volatile uint32_t finishedMs;
+    volatile Error lastError;
+};
+
+#endif // OTA_SERVICE_H
@@ -0,0 +1,118 @@
+/*
+================================================================================
+= ReportLinks.h                                                                =
+=                                                                              =
+= The host connections an input report goes out on, and how it goes out:     =
+= BleHidGamepad's link table and report fan-out. Each report is sent to the    =
+= active slot's host first and then to the mirror, each in its own mbuf; the  =
+= mirror's copy is skipped when fewer than MIRROR_MBUF_RESERVE mbufs are free, =
+= so the second link never takes the buffers the active host's next report    =
+= needs. Every link counts what it was sent, refused and skipped, and the     =
+= delay from the scan.                                                         =
+=                                                                              =
+= The BLE host task adds, removes and subscribes links; the report task sends; =
+= the loop reads the statistics. The table is guarded by a spinlock, held for  =
+= a copy at a time, never across a call into NimBLE.                          =
+================================================================================
+*/
+
+#ifndef REPORT_LINKS_H
+#define REPORT_LINKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <NimBLEDevice.h>
+#include <freertos/FreeRTOS.h>
+#include "LinkHealth.h"
+
+class ReportLinks {
+public:
+    // Concurrent host connections: the active slot's host and the mirror's.
+    static const uint8_t MAX_LINKS = 2;
+
+    // Free mbufs the mirror must leave to the active host. A report
+    // notification takes one; below this the mirror's report is skipped
+    // rather than queued ahead of the active host's next one.
+    static const int MIRROR_MBUF_RESERVE = 4;
+
+    /**
+     * @brief Per-connection delivery statistics, reset when the host connects.
+     */
+    struct Stats {
+        uint16_t connHandle;   // Identifies the connection
+        uint8_t slot;          // Host slot of the connection
+        bool primary;          // True for the active slot's host
+        uint32_t sent;         // Notifications queued by the stack
+        uint32_t failed;       // Notifications the stack refused
+        uint32_t skipped;      // Reports not sent to protect the primary link
+        uint32_t maxDelayUs;   // Longest scan-to-submission delay
+        uint64_t totalDelayUs; // Sum of scan-to-submission delays over sent
+    };
+
+    ReportLinks();
+
+    /**
+     * @brief Adds an accepted host's connection, unsubscribed, with fresh
+     * statistics. Ignored if every link is in use.
+     */
+    void add(uint16_t connHandle, uint8_t slot);
+
+    /**
+     * @brief Removes a connection, if it is one of the links.
+     * @return True if any link is left.
+     */
+    bool remove(uint16_t connHandle);
+
+    /**
+     * @brief Removes every link.
+     */
+    void clear();
+
+    void setSubscribed(uint16_t connHandle, bool subscribed);
+
+    bool isSlotLinked(uint8_t slot) const;
+
+    /**
+     * @brief The host slot of a connection, 0xFF if it is not a link.
+     */
+    uint8_t findSlot(uint16_t connHandle) const;
+
+    /**
+     * @brief Copies the connection handle and slot of every link in use.
+     * @return How many there are.
+     */
+    uint8_t getLinks(uint16_t (&connHandles)[MAX_LINKS], uint8_t (&slots)[MAX_LINKS]) const;
+
+    /**
+     * @brief The connection handle at an index, BLE_HS_CONN_HANDLE_NONE if
+     * that link is not in use.
+     */
+    uint16_t getConnHandle(uint8_t index) const;
+
+    /**
+     * @brief Copies the statistics of the link at an index.
+     * @return False if that link is not in use.
+     */
+    bool getStats(uint8_t index, uint8_t activeSlot, Stats& stats) const;
+
+    /**
+     * @brief Notifies the report to every subscribed link, activeSlot's host
+     * first, and counts the outcome on each.
+     * @param health Told the free mbufs at each submission; may be nullptr.
+     * @return False if the report reached no host.
+     */
+    bool send(NimBLECharacteristic* characteristic, const uint8_t* report, size_t length, uint32_t scanTimeUs,
+              uint8_t activeSlot, LinkHealth* health);
+
+private:
+    struct Link {
+        uint16_t connHandle; // BLE_HS_CONN_HANDLE_NONE if unused
+        bool subscribed;
+        Stats stats;
+    };
+
+    Link links[MAX_LINKS];
+    mutable portMUX_TYPE lock;
+};
+
+#endif // REPORT_LINKS_H
@@ -0,0 +1,86 @@
+/*
+================================================================================
+= ResourceMonitor.h                                                            =
+=                                                                              =
+= How close the firmware runs to its memory limits, sampled while it plays:    =
+= the stack high-water mark of each watched task (the loop task, the NimBLE    =
+= host, the input and report tasks, ...), free heap, the lowest free heap      =
+= since boot and the largest free block, and the use of every NimBLE memory    =
+= pool (mbufs, HCI events, GATT and L2CAP state).                              =
+=                                                                              =
+= Stacks and pools are sized for the worst case seen on the bench. Watching    =
+= the lows on a stick in the field is what shows they can be made smaller, or  =
+= that one is running short. The latest sample is printed over Serial and      =
+= streamed by TelemetryService.                                                =
+================================================================================
+*/
+
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#include <Arduino.h>
+
+class ResourceMonitor {
+public:
+    static const uint8_t MAX_TASKS = 8;
+    static const uint8_t MAX_POOLS = 12;
+    static const uint8_t POOL_NAME_LENGTH = 24;
+
+    struct TaskStack {
+        char name[configMAX_TASK_NAME_LEN];
+        uint32_t stackSize; // Bytes
+        uint32_t minFree;   // Fewest bytes ever left free, over every run of the
+                            // task; UINT32_MAX until it is first seen running
+        bool running;       // The task exists now (the NimBLE host only runs in wireless mode)
+    };
+
+    struct Pool {
+        char name[POOL_NAME_LENGTH];
+        uint16_t blockSize; // Bytes
+        uint16_t blocks;
+        uint16_t free;
+        uint16_t minFree;   // Fewest free blocks since the pool was created
+    };
+
+    // Everything in one sample, as copied by snapshot().
+    struct Snapshot {
+        uint32_t samples;      // Samples taken; 0 until the first one
+        uint32_t timeMs;       // millis() of the latest sample
+        uint32_t freeHeap;     // Bytes
+        uint32_t minFreeHeap;  // Fewest free bytes since boot
+        uint32_t largestBlock; // Largest block that can be allocated
+        uint8_t taskCount;
+        TaskStack tasks[MAX_TASKS];
+        uint8_t poolCount;
+        Pool pools[MAX_POOLS];
+    };
+
+    ResourceMonitor();
+
+    /**
+     * @brief Watches the stack of a task, found by its name at each sample,
+     * so a task that is deleted and created again (the NimBLE host) is still
+     * followed.
+     * @param stackSize The stack size the task was created with, in bytes.
+     * @return False if MAX_TASKS are already watched.
+     */
+    bool watchTask(const char* name, uint32_t stackSize);
+
+    /**
+     * @brief Takes a sample. Walks every task and pool, so call it from a
+     * low-priority task (the loop), about once per second.
+     */
+    void sample();
+
+    /**
+     * @brief Copies the latest sample, consistent at one point in time.
+     */
+    void snapshot(Snapshot& out) const;
+
+private:
+    // Only sample() writes it; readers copy it under the lock.
+    Snapshot latest;
+    mutable portMUX_TYPE lock;
+};
+
+#endif // RESOURCE_MONITOR_H
@@ -0,0 +1,85 @@
+/*
+================================================================================
+= ScanJitter.h                                                                 =
+=                                                                              =
+= Measures how far each input scan starts from its slot on the scan grid, to   =
+= check that something added to the firmware (lighting, telemetry, a flash     =
+= write) does not disturb the input timing. The input task records one offset  =
+= per scan and publishes the running statistics through a seqlock, so any     =
+= other task can read or restart them without stopping the scans.             =
+================================================================================
+*/
+
+#ifndef SCAN_JITTER_H
+#define SCAN_JITTER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "SeqLock.h"
+
+class ScanJitter {
+public:
+    // Upper bounds of the histogram buckets, in us; the last bucket holds
+    // everything above the last bound.
+    static const uint8_t BUCKET_COUNT = 6;
+    static constexpr uint16_t BUCKET_LIMITS_US[BUCKET_COUNT - 1] = {2, 5, 10, 25, 50};
+
+    struct Stats {
+        uint64_t totalUs;   // Sum of the offsets, for the average
+        uint32_t scans;     // Scans measured
+        uint32_t resyncs;   // Scans off the grid by more than half a period
+        uint32_t maxUs;     // Largest offset of a scan on the grid
+        uint32_t worstUs;   // Largest offset of any scan, resyncs included
+        uint32_t buckets[BUCKET_COUNT];
+    };
+
+    ScanJitter() : resetRequested(false), local() {}
+
+    /**
+     * @brief Records one scan. Input task only.
+     * @param offsetUs When the scan started minus when it was due.
+     * @param periodUs The scan period; larger offsets count as resyncs.
+     * Forced inline so it runs from the input task's IRAM, not from flash.
+     */
+    inline __attribute__((always_inline)) void record(int32_t offsetUs, uint32_t periodUs) {
+        if (resetRequested.exchange(false, std::memory_order_acquire)) {
+            local = Stats();
+        }
+        const uint32_t magnitudeUs = offsetUs < 0 ? -offsetUs : offsetUs;
+        if (magnitudeUs > local.worstUs) {
+            local.worstUs = magnitudeUs; // A stall shows up here, as a late scan
+        }
+        if (magnitudeUs > periodUs / 2) {
+            local.resyncs++;
+        } else {
+            local.scans++;
+            local.totalUs += magnitudeUs;
+            if (magnitudeUs > local.maxUs) {
+                local.maxUs = magnitudeUs;
+            }
+            uint8_t bucket = 0;
+            while (bucket < BUCKET_COUNT - 1 && magnitudeUs > BUCKET_LIMITS_US[bucket]) {
+                bucket++;
+            }
+            local.buckets[bucket]++;
+        }
+        published.write(local);
+    }
+
+    /**
+     * @brief Starts the statistics over from the next scan. Any task.
+     */
+    void reset() { resetRequested.store(true, std::memory_order_release); }
+
+    /**
+     * @brief The statistics as of the last scan. Any task.
+     */
+    Stats read() const { return published.read(); }
+
+private:
+    std::atomic<bool> resetRequested;
+    Stats local; // Input task only
+    SeqLock<Stats> published;
+};
+
+#endif // SCAN_JITTER_H
@@ -0,0 +1,88 @@
+/*
+================================================================================
+= SeqLock.h                                                                    =
+=                                                                              =
+= Publishes a small value from one writer task to any number of reader tasks.  =
+= The writer never waits: it bumps a sequence counter to odd, stores the value =
+= and bumps it back to even. A reader copies the value between two reads of    =
+= the counter and keeps the copy only if the counter was even and unchanged;   =
+= otherwise a write overlapped and it simply copies again. Writes take a few   =
+= dozen cycles, so a reader practically never needs a second attempt.          =
+=                                                                              =
+= The value is stored as relaxed atomic words, so concurrent access is well    =
+= defined without any lock.                                                    =
+================================================================================
+*/
+
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+/**
+ * @tparam T A trivially copyable value type.
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock values must be trivially copyable");
+
+public:
+    SeqLock() : sequence(0) {
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Publishes a new value. Single writer only; never blocks.
+     * Always inlined, so a writer in IRAM never calls into flash for it.
+     */
+    inline __attribute__((always_inline)) void write(const T& value) {
+        uint32_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        const uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed); // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(s + 2, std::memory_order_release); // Even: value complete
+    }
+
+    /**
+     * @brief Copies the latest complete value. Any task; never blocks the writer.
+     */
+    void read(T& value) const {
+        uint32_t buffer[WORDS];
+        uint32_t before;
+        uint32_t after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        memcpy(&value, buffer, sizeof(T));
+    }
+
+    T read() const {
+        T value;
+        read(value);
+        return value;
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> words[WORDS];
+};
+
+#endif // SEQ_LOCK_H
@@ -0,0 +1,78 @@
+/*
+================================================================================
+= SpscQueue.h                                                                  =
+=                                                                              =
+= A fixed-size, lock-free queue for exactly one producer task and one consumer =
+= task, possibly running on different cores. Neither side ever blocks or takes =
+= a lock: push() fails when the queue is full and pop() fails when it is       =
+= empty, and the caller decides what to do about it.                           =
+=                                                                              =
+= Each index is written by one side only. The producer publishes an element by =
+= storing the head with release ordering after writing the slot; the consumer  =
+= frees a slot by storing the tail with release ordering after reading it.     =
+================================================================================
+*/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @tparam T The element type, copied in and out.
+ * @tparam Size Number of slots, a power of two. Size - 1 elements fit.
+ */
+template <typename T, size_t Size>
+class SpscQueue {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    /**
+     * @brief Adds an element. Producer side only.
+     * @return False if the queue is full; the element is not added.
+     * Always inlined, so a producer in IRAM never calls into flash for it.
+     */
+    inline __attribute__((always_inline)) bool push(const T& value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        const size_t next = (h + 1) & (Size - 1);
+        if (next == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[h] = value;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element. Consumer side only.
+     * @return False if the queue is empty.
+     */
+    bool pop(T& value) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[t];
+        tail.store((t + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Number of queued elements. Exact only when called from either side
+     * while the other is idle; otherwise a snapshot.
+     */
+    size_t size() const {
+        return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (Size - 1);
+    }
+
+private:
+    T slots[Size];
+    std::atomic<size_t> head; // Written by the producer only
+    std::atomic<size_t> tail; // Written by the consumer only
+};
+
+#endif // SPSC_QUEUE_H
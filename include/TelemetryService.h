@@ -0,0 +1,197 @@
+/*
+================================================================================
+= TelemetryService.h                                                           =
+=                                                                              =
+= A vendor GATT service that streams the published input state and the report =
+= latency counters, for an input-display overlay or a bench analyzer. The      =
+= input state is sampled at a configurable rate, each sample is delta-encoded  =
+= against the previous one, and samples are batched into a single notification =
+= up to the negotiated MTU, so the stream costs little airtime.                =
+=                                                                              =
+= The HID report keeps priority: telemetry is sent from a low-priority task,   =
+= at most one notification per batch, and a batch is dropped rather than sent  =
+= when the stack is short of buffers.                                          =
+=                                                                              =
+= Stream format (little endian). A notification is a sequence of frames, each =
+= starting with its type byte:                                                 =
+=   0x01 KEY      u32 sequence, u32 scan time (us), u16 physical buttons,      =
+=                 u8 physical hat, u16 buttons, u8 hat, 4 x i8 sticks          =
+=   0x02 DELTA    varint sequence step, varint scan time step (us), u8 mask,   =
+=                 then the fields whose mask bit is set, in KEY order:         =
+=                 bit 0 physical buttons (u16, XOR with the previous frame),   =
+=                 bit 1 physical hat, bit 2 buttons (u16, XOR), bit 3 hat,     =
+=                 bit 4 all four sticks                                        =
+=   0x03 COUNTERS u32 reports sent, u32 failed, u32 skipped, u16 average and   =
+=                 u16 worst scan-to-submission delay (us, saturated), u16      =
+=                 telemetry batches dropped; for the active host's connection  =
+=   0x04 HEAP     u32 free heap, u32 fewest free since boot, u32 largest free  =
+=                 block (bytes)                                                =
+=   0x05 STACK    u8 task index (bit 7 set while the task runs), u16 stack     =
+=                 size, u16 fewest free bytes (0xFFFF: not seen yet), u8 name  =
+=                 length, name (up to 13 characters)                           =
+=   0x06 POOL     u8 NimBLE pool index, u16 block size, u16 blocks, u16 free,  =
+=                 u16 fewest free; the names are listed by the 'r' command     =
+=   0x07 REPORT   u32 report sequence, u32 scan time (us), u32 submission time =
+=                 (us), u8 length, the report bytes; for every report handed   =
+=                 to the stack, so a host can pair it with the one it received =
+= Every notification starts its input frames with a KEY, so it can be decoded =
+= on its own. Varints are unsigned LEB128. HEAP, then a STACK for every        =
+= watched task and a POOL for every pool, are sent every few seconds when a    =
+= ResourceMonitor is set. The report sequence counts every report sent; a gap  =
+= means REPORT frames were dropped.                                            =
+=                                                                              =
+= Clock sync: a client writes a u32 ping id to the clock characteristic and    =
+= the stick notifies it back to that client as u32 ping id, u32 time the write =
+= arrived (us), u32 time of the reply (us), u16 connection interval (1.25 ms). =
+= The reply always waits for the next connection event, one interval after the =
+= write arrived. With its own send and receive times, and that wait taken out, =
+= the client estimates the offset and drift between the two clocks the way NTP =
+= does and maps the stick's times above onto its own clock (see                =
+= tools/latency_analyzer.py). All stick times are micros(), which wraps every  =
+= 71 minutes.                                                                  =
+================================================================================
+*/
+
+#ifndef TELEMETRY_SERVICE_H
+#define TELEMETRY_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <NimBLEDevice.h>
+#include "BleHidGamepad.h"
+#include "GamepadReport.h"
+#include "ResourceMonitor.h"
+#include "SeqLock.h"
+#include "SpscQueue.h"
+
+class TelemetryService : public NimBLECharacteristicCallbacks {
+public:
+    static const char* const SERVICE_UUID;
+    static const char* const STREAM_UUID;  // Notify: the frame stream
+    static const char* const CONTROL_UUID; // Read/write: u16 sample rate in Hz
+    static const char* const CLOCK_UUID;   // Write/notify: clock sync pings
+    static const uint16_t MAX_RATE_HZ = 1000;
+    // Largest notification payload: the biggest ATT MTU NimBLE negotiates
+    // (247) minus the 3-byte notification header.
+    static const size_t MAX_PAYLOAD = 244;
+
+    enum FrameType : uint8_t {
+        FRAME_KEY = 0x01,
+        FRAME_DELTA = 0x02,
+        FRAME_COUNTERS = 0x03,
+        FRAME_HEAP = 0x04,
+        FRAME_STACK = 0x05,
+        FRAME_POOL = 0x06,
+        FRAME_REPORT = 0x07
+    };
+
+    // Longest report a REPORT frame carries.
+    static const size_t MAX_LOGGED_REPORT = 8;
+
+    /**
+     * @param snapshots The input state published by the input task.
+     * @param gamepad The HID transport, for its latency counters.
+     * @param rateHz Samples per second; 0 = stream off until a client sets a rate.
+     * @param batchMs How long a sample may wait for others to share its notification.
+     */
+    TelemetryService(const SeqLock<InputSnapshot>& snapshots, BleHidGamepad& gamepad,
+                     uint16_t rateHz, uint16_t batchMs);
+
+    /**
+     * @brief Adds the service to the server. Call between BleHidGamepad::begin()
+     * and BleHidGamepad::startAdvertising().
+     */
+    void begin(NimBLEServer* server);
+
+    /**
+     * @brief Stops streaming. Call before the BLE stack is shut down; waits
+     * for a notification in progress.
+     */
+    void end();
+
+    /**
+     * @brief Sets the sample rate in Hz, clamped to MAX_RATE_HZ. 0 stops sampling.
+     */
+    void setRate(uint16_t rateHz);
+
+    uint16_t getRate() const { return rateHz; }
+
+    /**
+     * @brief Streams the stack, heap and pool usage sampled by the monitor.
+     * Set before begin(); nullptr (the default) leaves it out.
+     */
+    void setResourceMonitor(const ResourceMonitor* monitor) { resources = monitor; }
+
+    /**
+     * @brief Takes one sample and sends the batch if it is due. Call from the
+     * telemetry task once per sample period (1000 / getRate() ms).
+     */
+    void poll(uint32_t nowUs);
+
+    /**
+     * @brief Logs a report handed to the stack, to stream it as a REPORT
+     * frame. Call from the report task only, after each sent report.
+     * @param submittedUs When the stack accepted it.
+     */
+    void logReport(const uint8_t* report, size_t length, uint32_t scanTimeUs, uint32_t submittedUs);
+
+protected:
+    void onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) override;
+    void onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) override;
+
+private:
+    static const uint32_t COUNTERS_PERIOD_US = 1000000;
+    static const uint32_t RESOURCES_PERIOD_US = 5000000;
+    // Reports logged but not yet streamed; one notification holds about 14.
+    static const size_t REPORT_LOG_SIZE = 32;
+
+    struct LoggedReport {
+        uint32_t sequence;
+        uint32_t scanTimeUs;
+        uint32_t submittedUs;
+        uint8_t length;
+        uint8_t bytes[MAX_LOGGED_REPORT];
+    };
+
+    size_t payloadLimit() const;
+    bool append(const uint8_t* frame, size_t length);
+    void flush();
+    size_t encodeInput(uint8_t* frame, const InputSnapshot& sample) const;
+    size_t encodeCounters(uint8_t* frame) const;
+    void appendResources();
+    void appendReports();
+    bool isStreaming() const;
+    void answerClockPing(NimBLEConnInfo& connInfo, uint32_t receivedUs);
+
+    const SeqLock<InputSnapshot>& snapshots;
+    BleHidGamepad& gamepad;
+    const ResourceMonitor* resources;
+    std::atomic<uint16_t> rateHz;
+    const uint32_t batchUs;
+
+    NimBLECharacteristic* stream;
+    NimBLECharacteristic* control;
+    NimBLECharacteristic* clock;
+    std::atomic<bool> open;
+    std::atomic<bool> sending;
+    // Connections subscribed to the stream; BLE_HS_CONN_HANDLE_NONE if unused.
+    std::atomic<uint16_t> subscribers[BleHidGamepad::MAX_LINKS];
+
+    // Report task to telemetry task.
+    SpscQueue<LoggedReport, REPORT_LOG_SIZE> reportLog;
+    uint32_t reportSequence; // Report task only
+
+    // Telemetry task only.
+    uint8_t batch[MAX_PAYLOAD];
+    size_t batchLength;
+    uint32_t batchStartedUs;
+    bool haveLast;      // `last` holds the previous frame of this batch
+    InputSnapshot last; // The previous input sample
+    uint32_t lastCountersUs;
+    uint32_t lastResourcesUs;
+    ResourceMonitor::Snapshot resourcesSample; // Too large for the task's stack
+    uint16_t droppedBatches;
+};
+
+#endif // TELEMETRY_SERVICE_H
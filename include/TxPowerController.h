@@ -0,0 +1,93 @@
+/*
+================================================================================
+= TxPowerController.h                                                          =
+=                                                                              =
+= Closed-loop transmit power for one BLE connection. The stick cannot measure  =
+= how strongly the host receives it, so it estimates that from the RSSI it     =
+= measures itself: the path loss is about the same both ways, so the host      =
+= hears us at roughly RSSI + (our power - the host's power).                   =
+=                                                                              =
+= Power steps down one level at a time, only after the estimate has stayed     =
+= above the target window for a while with no failed reports. It steps up as  =
+= soon as the estimate drops below the window, and goes straight to full power =
+= when a report fails. Every change starts a hold-off before the next step     =
+= down, so the power never oscillates around the window edge.                  =
+=                                                                              =
+= Like MacroEngine, the controller is a pure function of what it is given: it  =
+= reads no clock and touches no radio, the caller applies its decisions.       =
+================================================================================
+*/
+
+#ifndef TX_POWER_CONTROLLER_H
+#define TX_POWER_CONTROLLER_H
+
+#include <stdint.h>
+
+class TxPowerController {
+public:
+    // ESP32 connection power levels: -12 dBm to +9 dBm in 3 dB steps.
+    static const int8_t MIN_DBM = -12;
+    static const int8_t MAX_DBM = 9;
+    static const int8_t STEP_DBM = 3;
+
+    // Assumed transmit power of the host, for the estimate above. Most PCs,
+    // consoles and phones transmit between 0 and +10 dBm; assuming the low
+    // end errs towards more power.
+    static const int8_t HOST_TX_DBM = 0;
+
+    // The window for the estimated RSSI at the host. Receivers need around
+    // -90 dBm; the lower edge keeps a 20 dB margin for hands, bodies and
+    // fading. Above the upper edge the power can be reduced.
+    static const int8_t TARGET_LOW_DBM = -70;
+    static const int8_t TARGET_HIGH_DBM = -58;
+
+    // How long the estimate must stay above the window before stepping down,
+    // and how long after any change no step down is taken.
+    static const uint32_t STEP_DOWN_AFTER_MS = 5000;
+    static const uint32_t HOLD_OFF_MS = 10000;
+
+    enum Reason : uint8_t {
+        REASON_NONE,        // No change
+        REASON_MARGIN_HIGH, // Stepped down: plenty of margin
+        REASON_MARGIN_LOW,  // Stepped up: below the window
+        REASON_FAILURES     // Full power: reports failed
+    };
+
+    struct Decision {
+        Reason reason;
+        int8_t fromDbm;
+        int8_t toDbm;
+        int8_t rssiDbm;     // The RSSI that led to it
+        int8_t estimateDbm; // Estimated RSSI at the host, filtered
+    };
+
+    TxPowerController();
+
+    /**
+     * @brief Starts controlling a new connection, at full power.
+     */
+    void reset(uint32_t nowMs);
+
+    /**
+     * @brief Feeds one measurement and decides the power for the connection.
+     * @param nowMs Current time in milliseconds.
+     * @param rssiDbm RSSI of the host as measured now.
+     * @param failures Reports that failed since the last update.
+     * @return The decision; reason is REASON_NONE if the power stays as it is.
+     */
+    Decision update(uint32_t nowMs, int8_t rssiDbm, uint32_t failures);
+
+    int8_t getPowerDbm() const { return powerDbm; }
+
+    static const char* reasonName(Reason reason);
+
+private:
+    int8_t powerDbm;
+    int16_t filteredRssiX4; // RSSI smoothed over ~4 updates, times 4
+    bool filterPrimed;
+    uint32_t lastChangeMs;
+    uint32_t highSinceMs; // When the estimate went above the window
+    bool high;
+};
+
+#endif // TX_POWER_CONTROLLER_H
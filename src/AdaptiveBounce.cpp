@@ -0,0 +1,125 @@
+/*
+================================================================================
+= AdaptiveBounce.cpp                                                           =
+= Chatter measurement and adaptive debounce. See AdaptiveBounce.h.             =
+================================================================================
+*/
+
+#include "AdaptiveBounce.h"
+
+// Read on every scan, like the code below: in DRAM and IRAM, so a scan never
+// waits for the flash cache.
+DRAM_ATTR const uint32_t ChatterStats::BUCKET_LIMITS_US[ChatterStats::BUCKET_COUNT] = {
+    0, 500, 1000, 2000, 3000, 5000, 8000, 0xFFFFFFFF
+};
+
+// --- ChatterStats ---
+
+ChatterStats::ChatterStats()
+    : bursts(0),
+      maxBounceUs(0),
+      initialized(false),
+      lastRaw(false),
+      inBurst(false),
+      burstStartUs(0),
+      lastEdgeUs(0) {
+    for (uint8_t i = 0; i < BUCKET_COUNT; i++) {
+        histogram[i] = 0;
+    }
+}
+
+bool IRAM_ATTR ChatterStats::sample(uint32_t nowUs, bool raw) {
+    if (!initialized) {
+        initialized = true;
+        lastRaw = raw;
+        return false;
+    }
+
+    // Checked before taking a new edge, so an edge that comes once the pin has
+    // settled starts a burst of its own even without a sample in between.
+    const bool ended = inBurst && nowUs - lastEdgeUs >= SETTLE_US;
+    if (ended) {
+        endBurst();
+    }
+
+    if (raw != lastRaw) {
+        lastRaw = raw;
+        lastEdgeUs = nowUs;
+        if (!inBurst) {
+            inBurst = true;
+            burstStartUs = nowUs;
+        }
+    }
+    return ended;
+}
+
+void IRAM_ATTR ChatterStats::endBurst() {
+    inBurst = false;
+    const uint32_t bounceUs = lastEdgeUs - burstStartUs;
+    uint8_t bucket = 0;
+    while (bounceUs > BUCKET_LIMITS_US[bucket]) {
+        bucket++;
+    }
+    histogram[bucket]++;
+    bursts++;
+    if (bounceUs > maxBounceUs) {
+        maxBounceUs = bounceUs;
+    }
+}
+
+uint32_t IRAM_ATTR ChatterStats::percentile99Us() const {
+    if (bursts == 0) {
+        return 0;
+    }
+
+    const uint32_t target = bursts - bursts / 100; // 99% of all bursts
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < BUCKET_COUNT - 1; i++) {
+        cumulative += histogram[i];
+        if (cumulative >= target) {
+            return BUCKET_LIMITS_US[i];
+        }
+    }
+    return maxBounceUs; // Open-ended bucket: the worst seen is the best bound
+}
+
+uint32_t IRAM_ATTR ChatterStats::recommendedIntervalUs(uint32_t minUs, uint32_t maxUs) const {
+    const uint32_t intervalUs = percentile99Us() + SAFETY_MARGIN_US;
+    if (intervalUs < minUs) return minUs;
+    if (intervalUs > maxUs) return maxUs;
+    return intervalUs;
+}
+
+// --- AdaptiveBounce ---
+
+AdaptiveBounce::AdaptiveBounce()
+    : sampled(false),
+      sampledLevel(true),
+      adaptive(false),
+      minIntervalUs(0),
+      maxIntervalUs(0) {}
+
+void AdaptiveBounce::enableAdaptive(uint32_t minUs, uint32_t maxUs) {
+    adaptive = true;
+    minIntervalUs = minUs;
+    maxIntervalUs = maxUs;
+}
+
+bool IRAM_ATTR AdaptiveBounce::update(uint32_t nowUs, bool level) {
+    sampled = true;
+    sampledLevel = level;
+    const bool changed = BounceUs::update(nowUs);
+    sampled = false;
+    return changed;
+}
+
+bool IRAM_ATTR AdaptiveBounce::readCurrentState() {
+    const bool raw = sampled ? sampledLevel : digitalRead(pin);
+    // lastUpdateTime is the timestamp of the running update(), so the clock
+    // is not read again here. Keep the configured interval until there is
+    // enough data to trust.
+    if (stats.sample(lastUpdateTime, raw) && adaptive && stats.getBursts() >= ChatterStats::MIN_SAMPLES) {
+        interval(stats.recommendedIntervalUs(minIntervalUs, maxIntervalUs));
+    }
+    return raw;
+}
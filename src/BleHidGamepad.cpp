@@ -0,0 +1,408 @@
+/*
+================================================================================
+= BleHidGamepad.cpp                                                            =
+= BLE HID gamepad transport. See BleHidGamepad.h.                              =
+================================================================================
+*/
+
+#include "BleHidGamepad.h"
+#include <Arduino.h>
+#include "BondStore.h"
+#include <Preferences.h>
+#include <string.h>
+
+// USB-IF style identifiers reported in the PnP ID characteristic.
+static const uint8_t PNP_VENDOR_ID_SOURCE = 0x01; // Bluetooth SIG assigned
+static const uint16_t PNP_VENDOR_ID = 0xE502;
+static const uint16_t PNP_PRODUCT_ID = 0xBBAB;
+static const uint16_t PNP_VERSION = 0x0110;
+
+// NVS namespace holding the host slot table.
+static const char* const HOST_SLOTS_NAMESPACE = "hostslots";
+
+#ifdef CONFIG_BT_NIMBLE_MAX_BONDS
+static_assert(CONFIG_BT_NIMBLE_MAX_BONDS >= BleHidGamepad::HOST_SLOT_COUNT,
+              "The NimBLE store must hold a bond for every host slot");
+#endif
+
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+static_assert(CONFIG_BT_NIMBLE_MAX_CONNECTIONS >= BleHidGamepad::MAX_LINKS,
+              "NimBLE must accept a connection for every mirrored host");
+#endif
+
+static bool isEmptySlot(const ble_addr_t& host) {
+    static const ble_addr_t empty = {};
+    return memcmp(&host, &empty, sizeof(host)) == 0;
+}
+
+BleHidGamepad::BleHidGamepad(const char* deviceName, const char* manufacturer, uint8_t batteryLevel)
+    : deviceName(deviceName),
+      manufacturer(manufacturer),
+      batteryLevel(batteryLevel),
+      hid(nullptr),
+      inputReport(nullptr),
+      connected(false),
+      slotHosts{},
+      activeSlot(0),
+      mirrorSlot(-1),
+      switching(false),
+      switchCompleted(false),
+      switchStartedUs(0),
+      switchLatencyUs(0),
+      linksAdded(0),
+      health(nullptr) {}
+
+void BleHidGamepad::begin(const uint8_t* reportMap, uint16_t reportMapSize, uint8_t reportId) {
+    NimBLEDevice::init(deviceName);
+    NimBLEDevice::setSecurityAuth(true, false, false); // Bonding, no MITM, legacy pairing
+    BondStore::begin();
+    if (!hostSlotWrites.isDirty()) {
+        loadHostSlots(); // Otherwise the table in RAM is newer than the saved one
+    }
+
+    NimBLEServer* server = NimBLEDevice::createServer();
+    server->setCallbacks(this, false);
+    // Advertising depends on which hosts are missing, so it is restarted here
+    // (onDisconnect) rather than by the server.
+    server->advertiseOnDisconnect(false);
+
+    hid = new NimBLEHIDDevice(server);
+    inputReport = hid->getInputReport(reportId);
+    inputReport->setCallbacks(this);
+    hid->setManufacturer(manufacturer);
+    hid->setPnp(PNP_VENDOR_ID_SOURCE, PNP_VENDOR_ID, PNP_PRODUCT_ID, PNP_VERSION);
+    hid->setHidInfo(0x00, 0x01); // Country: not localized, flags: remote wake
+    hid->setReportMap(const_cast<uint8_t*>(reportMap), reportMapSize);
+    hid->setBatteryLevel(batteryLevel);
+    hid->startServices();
+
+    NimBLEAdvertising* advertising = server->getAdvertising();
+    advertising->setAppearance(HID_GAMEPAD);
+    advertising->addServiceUUID(hid->getHidService()->getUUID());
+    advertising->enableScanResponse(false);
+    // If directed advertising times out, keep waiting with undirected
+    // advertising; onAuthenticationComplete still turns away other hosts.
+    advertising->setAdvertisingCompleteCallback([this](NimBLEAdvertising* adv) {
+        if (isHostMissing()) {
+            adv->setConnectableMode(BLE_GAP_CONN_MODE_UND);
+            adv->start();
+        }
+    });
+}
+
+void BleHidGamepad::startAdvertising() {
+    advertiseForMissingHost();
+}
+
+void BleHidGamepad::end() {
+    connected = false;
+    flushPendingWrites();
+    BondStore::end();
+    NimBLEDevice::deinit(true); // Frees the server, services and characteristics
+    delete hid;
+    hid = nullptr;
+    inputReport = nullptr;
+    links.clear();
+}
+
+bool BleHidGamepad::sendReport(const uint8_t* report, size_t length, uint32_t scanTimeUs) {
+    if (!connected || inputReport == nullptr) {
+        return false;
+    }
+    inputReport->setValue(report, length); // What a host reading the report gets
+
+    return links.send(inputReport, report, length, scanTimeUs, activeSlot, health);
+}
+
+void BleHidGamepad::setBatteryLevel(uint8_t level) {
+    batteryLevel = level;
+    if (hid != nullptr) {
+        hid->setBatteryLevel(level, connected);
+    }
+}
+
+// --- Host Slots ---
+
+void BleHidGamepad::selectHostSlot(uint8_t slot) {
+    if (slot >= HOST_SLOT_COUNT) {
+        return;
+    }
+
+    if (slot == activeSlot && !isEmptySlot(slotHosts[slot])) {
+        // Same slot again: forget its host and pair a new one.
+        NimBLEDevice::deleteBond(NimBLEAddress(slotHosts[slot]));
+        slotHosts[slot] = ble_addr_t{};
+    }
+    activeSlot = slot;
+    hostSlotWrites.markChanged();
+
+    switchStartedUs = micros();
+    switching = true;
+    switchCompleted = false;
+
+    NimBLEServer* server = NimBLEDevice::getServer();
+    if (server == nullptr) {
+        return; // Not running; the slot is used on the next begin()
+    }
+
+    // Keep only hosts that belong to the new slot or to the mirror slot. A
+    // connection still pairing is not a link yet; onAuthenticationComplete()
+    // checks it against the new slots. No vectors: this runs after
+    // HeapGuard::arm().
+    uint16_t handles[MAX_LINKS];
+    uint8_t slots[MAX_LINKS];
+    const uint8_t count = links.getLinks(handles, slots);
+    for (uint8_t i = 0; i < count; i++) {
+        if (isEmptySlot(slotHosts[slots[i]]) ||
+            !(slots[i] == activeSlot || (isMirroring() && slots[i] == mirrorSlot))) {
+            removeLink(handles[i]);
+            server->disconnect(handles[i]);
+        }
+    }
+    if (links.isSlotLinked(activeSlot)) {
+        finishSlotSwitch(); // The mirror's host became the active one
+    }
+    server->getAdvertising()->stop();
+    advertiseForMissingHost();
+}
+
+bool BleHidGamepad::isHostSlotPaired(uint8_t slot) const {
+    return slot < HOST_SLOT_COUNT && !isEmptySlot(slotHosts[slot]);
+}
+
+bool BleHidGamepad::takeSlotSwitchLatency(uint32_t& latencyUs) {
+    if (!switchCompleted) {
+        return false;
+    }
+    switchCompleted = false;
+    latencyUs = switchLatencyUs;
+    return true;
+}
+
+void BleHidGamepad::finishSlotSwitch() {
+    if (switching) {
+        switchLatencyUs = micros() - switchStartedUs;
+        switching = false;
+        switchCompleted = true;
+    }
+}
+
+// --- Mirroring ---
+
+void BleHidGamepad::setMirrorSlot(int8_t slot) {
+    mirrorSlot = slot < HOST_SLOT_COUNT ? slot : -1;
+}
+
+bool BleHidGamepad::getLinkStats(uint8_t index, LinkStats& stats) const {
+    return links.getStats(index, activeSlot, stats);
+}
+
+bool BleHidGamepad::readLinkRssi(uint8_t index, int8_t& rssiDbm) const {
+    const uint16_t handle = links.getConnHandle(index);
+    return handle != BLE_HS_CONN_HANDLE_NONE && ble_gap_conn_rssi(handle, &rssiDbm) == 0;
+}
+
+bool BleHidGamepad::setLinkTxPower(uint8_t index, int8_t dbm) {
+    if (index >= MAX_LINKS || dbm < -12 || dbm > 9) {
+        return false;
+    }
+    const uint16_t handle = links.getConnHandle(index);
+#ifdef ESP_PLATFORM
+    // The controller keeps a power level per connection handle, for handles
+    // 0 to 8; ESP_PWR_LVL_N12 is -12 dBm and each level adds 3 dB.
+    if (handle > ESP_BLE_PWR_TYPE_CONN_HDL8 - ESP_BLE_PWR_TYPE_CONN_HDL0) {
+        return false;
+    }
+    const esp_power_level_t level = static_cast<esp_power_level_t>(ESP_PWR_LVL_N12 + (dbm + 12) / 3);
+    return NimBLEDevice::setPowerLevel(level, static_cast<esp_ble_power_type_t>(ESP_BLE_PWR_TYPE_CONN_HDL0 + handle));
+#else
+    return false;
+#endif
+}
+
+bool BleHidGamepad::isHostMissing() const {
+    return !links.isSlotLinked(activeSlot) || (isMirroring() && !links.isSlotLinked(mirrorSlot));
+}
+
+void BleHidGamepad::addLink(uint16_t connHandle, uint8_t slot) {
+    links.add(connHandle, slot);
+    linksAdded = linksAdded + 1;
+    connected = true;
+}
+
+void BleHidGamepad::removeLink(uint16_t connHandle) {
+    connected = links.remove(connHandle);
+}
+
+// --- Advertising ---
+
+void BleHidGamepad::advertiseForMissingHost() {
+    // The bond may have been removed from the store (e.g. the host re-paired
+    // from scratch); the slot is then empty again.
+    for (uint8_t slot = 0; slot < HOST_SLOT_COUNT; slot++) {
+        if (!isEmptySlot(slotHosts[slot]) && !NimBLEDevice::isBonded(NimBLEAddress(slotHosts[slot]))) {
+            slotHosts[slot] = ble_addr_t{};
+            hostSlotWrites.markChanged();
+        }
+    }
+
+    // The active host comes first; the mirror's is sought once it is back.
+    if (!links.isSlotLinked(activeSlot)) {
+        advertiseForSlot(activeSlot);
+    } else if (isMirroring() && !links.isSlotLinked(mirrorSlot)) {
+        advertiseForSlot(mirrorSlot);
+    }
+}
+
+void BleHidGamepad::advertiseForSlot(uint8_t slot) {
+    NimBLEAdvertising* advertising = NimBLEDevice::getAdvertising();
+    if (isEmptySlot(slotHosts[slot])) {
+        advertising->setConnectableMode(BLE_GAP_CONN_MODE_UND);
+        advertising->start();
+    } else {
+        // Directed advertising is answered only by this host, which
+        // reconnects as soon as it sees it.
+        const NimBLEAddress target(slotHosts[slot]);
+        advertising->setConnectableMode(BLE_GAP_CONN_MODE_DIR);
+        advertising->start(DIRECTED_ADVERTISING_MS, &target);
+    }
+}
+
+int BleHidGamepad::findHostSlot(const NimBLEAddress& host) const {
+    for (uint8_t i = 0; i < HOST_SLOT_COUNT; i++) {
+        if (!isEmptySlot(slotHosts[i]) && NimBLEAddress(slotHosts[i]) == host) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void BleHidGamepad::loadHostSlots() {
+    Preferences prefs;
+    prefs.begin(HOST_SLOTS_NAMESPACE, true);
+    if (prefs.getBytes("hosts", slotHosts, sizeof(slotHosts)) != sizeof(slotHosts)) {
+        memset(slotHosts, 0, sizeof(slotHosts));
+    }
+    activeSlot = prefs.getUChar("active", 0);
+    if (activeSlot >= HOST_SLOT_COUNT) {
+        activeSlot = 0;
+    }
+    prefs.end();
+}
+
+bool BleHidGamepad::hasPendingWrites() const {
+    return hostSlotWrites.isDirty() || BondStore::isDirty();
+}
+
+void BleHidGamepad::flushPendingWrites() {
+    if (hostSlotWrites.isDirty()) {
+        // A change made while the table is written stays pending, and the
+        // next flush writes it whole.
+        const uint32_t changes = hostSlotWrites.snapshot();
+        saveHostSlots();
+        hostSlotWrites.markSaved(changes);
+    }
+    BondStore::flush();
+}
+
+void BleHidGamepad::saveHostSlots() {
+    Preferences prefs;
+    prefs.begin(HOST_SLOTS_NAMESPACE, false);
+    prefs.putBytes("hosts", slotHosts, sizeof(slotHosts));
+    prefs.putUChar("active", activeSlot);
+    prefs.end();
+}
+
+// --- Server Callbacks ---
+
+void BleHidGamepad::onConnect(NimBLEServer* server, NimBLEConnInfo& connInfo) {
+    // Reports start once the host has proven which slot it belongs to, see
+    // onAuthenticationComplete().
+    if (health != nullptr) {
+        health->recordEvent(LinkHealth::EVENT_CONNECT, connInfo.getConnHandle(), 0xFF,
+                            connInfo.getConnInterval(), connInfo.getConnLatency(), connInfo.getConnTimeout());
+    }
+}
+
+void BleHidGamepad::onDisconnect(NimBLEServer* server, NimBLEConnInfo& connInfo, int reason) {
+    if (health != nullptr) {
+        health->recordEvent(LinkHealth::EVENT_DISCONNECT, connInfo.getConnHandle(),
+                            links.findSlot(connInfo.getConnHandle()), reason);
+    }
+    removeLink(connInfo.getConnHandle());
+    // Advertising may be aimed at the mirror's host while the active one just
+    // left; aim it again.
+    server->getAdvertising()->stop();
+    advertiseForMissingHost();
+}
+
+void BleHidGamepad::onAuthenticationComplete(NimBLEConnInfo& connInfo) {
+    NimBLEServer* server = NimBLEDevice::getServer();
+    if (!connInfo.isEncrypted()) {
+        server->disconnect(connInfo.getConnHandle());
+        return;
+    }
+
+    // The identity address is known only now, once the host's keys are.
+    const NimBLEAddress host = connInfo.getIdAddress();
+    int slot = findHostSlot(host);
+    if (slot < 0) {
+        // A new host pairs into the active slot, or into the mirror slot
+        // once the active one has its host.
+        if (isEmptySlot(slotHosts[activeSlot])) {
+            slot = activeSlot;
+        } else if (isMirroring() && isEmptySlot(slotHosts[mirrorSlot])) {
+            slot = mirrorSlot;
+        } else {
+            server->disconnect(connInfo.getConnHandle()); // A stranger
+            return;
+        }
+        slotHosts[slot] = *host.getBase();
+        hostSlotWrites.markChanged();
+    }
+    const bool wanted = slot == activeSlot || (isMirroring() && slot == mirrorSlot);
+    if (!wanted || links.isSlotLinked(slot)) {
+        server->disconnect(connInfo.getConnHandle()); // Another slot's host
+        return;
+    }
+
+    addLink(connInfo.getConnHandle(), slot);
+    if (health != nullptr) {
+        health->recordEvent(LinkHealth::EVENT_ACCEPTED, connInfo.getConnHandle(), slot);
+    }
+    if (slot == activeSlot) {
+        finishSlotSwitch();
+    }
+    advertiseForMissingHost(); // The other host, if it is still missing
+}
+
+void BleHidGamepad::onConnParamsUpdate(NimBLEConnInfo& connInfo) {
+    if (health != nullptr) {
+        health->recordEvent(LinkHealth::EVENT_CONN_PARAMS, connInfo.getConnHandle(),
+                            links.findSlot(connInfo.getConnHandle()), connInfo.getConnInterval(),
+                            connInfo.getConnLatency(), connInfo.getConnTimeout());
+    }
+}
+
+void BleHidGamepad::onMTUChange(uint16_t mtu, NimBLEConnInfo& connInfo) {
+    if (health != nullptr) {
+        health->recordEvent(LinkHealth::EVENT_MTU, connInfo.getConnHandle(),
+                            links.findSlot(connInfo.getConnHandle()), mtu);
+    }
+}
+
+// --- Characteristic Callbacks ---
+
+void BleHidGamepad::onStatus(NimBLECharacteristic* characteristic, int code) {
+    // Called by the stack with the result of every input report notification.
+    if (health != nullptr && characteristic == inputReport) {
+        health->recordNotifyResult(code);
+    }
+}
+
+void BleHidGamepad::onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) {
+    // A bonded host's subscription is restored right after encryption, so
+    // onAuthenticationComplete() has already added its link.
+    const bool notifications = (subValue & 0x0001) != 0;
+    links.setSubscribed(connInfo.getConnHandle(), notifications);
+}
@@ -0,0 +1,206 @@
+/*
+================================================================================
+= BondStore.cpp                                                                =
+= Deferred persistence of the NimBLE bond store. See BondStore.h.              =
+================================================================================
+*/
+
+#include "BondStore.h"
+#include <Preferences.h>
+#include <stdio.h>
+#include "FlashWrites.h"
+
+#if MYNEWT_VAL(BLE_STORE_CONFIG_PERSIST)
+#error "BondStore needs NimBLE's store in RAM: build with -D MYNEWT_VAL_BLE_STORE_CONFIG_PERSIST=0"
+#endif
+
+// NVS namespace of the saved store: "entry" holds sizeof(StoredEntry), so a
+// store saved by a build with another layout is not misread, and "bonds" the
+// entries (absent while there are none).
+static const char* const BOND_STORE_NAMESPACE = "bondstore";
+// Where NimBLE saves the store itself; only read to take it over.
+static const char* const NIMBLE_STORE_NAMESPACE = "nimble_bond";
+
+// The record types of a bond: the keys each side handed out, the host's
+// subscriptions and its supported GATT client features.
+static const int STORED_TYPES[] = {
+    BLE_STORE_OBJ_TYPE_OUR_SEC, BLE_STORE_OBJ_TYPE_PEER_SEC, BLE_STORE_OBJ_TYPE_CCCD, BLE_STORE_OBJ_TYPE_CSFC
+};
+
+struct StoredEntry {
+    uint8_t objType;
+    union ble_store_value value;
+};
+
+static const size_t MAX_ENTRIES = 2 * MYNEWT_VAL(BLE_STORE_MAX_BONDS) + MYNEWT_VAL(BLE_STORE_MAX_CCCDS) +
+                                  MYNEWT_VAL(BLE_STORE_MAX_CSFCS);
+
+// The store as saved, built by flush() and read back by load(). Static, so
+// a save needs no heap.
+static StoredEntry image[MAX_ENTRIES];
+static size_t imageCount = 0;
+
+// NimBLE's own RAM store, wrapped by onWrite() and onDelete().
+static ble_store_write_fn* storeWrite = nullptr;
+static ble_store_delete_fn* storeDelete = nullptr;
+
+// Changes made to the store, and the count at the last save. Changes are
+// made by the BLE host task, saves by whoever calls flush().
+static PendingWrites pending;
+static bool tracking = false;
+
+uint32_t BondStore::flushes = 0;
+
+void BondStore::begin() {
+    storeWrite = ble_hs_cfg.store_write_cb;
+    storeDelete = ble_hs_cfg.store_delete_cb;
+    const bool takenOver = !load() && takeOverNimbleStore();
+
+    ble_hs_cfg.store_write_cb = onWrite;
+    ble_hs_cfg.store_delete_cb = onDelete;
+    // Bonds taken over from NimBLE still have to be saved in our format.
+    pending.markSaved(pending.snapshot());
+    if (takenOver) {
+        pending.markChanged();
+    }
+    tracking = true;
+}
+
+void BondStore::end() {
+    tracking = false;
+}
+
+bool BondStore::isDirty() {
+    return tracking && pending.isDirty();
+}
+
+bool BondStore::flush() {
+    const uint32_t changesBefore = pending.snapshot();
+    if (!tracking || !pending.isDirty()) {
+        return true;
+    }
+
+    // Every store access holds the host lock, so each entry is read whole;
+    // only a change between two entries has to be caught.
+    imageCount = 0;
+    for (int objType : STORED_TYPES) {
+        ble_store_iterate(objType, collect, nullptr);
+    }
+    if (pending.snapshot() != changesBefore) {
+        return false;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(BOND_STORE_NAMESPACE, false)) {
+        return false;
+    }
+    bool saved = true;
+    if (prefs.getUInt("entry", 0) != sizeof(StoredEntry)) {
+        saved = prefs.putUInt("entry", sizeof(StoredEntry)) == sizeof(uint32_t);
+    }
+    const size_t bytes = imageCount * sizeof(StoredEntry);
+    if (bytes > 0) {
+        saved = saved && prefs.putBytes("bonds", image, bytes) == bytes;
+    } else if (prefs.isKey("bonds")) {
+        saved = saved && prefs.remove("bonds");
+    }
+    prefs.end();
+
+    if (saved) {
+        pending.markSaved(changesBefore);
+        flushes++;
+    }
+    return saved;
+}
+
+int BondStore::onWrite(int objType, const union ble_store_value* value) {
+    const int rc = storeWrite(objType, value);
+    if (rc == 0) {
+        pending.markChanged();
+    }
+    return rc;
+}
+
+int BondStore::onDelete(int objType, const union ble_store_key* key) {
+    const int rc = storeDelete(objType, key);
+    if (rc == 0) {
+        pending.markChanged();
+    }
+    return rc;
+}
+
+int BondStore::collect(int objType, union ble_store_value* value, void* cookie) {
+    if (imageCount == MAX_ENTRIES) {
+        return 1; // Cannot happen: the store holds no more than this
+    }
+    image[imageCount].objType = objType;
+    image[imageCount].value = *value;
+    imageCount++;
+    return 0;
+}
+
+/**
+ * @brief Loads the store saved by flush().
+ * @return False if BondStore has never saved one.
+ */
+bool BondStore::load() {
+    Preferences prefs;
+    if (!prefs.begin(BOND_STORE_NAMESPACE, true)) {
+        return false;
+    }
+    if (prefs.getUInt("entry", 0) != sizeof(StoredEntry)) {
+        prefs.end();
+        return false;
+    }
+    imageCount = 0;
+    if (prefs.isKey("bonds")) {
+        const size_t bytes = prefs.getBytesLength("bonds");
+        if (bytes <= sizeof(image) && bytes % sizeof(StoredEntry) == 0 &&
+            prefs.getBytes("bonds", image, bytes) == bytes) {
+            imageCount = bytes / sizeof(StoredEntry);
+        }
+    }
+    prefs.end();
+
+    for (size_t i = 0; i < imageCount; i++) {
+        ble_store_write(image[i].objType, &image[i].value);
+    }
+    return true;
+}
+
+/**
+ * @brief Loads the bonds NimBLE saved itself under its own keys
+ * ("our_sec_1", ...), so updating the firmware keeps every host paired.
+ * @return True if there were any.
+ */
+bool BondStore::takeOverNimbleStore() {
+    static const struct {
+        int objType;
+        const char* prefix;
+        int count;
+    } nimbleKeys[] = {
+        {BLE_STORE_OBJ_TYPE_OUR_SEC, "our_sec", MYNEWT_VAL(BLE_STORE_MAX_BONDS)},
+        {BLE_STORE_OBJ_TYPE_PEER_SEC, "peer_sec", MYNEWT_VAL(BLE_STORE_MAX_BONDS)},
+        {BLE_STORE_OBJ_TYPE_CCCD, "cccd_sec", MYNEWT_VAL(BLE_STORE_MAX_CCCDS)},
+        {BLE_STORE_OBJ_TYPE_CSFC, "csfc_sec", MYNEWT_VAL(BLE_STORE_MAX_CSFCS)},
+    };
+
+    Preferences prefs;
+    if (!prefs.begin(NIMBLE_STORE_NAMESPACE, true)) {
+        return false;
+    }
+    bool found = false;
+    char key[16];
+    union ble_store_value value;
+    for (const auto& keys : nimbleKeys) {
+        for (int i = 1; i <= keys.count; i++) {
+            snprintf(key, sizeof(key), "%s_%d", keys.prefix, i);
+            if (prefs.isKey(key) && prefs.getBytes(key, &value, sizeof(value)) > 0) {
+                ble_store_write(keys.objType, &value);
+                found = true;
+            }
+        }
+    }
+    prefs.end();
+    return found;
+}
@@ -0,0 +1,185 @@
+/*
+================================================================================
+= ButtonLighting.cpp                                                           =
+= Reactive WS2812 button lighting over RMT. See ButtonLighting.h.              =
+================================================================================
+*/
+
+#include "ButtonLighting.h"
+#include <Arduino.h>
+#include <string.h>
+
+// WS2812 bit timings in ns: a 0 is a short high pulse, a 1 a long one.
+static const uint32_t T0H_NS = 400;
+static const uint32_t T0L_NS = 850;
+static const uint32_t T1H_NS = 800;
+static const uint32_t T1L_NS = 450;
+
+// 80 MHz APB / 2: 25 ns per RMT tick.
+static const uint8_t RMT_CLOCK_DIVIDER = 2;
+// Two 64-item blocks of channel memory: while one half is sent, the driver
+// refills the other from its interrupt, leaving ~80 us to do it.
+static const uint8_t RMT_MEMORY_BLOCKS = 2;
+
+static const ButtonLighting::Color WHITE = {255, 255, 255};
+
+// The items for a 0 and a 1 bit, set up by begin(). Read from the RMT
+// interrupt, so they live in DRAM like any static.
+static rmt_item32_t bit0;
+static rmt_item32_t bit1;
+
+/**
+ * @brief Turns frame bytes into RMT items, MSB first. Called by the RMT
+ * driver from its interrupt whenever half of the channel memory is free.
+ */
+static void IRAM_ATTR translateFrame(const void* source, rmt_item32_t* items, size_t sourceSize,
+                                     size_t wantedItems, size_t* translatedSize, size_t* itemCount) {
+    if (source == nullptr || items == nullptr) {
+        *translatedSize = 0;
+        *itemCount = 0;
+        return;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(source);
+    size_t size = 0;
+    size_t count = 0;
+    while (size < sourceSize && count + 8 <= wantedItems) {
+        const uint8_t value = bytes[size];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            items[count++] = (value & (0x80 >> bit)) ? bit1 : bit0;
+        }
+        size++;
+    }
+    *translatedSize = size;
+    *itemCount = count;
+}
+
+static uint8_t scale(uint8_t value, uint8_t level) {
+    return (uint16_t(value) * level + 255) >> 8;
+}
+
+static ButtonLighting::Color mix(ButtonLighting::Color from, ButtonLighting::Color to,
+                                 uint32_t step, uint32_t steps) {
+    ButtonLighting::Color out;
+    out.r = from.r + (int32_t(to.r) - from.r) * int32_t(step) / int32_t(steps);
+    out.g = from.g + (int32_t(to.g) - from.g) * int32_t(step) / int32_t(steps);
+    out.b = from.b + (int32_t(to.b) - from.b) * int32_t(step) / int32_t(steps);
+    return out;
+}
+
+ButtonLighting::ButtonLighting(const SeqLock<InputSnapshot>& snapshots)
+    : snapshots(snapshots),
+      channel(RMT_CHANNEL_0),
+      ready(false),
+      enabled(true),
+      blanked(false),
+      ledButtons(),
+      ledCount(0),
+      colors(),
+      brightness(255),
+      idleLevel(32),
+      leds(),
+      frames(),
+      nextFrame(0),
+      framesSent(0),
+      framesSkipped(0),
+      maxRenderUs(0) {}
+
+bool ButtonLighting::begin(gpio_num_t pin, rmt_channel_t channel, const int8_t* ledButtons, uint8_t ledCount) {
+    this->channel = channel;
+    this->ledCount = ledCount < MAX_LEDS ? ledCount : MAX_LEDS;
+    memcpy(this->ledButtons, ledButtons, this->ledCount);
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX(pin, channel);
+    config.clk_div = RMT_CLOCK_DIVIDER;
+    config.mem_block_num = RMT_MEMORY_BLOCKS;
+    // The interrupt is allocated on the calling core.
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(channel, 0, 0) != ESP_OK) {
+        return false;
+    }
+
+    uint32_t clockHz = 0;
+    rmt_get_counter_clock(channel, &clockHz);
+    const uint32_t ticksPerUs = clockHz / 1000000;
+    bit0.level0 = 1;
+    bit0.duration0 = T0H_NS * ticksPerUs / 1000;
+    bit0.level1 = 0;
+    bit0.duration1 = T0L_NS * ticksPerUs / 1000;
+    bit1.level0 = 1;
+    bit1.duration0 = T1H_NS * ticksPerUs / 1000;
+    bit1.level1 = 0;
+    bit1.duration1 = T1L_NS * ticksPerUs / 1000;
+
+    if (rmt_translator_init(channel, translateFrame) != ESP_OK) {
+        rmt_driver_uninstall(channel);
+        return false;
+    }
+    ready = true;
+    return true;
+}
+
+void ButtonLighting::setColor(uint8_t led, Color color) {
+    if (led < MAX_LEDS) {
+        colors[led] = color;
+    }
+}
+
+void ButtonLighting::setBrightness(uint8_t brightness, uint8_t idleLevel) {
+    this->brightness = brightness;
+    this->idleLevel = idleLevel;
+}
+
+void ButtonLighting::update(uint32_t nowMs) {
+    if (!ready || (!enabled && blanked)) {
+        return;
+    }
+    // The frame sent last is still being read by the RMT driver until it is
+    // done; render into the other one.
+    if (rmt_wait_tx_done(channel, 0) != ESP_OK) {
+        framesSkipped++;
+        return;
+    }
+    uint8_t* frame = frames[nextFrame];
+    const uint32_t startUs = micros();
+    if (enabled) {
+        render(nowMs, frame);
+        blanked = false;
+    } else {
+        memset(frame, 0, ledCount * 3);
+        blanked = true;
+    }
+    const uint32_t renderUs = micros() - startUs;
+    if (renderUs > maxRenderUs) {
+        maxRenderUs = renderUs;
+    }
+    rmt_write_sample(channel, frame, ledCount * 3, false);
+    nextFrame ^= 1;
+    framesSent++;
+}
+
+void ButtonLighting::render(uint32_t nowMs, uint8_t* frame) {
+    const uint16_t buttons = snapshots.read().physical.buttons;
+    for (uint8_t i = 0; i < ledCount; i++) {
+        const bool held = ledButtons[i] >= 0 && (buttons & (1 << ledButtons[i]));
+        if (held != leds[i].held) {
+            leds[i].held = held;
+            leds[i].changedMs = nowMs;
+        }
+        const Color color = shade(i, nowMs);
+        frame[i * 3] = scale(color.g, brightness);
+        frame[i * 3 + 1] = scale(color.r, brightness);
+        frame[i * 3 + 2] = scale(color.b, brightness);
+    }
+}
+
+ButtonLighting::Color ButtonLighting::shade(uint8_t led, uint32_t nowMs) const {
+    const Color full = colors[led];
+    const Color idle = {scale(full.r, idleLevel), scale(full.g, idleLevel), scale(full.b, idleLevel)};
+    const uint32_t sinceMs = nowMs - leds[led].changedMs;
+    if (leds[led].held) {
+        return sinceMs < FLASH_MS ? mix(WHITE, full, sinceMs, FLASH_MS) : full;
+    }
+    if (leds[led].changedMs == 0 || sinceMs >= FADE_MS) {
+        return idle; // Never pressed, or faded out
+    }
+    return mix(full, idle, sinceMs, FADE_MS);
+}
@@ -0,0 +1,215 @@
+/*
+================================================================================
+= HeapGuard.cpp                                                                =
+= Allocation tracing after boot. See HeapGuard.h.                              =
+================================================================================
+*/
+
+#include "HeapGuard.h"
+#include <esp_attr.h>
+#include <string.h>
+
+#ifdef HEAP_GUARD
+#include <esp_debug_helpers.h>
+#include <esp_heap_caps.h>
+#include <esp_spi_flash.h>
+#endif
+
+// Frames of the guard itself at the top of every stack: record() and the
+// malloc wrapper that called it.
+static const uint8_t GUARD_FRAMES = 2;
+
+// Allocations can come from any task, on either core, and from interrupts.
+static portMUX_TYPE sitesLock = portMUX_INITIALIZER_UNLOCKED;
+static HeapGuard::Site sites[HeapGuard::MAX_SITES];
+static uint8_t siteCount = 0;
+static HeapGuard::Totals totals = {};
+static TaskHandle_t hotTasks[HeapGuard::MAX_HOT_TASKS] = {};
+
+volatile bool HeapGuard::armed = false;
+
+void HeapGuard::markHotTask(TaskHandle_t task) {
+    portENTER_CRITICAL(&sitesLock);
+    for (TaskHandle_t& hot : hotTasks) {
+        if (hot == nullptr || hot == task) {
+            hot = task;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&sitesLock);
+}
+
+void HeapGuard::arm() {
+    armed = ENABLED;
+}
+
+bool HeapGuard::disarm() {
+    const bool wasArmed = armed;
+    armed = false;
+    return wasArmed;
+}
+
+void HeapGuard::clear() {
+    portENTER_CRITICAL(&sitesLock);
+    siteCount = 0;
+    totals = Totals{};
+    portEXIT_CRITICAL(&sitesLock);
+}
+
+void HeapGuard::getTotals(Totals& out) {
+    portENTER_CRITICAL(&sitesLock);
+    out = totals;
+    portEXIT_CRITICAL(&sitesLock);
+}
+
+bool HeapGuard::getSite(uint8_t index, Site& site) {
+    portENTER_CRITICAL(&sitesLock);
+    const bool found = index < siteCount;
+    if (found) {
+        site = sites[index];
+    }
+    portEXIT_CRITICAL(&sitesLock);
+    return found;
+}
+
+#ifdef HEAP_GUARD
+
+/**
+ * @brief Turns a return address saved on the stack into the address of the
+ * call: the top two bits hold the caller's register window, and the call
+ * instruction is 3 bytes before the return address.
+ */
+static inline uint32_t IRAM_ATTR callAddress(uint32_t pc) {
+    if (pc & 0x80000000) {
+        pc = (pc & 0x3FFFFFFF) | 0x40000000;
+    }
+    return pc - 3;
+}
+
+// Not inlined, so the guard's own frames are always GUARD_FRAMES deep.
+void __attribute__((noinline)) IRAM_ATTR HeapGuard::record(size_t bytes) {
+    const bool inIsr = xPortInIsrContext();
+    const TaskHandle_t task = inIsr ? nullptr : xTaskGetCurrentTaskHandle();
+    bool hot = false;
+    for (TaskHandle_t hotTask : hotTasks) {
+        hot |= hotTask != nullptr && hotTask == task;
+    }
+
+    // With the flash cache off (another core writing the flash) nothing in
+    // flash may run, task names included: count the allocation only.
+    Site site;
+    site.depth = 0;
+    const bool traced = spi_flash_cache_enabled();
+    if (traced) {
+        esp_backtrace_frame_t frame = {};
+        esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+        bool more = true;
+        for (uint8_t i = 0; more && site.depth < MAX_DEPTH; i++) {
+            if (i >= GUARD_FRAMES) {
+                site.pc[site.depth] = callAddress(frame.pc);
+                site.sp[site.depth] = frame.sp;
+                site.depth++;
+            }
+            more = frame.next_pc != 0 && esp_backtrace_get_next_frame(&frame);
+        }
+        strncpy(site.task, inIsr ? "ISR" : pcTaskGetName(task), sizeof(site.task) - 1);
+        site.task[sizeof(site.task) - 1] = '\0';
+    }
+
+    portENTER_CRITICAL_SAFE(&sitesLock);
+    if (hot) {
+        totals.hotCount++;
+        totals.hotBytes += bytes;
+    } else {
+        totals.otherCount++;
+        totals.otherBytes += bytes;
+    }
+    Site* found = nullptr;
+    if (traced) {
+        for (uint8_t i = 0; i < siteCount && found == nullptr; i++) {
+            if (sites[i].depth == site.depth && memcmp(sites[i].pc, site.pc, site.depth * sizeof(site.pc[0])) == 0) {
+                found = &sites[i];
+            }
+        }
+        if (found == nullptr && siteCount < MAX_SITES) {
+            found = &sites[siteCount++];
+            *found = site;
+            found->hot = hot;
+            found->count = 0;
+            found->bytes = 0;
+            found->largest = 0;
+        }
+    }
+    if (found != nullptr) {
+        found->count++;
+        found->bytes += bytes;
+        if (bytes > found->largest) {
+            found->largest = bytes;
+        }
+    } else {
+        totals.unsited++;
+    }
+    portEXIT_CRITICAL_SAFE(&sitesLock);
+}
+
+// Link-time wrappers (-Wl,--wrap=malloc, ...): every call to these functions
+// from another object file lands here instead. They can be called with the
+// flash cache off, so they live in IRAM like the allocator itself.
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_heap_caps_malloc(size_t size, uint32_t caps);
+void* __real_heap_caps_calloc(size_t count, size_t size, uint32_t caps);
+void* __real_heap_caps_realloc(void* ptr, size_t size, uint32_t caps);
+
+void* IRAM_ATTR __wrap_malloc(size_t size) {
+    if (HeapGuard::isArmed()) {
+        HeapGuard::record(size);
+    }
+    return __real_malloc(size);
+}
+
+void* IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+    if (HeapGuard::isArmed()) {
+        HeapGuard::record(count * size);
+    }
+    return __real_calloc(count, size);
+}
+
+void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size) {
+    if (HeapGuard::isArmed() && size > 0) { // realloc(ptr, 0) only frees
+        HeapGuard::record(size);
+    }
+    return __real_realloc(ptr, size);
+}
+
+void* IRAM_ATTR __wrap_heap_caps_malloc(size_t size, uint32_t caps) {
+    if (HeapGuard::isArmed()) {
+        HeapGuard::record(size);
+    }
+    return __real_heap_caps_malloc(size, caps);
+}
+
+void* IRAM_ATTR __wrap_heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    if (HeapGuard::isArmed()) {
+        HeapGuard::record(count * size);
+    }
+    return __real_heap_caps_calloc(count, size, caps);
+}
+
+void* IRAM_ATTR __wrap_heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    if (HeapGuard::isArmed() && size > 0) {
+        HeapGuard::record(size);
+    }
+    return __real_heap_caps_realloc(ptr, size, caps);
+}
+
+} // extern "C"
+
+#else
+
+void HeapGuard::record(size_t bytes) {}
+
+#endif // HEAP_GUARD
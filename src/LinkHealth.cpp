@@ -0,0 +1,172 @@
+/*
+================================================================================
+= LinkHealth.cpp                                                               =
+= Bluetooth link flight recorder. See LinkHealth.h.                            =
+================================================================================
+*/
+
+#include "LinkHealth.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+#include <atomic>
+
+// Marks a record that was initialised by this firmware; bump the low byte
+// whenever the layout of Record changes.
+static const uint32_t RECORD_MAGIC = 0x4C484302; // "LHC", version 2
+
+// Kept through soft resets; only begin() and clear() initialise it.
+RTC_NOINIT_ATTR static LinkHealth::Record record;
+// Record::queueOverflows, counted apart so the input task's scan never waits
+// for recordLock; snapshot() copies it into the record.
+RTC_NOINIT_ATTR static std::atomic<uint32_t> queueOverflows;
+
+// Events and counters arrive from the BLE host task, the report task and the
+// input task, on both cores.
+static portMUX_TYPE recordLock = portMUX_INITIALIZER_UNLOCKED;
+
+void LinkHealth::begin() {
+    const esp_reset_reason_t reason = esp_reset_reason();
+    const bool valid = record.magic == RECORD_MAGIC && record.eventNext < EVENT_COUNT &&
+                       record.eventCount <= EVENT_COUNT;
+    if (!valid || reason == ESP_RST_POWERON) {
+        clear();
+    }
+    portENTER_CRITICAL(&recordLock);
+    record.boot++;
+    portEXIT_CRITICAL(&recordLock);
+    recordEvent(EVENT_BOOT, 0xFFFF, 0xFF, reason);
+}
+
+void LinkHealth::clear() {
+    portENTER_CRITICAL(&recordLock);
+    memset(&record, 0, sizeof(record));
+    record.magic = RECORD_MAGIC;
+    record.minFreeMbufs = 0xFFFF;
+    portEXIT_CRITICAL(&recordLock);
+    queueOverflows.store(0, std::memory_order_relaxed);
+}
+
+void LinkHealth::recordNotifyResult(int code) {
+    portENTER_CRITICAL(&recordLock);
+    if (code == 0) {
+        record.notifySent++;
+    } else {
+        bool counted = false;
+        for (ResultCount& entry : record.notifyErrors) {
+            if (entry.count > 0 && entry.code == code) {
+                entry.count++;
+                counted = true;
+                break;
+            }
+            if (entry.count == 0) {
+                entry.code = code; // First time this code is seen
+                entry.count = 1;
+                counted = true;
+                break;
+            }
+        }
+        if (!counted) {
+            record.notifyOtherErrors++;
+        }
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void LinkHealth::recordSubmission(int freeMbufs, bool failed) {
+    portENTER_CRITICAL(&recordLock);
+    if (freeMbufs < record.minFreeMbufs) {
+        record.minFreeMbufs = freeMbufs < 0 ? 0 : freeMbufs;
+    }
+    if (failed && freeMbufs <= 0) {
+        record.mbufExhausted++;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void LinkHealth::recordQueueDepth(size_t depth) {
+    portENTER_CRITICAL(&recordLock);
+    if (depth > record.maxQueueDepth) {
+        record.maxQueueDepth = depth;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+// Called from the input task's scan, hence in IRAM and without recordLock:
+// snapshot() and the BLE host hold it on the other core.
+void IRAM_ATTR LinkHealth::recordQueueOverflow() {
+    queueOverflows.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LinkHealth::recordEvent(EventType type, uint16_t connHandle, uint8_t slot,
+                             uint16_t a, uint16_t b, uint16_t c) {
+    const uint32_t nowMs = millis();
+    portENTER_CRITICAL(&recordLock);
+    Event& event = record.events[record.eventNext];
+    event.timeMs = nowMs;
+    event.boot = record.boot;
+    event.type = type;
+    event.slot = slot;
+    event.connHandle = connHandle;
+    event.a = a;
+    event.b = b;
+    event.c = c;
+    record.eventNext = (record.eventNext + 1) % EVENT_COUNT;
+    if (record.eventCount < EVENT_COUNT) {
+        record.eventCount++;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void LinkHealth::snapshot(Record& out) const {
+    portENTER_CRITICAL(&recordLock);
+    memcpy(&out, &record, sizeof(out));
+    portEXIT_CRITICAL(&recordLock);
+    out.queueOverflows = queueOverflows.load(std::memory_order_relaxed);
+}
+
+const char* LinkHealth::eventName(uint8_t type) {
+    switch (type) {
+        case EVENT_BOOT:
+            return "boot";
+        case EVENT_CONNECT:
+            return "connect";
+        case EVENT_ACCEPTED:
+            return "accepted";
+        case EVENT_DISCONNECT:
+            return "disconnect";
+        case EVENT_CONN_PARAMS:
+            return "params";
+        case EVENT_MTU:
+            return "mtu";
+        default:
+            return "?";
+    }
+}
+
+const char* LinkHealth::disconnectReasonName(uint16_t reason) {
+    // NimBLE reports HCI disconnect reasons as 0x200 + the HCI error code.
+    switch (reason) {
+        case 0x208:
+            return "supervision timeout";
+        case 0x213:
+            return "host closed the connection";
+        case 0x214:
+            return "host low on resources";
+        case 0x215:
+            return "host powering off";
+        case 0x216:
+            return "closed by the stick";
+        case 0x222:
+            return "link layer response timeout";
+        case 0x23B:
+            return "unacceptable connection parameters";
+        case 0x23D:
+            return "MIC failure";
+        case 0x23E:
+            return "failed to establish";
+        default:
+            return nullptr;
+    }
+}
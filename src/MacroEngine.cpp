@@ -0,0 +1,175 @@
+/*
+================================================================================
+= MacroEngine.cpp                                                              =
+= Turbo and recorded-sequence playback. See MacroEngine.h.                     =
+================================================================================
+*/
+
+#include "MacroEngine.h"
+#include <esp_attr.h>
+
+MacroEngine::MacroEngine()
+    : turboMask(0),
+      previousButtons(0),
+      stepCount(0),
+      recording(false),
+      recordedReport(EMPTY_GAMEPAD_REPORT),
+      recordedSinceUs(0),
+      playing(false),
+      playIndex(0),
+      stepDeadlineUs(0) {
+    for (uint8_t i = 0; i < MAX_BUTTONS; i++) {
+        turboRateHz[i] = 0;
+        turboHalfPeriodUs[i] = 0;
+        turboPressedAtUs[i] = 0;
+    }
+}
+
+// --- Turbo ---
+
+void IRAM_ATTR MacroEngine::setTurbo(uint8_t button, uint16_t rateHz) {
+    if (button >= MAX_BUTTONS) {
+        return;
+    }
+
+    const uint16_t bit = (uint16_t)(1u << button);
+    turboRateHz[button] = rateHz;
+    if (rateHz == 0) {
+        turboMask &= ~bit;
+        turboHalfPeriodUs[button] = 0;
+    } else {
+        // One press + one release per period.
+        turboHalfPeriodUs[button] = 500000UL / rateHz;
+        turboMask |= bit;
+    }
+}
+
+uint16_t IRAM_ATTR MacroEngine::getTurbo(uint8_t button) const {
+    return button < MAX_BUTTONS ? turboRateHz[button] : 0;
+}
+
+// --- Recording ---
+
+void IRAM_ATTR MacroEngine::startRecording(uint32_t nowUs) {
+    playing = false;
+    stepCount = 0;
+    recording = true;
+    recordedReport = EMPTY_GAMEPAD_REPORT;
+    recordedSinceUs = nowUs;
+}
+
+void IRAM_ATTR MacroEngine::stopRecording(uint32_t nowUs) {
+    if (!recording) {
+        return;
+    }
+    // A release at the end is implicit: once playback finishes the output
+    // falls back to the physical inputs, so an idle tail is not stored.
+    if (recordedReport.buttons != 0 || recordedReport.hat != HAT_CENTERED) {
+        closeRecordedStep(nowUs);
+    }
+    recording = false;
+}
+
+void IRAM_ATTR MacroEngine::closeRecordedStep(uint32_t nowUs) {
+    if (stepCount >= MAX_STEPS) {
+        return;
+    }
+    MacroStep& step = steps[stepCount++];
+    step.buttons = recordedReport.buttons;
+    step.hat = recordedReport.hat;
+    step.durationUs = nowUs - recordedSinceUs;
+}
+
+void IRAM_ATTR MacroEngine::recordReport(uint32_t nowUs, const GamepadReport& report) {
+    if (report == recordedReport) {
+        return;
+    }
+
+    // Idle time before the first input is not part of the sequence.
+    const bool leadingIdle = stepCount == 0 && recordedReport.buttons == 0 &&
+                             recordedReport.hat == HAT_CENTERED;
+    if (!leadingIdle) {
+        closeRecordedStep(nowUs);
+    }
+
+    recordedReport = report;
+    recordedSinceUs = nowUs;
+
+    if (stepCount >= MAX_STEPS) {
+        recording = false; // Sequence is full
+    }
+}
+
+bool MacroEngine::loadSequence(const MacroStep* sequence, uint8_t count) {
+    if (count > MAX_STEPS) {
+        return false;
+    }
+    playing = false;
+    recording = false;
+    for (uint8_t i = 0; i < count; i++) {
+        steps[i] = sequence[i];
+    }
+    stepCount = count;
+    return true;
+}
+
+// --- Playback ---
+
+void IRAM_ATTR MacroEngine::play(uint32_t nowUs) {
+    if (recording || stepCount == 0) {
+        return;
+    }
+    playing = true;
+    playIndex = 0;
+    stepDeadlineUs = nowUs + steps[0].durationUs;
+}
+
+// Runs on every scan: in IRAM, so it never waits for the flash cache.
+GamepadReport IRAM_ATTR MacroEngine::process(uint32_t nowUs, const GamepadReport& physical) {
+    if (recording) {
+        recordReport(nowUs, physical);
+    }
+
+    GamepadReport output = physical;
+
+    // Turbo: each held turbo button is on for the first half of every period,
+    // counted from the scan on which it was pressed.
+    const uint16_t pressedNow = physical.buttons & ~previousButtons;
+    uint16_t pending = physical.buttons & turboMask;
+    while (pending) {
+        const uint8_t button = (uint8_t)__builtin_ctz(pending);
+        const uint16_t bit = (uint16_t)(1u << button);
+        pending &= ~bit;
+
+        if (pressedNow & bit) {
+            turboPressedAtUs[button] = nowUs;
+        }
+        const uint32_t phase = (nowUs - turboPressedAtUs[button]) / turboHalfPeriodUs[button];
+        if (phase & 1) {
+            output.buttons &= ~bit;
+        }
+    }
+    previousButtons = physical.buttons;
+
+    // Playback: advance over every step whose deadline has passed. Deadlines
+    // are chained from the previous one, so a late scan never shifts the
+    // steps that follow it.
+    if (playing) {
+        while ((int32_t)(nowUs - stepDeadlineUs) >= 0) {
+            if (++playIndex >= stepCount) {
+                playing = false;
+                break;
+            }
+            stepDeadlineUs += steps[playIndex].durationUs;
+        }
+    }
+    if (playing) {
+        const MacroStep& step = steps[playIndex];
+        output.buttons |= step.buttons;
+        if (step.hat != HAT_CENTERED) {
+            output.hat = step.hat;
+        }
+    }
+
+    return output;
+}
@@ -0,0 +1,318 @@
+/*
+================================================================================
+= OtaService.cpp                                                               =
+= Firmware update over BLE. See OtaService.h.                                  =
+================================================================================
+*/
+
+#include "OtaService.h"
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
+#include <string.h>
+
+const char* const OtaService::SERVICE_UUID = "6e1f0101-3c5a-4b8e-9d2f-a17c52e4b0d1";
+const char* const OtaService::CONTROL_UUID = "6e1f0102-3c5a-4b8e-9d2f-a17c52e4b0d1";
+const char* const OtaService::DATA_UUID = "6e1f0103-3c5a-4b8e-9d2f-a17c52e4b0d1";
+
+// Time for the DONE notification to reach the client before restarting.
+static const uint32_t RESTART_DELAY_MS = 500;
+
+static uint32_t readU32(const uint8_t* in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | (uint32_t(in[3]) << 24);
+}
+
+static void writeU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = value >> 24;
+}
+
+OtaService::OtaService()
+    : control(nullptr),
+      data(nullptr),
+      open(false),
+      notifying(0),
+      writerTask(nullptr),
+      active(false),
+      imageSize(0),
+      imageCrc(0),
+      expectedOffset(0),
+      resendSent(false),
+      partition(nullptr),
+      sectorFill(0),
+      written(0),
+      writtenCrc(0),
+      expectedSize(0),
+      expectedCrc(0),
+      startedMs(0),
+      finishedMs(0),
+      lastError(ERROR_NONE) {}
+
+void OtaService::begin(NimBLEServer* server) {
+    NimBLEService* service = server->createService(SERVICE_UUID);
+    control = service->createCharacteristic(CONTROL_UUID, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_ENC |
+                                                              NIMBLE_PROPERTY::NOTIFY);
+    control->setCallbacks(this);
+    data = service->createCharacteristic(DATA_UUID, NIMBLE_PROPERTY::WRITE_NR | NIMBLE_PROPERTY::WRITE_ENC,
+                                         4 + MAX_CHUNK_DATA + 4);
+    data->setCallbacks(this);
+    service->start();
+    open = true;
+}
+
+void OtaService::end() {
+    open = false;
+    while (notifying.load() > 0) {
+        delay(1);
+    }
+    resendSent = false; // The client resumes with BEGIN after reconnecting
+    control = nullptr;  // Freed with the rest of the server by NimBLEDevice::deinit()
+    data = nullptr;
+}
+
+uint32_t OtaService::getElapsedMs() const {
+    if (startedMs == 0) {
+        return 0;
+    }
+    return (finishedMs != 0 ? finishedMs : millis()) - startedMs;
+}
+
+// --- Receiving (BLE host task) ---
+
+void OtaService::onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) {
+    const NimBLEAttValue value = characteristic->getValue();
+    if (characteristic == control) {
+        handleControl(value.data(), value.size());
+    } else if (characteristic == data) {
+        handleData(value.data(), value.size());
+    }
+}
+
+void OtaService::handleControl(const uint8_t* value, size_t length) {
+    if (length < 1) {
+        return;
+    }
+    Chunk chunk = {};
+    switch (value[0]) {
+        case CMD_BEGIN: {
+            if (length < 9) {
+                return;
+            }
+            const uint32_t size = readU32(value + 1);
+            const uint32_t crc = readU32(value + 5);
+            if (active && size == imageSize && crc == imageCrc) {
+                // The same image again: resume where the last chunk left off.
+                resendSent = false;
+                notifyStatus(STATUS_READY, expectedOffset);
+                return;
+            }
+            const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+            if (target == nullptr) {
+                notifyStatus(STATUS_ERROR, ERROR_NO_PARTITION);
+                return;
+            }
+            if (size == 0 || size > target->size) {
+                notifyStatus(STATUS_ERROR, ERROR_TOO_LARGE);
+                return;
+            }
+            chunk.op = OP_BEGIN;
+            chunk.offset = size;
+            writeU32(chunk.data, crc);
+            if (!queue(chunk)) {
+                notifyStatus(STATUS_ERROR, ERROR_BUSY);
+                return;
+            }
+            imageSize = size;
+            imageCrc = crc;
+            expectedOffset = 0;
+            resendSent = false;
+            active = true;
+            notifyStatus(STATUS_READY, 0);
+            break;
+        }
+        case CMD_COMMIT:
+            if (!active || expectedOffset != imageSize) {
+                notifyStatus(STATUS_ERROR, ERROR_INCOMPLETE);
+                return;
+            }
+            chunk.op = OP_COMMIT;
+            if (!queue(chunk)) {
+                notifyStatus(STATUS_ERROR, ERROR_BUSY);
+            }
+            // The OTA task replies DONE or ERROR once the flash is written.
+            break;
+        case CMD_ABORT:
+            chunk.op = OP_ABORT;
+            if (!queue(chunk)) {
+                notifyStatus(STATUS_ERROR, ERROR_BUSY);
+                return;
+            }
+            active = false;
+            notifyStatus(STATUS_IDLE, 0);
+            break;
+        case CMD_STATUS:
+            if (active) {
+                notifyStatus(STATUS_READY, expectedOffset);
+            } else {
+                notifyStatus(STATUS_IDLE, 0);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void OtaService::handleData(const uint8_t* value, size_t length) {
+    if (!active || length < 9 || length > 4 + MAX_CHUNK_DATA + 4) {
+        return;
+    }
+    const uint32_t offset = readU32(value);
+    const uint16_t dataLength = length - 8;
+    const uint32_t crc = readU32(value + 4 + dataLength);
+
+    Chunk chunk;
+    chunk.op = OP_DATA;
+    chunk.offset = offset;
+    chunk.length = dataLength;
+    memcpy(chunk.data, value + 4, dataLength);
+
+    // Chunks after a bad one keep arriving until the client sees the RESEND;
+    // they are dropped without another RESEND each.
+    const bool valid = offset == expectedOffset && offset + dataLength <= imageSize &&
+                       esp_rom_crc32_le(0, chunk.data, dataLength) == crc;
+    if (valid && queue(chunk)) {
+        expectedOffset += dataLength;
+        resendSent = false;
+    } else if (!resendSent && offset >= expectedOffset) {
+        resendSent = true;
+        notifyStatus(STATUS_RESEND, expectedOffset);
+    }
+}
+
+bool OtaService::queue(const Chunk& chunk) {
+    if (!chunks.push(chunk)) {
+        return false; // The client sent more than the window
+    }
+    if (writerTask != nullptr) {
+        xTaskNotifyGive(writerTask);
+    }
+    return true;
+}
+
+void OtaService::notifyStatus(Status status, uint32_t offset) {
+    // Counted before open is checked: once end() has cleared open and seen no
+    // notification in progress, none can start.
+    notifying.fetch_add(1);
+    if (!open || control == nullptr) {
+        notifying.fetch_sub(1);
+        return;
+    }
+    uint8_t value[8];
+    value[0] = status;
+    value[1] = QUEUE_SIZE - 1;
+    value[2] = MAX_CHUNK_DATA & 0xFF;
+    value[3] = MAX_CHUNK_DATA >> 8;
+    writeU32(value + 4, offset);
+    control->notify(value, sizeof(value));
+    notifying.fetch_sub(1);
+}
+
+// --- Writing (OTA task) ---
+
+void OtaService::process() {
+    Chunk chunk;
+    while (chunks.pop(chunk)) {
+        switch (chunk.op) {
+            case OP_BEGIN:
+                partition = esp_ota_get_next_update_partition(nullptr);
+                sectorFill = 0;
+                written = 0;
+                writtenCrc = 0;
+                expectedSize = chunk.offset;
+                expectedCrc = readU32(chunk.data);
+                startedMs = millis();
+                finishedMs = 0;
+                lastError = ERROR_NONE;
+                break;
+            case OP_DATA:
+                if (partition == nullptr) {
+                    break; // The upload failed or was aborted; drain
+                }
+            {
+                writtenCrc = esp_rom_crc32_le(writtenCrc, chunk.data, chunk.length);
+                // A chunk may run past the sector; the rest starts the next.
+                const size_t room = SECTOR_SIZE - sectorFill;
+                const size_t first = chunk.length < room ? chunk.length : room;
+                memcpy(sector + sectorFill, chunk.data, first);
+                sectorFill += first;
+                if (sectorFill == SECTOR_SIZE) {
+                    if (!flushSector()) {
+                        break;
+                    }
+                    memcpy(sector, chunk.data + first, chunk.length - first);
+                    sectorFill = chunk.length - first;
+                }
+                break;
+            }
+            case OP_COMMIT:
+                if (partition != nullptr) {
+                    commit();
+                }
+                break;
+            case OP_ABORT:
+                partition = nullptr;
+                finishedMs = millis();
+                break;
+        }
+    }
+}
+
+bool OtaService::flushSector() {
+    // Each sector is erased just before it is written, so the erase of the
+    // whole partition is spread over the upload instead of stalling its start.
+    const uint32_t sectorStart = written;
+    if (esp_partition_erase_range(partition, sectorStart, SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(partition, sectorStart, sector, sectorFill) != ESP_OK) {
+        fail(ERROR_FLASH);
+        return false;
+    }
+    written = sectorStart + sectorFill;
+    sectorFill = 0;
+    notifyStatus(STATUS_PROGRESS, written);
+    return true;
+}
+
+void OtaService::commit() {
+    if (sectorFill > 0 && !flushSector()) {
+        return;
+    }
+    if (written != expectedSize) {
+        fail(ERROR_INCOMPLETE);
+        return;
+    }
+    if (writtenCrc != expectedCrc) {
+        fail(ERROR_CRC);
+        return;
+    }
+    // Checks the image headers and hash, then switches the boot partition in
+    // one step: the previous firmware stays the boot image until this returns.
+    if (esp_ota_set_boot_partition(partition) != ESP_OK) {
+        fail(ERROR_INVALID);
+        return;
+    }
+    finishedMs = millis();
+    active = false;
+    partition = nullptr;
+    notifyStatus(STATUS_DONE, written);
+    delay(RESTART_DELAY_MS);
+    esp_restart();
+}
+
+void OtaService::fail(Error error) {
+    lastError = error;
+    finishedMs = millis();
+    partition = nullptr; // Remaining chunks of this upload are drained
+    active = false;
+    notifyStatus(STATUS_ERROR, error);
+}
@@ -0,0 +1,178 @@
+/*
+================================================================================
+= ReportLinks.cpp                                                              =
+= Host links and report fan-out. See ReportLinks.h.                            =
+================================================================================
+*/
+
+#include "ReportLinks.h"
+#include <Arduino.h>
+
+ReportLinks::ReportLinks() : links{}, lock(portMUX_INITIALIZER_UNLOCKED) {
+    for (Link& link : links) {
+        link.connHandle = BLE_HS_CONN_HANDLE_NONE;
+    }
+}
+
+void ReportLinks::add(uint16_t connHandle, uint8_t slot) {
+    portENTER_CRITICAL(&lock);
+    for (Link& link : links) {
+        if (link.connHandle == BLE_HS_CONN_HANDLE_NONE) {
+            link.connHandle = connHandle;
+            link.subscribed = false;
+            link.stats = Stats{};
+            link.stats.connHandle = connHandle;
+            link.stats.slot = slot;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+bool ReportLinks::remove(uint16_t connHandle) {
+    bool any = false;
+    portENTER_CRITICAL(&lock);
+    for (Link& link : links) {
+        if (link.connHandle == connHandle) {
+            link.connHandle = BLE_HS_CONN_HANDLE_NONE;
+        }
+        any |= link.connHandle != BLE_HS_CONN_HANDLE_NONE;
+    }
+    portEXIT_CRITICAL(&lock);
+    return any;
+}
+
+void ReportLinks::clear() {
+    portENTER_CRITICAL(&lock);
+    for (Link& link : links) {
+        link.connHandle = BLE_HS_CONN_HANDLE_NONE;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void ReportLinks::setSubscribed(uint16_t connHandle, bool subscribed) {
+    portENTER_CRITICAL(&lock);
+    for (Link& link : links) {
+        if (link.connHandle == connHandle) {
+            link.subscribed = subscribed;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+bool ReportLinks::isSlotLinked(uint8_t slot) const {
+    bool linked = false;
+    portENTER_CRITICAL(&lock);
+    for (const Link& link : links) {
+        linked |= link.connHandle != BLE_HS_CONN_HANDLE_NONE && link.stats.slot == slot;
+    }
+    portEXIT_CRITICAL(&lock);
+    return linked;
+}
+
+uint8_t ReportLinks::findSlot(uint16_t connHandle) const {
+    uint8_t slot = 0xFF;
+    portENTER_CRITICAL(&lock);
+    for (const Link& link : links) {
+        if (link.connHandle == connHandle) {
+            slot = link.stats.slot;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return slot;
+}
+
+uint8_t ReportLinks::getLinks(uint16_t (&connHandles)[MAX_LINKS], uint8_t (&slots)[MAX_LINKS]) const {
+    uint8_t count = 0;
+    portENTER_CRITICAL(&lock);
+    for (const Link& link : links) {
+        if (link.connHandle != BLE_HS_CONN_HANDLE_NONE) {
+            connHandles[count] = link.connHandle;
+            slots[count] = link.stats.slot;
+            count++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+uint16_t ReportLinks::getConnHandle(uint8_t index) const {
+    if (index >= MAX_LINKS) {
+        return BLE_HS_CONN_HANDLE_NONE;
+    }
+    portENTER_CRITICAL(&lock);
+    const uint16_t handle = links[index].connHandle;
+    portEXIT_CRITICAL(&lock);
+    return handle;
+}
+
+bool ReportLinks::getStats(uint8_t index, uint8_t activeSlot, Stats& stats) const {
+    if (index >= MAX_LINKS) {
+        return false;
+    }
+    portENTER_CRITICAL(&lock);
+    const bool used = links[index].connHandle != BLE_HS_CONN_HANDLE_NONE;
+    stats = links[index].stats;
+    portEXIT_CRITICAL(&lock);
+    stats.primary = stats.slot == activeSlot;
+    return used;
+}
+
+bool ReportLinks::send(NimBLECharacteristic* characteristic, const uint8_t* report, size_t length,
+                       uint32_t scanTimeUs, uint8_t activeSlot, LinkHealth* health) {
+    // Snapshot the links, active host first. The table may change under us
+    // (the BLE host task preempts this one), so sending works on the copy.
+    uint16_t handles[MAX_LINKS];
+    bool primary[MAX_LINKS];
+    uint8_t count = 0;
+    portENTER_CRITICAL(&lock);
+    for (int pass = 0; pass < 2; pass++) {
+        for (const Link& link : links) {
+            if (link.connHandle != BLE_HS_CONN_HANDLE_NONE && link.subscribed &&
+                (link.stats.slot == activeSlot) == (pass == 0)) {
+                handles[count] = link.connHandle;
+                primary[count] = pass == 0;
+                count++;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    // The report was packed once by the input task; each host gets the same
+    // bytes in its own mbuf, as every notification needs one.
+    bool sentAny = false;
+    for (uint8_t i = 0; i < count; i++) {
+        int result; // 1 sent, 0 failed, -1 skipped
+        const int freeMbufs = os_msys_num_free();
+        if (!primary[i] && freeMbufs < MIRROR_MBUF_RESERVE) {
+            result = -1;
+        } else {
+            result = characteristic->notify(report, length, handles[i]) ? 1 : 0;
+            if (health != nullptr) {
+                health->recordSubmission(freeMbufs, result == 0);
+            }
+        }
+        const uint32_t delayUs = micros() - scanTimeUs;
+        sentAny |= result == 1;
+
+        portENTER_CRITICAL(&lock);
+        for (Link& link : links) {
+            if (link.connHandle != handles[i]) {
+                continue; // Only the connection sent to, if it is still there
+            }
+            if (result < 0) {
+                link.stats.skipped++;
+            } else if (result == 0) {
+                link.stats.failed++;
+            } else {
+                link.stats.sent++;
+                link.stats.totalDelayUs += delayUs;
+                if (delayUs > link.stats.maxDelayUs) {
+                    link.stats.maxDelayUs = delayUs;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+    return sentAny;
+}
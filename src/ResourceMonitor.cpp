@@ -0,0 +1,86 @@
+/*
+================================================================================
+= ResourceMonitor.cpp                                                          =
+= Stack, heap and NimBLE pool usage. See ResourceMonitor.h.                    =
+================================================================================
+*/
+
+#include "ResourceMonitor.h"
+#include <NimBLEDevice.h>
+#include <string.h>
+
+ResourceMonitor::ResourceMonitor() : latest{}, lock(portMUX_INITIALIZER_UNLOCKED) {}
+
+bool ResourceMonitor::watchTask(const char* name, uint32_t stackSize) {
+    portENTER_CRITICAL(&lock);
+    const bool added = latest.taskCount < MAX_TASKS;
+    if (added) {
+        TaskStack& task = latest.tasks[latest.taskCount++];
+        strncpy(task.name, name, sizeof(task.name) - 1);
+        task.name[sizeof(task.name) - 1] = '\0';
+        task.stackSize = stackSize;
+        task.minFree = UINT32_MAX;
+        task.running = false;
+    }
+    portEXIT_CRITICAL(&lock);
+    return added;
+}
+
+void ResourceMonitor::sample() {
+    // Names and sizes only change in watchTask(), which is done before the
+    // first sample, so they can be read here without the lock.
+    uint32_t taskFree[MAX_TASKS];
+    bool taskRunning[MAX_TASKS];
+    const uint8_t taskCount = latest.taskCount;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        // The only task that is ever deleted, the NimBLE host, is deleted by
+        // the loop task, which is also the one sampling: the handle stays
+        // valid until it has been read.
+        const TaskHandle_t handle = xTaskGetHandle(latest.tasks[i].name);
+        taskRunning[i] = handle != nullptr;
+        taskFree[i] = taskRunning[i] ? uxTaskGetStackHighWaterMark(handle) : 0;
+    }
+
+    // NimBLE's pools are created and freed with the stack, also by the loop
+    // task.
+    Pool pools[MAX_POOLS];
+    uint8_t poolCount = 0;
+    struct os_mempool_info info;
+    struct os_mempool* pool = nullptr;
+    while (poolCount < MAX_POOLS && (pool = os_mempool_info_get_next(pool, &info)) != nullptr) {
+        Pool& entry = pools[poolCount++];
+        strncpy(entry.name, info.omi_name, sizeof(entry.name) - 1);
+        entry.name[sizeof(entry.name) - 1] = '\0';
+        entry.blockSize = info.omi_block_size;
+        entry.blocks = info.omi_num_blocks;
+        entry.free = info.omi_num_free;
+        entry.minFree = info.omi_min_free;
+    }
+
+    const uint32_t freeHeap = ESP.getFreeHeap();
+    const uint32_t minFreeHeap = ESP.getMinFreeHeap();
+    const uint32_t largestBlock = ESP.getMaxAllocHeap();
+
+    portENTER_CRITICAL(&lock);
+    latest.samples++;
+    latest.timeMs = millis();
+    latest.freeHeap = freeHeap;
+    latest.minFreeHeap = minFreeHeap;
+    latest.largestBlock = largestBlock;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        TaskStack& task = latest.tasks[i];
+        task.running = taskRunning[i];
+        if (taskRunning[i] && taskFree[i] < task.minFree) {
+            task.minFree = taskFree[i];
+        }
+    }
+    latest.poolCount = poolCount;
+    memcpy(latest.pools, pools, poolCount * sizeof(pools[0]));
+    portEXIT_CRITICAL(&lock);
+}
+
+void ResourceMonitor::snapshot(Snapshot& out) const {
+    portENTER_CRITICAL(&lock);
+    out = latest;
+    portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,436 @@
+/*
+================================================================================
+= TelemetryService.cpp                                                         =
+= Input-display and latency telemetry stream. See TelemetryService.h.          =
+================================================================================
+*/
+
+#include "TelemetryService.h"
+#include <Arduino.h>
+#include <string.h>
+
+const char* const TelemetryService::SERVICE_UUID = "6e1f0001-3c5a-4b8e-9d2f-a17c52e4b0d1";
+const char* const TelemetryService::STREAM_UUID = "6e1f0002-3c5a-4b8e-9d2f-a17c52e4b0d1";
+const char* const TelemetryService::CONTROL_UUID = "6e1f0003-3c5a-4b8e-9d2f-a17c52e4b0d1";
+const char* const TelemetryService::CLOCK_UUID = "6e1f0004-3c5a-4b8e-9d2f-a17c52e4b0d1";
+
+// Free mbufs a telemetry batch must leave to the HID reports. Higher than the
+// mirror's reserve, so telemetry is the first thing to give way.
+static const int TELEMETRY_MBUF_RESERVE = 6;
+
+// The longest frame: a DELTA with both varints at 5 bytes and every field
+// changed is 22 bytes, as is a REPORT of MAX_LOGGED_REPORT bytes; KEY and
+// COUNTERS are 19, STACK at most 20.
+static const size_t MAX_FRAME = 22;
+
+// Longest task name a STACK frame carries.
+static const size_t STACK_NAME_MAX = 13;
+
+static size_t putU16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+    return 2;
+}
+
+static size_t putU32(uint8_t* out, uint32_t value) {
+    putU16(out, value & 0xFFFF);
+    putU16(out + 2, value >> 16);
+    return 4;
+}
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[length++] = value ? (byte | 0x80) : byte;
+    } while (value);
+    return length;
+}
+
+static uint16_t saturate16(uint32_t value) {
+    return value > 0xFFFF ? 0xFFFF : value;
+}
+
+TelemetryService::TelemetryService(const SeqLock<InputSnapshot>& snapshots, BleHidGamepad& gamepad,
+                                   uint16_t rateHz, uint16_t batchMs)
+    : snapshots(snapshots),
+      gamepad(gamepad),
+      resources(nullptr),
+      rateHz(rateHz > MAX_RATE_HZ ? MAX_RATE_HZ : rateHz),
+      batchUs(batchMs * 1000UL),
+      stream(nullptr),
+      control(nullptr),
+      clock(nullptr),
+      open(false),
+      sending(false),
+      reportSequence(0),
+      batchLength(0),
+      batchStartedUs(0),
+      haveLast(false),
+      last{},
+      lastCountersUs(0),
+      lastResourcesUs(0),
+      resourcesSample{},
+      droppedBatches(0) {
+    for (auto& handle : subscribers) {
+        handle = BLE_HS_CONN_HANDLE_NONE;
+    }
+}
+
+void TelemetryService::begin(NimBLEServer* server) {
+    NimBLEService* service = server->createService(SERVICE_UUID);
+    stream = service->createCharacteristic(STREAM_UUID, NIMBLE_PROPERTY::NOTIFY, MAX_PAYLOAD);
+    stream->setCallbacks(this);
+    control = service->createCharacteristic(CONTROL_UUID,
+                                            NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE |
+                                                NIMBLE_PROPERTY::WRITE_ENC);
+    control->setCallbacks(this);
+    control->setValue(static_cast<uint16_t>(rateHz));
+    clock = service->createCharacteristic(CLOCK_UUID, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR |
+                                                          NIMBLE_PROPERTY::NOTIFY);
+    clock->setCallbacks(this);
+    service->start();
+
+    for (auto& handle : subscribers) {
+        handle = BLE_HS_CONN_HANDLE_NONE;
+    }
+    batchLength = 0;
+    haveLast = false;
+    open = true;
+}
+
+void TelemetryService::end() {
+    open = false;
+    while (sending) {
+        delay(1);
+    }
+    stream = nullptr; // Freed with the rest of the server by NimBLEDevice::deinit()
+    control = nullptr;
+    clock = nullptr;
+}
+
+void TelemetryService::setRate(uint16_t rate) {
+    rateHz = rate > MAX_RATE_HZ ? MAX_RATE_HZ : rate;
+}
+
+bool TelemetryService::isStreaming() const {
+    bool subscribed = false;
+    for (const auto& handle : subscribers) {
+        subscribed |= handle != BLE_HS_CONN_HANDLE_NONE;
+    }
+    return open && subscribed && rateHz != 0;
+}
+
+void TelemetryService::logReport(const uint8_t* report, size_t length, uint32_t scanTimeUs,
+                                 uint32_t submittedUs) {
+    LoggedReport logged;
+    logged.sequence = reportSequence++;
+    if (!isStreaming()) {
+        return; // Counted all the same, so the sequence keeps counting every report
+    }
+    logged.scanTimeUs = scanTimeUs;
+    logged.submittedUs = submittedUs;
+    logged.length = length > MAX_LOGGED_REPORT ? MAX_LOGGED_REPORT : length;
+    memcpy(logged.bytes, report, logged.length);
+    reportLog.push(logged); // When full, the gap in the sequence shows it
+}
+
+void TelemetryService::poll(uint32_t nowUs) {
+    // Marked busy for the whole poll, so end() never frees the characteristic
+    // under it.
+    sending = true;
+    if (!isStreaming()) {
+        LoggedReport stale;
+        while (reportLog.pop(stale)) {
+        }
+        batchLength = 0;
+        haveLast = false;
+        last = InputSnapshot{}; // A new subscriber starts from the current state
+        sending = false;
+        return;
+    }
+
+    uint8_t frame[MAX_FRAME];
+    size_t length;
+
+    // Input: only samples that differ from the previous one make a frame.
+    const InputSnapshot sample = snapshots.read();
+    if (sample.sequence != last.sequence &&
+        (sample.physical != last.physical || sample.output != last.output || last.sequence == 0)) {
+        length = encodeInput(frame, sample);
+        if (!append(frame, length)) {
+            flush();
+            length = encodeInput(frame, sample); // Now the KEY of a new batch
+            append(frame, length);
+        }
+        haveLast = true;
+        last = sample;
+    }
+
+    appendReports();
+
+    if (nowUs - lastCountersUs >= COUNTERS_PERIOD_US) {
+        lastCountersUs = nowUs;
+        length = encodeCounters(frame);
+        if (!append(frame, length)) {
+            flush();
+            append(frame, length);
+        }
+    }
+
+    if (resources != nullptr && nowUs - lastResourcesUs >= RESOURCES_PERIOD_US) {
+        lastResourcesUs = nowUs;
+        appendResources();
+    }
+
+    if (batchLength > 0 && (batchUs == 0 || nowUs - batchStartedUs >= batchUs)) {
+        flush();
+    }
+    sending = false;
+}
+
+size_t TelemetryService::payloadLimit() const {
+    // The batch must fit every subscriber's MTU.
+    size_t limit = MAX_PAYLOAD;
+    NimBLEServer* server = NimBLEDevice::getServer();
+    for (const auto& subscriber : subscribers) {
+        const uint16_t handle = subscriber;
+        if (handle != BLE_HS_CONN_HANDLE_NONE) {
+            const uint16_t mtu = server->getPeerMTU(handle);
+            if (mtu > 3 && size_t(mtu - 3) < limit) {
+                limit = mtu - 3;
+            }
+        }
+    }
+    return limit;
+}
+
+bool TelemetryService::append(const uint8_t* frame, size_t length) {
+    if (batchLength + length > payloadLimit()) {
+        return false;
+    }
+    if (batchLength == 0) {
+        batchStartedUs = micros();
+    }
+    memcpy(batch + batchLength, frame, length);
+    batchLength += length;
+    return true;
+}
+
+void TelemetryService::flush() {
+    if (batchLength == 0) {
+        return;
+    }
+    if (os_msys_num_free() < TELEMETRY_MBUF_RESERVE) {
+        droppedBatches++; // The HID reports need the buffers more
+    } else {
+        // One notification per subscriber: notifying them all at once makes
+        // NimBLE build a std::vector of the connections on every batch.
+        for (const auto& subscriber : subscribers) {
+            const uint16_t handle = subscriber;
+            if (handle != BLE_HS_CONN_HANDLE_NONE) {
+                stream->notify(batch, batchLength, handle);
+            }
+        }
+    }
+    batchLength = 0;
+    haveLast = false; // The next batch starts with a KEY
+}
+
+size_t TelemetryService::encodeInput(uint8_t* frame, const InputSnapshot& sample) const {
+    size_t n = 0;
+    if (!haveLast) {
+        frame[n++] = FRAME_KEY;
+        n += putU32(frame + n, sample.sequence);
+        n += putU32(frame + n, sample.scanTimeUs);
+        n += putU16(frame + n, sample.physical.buttons);
+        frame[n++] = sample.physical.hat;
+        n += putU16(frame + n, sample.output.buttons);
+        frame[n++] = sample.output.hat;
+        frame[n++] = sample.output.leftX;
+        frame[n++] = sample.output.leftY;
+        frame[n++] = sample.output.rightX;
+        frame[n++] = sample.output.rightY;
+        return n;
+    }
+
+    frame[n++] = FRAME_DELTA;
+    n += putVarint(frame + n, sample.sequence - last.sequence);
+    n += putVarint(frame + n, sample.scanTimeUs - last.scanTimeUs);
+    uint8_t& mask = frame[n++];
+    mask = 0;
+    if (sample.physical.buttons != last.physical.buttons) {
+        mask |= 1 << 0;
+        n += putU16(frame + n, sample.physical.buttons ^ last.physical.buttons);
+    }
+    if (sample.physical.hat != last.physical.hat) {
+        mask |= 1 << 1;
+        frame[n++] = sample.physical.hat;
+    }
+    if (sample.output.buttons != last.output.buttons) {
+        mask |= 1 << 2;
+        n += putU16(frame + n, sample.output.buttons ^ last.output.buttons);
+    }
+    if (sample.output.hat != last.output.hat) {
+        mask |= 1 << 3;
+        frame[n++] = sample.output.hat;
+    }
+    if (sample.output.leftX != last.output.leftX || sample.output.leftY != last.output.leftY ||
+        sample.output.rightX != last.output.rightX || sample.output.rightY != last.output.rightY) {
+        mask |= 1 << 4;
+        frame[n++] = sample.output.leftX;
+        frame[n++] = sample.output.leftY;
+        frame[n++] = sample.output.rightX;
+        frame[n++] = sample.output.rightY;
+    }
+    return n;
+}
+
+size_t TelemetryService::encodeCounters(uint8_t* frame) const {
+    BleHidGamepad::LinkStats active = {};
+    for (uint8_t i = 0; i < BleHidGamepad::MAX_LINKS; i++) {
+        BleHidGamepad::LinkStats stats;
+        if (gamepad.getLinkStats(i, stats) && stats.primary) {
+            active = stats;
+        }
+    }
+
+    size_t n = 0;
+    frame[n++] = FRAME_COUNTERS;
+    n += putU32(frame + n, active.sent);
+    n += putU32(frame + n, active.failed);
+    n += putU32(frame + n, active.skipped);
+    n += putU16(frame + n, saturate16(active.sent ? active.totalDelayUs / active.sent : 0));
+    n += putU16(frame + n, saturate16(active.maxDelayUs));
+    n += putU16(frame + n, droppedBatches);
+    return n;
+}
+
+/**
+ * @brief Appends a REPORT frame for every report logged since the last poll.
+ */
+void TelemetryService::appendReports() {
+    LoggedReport logged;
+    while (reportLog.pop(logged)) {
+        uint8_t frame[MAX_FRAME];
+        size_t n = 0;
+        frame[n++] = FRAME_REPORT;
+        n += putU32(frame + n, logged.sequence);
+        n += putU32(frame + n, logged.scanTimeUs);
+        n += putU32(frame + n, logged.submittedUs);
+        frame[n++] = logged.length;
+        memcpy(frame + n, logged.bytes, logged.length);
+        n += logged.length;
+        if (!append(frame, n)) {
+            flush();
+            append(frame, n);
+        }
+    }
+}
+
+/**
+ * @brief Appends a HEAP frame, then a STACK frame per watched task and a POOL
+ * frame per NimBLE pool, from the monitor's latest sample.
+ */
+void TelemetryService::appendResources() {
+    resources->snapshot(resourcesSample);
+    if (resourcesSample.samples == 0) {
+        return;
+    }
+    const ResourceMonitor::Snapshot& sample = resourcesSample;
+    const uint8_t frameCount = 1 + sample.taskCount + sample.poolCount;
+    for (uint8_t i = 0; i < frameCount; i++) {
+        uint8_t frame[MAX_FRAME];
+        size_t n = 0;
+        if (i == 0) {
+            frame[n++] = FRAME_HEAP;
+            n += putU32(frame + n, sample.freeHeap);
+            n += putU32(frame + n, sample.minFreeHeap);
+            n += putU32(frame + n, sample.largestBlock);
+        } else if (i <= sample.taskCount) {
+            const uint8_t index = i - 1;
+            const ResourceMonitor::TaskStack& task = sample.tasks[index];
+            const size_t nameLength = strnlen(task.name, STACK_NAME_MAX);
+            frame[n++] = FRAME_STACK;
+            frame[n++] = index | (task.running ? 0x80 : 0);
+            n += putU16(frame + n, saturate16(task.stackSize));
+            n += putU16(frame + n, saturate16(task.minFree));
+            frame[n++] = nameLength;
+            memcpy(frame + n, task.name, nameLength);
+            n += nameLength;
+        } else {
+            const uint8_t index = i - 1 - sample.taskCount;
+            const ResourceMonitor::Pool& pool = sample.pools[index];
+            frame[n++] = FRAME_POOL;
+            frame[n++] = index;
+            n += putU16(frame + n, pool.blockSize);
+            n += putU16(frame + n, pool.blocks);
+            n += putU16(frame + n, pool.free);
+            n += putU16(frame + n, pool.minFree);
+        }
+        if (!append(frame, n)) {
+            flush();
+            append(frame, n);
+        }
+    }
+}
+
+// --- Characteristic Callbacks ---
+
+void TelemetryService::onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) {
+    if (characteristic == clock) {
+        answerClockPing(connInfo, micros());
+        return;
+    }
+    if (characteristic != control) {
+        return;
+    }
+    const NimBLEAttValue value = characteristic->getValue();
+    if (value.size() == 2) {
+        setRate(value.data()[0] | (value.data()[1] << 8));
+    }
+    control->setValue(static_cast<uint16_t>(rateHz)); // Reads return the rate in effect
+}
+
+/**
+ * @brief Answers a clock ping with the time it arrived, the time of the
+ * answer and the connection interval, to the client that sent it. Runs in
+ * the BLE host task after the connection event that brought the ping, so the
+ * answer leaves one interval later, at the next event: the client takes that
+ * wait out of the way back.
+ */
+void TelemetryService::answerClockPing(NimBLEConnInfo& connInfo, uint32_t receivedUs) {
+    if (clock->getLength() != sizeof(uint32_t)) {
+        return;
+    }
+    const uint32_t pingId = clock->getValue<uint32_t>();
+    uint8_t reply[14];
+    putU32(reply, pingId);
+    putU32(reply + 4, receivedUs);
+    putU16(reply + 12, connInfo.getConnInterval());
+    putU32(reply + 8, micros()); // Last, as close to the notification as it gets
+    clock->notify(reply, sizeof(reply), connInfo.getConnHandle());
+}
+
+void TelemetryService::onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo,
+                                   uint16_t subValue) {
+    if (characteristic != stream) {
+        return;
+    }
+    const uint16_t handle = connInfo.getConnHandle();
+    const bool notify = (subValue & 0x0001) != 0;
+    for (auto& subscriber : subscribers) {
+        if (subscriber == handle) {
+            subscriber = BLE_HS_CONN_HANDLE_NONE; // Re-added below if still subscribed
+        }
+    }
+    if (notify) {
+        for (auto& subscriber : subscribers) {
+            uint16_t none = BLE_HS_CONN_HANDLE_NONE;
+            if (subscriber.compare_exchange_strong(none, handle)) {
+                break;
+            }
+        }
+    }
+}
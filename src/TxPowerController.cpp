@@ -0,0 +1,83 @@
+/*
+================================================================================
+= TxPowerController.cpp                                                        =
+= Adaptive transmit power for one connection. See TxPowerController.h.         =
+================================================================================
+*/
+
+#include "TxPowerController.h"
+
+TxPowerController::TxPowerController() {
+    reset(0);
+}
+
+void TxPowerController::reset(uint32_t nowMs) {
+    powerDbm = MAX_DBM;
+    filteredRssiX4 = 0;
+    filterPrimed = false;
+    lastChangeMs = nowMs;
+    highSinceMs = nowMs;
+    high = false;
+}
+
+TxPowerController::Decision TxPowerController::update(uint32_t nowMs, int8_t rssiDbm, uint32_t failures) {
+    // Exponential average with a weight of 1/4 on the new sample.
+    if (!filterPrimed) {
+        filteredRssiX4 = rssiDbm * 4;
+        filterPrimed = true;
+    } else {
+        filteredRssiX4 += rssiDbm - filteredRssiX4 / 4;
+    }
+
+    // Stepping up reacts to the raw sample, stepping down only to the average.
+    const int16_t rawEstimate = rssiDbm + powerDbm - HOST_TX_DBM;
+    const int16_t estimate = filteredRssiX4 / 4 + powerDbm - HOST_TX_DBM;
+
+    Decision decision = {REASON_NONE, powerDbm, powerDbm, rssiDbm, static_cast<int8_t>(estimate)};
+
+    if (failures > 0) {
+        if (powerDbm < MAX_DBM) {
+            decision.reason = REASON_FAILURES;
+            powerDbm = MAX_DBM;
+        }
+    } else if (rawEstimate < TARGET_LOW_DBM || estimate < TARGET_LOW_DBM) {
+        if (powerDbm < MAX_DBM) {
+            decision.reason = REASON_MARGIN_LOW;
+            powerDbm += STEP_DBM;
+        }
+    } else if (estimate > TARGET_HIGH_DBM) {
+        if (!high) {
+            high = true;
+            highSinceMs = nowMs;
+        }
+        // The estimate must still be inside the window after the step, or the
+        // next update would step straight back up.
+        if (powerDbm > MIN_DBM && estimate - STEP_DBM >= TARGET_LOW_DBM &&
+            nowMs - highSinceMs >= STEP_DOWN_AFTER_MS && nowMs - lastChangeMs >= HOLD_OFF_MS) {
+            decision.reason = REASON_MARGIN_HIGH;
+            powerDbm -= STEP_DBM;
+        }
+    } else {
+        high = false;
+    }
+
+    if (decision.reason != REASON_NONE) {
+        decision.toDbm = powerDbm;
+        lastChangeMs = nowMs;
+        high = false;
+    }
+    return decision;
+}
+
+const char* TxPowerController::reasonName(Reason reason) {
+    switch (reason) {
+        case REASON_MARGIN_HIGH:
+            return "margin high";
+        case REASON_MARGIN_LOW:
+            return "margin low";
+        case REASON_FAILURES:
+            return "reports failed";
+        default:
+            return "none";
+    }
+}
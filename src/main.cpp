@@ -17,14 +17,38 @@
 =   wired mode, waking up instantly when the mode switch is toggled.           =
 = - Debouncing: Uses the Bounce2 library for precise and reliable button       =
 =   reading.                                                                   =
+= - Training Mode: Per-button turbo and recorded macros, scheduled on the      =
+=   same fixed scan grid as the physical inputs.                               =
+= - Dual-Core Layout: Inputs are scanned on one core and handed to the         =
+=   Bluetooth stack on the other through a lock-free queue.                    =
 ================================================================================
 */
 
 // --- 1. Library Includes ---
 #include <Arduino.h>
-#include <BleGamepad.h>
 #include <Bounce2.h>
+#include <Preferences.h>
+#include <atomic>
 #include "esp_sleep.h" // Required for low-power sleep mode
+#include "soc/gpio_reg.h"
+#include "AdaptiveBounce.h"
+#include "BleHidGamepad.h"
+#include "ButtonLighting.h"
+#include "FlashWrites.h"
+#include "HeapGuard.h"
+#include "HidDescriptor.h"
+#include "InputPipeline.h"
+#include "InputStages.h"
+#include "LinkHealth.h"
+#include "OtaService.h"
+#include "GamepadReport.h"
+#include "MacroEngine.h"
+#include "ResourceMonitor.h"
+#include "ScanJitter.h"
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include "TelemetryService.h"
+#include "TxPowerController.h"
 
 // --- 2. Definitions and Constants ---
 
@@ -56,41 +80,205 @@ const int MODE_SWITCH_PIN = 23;
 const int STATUS_LED_PIN = 2; // The built-in LED on many ESP32 boards
 
 // --- RESPONSE AND DELAY CONFIGURATION ---
-// Debounce interval in milliseconds. 5ms is a good balance.
-const int DEBOUNCE_INTERVAL_MS = 5;
+// Debounce interval in microseconds. 5000us (5ms) is a good balance.
+const uint32_t DEBOUNCE_INTERVAL_US = 5000;
+
+// Debounce method:
+// - DebouncerUs::PROMPT_DETECTION (default): a press is reported on its very
+//   first edge, then further edges are ignored until the switch settles. This
+//   removes the debounce interval from the press latency entirely.
+// - DebouncerUs::STABLE_INTERVAL: a press is reported once the switch has been
+//   stable for the interval. Filters electrical noise, but adds the interval
+//   to every press.
+const DebouncerUs::Mode DEBOUNCE_MODE = DebouncerUs::PROMPT_DETECTION;
+
+// Adaptive debounce: every switch measures its own bounce and shortens (or
+// lengthens) its interval to the shortest safe value, within the range below.
+// DEBOUNCE_INTERVAL_US is used until a switch has enough measurements.
+// Send 'd' over Serial to see the bounce statistics of every switch.
+const bool ADAPTIVE_DEBOUNCE = true;
+const uint32_t DEBOUNCE_MIN_INTERVAL_US = 1000;
+const uint32_t DEBOUNCE_MAX_INTERVAL_US = 10000;
 
 // Main loop delay in milliseconds.
-// Increasing this value reduces CPU load but INCREASES LATENCY.
-// For fighting games, a very low value (0 or 1) is recommended.
-// 0 = no delay, maximum responsiveness.
-// 1 = a minimal delay to yield some time to background tasks.
-const int MAIN_LOOP_DELAY_MS = 1;
+// The main loop only handles the mode switch, the status LED and Serial
+// commands; inputs are scanned by their own task (see CORE LAYOUT), so this
+// value does not affect input latency.
+const int MAIN_LOOP_DELAY_MS = 5;
+
+// Input scan period in microseconds. A hardware timer wakes the input task on
+// this period, and buttons, turbo and macros are all evaluated on this fixed
+// grid, so their timing does not depend on anything else the firmware does.
+const uint32_t SCAN_PERIOD_US = 1000;
+
+// --- CORE LAYOUT ---
+// The input pipeline (scan, debounce, hotkeys, macros, report build) runs in
+// its own task on the application core. The NimBLE host runs on the protocol
+// core next to the radio controller, together with the task that submits
+// reports to it. The two sides only meet through a lock-free queue of packed
+// reports, so the radio stack never delays a scan and a scan never waits for
+// the radio.
+const BaseType_t INPUT_CORE = 1;
+const BaseType_t BLE_CORE = 0; // Must match CONFIG_BT_NIMBLE_PINNED_TO_CORE
+const UBaseType_t INPUT_TASK_PRIORITY = configMAX_PRIORITIES - 2;
+const UBaseType_t REPORT_TASK_PRIORITY = configMAX_PRIORITIES - 5; // Just below the NimBLE host
+const uint32_t INPUT_TASK_STACK_SIZE = 4096;
+const uint32_t REPORT_TASK_STACK_SIZE = 4096;
+const uint8_t SCAN_TIMER_NUM = 0;
+// Reports waiting for the radio. If it falls this far behind, intermediate
+// reports are merged and only the newest state is sent.
+const size_t REPORT_QUEUE_SIZE = 16;
+#ifdef CONFIG_BT_NIMBLE_PINNED_TO_CORE
+static_assert(BLE_CORE == CONFIG_BT_NIMBLE_PINNED_TO_CORE, "Report task must run on the NimBLE host core");
+#endif
+
+// --- TRAINING MODE CONFIGURATION ---
+// Holding Start + Select opens the hotkey layer (nothing is sent to the host
+// while it is held):
+//   Start + Select + Action button  -> toggle turbo on that button
+//   Start + Select + Up             -> start/stop recording the macro
+//   Start + Select + Down           -> play the recorded macro
+// Holding Start + Select alone for HOST_SELECT_HOLD_US switches the action
+// buttons to host selection instead:
+//   Start + Select (held) + Button N -> switch to host slot N (1-4); choosing
+//                                       the active slot again pairs a new host
+// Turbo rate in presses per second. 30 = pressed one frame, released the next
+// at 60 FPS.
+const uint16_t TURBO_RATE_HZ = 30;
+const uint32_t HOST_SELECT_HOLD_US = 1000000;
+
+// --- MIRROR CONFIGURATION ---
+// Host slot (0-3) whose host stays connected next to the active one and gets
+// a copy of every report, e.g. an input-display/overlay PC while streaming.
+// While the mirror slot is empty, the next new host to connect once the active
+// slot has its host is paired into it.
+// -1 = no mirror. Send 'l' over Serial to see the per-connection statistics.
+const int8_t MIRROR_HOST_SLOT = -1;
+
+// --- TX POWER CONFIGURATION ---
+// When true, the transmit power of each connection follows the link: it
+// starts at full power, steps down while the host is close and the signal is
+// strong, and jumps back up as soon as the signal weakens or a report fails
+// (see TxPowerController.h). Every change is logged over Serial.
+const bool ADAPTIVE_TX_POWER = true;
+const uint32_t TX_POWER_UPDATE_MS = 500;
+
+// --- TELEMETRY CONFIGURATION ---
+// A vendor GATT service streams the input state and the report latency
+// counters to an overlay or analyzer (format in TelemetryService.h). Samples
+// per second; 0 = off until a client writes a rate to the control
+// characteristic. Samples wait up to TELEMETRY_BATCH_MS to share a
+// notification. The stream runs below the report task and gives way to it.
+const uint16_t TELEMETRY_RATE_HZ = 60;
+const uint16_t TELEMETRY_BATCH_MS = 50;
+const UBaseType_t TELEMETRY_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+const uint32_t TELEMETRY_TASK_STACK_SIZE = 3072;
+
+// --- FIRMWARE UPDATE CONFIGURATION ---
+// A bonded host can upload new firmware over Bluetooth with tools/ble_ota.py
+// (protocol in OtaService.h). The OTA task erases and writes the flash while
+// the BLE stack keeps receiving; it runs below the report task so reports go
+// out first, but scan timing is not guaranteed while the flash is written.
+const UBaseType_t OTA_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+const uint32_t OTA_TASK_STACK_SIZE = 3072;
+
+// --- BUTTON LIGHTING CONFIGURATION ---
+// A chain of WS2812 LEDs, one under each button, driven by the RMT
+// peripheral (see ButtonLighting.h). Each LED glows in its colour, flashes on
+// a press and fades after the release. Frames are rendered at a fixed low
+// rate on BLE_CORE and never touch the input core; send 'j' over Serial to
+// measure the scan jitter with the lighting off and on.
+const bool BUTTON_LIGHTING = true;
+const gpio_num_t LIGHTING_DATA_PIN = GPIO_NUM_16;
+const rmt_channel_t LIGHTING_RMT_CHANNEL = RMT_CHANNEL_0;
+const uint16_t LIGHTING_FRAME_RATE_HZ = 60;
+const uint8_t LIGHTING_BRIGHTNESS = 128;  // 0-255
+const uint8_t LIGHTING_IDLE_LEVEL = 40;   // Idle glow, 0-255 of the full colour
+const UBaseType_t LIGHTING_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+const uint32_t LIGHTING_TASK_STACK_SIZE = 3072;
+// How long each half of the 'j' benchmark measures.
+const uint32_t LIGHTING_BENCHMARK_MS = 10000;
+
+// --- DIRECTION OUTPUT CONFIGURATION ---
+// How the joystick is reported to the host. Many PC games only read analog
+// sticks, so the lever can also drive the stick axes instead of the hat.
+// Cycle through the modes with Start + Select + Left/Right.
+enum DirectionMode : uint8_t {
+    DIRECTION_MODE_HAT,         // D-pad (hat switch) only
+    DIRECTION_MODE_LEFT_STICK,  // Left analog stick only
+    DIRECTION_MODE_RIGHT_STICK, // Right analog stick only
+    DIRECTION_MODE_BOTH_STICKS, // Left and right analog sticks together
+    DIRECTION_MODE_COUNT
+};
+const DirectionMode DEFAULT_DIRECTION_MODE = DIRECTION_MODE_HAT;
+
+// --- SOCD CONFIGURATION ---
+// What opposing directions held together (left + right, up + down) report;
+// see SocdMode in InputStages.h.
+const SocdMode SOCD_MODE = SOCD_UP_LEFT_PRIORITY;
+
+// --- FLASH WRITE CONFIGURATION ---
+// Writing the flash stalls both cores, the input task included, for as long
+// as the write takes. Settings that change while the stick is in use (the
+// host slot table and the bonds) are therefore kept in RAM and only written
+// once nothing has been held or sent for FLASH_WRITE_IDLE_MS. Send 'n' over
+// Serial to measure the stall of a forced write.
+const uint32_t FLASH_WRITE_IDLE_MS = 2000;
+// The 'n' test: how many forced NVS writes, of how many bytes, and the pause
+// after each one.
+const uint8_t FLASH_STALL_TEST_WRITES = 20;
+const size_t FLASH_STALL_TEST_BYTES = 256;
+const uint32_t FLASH_STALL_TEST_GAP_MS = 50;
+const char* const FLASH_STALL_TEST_NAMESPACE = "stalltest";
+
+// --- RESOURCE MONITOR CONFIGURATION ---
+// The stacks of the firmware's tasks, the loop task and the NimBLE host, the
+// heap and NimBLE's memory pools are sampled every RESOURCE_SAMPLE_MS. Send
+// 'r' over Serial for the lows seen so far; they are also in the telemetry
+// stream. A stack that has come within STACK_LOW_MARGIN_BYTES of its end is
+// marked LOW.
+const uint32_t RESOURCE_SAMPLE_MS = 1000;
+const uint32_t STACK_LOW_MARGIN_BYTES = 512;
+
+// --- NOTIFY BENCHMARK ---
+// Notifications sent by the 'b' benchmark (see runNotifyBenchmark()). It
+// sends as fast as NimBLE frees mbufs, waiting for a tick whenever fewer than
+// NOTIFY_BENCHMARK_MBUF_RESERVE are left, so it measures what the stack and
+// the connection interval sustain rather than how soon the pool runs dry.
+const uint32_t NOTIFY_BENCHMARK_REPORTS = 1000;
+const int NOTIFY_BENCHMARK_MBUF_RESERVE = 4;
 
 // --- 3. Global Variables and Objects ---
 
 // Bluetooth Gamepad Object
 // The name that will appear when scanning for Bluetooth devices.
 // The 100 represents the initial battery level.
-BleGamepad bleGamepad("ArcadeStickESP32", "MatMont01", 100);
+BleHidGamepad bleGamepad("ArcadeStickESP32", "MatMont01", 100);
 
 // --- Button Debouncing ---
-const int TOTAL_BUTTONS = 10; // 8 action + Start + Select
-Bounce buttonDebouncers[TOTAL_BUTTONS];
+// TOTAL_BUTTONS is in InputStages.h, with the report layout it sizes.
+AdaptiveBounce buttonDebouncers[TOTAL_BUTTONS];
 const int buttonPins[TOTAL_BUTTONS] = {
     ACTION_BUTTON_PIN_1, ACTION_BUTTON_PIN_2, ACTION_BUTTON_PIN_3, ACTION_BUTTON_PIN_4,
     ACTION_BUTTON_PIN_5, ACTION_BUTTON_PIN_6, ACTION_BUTTON_PIN_7, ACTION_BUTTON_PIN_8,
     START_BUTTON_PIN, SELECT_BUTTON_PIN
 };
-// Map our physical pins to the buttons the OS will understand.
-const int gamepadButtonMap[TOTAL_BUTTONS] = {
-    BUTTON_1, BUTTON_2, BUTTON_3, BUTTON_4,
-    BUTTON_5, BUTTON_6, BUTTON_7, BUTTON_8,
-    BUTTON_9,  // Mapped to Start
-    BUTTON_10 // Mapped to Select
+// Map our physical pins to the buttons the OS will understand (1-based).
+// Read on every scan, so it is kept in DRAM (see 5. Input Pipeline).
+DRAM_ATTR const int gamepadButtonMap[TOTAL_BUTTONS] = {
+    1, 2, 3, 4,
+    5, 6, 7, 8,
+    9,  // Mapped to Start
+    10 // Mapped to Select
 };
 
+// Button indexes (into buttonPins) that form the hotkey layer chord.
+const int START_BUTTON_INDEX = 8;
+const int SELECT_BUTTON_INDEX = 9;
+const uint16_t HOTKEY_CHORD_MASK = (1 << START_BUTTON_INDEX) | (1 << SELECT_BUTTON_INDEX);
+
 // --- Joystick Debouncing ---
-Bounce joystickDebouncers[4];
+AdaptiveBounce joystickDebouncers[4];
 const int joystickPins[4] = {
     JOYSTICK_UP_PIN, JOYSTICK_DOWN_PIN, JOYSTICK_LEFT_PIN, JOYSTICK_RIGHT_PIN
 };
@@ -101,25 +289,273 @@ Bounce modeDebouncer = Bounce();
 // when waking up from sleep mode.
 volatile bool isWirelessMode = true;
 
+// --- Report Building ---
+// Turbo and macro playback, merged into every report.
+MacroEngine macroEngine;
+// The last report queued for the BLE stack; only changes are sent.
+GamepadReport lastSentReport = EMPTY_GAMEPAD_REPORT;
+// bleGamepad.getLinksAdded() when lastSentReport was last reset.
+uint32_t linksAddedSeen = 0;
+// Timestamp of the next scheduled input scan.
+uint32_t nextScanUs = 0;
+
+// --- Task Handoff ---
+// A packed report and the scan it comes from.
+struct QueuedReport {
+    StickReportLayout::Report packed;
+    uint32_t scanTimeUs;
+};
+// Reports from the input task (producer) to the report task (consumer).
+SpscQueue<QueuedReport, REPORT_QUEUE_SIZE> reportQueue;
+TaskHandle_t inputTaskHandle = nullptr;
+TaskHandle_t reportTaskHandle = nullptr;
+TaskHandle_t telemetryTaskHandle = nullptr;
+TaskHandle_t otaTaskHandle = nullptr;
+TaskHandle_t lightingTaskHandle = nullptr;
+hw_timer_t* scanTimer = nullptr;
+// Reports are only submitted while the BLE stack is up. The report task marks
+// itself busy around each submission so the stack is never stopped under it.
+std::atomic<bool> reportPathOpen(false);
+std::atomic<bool> reportSubmitting(false);
+// The last report the report task submitted, which the notify benchmark sends
+// again; only the report task touches it.
+QueuedReport lastSubmittedReport;
+bool reportSubmitted = false;
+
+// --- Notify Benchmark ---
+// Requested by the loop task, run by the report task (the only one that ever
+// calls sendReport()), then read by the loop task once done is set.
+struct NotifyBenchmark {
+    uint32_t sent;
+    uint32_t failed;
+    uint32_t mbufWaits;   // Ticks spent waiting for NimBLE to free mbufs
+    uint32_t elapsedUs;
+    uint32_t fewestCycles;
+    uint64_t totalCycles;
+    uint32_t allocations; // During the run, any task (esp32dev_zero_heap build only)
+};
+NotifyBenchmark notifyBenchmark;
+std::atomic<bool> notifyBenchmarkRequested(false);
+std::atomic<bool> notifyBenchmarkDone(false);
+
+// Host slot chosen with the hotkey layer, applied by the main loop; -1 = none.
+std::atomic<int8_t> requestedHostSlot(-1);
+
+// What the hotkey layer did, printed by the main loop: the input task never
+// waits for the UART. Events the loop has not caught up with are dropped.
+enum HotkeyEventType : uint8_t {
+    HOTKEY_HOST_SELECT,    // The chord was held: buttons now pick a host slot
+    HOTKEY_TURBO,          // value = button index, on = turbo now on
+    HOTKEY_RECORDING,      // Macro recording started
+    HOTKEY_RECORDED,       // value = steps recorded
+    HOTKEY_DIRECTION_MODE  // value = the new DirectionMode
+};
+struct HotkeyEvent {
+    HotkeyEventType type;
+    uint8_t value;
+    bool on;
+};
+const size_t HOTKEY_EVENT_QUEUE_SIZE = 8;
+SpscQueue<HotkeyEvent, HOTKEY_EVENT_QUEUE_SIZE> hotkeyEvents;
+
+// --- Published Input State ---
+// Written by the input task once per scan; any other task reads it with
+// inputSnapshot.read() instead of touching the debouncers. The input task
+// never waits for a reader.
+SeqLock<InputSnapshot> inputSnapshot;
+uint32_t scansPublished = 0;
+// Settings are only written to flash once no scan has had anything held or
+// sent for FLASH_WRITE_IDLE_MS.
+FlashWriteWindow flashWriteWindow(FLASH_WRITE_IDLE_MS);
+TelemetryService telemetry(inputSnapshot, bleGamepad, TELEMETRY_RATE_HZ, TELEMETRY_BATCH_MS);
+
+// --- TX Power ---
+// One controller per connection, with the connection it is controlling and
+// that connection's failure count at the last update.
+TxPowerController txPower[BleHidGamepad::MAX_LINKS];
+uint16_t txPowerLink[BleHidGamepad::MAX_LINKS] = {BLE_HS_CONN_HANDLE_NONE, BLE_HS_CONN_HANDLE_NONE};
+uint32_t txPowerFailures[BleHidGamepad::MAX_LINKS] = {};
+
+// --- Link Health ---
+// Notification results, buffer and queue pressure and connection events,
+// kept through soft resets. Send 'h' over Serial to dump it.
+LinkHealth linkHealth;
+
+// --- Firmware Update ---
+OtaService ota;
+
+// --- Resource Usage ---
+// Stack, heap and NimBLE pool lows, sampled by the main loop.
+ResourceMonitor resources;
+
+// --- Scan Timing ---
+// How far each scan starts from its slot on the grid, recorded by the input
+// task. Send 'j' over Serial to compare it with the lighting off and on.
+ScanJitter scanJitter;
+
+// --- Button Lighting ---
+// LEDs in chain order: the button (index into buttonPins) each one lights
+// and its colour.
+const int8_t lightingLedButtons[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+const ButtonLighting::Color lightingColors[] = {
+    {255, 0, 0},   {255, 128, 0}, {255, 255, 0}, {0, 255, 0},   // Top row
+    {0, 0, 255},   {128, 0, 255}, {255, 0, 255}, {0, 255, 255}, // Bottom row
+    {255, 255, 255}, {255, 255, 255}                            // Start, Select
+};
+static_assert(sizeof(lightingLedButtons) == sizeof(lightingColors) / sizeof(lightingColors[0]),
+              "Every LED needs a colour");
+ButtonLighting lighting(inputSnapshot);
+
+// The 'j' benchmark: scan jitter with the lighting off, then on.
+enum LightingBenchmarkPhase : uint8_t {
+    BENCHMARK_IDLE,
+    BENCHMARK_LIGHTING_OFF,
+    BENCHMARK_LIGHTING_ON
+};
+LightingBenchmarkPhase benchmarkPhase = BENCHMARK_IDLE;
+uint32_t benchmarkPhaseStartMs = 0;
+bool benchmarkLightingWasEnabled = false;
+ScanJitter::Stats benchmarkOffStats;
+uint32_t benchmarkFramesSent = 0;    // Frame counters when the lighting came on
+uint32_t benchmarkFramesSkipped = 0;
+
+// --- Direction Output ---
+// One precomputed report template per direction mode, indexed by hat value.
+// Switching modes only swaps the active table; the BLE report layout always
+// carries the hat and both sticks, so the stack never has to be restarted.
+const int HAT_POSITIONS = 9; // Centered + 8 directions
+GamepadReport directionTemplates[DIRECTION_MODE_COUNT][HAT_POSITIONS];
+DirectionMode directionMode = DEFAULT_DIRECTION_MODE;
+const GamepadReport* activeDirectionTemplate = directionTemplates[DEFAULT_DIRECTION_MODE];
+
 // --- 4. Function Prototypes ---
 void initializePins();
-void manageInputs();
-void readAndProcessButtons();
-void readAndProcessJoystick();
+void watchTaskStacks();
+void startTasks();
+void inputTask(void* parameter);
+void reportTask(void* parameter);
+void measureNotifyPath();
+void telemetryTask(void* parameter);
+void otaTask(void* parameter);
+void lightingTask(void* parameter);
+void onScanTimer();
+uint32_t nextScanTime();
+void manageInputs(uint32_t scanTimeUs);
+GamepadReport processHotkeys(uint32_t scanTimeUs, const GamepadReport& physical);
+void buildDirectionTemplates();
+void setDirectionMode(DirectionMode mode);
+void applyDirectionMode(GamepadReport& report);
+void queueGamepadReport(const InputFrame& frame);
+void openReportPath();
+void closeReportPath();
 void manageModeSwitch();
+void manageHostSlots();
+void printHotkeyEvents();
+void manageTxPower();
+void manageFlashWrites();
+void manageResources();
+void startLightingBenchmark();
+void manageLightingBenchmark();
 void activateWirelessMode();
 void deactivateForWiredMode();
 void enterLightSleepMode();
 void manageStatusLED();
+void publishInputSnapshot(uint32_t scanTimeUs, const GamepadReport& physical, const GamepadReport& output);
+void manageSerialCommands();
+void printInputSnapshot();
+void printLinkStats();
+void printLinkHealth();
+void printOtaStatus();
+void printHeapGuard();
+void printResources();
+void printScanJitterHeader(const char* title);
+void printScanJitter(const char* label, const ScanJitter::Stats& stats);
+void printSwitchStats(const char* name, const AdaptiveBounce& debouncer);
+void printDebounceStats();
+void runFlashStallTest();
+void runNotifyBenchmark();
+
+// --- 5. Input Pipeline ---
+// One scan is one run of the pipeline over a single InputFrame. Each stage
+// fills in its part of the frame; see InputPipeline.h. The stages that only
+// work on the frame are in InputStages.h, where the native pipeline benchmark
+// (test/test_pipeline_benchmark) runs them too; those that touch the hardware
+// or the firmware's state are here. To add a feature to the input path, add a
+// stage and list it in StickPipeline.
+// The scan runs from IRAM: the input task and the firmware functions a scan
+// calls are IRAM_ATTR, and so are the MacroEngine and AdaptiveBounce members
+// it reaches and, with BOUNCE2_UPDATE_IN_IRAM, Bounce2's update(). The stages
+// and the header-only helpers (SeqLock::write(), SpscQueue::push(),
+// ScanJitter::record()) are forced inline into the IRAM callers, and the
+// tables a scan reads are DRAM_ATTR. The hotkey layer queues its messages for
+// the main loop (see printHotkeyEvents()) instead of printing. Outside the
+// firmware, micros() is IRAM_ATTR in the Arduino core and the FreeRTOS calls
+// are in IRAM in the default ESP-IDF configuration. A flash write still
+// stalls the scan, hence FLASH WRITE CONFIGURATION.
 
-// --- 5. Setup Function ---
+/**
+ * @brief Reads every GPIO at once: two register reads for all switches.
+ */
+struct ScanStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        frame.levels = REG_READ(GPIO_IN_REG) | ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);
+    }
+};
+
+/**
+ * @brief The Start + Select hotkey layer; see processHotkeys().
+ */
+struct HotkeyStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        frame.report = processHotkeys(frame.scanTimeUs, frame.physical);
+    }
+};
+
+/**
+ * @brief Applies the direction mode to the hat and sticks.
+ */
+struct DirectionStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        applyDirectionMode(frame.report);
+    }
+};
+
+/**
+ * @brief Queues the report for the report task and publishes the scan.
+ */
+struct HandOffStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        queueGamepadReport(frame);
+        publishInputSnapshot(frame.scanTimeUs, frame.physical, frame.report);
+    }
+};
+
+using StickPipeline = Pipeline<ScanStage, DebounceStage, SocdStage, HotkeyStage, MacroStage,
+                               DirectionStage, RemapStage, ReportBuildStage, HandOffStage>;
+StickPipeline stickPipeline(ScanStage(), DebounceStage{buttonDebouncers, joystickDebouncers},
+                            SocdStage{SOCD_MODE, 0, 0, 0}, HotkeyStage(), MacroStage{&macroEngine},
+                            DirectionStage(), RemapStage{gamepadButtonMap}, ReportBuildStage(),
+                            HandOffStage());
+
+// --- 6. Setup Function ---
 void setup() {
     Serial.begin(115200);
     Serial.println("\n\n===============================================");
     Serial.println("=   Hybrid Arcade Stick - Firmware v1.0       =");
     Serial.println("===============================================");
+    Serial.println("Send 'd' for debounce statistics, 'i' for the input state, 'l' for the links,");
+    Serial.println("'h' for the link health record ('H' clears it), 'o' for the firmware update,");
+    Serial.println("'j' to benchmark the scan jitter with the lighting off and on, 'n' to measure");
+    Serial.println("the scan stall of a flash write, 'm' for the heap allocations made since boot");
+    Serial.println("(esp32dev_zero_heap build only), 'r' for the stack, heap and Bluetooth buffer");
+    Serial.println("usage, 'b' to benchmark the report notifications.");
 
+    linkHealth.begin();
+    bleGamepad.setHealthMonitor(&linkHealth);
+    watchTaskStacks();
+    telemetry.setResourceMonitor(&resources);
     initializePins();
+    buildDirectionTemplates();
 
     // Determine the initial mode based on the pin reading.
     // This is useful if the mode switch is already in a position at power-on.
@@ -128,25 +564,39 @@ void setup() {
 
     if (isWirelessMode) {
         activateWirelessMode();
+        // What the NimBLE build profile costs at boot (see platformio.ini and
+        // tools/nimble_profile_report.py).
+        Serial.printf("Bluetooth advertising %lu ms after boot, free heap %lu bytes.\n",
+                      (unsigned long)millis(), (unsigned long)ESP.getFreeHeap());
     } else {
         deactivateForWiredMode();
     }
+
+    startTasks();
+    // Everything is allocated by now: from here on, every allocation is
+    // traced (esp32dev_zero_heap build only), the scan, report and notify
+    // path's apart from the rest.
+    HeapGuard::markHotTask(inputTaskHandle);
+    HeapGuard::markHotTask(reportTaskHandle);
+    HeapGuard::markHotTask(telemetryTaskHandle);
+    HeapGuard::arm();
 }
 
-// --- 6. Main Loop ---
+// --- 7. Main Loop ---
 void loop() {
-    // The main loop is now much simpler and faster.
-    // It delegates logic to specific functions based on the current mode.
+    // Inputs are handled by the input task; the main loop only deals with
+    // the slow, housekeeping parts of each mode.
     if (isWirelessMode) {
         manageModeSwitch(); // Check if we need to switch to wired mode
-        if (bleGamepad.isConnected()) {
-            manageInputs(); // Process buttons and joystick
-        }
+        manageHostSlots(); // Apply host slot switches requested by hotkey
+        printHotkeyEvents(); // Report what the hotkey layer did
+        manageTxPower(); // Follow each link with its transmit power
+        manageFlashWrites(); // Save changed settings while the stick is idle
+        manageResources(); // Sample the stack, heap and pool usage
+        manageLightingBenchmark(); // Advance a running 'j' benchmark
         manageStatusLED(); // Update the status LED
-        
-        // Add a configurable delay at the end of the wireless mode loop.
-        // This yields processing time to other ESP32 tasks (like the Bluetooth stack).
-        // It's not strictly necessary for latency but can improve stability.
+        manageSerialCommands(); // Diagnostics requested over Serial
+
         if (MAIN_LOOP_DELAY_MS > 0) {
             delay(MAIN_LOOP_DELAY_MS);
         }
@@ -158,7 +608,7 @@ void loop() {
     }
 }
 
-// --- 7. Function Implementations ---
+// --- 8. Function Implementations ---
 
 /**
  * @brief Initializes all input pins, debouncers, and the LED.
@@ -166,12 +616,20 @@ void loop() {
 void initializePins() {
     for (int i = 0; i < TOTAL_BUTTONS; i++) {
         buttonDebouncers[i].attach(buttonPins[i], INPUT_PULLUP);
-        buttonDebouncers[i].interval(DEBOUNCE_INTERVAL_MS);
+        buttonDebouncers[i].setMode(DEBOUNCE_MODE);
+        buttonDebouncers[i].interval(DEBOUNCE_INTERVAL_US);
+        if (ADAPTIVE_DEBOUNCE) {
+            buttonDebouncers[i].enableAdaptive(DEBOUNCE_MIN_INTERVAL_US, DEBOUNCE_MAX_INTERVAL_US);
+        }
     }
 
     for (int i = 0; i < 4; i++) {
         joystickDebouncers[i].attach(joystickPins[i], INPUT_PULLUP);
-        joystickDebouncers[i].interval(DEBOUNCE_INTERVAL_MS);
+        joystickDebouncers[i].setMode(DEBOUNCE_MODE);
+        joystickDebouncers[i].interval(DEBOUNCE_INTERVAL_US);
+        if (ADAPTIVE_DEBOUNCE) {
+            joystickDebouncers[i].enableAdaptive(DEBOUNCE_MIN_INTERVAL_US, DEBOUNCE_MAX_INTERVAL_US);
+        }
     }
 
     modeDebouncer.attach(MODE_SWITCH_PIN, INPUT_PULLUP);
@@ -180,57 +638,426 @@ void initializePins() {
     pinMode(STATUS_LED_PIN, OUTPUT);
 }
 
+/**
+ * @brief Registers every task whose stack the resource monitor follows, with
+ * the size it is created with.
+ */
+void watchTaskStacks() {
+    resources.watchTask("loopTask", getArduinoLoopTaskStackSize());
+    resources.watchTask("nimble_host", CONFIG_BT_NIMBLE_HOST_TASK_STACK_SIZE);
+    resources.watchTask("input", INPUT_TASK_STACK_SIZE);
+    resources.watchTask("report", REPORT_TASK_STACK_SIZE);
+    resources.watchTask("telemetry", TELEMETRY_TASK_STACK_SIZE);
+    resources.watchTask("ota", OTA_TASK_STACK_SIZE);
+    if (BUTTON_LIGHTING) {
+        resources.watchTask("lighting", LIGHTING_TASK_STACK_SIZE);
+    }
+}
+
+/**
+ * @brief Starts the input task and the report task on their cores.
+ */
+void startTasks() {
+    xTaskCreatePinnedToCore(reportTask, "report", REPORT_TASK_STACK_SIZE, nullptr,
+                            REPORT_TASK_PRIORITY, &reportTaskHandle, BLE_CORE);
+    xTaskCreatePinnedToCore(telemetryTask, "telemetry", TELEMETRY_TASK_STACK_SIZE, nullptr,
+                            TELEMETRY_TASK_PRIORITY, &telemetryTaskHandle, BLE_CORE);
+    xTaskCreatePinnedToCore(otaTask, "ota", OTA_TASK_STACK_SIZE, nullptr,
+                            OTA_TASK_PRIORITY, &otaTaskHandle, BLE_CORE);
+    ota.setWriterTask(otaTaskHandle);
+    if (BUTTON_LIGHTING) {
+        xTaskCreatePinnedToCore(lightingTask, "lighting", LIGHTING_TASK_STACK_SIZE, nullptr,
+                                LIGHTING_TASK_PRIORITY, &lightingTaskHandle, BLE_CORE);
+    }
+    xTaskCreatePinnedToCore(inputTask, "input", INPUT_TASK_STACK_SIZE, nullptr,
+                            INPUT_TASK_PRIORITY, &inputTaskHandle, INPUT_CORE);
+}
+
+/**
+ * @brief Wakes the input task once per scan period.
+ */
+void IRAM_ATTR onScanTimer() {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(inputTaskHandle, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief The input pipeline: one scan per timer tick, on INPUT_CORE.
+ */
+void IRAM_ATTR inputTask(void* parameter) {
+    // The timer interrupt is allocated on the core that attaches it, so it is
+    // set up here to keep it on the input core as well.
+    scanTimer = timerBegin(SCAN_TIMER_NUM, 80, true); // 80 MHz APB / 80 = 1 tick per us
+    timerAttachInterrupt(scanTimer, onScanTimer, true);
+    timerAlarmWrite(scanTimer, SCAN_PERIOD_US, true);
+    timerAlarmEnable(scanTimer);
+
+    for (;;) {
+        // Ticks that arrived while a scan was running are merged into one.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        const uint32_t scanTimeUs = nextScanTime();
+        // Inputs are scanned while disconnected too, so the hotkey layer can
+        // switch to a host slot whose host is not connected.
+        if (isWirelessMode) {
+            manageInputs(scanTimeUs);
+        }
+    }
+}
+
+/**
+ * @brief Submits queued reports to the BLE stack, on BLE_CORE.
+ * Woken by the input task whenever it queues a report.
+ */
+void reportTask(void* parameter) {
+    QueuedReport queued;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        linkHealth.recordQueueDepth(reportQueue.size());
+        while (reportQueue.pop(queued)) {
+            reportSubmitting = true;
+            if (reportPathOpen &&
+                bleGamepad.sendReport(queued.packed.bytes, sizeof(queued.packed.bytes), queued.scanTimeUs)) {
+                // For a host pairing what it received with what was sent.
+                telemetry.logReport(queued.packed.bytes, sizeof(queued.packed.bytes), queued.scanTimeUs, micros());
+                lastSubmittedReport = queued;
+                reportSubmitted = true;
+            }
+            reportSubmitting = false;
+            // Reports popped while the path is closed are stale; drop them.
+        }
+        // Reports the input task queues meanwhile wait, or overflow and are
+        // retried on a later scan, so no input is lost to the benchmark.
+        if (notifyBenchmarkRequested) {
+            reportSubmitting = true;
+            measureNotifyPath();
+            reportSubmitting = false;
+            notifyBenchmarkRequested = false;
+            notifyBenchmarkDone = true;
+        }
+    }
+}
+
+/**
+ * @brief Sends the last submitted report NOTIFY_BENCHMARK_REPORTS times, on
+ * the report task, and times each sendReport(). The host sees the same state
+ * over and over, so nothing it reads as input changes.
+ */
+void measureNotifyPath() {
+    NotifyBenchmark result = {};
+    result.fewestCycles = UINT32_MAX;
+    HeapGuard::Totals before;
+    HeapGuard::getTotals(before);
+    const uint32_t startUs = micros();
+    for (uint32_t i = 0; i < NOTIFY_BENCHMARK_REPORTS && reportSubmitted && reportPathOpen; i++) {
+        while (os_msys_num_free() < NOTIFY_BENCHMARK_MBUF_RESERVE && reportPathOpen && bleGamepad.isConnected()) {
+            result.mbufWaits++;
+            vTaskDelay(1);
+        }
+        const uint32_t start = ESP.getCycleCount();
+        const bool sent = bleGamepad.sendReport(lastSubmittedReport.packed.bytes,
+                                                sizeof(lastSubmittedReport.packed.bytes), micros());
+        const uint32_t cycles = ESP.getCycleCount() - start;
+        result.totalCycles += cycles;
+        if (cycles < result.fewestCycles) {
+            result.fewestCycles = cycles;
+        }
+        if (sent) {
+            result.sent++;
+        } else {
+            result.failed++;
+        }
+    }
+    result.elapsedUs = micros() - startUs;
+    HeapGuard::Totals after;
+    HeapGuard::getTotals(after);
+    result.allocations = (after.hotCount + after.otherCount) - (before.hotCount + before.otherCount);
+    notifyBenchmark = result;
+}
+
+/**
+ * @brief Samples the input state for the telemetry stream, on BLE_CORE at the
+ * lowest priority that still runs, once per sample period.
+ */
+void telemetryTask(void* parameter) {
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        const uint16_t rateHz = telemetry.getRate();
+        if (rateHz == 0) {
+            vTaskDelay(pdMS_TO_TICKS(100)); // Off; check again for a new rate
+            lastWake = xTaskGetTickCount();
+            continue;
+        }
+        const TickType_t period = pdMS_TO_TICKS(1000 / rateHz);
+        vTaskDelayUntil(&lastWake, period > 0 ? period : 1);
+        telemetry.poll(micros());
+    }
+}
+
+/**
+ * @brief Writes received firmware chunks to flash, on BLE_CORE.
+ * Woken by the OTA service whenever it queues a chunk or command.
+ */
+void otaTask(void* parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ota.process();
+    }
+}
+
+/**
+ * @brief Renders and sends the button lighting, on BLE_CORE at a fixed frame
+ * rate. The RMT driver is installed here so its interrupt is on this core too.
+ */
+void lightingTask(void* parameter) {
+    const uint8_t ledCount = sizeof(lightingLedButtons);
+    if (!lighting.begin(LIGHTING_DATA_PIN, LIGHTING_RMT_CHANNEL, lightingLedButtons, ledCount)) {
+        Serial.println("Button lighting: RMT setup failed.");
+        vTaskDelete(nullptr);
+    }
+    for (uint8_t i = 0; i < ledCount; i++) {
+        lighting.setColor(i, lightingColors[i]);
+    }
+    lighting.setBrightness(LIGHTING_BRIGHTNESS, LIGHTING_IDLE_LEVEL);
+
+    TickType_t lastWake = xTaskGetTickCount();
+    const TickType_t period = pdMS_TO_TICKS(1000 / LIGHTING_FRAME_RATE_HZ);
+    for (;;) {
+        vTaskDelayUntil(&lastWake, period > 0 ? period : 1);
+        lighting.update(millis());
+    }
+}
+
+/**
+ * @brief Returns the timestamp of the scan that is running now.
+ * Scans are scheduled on a fixed grid of SCAN_PERIOD_US. The timestamp handed
+ * out is the scheduled one, not the time the task happened to wake up, so
+ * everything driven by it (turbo, macros) lands on exact multiples of the
+ * scan period.
+ */
+uint32_t IRAM_ATTR nextScanTime() {
+    const uint32_t now = micros();
+    uint32_t scanTimeUs = nextScanUs;
+    const int32_t offsetUs = (int32_t)(now - scanTimeUs);
+    scanJitter.record(offsetUs, SCAN_PERIOD_US);
+    if (offsetUs > (int32_t)(SCAN_PERIOD_US / 2) || offsetUs < -(int32_t)(SCAN_PERIOD_US / 2)) {
+        // The grid no longer matches the timer (first scan, or ticks were
+        // missed). Restart it here instead of replaying the missed scans.
+        scanTimeUs = now;
+    }
+    nextScanUs = scanTimeUs + SCAN_PERIOD_US;
+    return scanTimeUs;
+}
+
 /**
  * @brief Main function to process all player inputs.
- * Called continuously only in wireless and connected mode.
+ * Called once per scan period in wireless mode.
+ * Physical inputs, hotkeys, turbo and macros are merged into a single report,
+ * which is then sent to the host; see StickPipeline for the stages.
+ */
+void IRAM_ATTR manageInputs(uint32_t scanTimeUs) {
+    InputFrame frame;
+    frame.scanTimeUs = scanTimeUs;
+    stickPipeline.run(frame);
+}
+
+/**
+ * @brief Publishes the outcome of a scan for readers on other tasks.
  */
-void manageInputs() {
-    readAndProcessButtons();
-    readAndProcessJoystick();
+void IRAM_ATTR publishInputSnapshot(uint32_t scanTimeUs, const GamepadReport& physical, const GamepadReport& output) {
+    InputSnapshot snapshot;
+    snapshot.sequence = ++scansPublished;
+    snapshot.scanTimeUs = scanTimeUs;
+    snapshot.physical = physical;
+    snapshot.output = output;
+    inputSnapshot.write(snapshot);
+    if (physical != EMPTY_GAMEPAD_REPORT || output != EMPTY_GAMEPAD_REPORT) {
+        flashWriteWindow.recordActivity(scanTimeUs);
+    }
 }
 
 /**
- * @brief Reads the state of all buttons and updates the gamepad state.
- * The report sending is handled automatically by the BleGamepad library.
+ * @brief Handles the Start + Select hotkey layer.
+ * While the chord is held, every other input is consumed as a command and
+ * an empty report is returned, so nothing leaks to the game or into a macro
+ * being recorded.
  */
-void readAndProcessButtons() {
+GamepadReport IRAM_ATTR processHotkeys(uint32_t scanTimeUs, const GamepadReport& physical) {
+    static uint16_t previousButtons = 0;
+    static uint8_t previousHat = HAT_CENTERED;
+    static bool chordHeld = false;
+    static uint32_t chordSinceUs = 0;
+    static bool chordUsed = false; // A command was given since the chord formed
+    static bool hostSelectShown = false;
+
+    const uint16_t pressed = physical.buttons & ~previousButtons;
+    const bool hatChanged = physical.hat != previousHat;
+    previousButtons = physical.buttons;
+    previousHat = physical.hat;
+
+    if ((physical.buttons & HOTKEY_CHORD_MASK) != HOTKEY_CHORD_MASK) {
+        chordHeld = false;
+        return physical;
+    }
+
+    if (!chordHeld) {
+        chordHeld = true;
+        chordSinceUs = scanTimeUs;
+        chordUsed = false;
+        hostSelectShown = false;
+    }
+    // Holding the chord alone for a while turns the action buttons into
+    // host slot selectors.
+    const bool hostSelect = !chordUsed && scanTimeUs - chordSinceUs >= HOST_SELECT_HOLD_US;
+    if (hostSelect && !hostSelectShown) {
+        hostSelectShown = true;
+        hotkeyEvents.push({HOTKEY_HOST_SELECT, 0, false});
+    }
+
     for (int i = 0; i < TOTAL_BUTTONS; i++) {
-        buttonDebouncers[i].update();
-        if (buttonDebouncers[i].fell()) { // If the button was pressed
-            bleGamepad.press(gamepadButtonMap[i]);
-        } else if (buttonDebouncers[i].rose()) { // If the button was released
-            bleGamepad.release(gamepadButtonMap[i]);
+        if ((pressed & (1 << i)) && !(HOTKEY_CHORD_MASK & (1 << i))) {
+            if (hostSelect) {
+                if (i < BleHidGamepad::HOST_SLOT_COUNT) {
+                    requestedHostSlot = i;
+                }
+                continue;
+            }
+            const uint16_t rate = macroEngine.getTurbo(i) ? 0 : TURBO_RATE_HZ;
+            macroEngine.setTurbo(i, rate);
+            hotkeyEvents.push({HOTKEY_TURBO, (uint8_t)i, rate != 0});
+            chordUsed = true;
+        }
+    }
+
+    if (hatChanged && physical.hat != HAT_CENTERED) {
+        chordUsed = true;
+    }
+
+    if (hatChanged && physical.hat == HAT_UP) {
+        if (macroEngine.isRecording()) {
+            macroEngine.stopRecording(scanTimeUs);
+            hotkeyEvents.push({HOTKEY_RECORDED, macroEngine.getStepCount(), false});
+        } else {
+            macroEngine.startRecording(scanTimeUs);
+            hotkeyEvents.push({HOTKEY_RECORDING, 0, true});
         }
+    } else if (hatChanged && physical.hat == HAT_DOWN) {
+        macroEngine.play(scanTimeUs);
+    } else if (hatChanged && physical.hat == HAT_RIGHT) {
+        setDirectionMode((DirectionMode)((directionMode + 1) % DIRECTION_MODE_COUNT));
+    } else if (hatChanged && physical.hat == HAT_LEFT) {
+        setDirectionMode((DirectionMode)((directionMode + DIRECTION_MODE_COUNT - 1) % DIRECTION_MODE_COUNT));
     }
+
+    return EMPTY_GAMEPAD_REPORT;
 }
 
 /**
- * @brief Reads the joystick state and maps it to the Hat Switch (DPAD).
+ * @brief Precomputes the report template of every direction mode.
+ * Each template holds the hat and stick values for one hat position, so
+ * applying a mode at scan time is a single table lookup.
  */
-void readAndProcessJoystick() {
-    for (int i = 0; i < 4; i++) {
-        joystickDebouncers[i].update();
-    }
-
-    bool up = !joystickDebouncers[0].read();
-    bool down = !joystickDebouncers[1].read();
-    bool left = !joystickDebouncers[2].read();
-    bool right = !joystickDebouncers[3].read();
-
-    if (up) {
-        if (left) bleGamepad.setHat(HAT_UP_LEFT);
-        else if (right) bleGamepad.setHat(HAT_UP_RIGHT);
-        else bleGamepad.setHat(HAT_UP);
-    } else if (down) {
-        if (left) bleGamepad.setHat(HAT_DOWN_LEFT);
-        else if (right) bleGamepad.setHat(HAT_DOWN_RIGHT);
-        else bleGamepad.setHat(HAT_DOWN);
-    } else if (left) {
-        bleGamepad.setHat(HAT_LEFT);
-    } else if (right) {
-        bleGamepad.setHat(HAT_RIGHT);
-    } else {
-        bleGamepad.setHat(HAT_CENTERED);
+void buildDirectionTemplates() {
+    // Direction of each hat value (index = hat), with +Y pointing down as in HID.
+    static const int8_t hatX[HAT_POSITIONS] = {0, 0, 1, 1, 1, 0, -1, -1, -1};
+    static const int8_t hatY[HAT_POSITIONS] = {0, -1, -1, 0, 1, 1, 1, 0, -1};
+
+    for (int mode = 0; mode < DIRECTION_MODE_COUNT; mode++) {
+        for (int hat = 0; hat < HAT_POSITIONS; hat++) {
+            const int8_t x = hatX[hat] * REPORT_AXIS_MAX;
+            const int8_t y = hatY[hat] * REPORT_AXIS_MAX;
+            const bool left = mode == DIRECTION_MODE_LEFT_STICK || mode == DIRECTION_MODE_BOTH_STICKS;
+            const bool right = mode == DIRECTION_MODE_RIGHT_STICK || mode == DIRECTION_MODE_BOTH_STICKS;
+
+            GamepadReport& entry = directionTemplates[mode][hat];
+            entry.buttons = 0;
+            entry.hat = mode == DIRECTION_MODE_HAT ? hat : HAT_CENTERED;
+            entry.leftX = left ? x : 0;
+            entry.leftY = left ? y : 0;
+            entry.rightX = right ? x : 0;
+            entry.rightY = right ? y : 0;
+        }
+    }
+}
+
+/**
+ * @brief Selects how the joystick is reported to the host. Called by the
+ * hotkey layer, on the input task.
+ */
+void IRAM_ATTR setDirectionMode(DirectionMode mode) {
+    directionMode = mode;
+    activeDirectionTemplate = directionTemplates[mode];
+    hotkeyEvents.push({HOTKEY_DIRECTION_MODE, (uint8_t)mode, false});
+}
+
+/**
+ * @brief Replaces the hat and stick fields of a report with the active mode's template.
+ */
+void IRAM_ATTR applyDirectionMode(GamepadReport& report) {
+    const GamepadReport& entry = activeDirectionTemplate[report.hat];
+    report.hat = entry.hat;
+    report.leftX = entry.leftX;
+    report.leftY = entry.leftY;
+    report.rightX = entry.rightX;
+    report.rightY = entry.rightY;
+}
+
+/**
+ * @brief Queues a report for the host if it differs from the last one queued.
+ * The report was packed into the compact HID layout by the pipeline, on the
+ * input core, and is sent as a single notification by the report task, so
+ * all changes from a scan reach the host together. With a mirror host
+ * connected, the same packed report goes to both hosts.
+ */
+void IRAM_ATTR queueGamepadReport(const InputFrame& frame) {
+    const GamepadReport& report = frame.report;
+    if (!bleGamepad.isConnected()) {
+        // A host starts from an all-zero report, so the first scan after it
+        // connects sends whatever is held by then.
+        lastSentReport = EMPTY_GAMEPAD_REPORT;
+        return;
+    }
+    const uint32_t linksAdded = bleGamepad.getLinksAdded();
+    if (linksAdded != linksAddedSeen) {
+        // Another host just joined, e.g. the mirror next to the active one;
+        // resend the current state so it starts from it too.
+        linksAddedSeen = linksAdded;
+        lastSentReport = EMPTY_GAMEPAD_REPORT;
+    }
+    if (report == lastSentReport) {
+        return;
+    }
+
+    QueuedReport queued;
+    queued.scanTimeUs = frame.scanTimeUs;
+    queued.packed = frame.packed;
+    if (!reportQueue.push(queued)) {
+        linkHealth.recordQueueOverflow();
+        // The radio is behind. lastSentReport is left as it is, so the next
+        // scan tries again with whatever the state is by then.
+        return;
+    }
+    lastSentReport = report;
+    xTaskNotifyGive(reportTaskHandle);
+}
+
+/**
+ * @brief Lets the report task submit reports. Call once the BLE stack is up.
+ */
+void openReportPath() {
+    reportPathOpen = true;
+}
+
+/**
+ * @brief Stops report submission and waits for one in progress to finish,
+ * so the BLE stack can be shut down safely.
+ */
+void closeReportPath() {
+    reportPathOpen = false;
+    while (reportSubmitting) {
+        delay(1);
     }
 }
 
@@ -245,28 +1072,172 @@ void manageModeSwitch() {
     }
 }
 
+/**
+ * @brief Switches to the host slot requested with the hotkey layer, and
+ * reports how long the last switch took.
+ */
+void manageHostSlots() {
+    const int8_t slot = requestedHostSlot.exchange(-1);
+    if (slot >= 0) {
+        const bool repair = slot == bleGamepad.getHostSlot() && bleGamepad.isHostSlotPaired(slot);
+        bleGamepad.selectHostSlot(slot);
+        Serial.printf("Host slot %d: %s\n", slot + 1,
+                      repair ? "forgotten, pairing a new host..."
+                             : (bleGamepad.isHostSlotPaired(slot) ? "reconnecting..." : "pairing a new host..."));
+    }
+
+    uint32_t latencyUs;
+    if (bleGamepad.takeSlotSwitchLatency(latencyUs)) {
+        Serial.printf("Host slot %d connected in %lu ms.\n", bleGamepad.getHostSlot() + 1,
+                      (unsigned long)(latencyUs / 1000));
+    }
+}
+
+/**
+ * @brief Runs the transmit power controller of each connection every
+ * TX_POWER_UPDATE_MS, applies its decisions and logs them.
+ */
+void manageTxPower() {
+    static uint32_t lastUpdateMs = 0;
+    const uint32_t nowMs = millis();
+    if (!ADAPTIVE_TX_POWER || nowMs - lastUpdateMs < TX_POWER_UPDATE_MS) {
+        return;
+    }
+    lastUpdateMs = nowMs;
+
+    for (uint8_t i = 0; i < BleHidGamepad::MAX_LINKS; i++) {
+        BleHidGamepad::LinkStats stats;
+        if (!bleGamepad.getLinkStats(i, stats)) {
+            txPowerLink[i] = BLE_HS_CONN_HANDLE_NONE;
+            continue;
+        }
+        // Skipped mirror reports were held back for the mbuf reserve, not lost
+        // on air, so they say nothing about this link's radio.
+        const uint32_t failures = stats.failed;
+        if (stats.connHandle != txPowerLink[i]) {
+            // A new connection starts at full power.
+            txPowerLink[i] = stats.connHandle;
+            txPowerFailures[i] = failures;
+            txPower[i].reset(nowMs);
+            bleGamepad.setLinkTxPower(i, txPower[i].getPowerDbm());
+            Serial.printf("TX power slot %u: %+d dBm (new connection)\n", stats.slot + 1,
+                          txPower[i].getPowerDbm());
+            continue;
+        }
+
+        int8_t rssiDbm;
+        if (!bleGamepad.readLinkRssi(i, rssiDbm)) {
+            continue;
+        }
+        const TxPowerController::Decision decision =
+            txPower[i].update(nowMs, rssiDbm, failures - txPowerFailures[i]);
+        txPowerFailures[i] = failures;
+        if (decision.reason != TxPowerController::REASON_NONE) {
+            bleGamepad.setLinkTxPower(i, decision.toDbm);
+            Serial.printf("TX power slot %u: %+d -> %+d dBm (%s; RSSI %d dBm, ~%d dBm at host)\n",
+                          stats.slot + 1, decision.fromDbm, decision.toDbm,
+                          TxPowerController::reasonName(decision.reason),
+                          decision.rssiDbm, decision.estimateDbm);
+        }
+    }
+}
+
+/**
+ * @brief Prints what the hotkey layer did since the last call. The input task
+ * only queues the events, as printing would hold up its scans.
+ */
+void printHotkeyEvents() {
+    static const char* const modeNames[DIRECTION_MODE_COUNT] = {
+        "HAT", "LEFT STICK", "RIGHT STICK", "BOTH STICKS"
+    };
+    HotkeyEvent event;
+    while (hotkeyEvents.pop(event)) {
+        switch (event.type) {
+            case HOTKEY_HOST_SELECT:
+                Serial.printf("Host select: press button 1-%d (active slot: %d)\n",
+                              BleHidGamepad::HOST_SLOT_COUNT, bleGamepad.getHostSlot() + 1);
+                break;
+            case HOTKEY_TURBO:
+                Serial.printf("Turbo on button %d: %s\n", event.value + 1, event.on ? "ON" : "OFF");
+                break;
+            case HOTKEY_RECORDING:
+                Serial.println("Recording macro...");
+                break;
+            case HOTKEY_RECORDED:
+                Serial.printf("Macro recorded: %d steps.\n", event.value);
+                break;
+            case HOTKEY_DIRECTION_MODE:
+                Serial.printf("Direction mode: %s\n", modeNames[event.value]);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Writes changed settings (host slots, bonds) to flash once nothing
+ * has been held or sent for FLASH_WRITE_IDLE_MS. The write stalls the input
+ * task as well, so it is kept out of play, and out of a running 'j'
+ * benchmark.
+ */
+void manageFlashWrites() {
+    if (!flashWriteWindow.shouldFlush(micros(), bleGamepad.hasPendingWrites(), benchmarkPhase != BENCHMARK_IDLE)) {
+        return;
+    }
+    bleGamepad.flushPendingWrites();
+}
+
+/**
+ * @brief Samples the stack, heap and NimBLE pool usage every
+ * RESOURCE_SAMPLE_MS.
+ */
+void manageResources() {
+    static uint32_t lastSampleMs = 0;
+    const uint32_t nowMs = millis();
+    if (nowMs - lastSampleMs < RESOURCE_SAMPLE_MS) {
+        return;
+    }
+    lastSampleMs = nowMs;
+    resources.sample();
+}
+
 /**
  * @brief Configures the system to operate in wireless (Bluetooth) mode.
  */
 void activateWirelessMode() {
+    const bool heapGuardArmed = HeapGuard::disarm(); // Starting the stack allocates it
     Serial.println("Current mode: WIRELESS.");
     Serial.println("Starting Bluetooth services. Waiting for connection...");
 
-    BleGamepadConfiguration bleGamepadConfig;
-    bleGamepadConfig.setButtonCount(10);
-    bleGamepadConfig.setHatSwitchCount(1);
-    bleGamepadConfig.setWhichAxes(false, false, false, false, false, false, false, false);
-    bleGamepad.begin(&bleGamepadConfig);
+    // The host starts from an all-zero report, which is what the stick
+    // looks like with nothing pressed.
+    lastSentReport = EMPTY_GAMEPAD_REPORT;
+    bleGamepad.setMirrorSlot(MIRROR_HOST_SLOT);
+    bleGamepad.begin(StickReportLayout::descriptor.data(), StickReportLayout::descriptor.size(),
+                     GAMEPAD_REPORT_ID);
+    telemetry.begin(NimBLEDevice::getServer());
+    ota.begin(NimBLEDevice::getServer());
+    bleGamepad.startAdvertising();
+    openReportPath();
+    if (heapGuardArmed) {
+        HeapGuard::arm();
+    }
 }
 
 /**
  * @brief Prepares the system to switch to wired mode and enter low-power sleep.
  */
 void deactivateForWiredMode() {
+    const bool heapGuardArmed = HeapGuard::disarm();
     Serial.println("Current mode: WIRED.");
     Serial.println("Stopping Bluetooth services.");
-    if (bleGamepad.isConnected()) {
-        bleGamepad.end();
+    // Always shut the stack down, even when nobody is connected, so it is not
+    // left advertising during sleep and starts clean on wake-up.
+    closeReportPath();
+    telemetry.end();
+    ota.end();
+    bleGamepad.end();
+    if (heapGuardArmed) {
+        HeapGuard::arm();
     }
 }
 
@@ -311,4 +1282,480 @@ void manageStatusLED() {
             digitalWrite(STATUS_LED_PIN, !digitalRead(STATUS_LED_PIN));
         }
     }
-}
\ No newline at end of file
+}
+/**
+ * @brief Handles single-character diagnostic commands received over Serial.
+ * - 'd': Print the debounce statistics of every switch.
+ * - 'i': Print the latest published input state.
+ * - 'l': Print the statistics of each host connection.
+ * - 'h': Print the link health record; 'H' clears it.
+ * - 'o': Print the progress of the current or last firmware update.
+ * - 'j': Measure the scan jitter with the button lighting off, then on.
+ * - 'n': Measure the scan stall of a flash write.
+ * - 'm': Print the heap allocations made since boot.
+ * - 'r': Print the stack, heap and NimBLE pool usage.
+ * - 'b': Measure the notify path to the connected hosts.
+ */
+void manageSerialCommands() {
+    while (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 'd':
+                printDebounceStats();
+                break;
+            case 'i':
+                printInputSnapshot();
+                break;
+            case 'l':
+                printLinkStats();
+                break;
+            case 'h':
+                printLinkHealth();
+                break;
+            case 'H':
+                linkHealth.clear();
+                Serial.println("Link health record cleared.");
+                break;
+            case 'o':
+                printOtaStatus();
+                break;
+            case 'j':
+                startLightingBenchmark();
+                break;
+            case 'n':
+                runFlashStallTest();
+                break;
+            case 'm':
+                printHeapGuard();
+                break;
+            case 'r':
+                printResources();
+                break;
+            case 'b':
+                runNotifyBenchmark();
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Prints one row of the debounce statistics table.
+ */
+void printSwitchStats(const char* name, const AdaptiveBounce& debouncer) {
+    const ChatterStats& stats = debouncer.getStats();
+    Serial.printf("%-7s %7lu %7lu %7lu %7lu %6lu  ",
+                  name,
+                  (unsigned long)stats.getBursts(),
+                  (unsigned long)stats.getBouncedBursts(),
+                  (unsigned long)stats.percentile99Us(),
+                  (unsigned long)stats.getMaxBounceUs(),
+                  (unsigned long)debouncer.getInterval());
+    for (uint8_t i = 0; i < ChatterStats::BUCKET_COUNT; i++) {
+        Serial.printf(" %5lu", (unsigned long)stats.getBucket(i));
+    }
+    Serial.println(stats.isWorn() ? "  WORN - consider replacing" : "");
+}
+
+/**
+ * @brief Prints the bounce statistics of every switch.
+ * A switch marked WORN bounces for longer than a fresh one should; it still
+ * works because its interval has grown, but it is a candidate for replacement.
+ */
+void printDebounceStats() {
+    static const char* const buttonNames[TOTAL_BUTTONS] = {
+        "B1", "B2", "B3", "B4", "B5", "B6", "B7", "B8", "START", "SELECT"
+    };
+    static const char* const joystickNames[4] = {"UP", "DOWN", "LEFT", "RIGHT"};
+
+    Serial.printf("\n%-7s %7s %7s %7s %7s %6s   Bounce histogram (clean, <=0.5, 1, 2, 3, 5, 8, >8 ms)\n",
+                  "Switch", "Bursts", "Bounced", "p99 us", "max us", "int us");
+    for (int i = 0; i < TOTAL_BUTTONS; i++) {
+        printSwitchStats(buttonNames[i], buttonDebouncers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        printSwitchStats(joystickNames[i], joystickDebouncers[i]);
+    }
+}
+
+/**
+ * @brief Prints the latest input state published by the input task.
+ * Read through the seqlock, as any task other than the input task should.
+ */
+void printInputSnapshot() {
+    const InputSnapshot snapshot = inputSnapshot.read();
+    Serial.printf("\nScan #%lu at %lu us\n", (unsigned long)snapshot.sequence,
+                  (unsigned long)snapshot.scanTimeUs);
+    Serial.printf("Physical: buttons 0x%04X hat %u\n", snapshot.physical.buttons, snapshot.physical.hat);
+    Serial.printf("Output:   buttons 0x%04X hat %u  L(%d,%d) R(%d,%d)\n",
+                  snapshot.output.buttons, snapshot.output.hat,
+                  snapshot.output.leftX, snapshot.output.leftY,
+                  snapshot.output.rightX, snapshot.output.rightY);
+}
+
+/**
+ * @brief Prints the delivery statistics of each connected host.
+ * Delay is measured from the scan to the report being handed to the stack;
+ * the mirror is always served after the active host.
+ */
+void printLinkStats() {
+    Serial.printf("\n%-4s %-7s %8s %8s %8s %8s %8s %6s\n",
+                  "Slot", "Role", "Sent", "Failed", "Skipped", "avg us", "max us", "TX dBm");
+    bool any = false;
+    for (uint8_t i = 0; i < BleHidGamepad::MAX_LINKS; i++) {
+        BleHidGamepad::LinkStats stats;
+        if (!bleGamepad.getLinkStats(i, stats)) {
+            continue;
+        }
+        any = true;
+        Serial.printf("%-4u %-7s %8lu %8lu %8lu %8lu %8lu %+6d\n",
+                      stats.slot + 1, stats.primary ? "active" : "mirror",
+                      (unsigned long)stats.sent, (unsigned long)stats.failed,
+                      (unsigned long)stats.skipped,
+                      (unsigned long)(stats.sent ? stats.totalDelayUs / stats.sent : 0),
+                      (unsigned long)stats.maxDelayUs,
+                      ADAPTIVE_TX_POWER ? txPower[i].getPowerDbm() : NimBLEDevice::getPower(NimBLETxPowerType::Connection));
+    }
+    if (!any) {
+        Serial.println("No host connected.");
+    }
+}
+
+/**
+ * @brief Prints the link health record: notification results, buffer and
+ * queue pressure, then the recorded events from oldest to newest. Events
+ * from before the last reset are kept and marked with their boot number.
+ */
+void printLinkHealth() {
+    static LinkHealth::Record record; // Too large for the loop task's stack
+    linkHealth.snapshot(record);
+
+    Serial.printf("\nLink health, boot #%u\n", record.boot);
+    Serial.printf("Input reports sent: %lu\n", (unsigned long)record.notifySent);
+    for (const LinkHealth::ResultCount& entry : record.notifyErrors) {
+        if (entry.count > 0) {
+            Serial.printf("  failed, rc %d: %lu\n", entry.code, (unsigned long)entry.count);
+        }
+    }
+    if (record.notifyOtherErrors > 0) {
+        Serial.printf("  failed, other codes: %lu\n", (unsigned long)record.notifyOtherErrors);
+    }
+    Serial.printf("Submitted with no free mbuf: %lu, fewest free mbufs: %u\n",
+                  (unsigned long)record.mbufExhausted,
+                  record.minFreeMbufs == 0xFFFF ? 0 : record.minFreeMbufs);
+    Serial.printf("Report queue: deepest %u of %u, overflows %lu\n", record.maxQueueDepth,
+                  (unsigned)(REPORT_QUEUE_SIZE - 1), (unsigned long)record.queueOverflows);
+
+    Serial.printf("%-5s %10s %-10s %4s %6s  %s\n", "Boot", "Time ms", "Event", "Slot", "Conn", "Details");
+    for (uint8_t i = 0; i < record.eventCount; i++) {
+        const uint8_t index = (record.eventNext + LinkHealth::EVENT_COUNT - record.eventCount + i) %
+                              LinkHealth::EVENT_COUNT;
+        const LinkHealth::Event& event = record.events[index];
+        Serial.printf("%-5u %10lu %-10s ", event.boot, (unsigned long)event.timeMs,
+                      LinkHealth::eventName(event.type));
+        if (event.slot == 0xFF) {
+            Serial.print("   -");
+        } else {
+            Serial.printf("%4u", event.slot + 1);
+        }
+        if (event.connHandle == 0xFFFF) {
+            Serial.print("      -  ");
+        } else {
+            Serial.printf(" %6u  ", event.connHandle);
+        }
+        switch (event.type) {
+            case LinkHealth::EVENT_BOOT:
+                Serial.printf("reset reason %u\n", event.a);
+                break;
+            case LinkHealth::EVENT_CONNECT:
+            case LinkHealth::EVENT_CONN_PARAMS:
+                Serial.printf("interval %u.%02u ms, latency %u, timeout %u ms\n",
+                              event.a * 125 / 100, event.a * 125 % 100, event.b, event.c * 10);
+                break;
+            case LinkHealth::EVENT_DISCONNECT: {
+                const char* name = LinkHealth::disconnectReasonName(event.a);
+                Serial.printf("reason 0x%03X%s%s\n", event.a, name ? " " : "", name ? name : "");
+                break;
+            }
+            case LinkHealth::EVENT_MTU:
+                Serial.printf("MTU %u\n", event.a);
+                break;
+            default:
+                Serial.println();
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Prints the heap allocations made since the end of setup(), hot path
+ * first, with the call stack of each call site. Paste the Backtrace lines
+ * into the monitor's esp32_exception_decoder (or addr2line) for file and
+ * line.
+ */
+void printHeapGuard() {
+    if (!HeapGuard::ENABLED) {
+        Serial.println("Allocations are only traced in the esp32dev_zero_heap build.");
+        return;
+    }
+    // Printing allocates too; that is not what is being looked for.
+    const bool armed = HeapGuard::disarm();
+    HeapGuard::Totals totals;
+    HeapGuard::getTotals(totals);
+    Serial.printf("\nHeap allocations since boot: %lu on the hot path (%lu bytes), %lu elsewhere (%lu bytes)\n",
+                  (unsigned long)totals.hotCount, (unsigned long)totals.hotBytes,
+                  (unsigned long)totals.otherCount, (unsigned long)totals.otherBytes);
+    Serial.printf("Free heap %lu bytes, largest free block %lu bytes\n", (unsigned long)ESP.getFreeHeap(),
+                  (unsigned long)ESP.getMaxAllocHeap());
+    if (totals.unsited > 0) {
+        Serial.printf("%lu not traced (site table full or flash cache off)\n", (unsigned long)totals.unsited);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        HeapGuard::Site site;
+        for (uint8_t i = 0; HeapGuard::getSite(i, site); i++) {
+            if (site.hot != (pass == 0)) {
+                continue;
+            }
+            Serial.printf("%s task '%s': %lu allocations, %lu bytes, largest %lu\n", site.hot ? "HOT" : "   ",
+                          site.task, (unsigned long)site.count, (unsigned long)site.bytes,
+                          (unsigned long)site.largest);
+            Serial.print("Backtrace:");
+            for (uint8_t frame = 0; frame < site.depth; frame++) {
+                Serial.printf(" 0x%08lx:0x%08lx", (unsigned long)site.pc[frame], (unsigned long)site.sp[frame]);
+            }
+            Serial.println();
+        }
+    }
+    if (armed) {
+        HeapGuard::arm();
+    }
+}
+
+/**
+ * @brief Prints the latest resource sample: each watched stack with the
+ * fewest bytes it has had free, the heap, and each NimBLE pool with the
+ * fewest blocks it has had free. A stack within STACK_LOW_MARGIN_BYTES of
+ * its end, or a pool that has run out, is marked LOW.
+ */
+void printResources() {
+    static ResourceMonitor::Snapshot sample; // Too large for the loop task's stack
+    resources.sample(); // Up to date, even between two periodic samples
+    resources.snapshot(sample);
+
+    Serial.printf("\nHeap: %lu bytes free, fewest %lu since boot, largest block %lu\n",
+                  (unsigned long)sample.freeHeap, (unsigned long)sample.minFreeHeap,
+                  (unsigned long)sample.largestBlock);
+    Serial.printf("%-12s %6s %9s %5s\n", "Task", "Stack", "Min free", "Used");
+    for (uint8_t i = 0; i < sample.taskCount; i++) {
+        const ResourceMonitor::TaskStack& task = sample.tasks[i];
+        Serial.printf("%-12s %6lu ", task.name, (unsigned long)task.stackSize);
+        if (task.minFree == UINT32_MAX) {
+            Serial.println("        -     -  not running");
+            continue;
+        }
+        Serial.printf("%9lu %4lu%%%s%s\n", (unsigned long)task.minFree,
+                      (unsigned long)((task.stackSize - task.minFree) * 100 / task.stackSize),
+                      task.minFree < STACK_LOW_MARGIN_BYTES ? "  LOW" : "", task.running ? "" : "  not running");
+    }
+    if (sample.poolCount == 0) {
+        Serial.println("No NimBLE pools (Bluetooth is off).");
+        return;
+    }
+    Serial.printf("%-3s %-28s %6s %6s %6s %8s\n", "#", "NimBLE pool", "Block", "Blocks", "Free", "Min free");
+    for (uint8_t i = 0; i < sample.poolCount; i++) {
+        const ResourceMonitor::Pool& pool = sample.pools[i];
+        Serial.printf("%-3u %-28s %6u %6u %6u %8u%s\n", i, pool.name, pool.blockSize, pool.blocks, pool.free,
+                      pool.minFree, pool.blocks > 0 && pool.minFree == 0 ? "  LOW" : "");
+    }
+}
+
+/**
+ * @brief Prints the progress and throughput of the current or last firmware
+ * update.
+ */
+void printOtaStatus() {
+    const uint32_t size = ota.getImageSize();
+    if (size == 0) {
+        Serial.println("No firmware update since boot.");
+        return;
+    }
+    const uint32_t written = ota.getWrittenBytes();
+    const uint32_t elapsedMs = ota.getElapsedMs();
+    Serial.printf("Firmware update %s: %lu/%lu bytes in flash, %lu ms, %lu B/s, last error %lu\n",
+                  ota.isActive() ? "in progress" : "stopped", (unsigned long)written,
+                  (unsigned long)size, (unsigned long)elapsedMs,
+                  (unsigned long)(elapsedMs ? (uint64_t)written * 1000 / elapsedMs : 0),
+                  (unsigned long)ota.getLastError());
+}
+
+/**
+ * @brief Starts the lighting benchmark: the scan jitter is measured for
+ * LIGHTING_BENCHMARK_MS with the lighting off, then as long with it on.
+ */
+void startLightingBenchmark() {
+    if (benchmarkPhase != BENCHMARK_IDLE) {
+        Serial.println("Benchmark already running.");
+        return;
+    }
+    if (!isWirelessMode) {
+        Serial.println("Inputs are only scanned in wireless mode.");
+        return;
+    }
+    Serial.printf("Measuring scan jitter: %lu s with the lighting off, then %lu s on...\n",
+                  (unsigned long)(LIGHTING_BENCHMARK_MS / 1000), (unsigned long)(LIGHTING_BENCHMARK_MS / 1000));
+    benchmarkLightingWasEnabled = lighting.isEnabled();
+    lighting.setEnabled(false);
+    scanJitter.reset();
+    benchmarkPhase = BENCHMARK_LIGHTING_OFF;
+    benchmarkPhaseStartMs = millis();
+}
+
+/**
+ * @brief Moves the lighting benchmark to its next phase when the current one
+ * has run for LIGHTING_BENCHMARK_MS, and prints the result at the end.
+ */
+void manageLightingBenchmark() {
+    if (benchmarkPhase == BENCHMARK_IDLE || millis() - benchmarkPhaseStartMs < LIGHTING_BENCHMARK_MS) {
+        return;
+    }
+    if (benchmarkPhase == BENCHMARK_LIGHTING_OFF) {
+        benchmarkOffStats = scanJitter.read();
+        lighting.setEnabled(true);
+        benchmarkFramesSent = lighting.getFramesSent();
+        benchmarkFramesSkipped = lighting.getFramesSkipped();
+        scanJitter.reset();
+        benchmarkPhase = BENCHMARK_LIGHTING_ON;
+        benchmarkPhaseStartMs = millis();
+        return;
+    }
+    const ScanJitter::Stats onStats = scanJitter.read();
+    const uint32_t framesSent = lighting.getFramesSent() - benchmarkFramesSent;
+    const uint32_t framesSkipped = lighting.getFramesSkipped() - benchmarkFramesSkipped;
+    lighting.setEnabled(benchmarkLightingWasEnabled);
+    benchmarkPhase = BENCHMARK_IDLE;
+
+    printScanJitterHeader("Lighting");
+    printScanJitter("off", benchmarkOffStats);
+    printScanJitter("on", onStats);
+    Serial.printf("Lighting: %s, %lu frames sent, %lu skipped, render max %lu us\n",
+                  BUTTON_LIGHTING ? "running" : "not built in (BUTTON_LIGHTING = false)",
+                  (unsigned long)framesSent, (unsigned long)framesSkipped,
+                  (unsigned long)lighting.getMaxRenderUs());
+}
+
+/**
+ * @brief Prints the header of the scan jitter table.
+ */
+void printScanJitterHeader(const char* title) {
+    Serial.printf("\n%-9s %8s %8s %7s %7s %8s   Offset histogram (<=2, 5, 10, 25, 50, >50 us)\n",
+                  title, "Scans", "Resyncs", "avg us", "max us", "worst us");
+}
+
+/**
+ * @brief Prints one row of the scan jitter table.
+ */
+void printScanJitter(const char* label, const ScanJitter::Stats& stats) {
+    Serial.printf("%-9s %8lu %8lu %7lu %7lu %8lu  ", label, (unsigned long)stats.scans,
+                  (unsigned long)stats.resyncs,
+                  (unsigned long)(stats.scans ? stats.totalUs / stats.scans : 0),
+                  (unsigned long)stats.maxUs, (unsigned long)stats.worstUs);
+    for (uint8_t i = 0; i < ScanJitter::BUCKET_COUNT; i++) {
+        Serial.printf(" %7lu", (unsigned long)stats.buckets[i]);
+    }
+    Serial.println();
+}
+
+/**
+ * @brief Measures how long a flash write stalls the input scan: records the
+ * scan timing for a while without writing, then while forcing
+ * FLASH_STALL_TEST_WRITES NVS writes, and prints both. The worst offset with
+ * writes is the stall manageFlashWrites() keeps out of play.
+ */
+void runFlashStallTest() {
+    if (!isWirelessMode) {
+        Serial.println("Inputs are only scanned in wireless mode.");
+        return;
+    }
+    const uint32_t phaseMs = FLASH_STALL_TEST_WRITES * FLASH_STALL_TEST_GAP_MS;
+    Serial.printf("Measuring scan stalls: %lu ms without flash writes, then %u forced NVS writes of %u bytes...\n",
+                  (unsigned long)phaseMs, FLASH_STALL_TEST_WRITES, (unsigned)FLASH_STALL_TEST_BYTES);
+
+    scanJitter.reset();
+    delay(phaseMs);
+    const ScanJitter::Stats quietStats = scanJitter.read();
+
+    static uint8_t blob[FLASH_STALL_TEST_BYTES];
+    Preferences prefs;
+    if (!prefs.begin(FLASH_STALL_TEST_NAMESPACE, false)) {
+        Serial.println("NVS could not be opened.");
+        return;
+    }
+    uint32_t longestWriteUs = 0;
+    scanJitter.reset();
+    for (uint8_t i = 0; i < FLASH_STALL_TEST_WRITES; i++) {
+        memset(blob, i, sizeof(blob)); // A new value every time, so every write reaches the flash
+        const uint32_t startUs = micros();
+        prefs.putBytes("blob", blob, sizeof(blob));
+        const uint32_t writeUs = micros() - startUs;
+        if (writeUs > longestWriteUs) {
+            longestWriteUs = writeUs;
+        }
+        delay(FLASH_STALL_TEST_GAP_MS);
+    }
+    const ScanJitter::Stats writeStats = scanJitter.read();
+    prefs.clear();
+    prefs.end();
+
+    printScanJitterHeader("Flash");
+    printScanJitter("no writes", quietStats);
+    printScanJitter("writes", writeStats);
+    Serial.printf("Longest write: %lu us. Settings waiting for an idle window: %s\n",
+                  (unsigned long)longestWriteUs, bleGamepad.hasPendingWrites() ? "yes" : "no");
+}
+
+/**
+ * @brief Measures the notify path on the live connections: has the report
+ * task send the last report NOTIFY_BENCHMARK_REPORTS times and prints the
+ * notifications per second, the fewest and the average CPU cycles per
+ * sendReport() (every connected host included) and, in the
+ * esp32dev_zero_heap build, the heap allocations per notification. The
+ * benchmark reports are counted in the 'l' and 'h' statistics.
+ */
+void runNotifyBenchmark() {
+    if (!isWirelessMode || !bleGamepad.isConnected()) {
+        Serial.println("Connect a host first.");
+        return;
+    }
+    Serial.printf("Sending the last report %lu times to the connected hosts...\n",
+                  (unsigned long)NOTIFY_BENCHMARK_REPORTS);
+    notifyBenchmarkDone = false;
+    notifyBenchmarkRequested = true;
+    xTaskNotifyGive(reportTaskHandle);
+    while (!notifyBenchmarkDone) {
+        delay(10);
+    }
+
+    const NotifyBenchmark result = notifyBenchmark;
+    const uint32_t calls = result.sent + result.failed;
+    if (calls == 0) {
+        Serial.println("No report has been sent yet; press a button and try again.");
+        return;
+    }
+    const uint32_t mhz = getCpuFrequencyMhz();
+    const uint32_t averageCycles = result.totalCycles / calls;
+    const uint32_t elapsedMs = result.elapsedUs / 1000;
+    Serial.printf("\nNotify path, %lu reports in %lu ms: %lu per second, %lu failed, %lu ticks waiting for mbufs\n",
+                  (unsigned long)calls, (unsigned long)elapsedMs,
+                  (unsigned long)(result.elapsedUs > 0 ? (uint64_t)calls * 1000000 / result.elapsedUs : 0),
+                  (unsigned long)result.failed, (unsigned long)result.mbufWaits);
+    Serial.printf("CPU per sendReport(): min %lu cycles (%lu ns), avg %lu cycles (%lu ns)\n",
+                  (unsigned long)result.fewestCycles, (unsigned long)(result.fewestCycles * 1000 / mhz),
+                  (unsigned long)averageCycles, (unsigned long)(averageCycles * 1000 / mhz));
+    if (HeapGuard::ENABLED && HeapGuard::isArmed()) {
+        Serial.printf("Heap allocations: %lu, %lu.%02lu per report\n", (unsigned long)result.allocations,
+                      (unsigned long)(result.allocations / calls),
+                      (unsigned long)(result.allocations * 100 / calls % 100));
+    } else {
+        Serial.println("Heap allocations: not counted (esp32dev_zero_heap build only)");
+    }
+}
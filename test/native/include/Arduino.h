@@ -0,0 +1,123 @@
+/*
+================================================================================
+= Arduino.h (native)                                                           =
+=                                                                              =
+= The part of the Arduino API that the tested modules, Bounce2 and NimBLE use, =
+= for the native test build. Time and pins are plain variables a test sets:    =
+= micros() returns nativeMicros, and digitalRead() returns the level in        =
+= nativePins. Pins can also be coupled by closed switches, as the keys of a    =
+= matrix couple its rows and columns: an input then reads LOW while a pin      =
+= driven LOW reaches it. String is only what NimBLEAttValue converts to and    =
+= from.                                                                        =
+================================================================================
+*/
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include "esp_attr.h"
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+static const uint8_t NATIVE_PIN_COUNT = 64;
+
+// The clock and the pins, as the test sets them.
+inline uint32_t nativeMicros = 0;
+inline bool nativePins[NATIVE_PIN_COUNT] = {};
+inline uint8_t nativePinModes[NATIVE_PIN_COUNT] = {};
+
+// The pins each pin has a closed switch to, kept symmetric by
+// nativeSetSwitch(). Without diodes a LOW reaches an input through any chain
+// of switches and floating pins, which is how a key matrix ghosts; with a
+// diode per switch only through a switch straight to the driven pin.
+inline uint64_t nativeSwitches[NATIVE_PIN_COUNT] = {};
+inline bool nativeDiodes = false;
+
+inline void nativeSetSwitch(uint8_t a, uint8_t b, bool closed) {
+    if (closed) {
+        nativeSwitches[a] |= (uint64_t)1 << b;
+        nativeSwitches[b] |= (uint64_t)1 << a;
+    } else {
+        nativeSwitches[a] &= ~((uint64_t)1 << b);
+        nativeSwitches[b] &= ~((uint64_t)1 << a);
+    }
+}
+
+// True while a pin driven LOW reaches this one through closed switches.
+inline bool nativePulledLow(uint8_t pin) {
+    uint64_t reached = (uint64_t)1 << pin;
+    uint64_t frontier = reached;
+    while (frontier != 0) {
+        uint64_t next = 0;
+        for (uint8_t p = 0; p < NATIVE_PIN_COUNT; p++) {
+            if (frontier & ((uint64_t)1 << p)) {
+                next |= nativeSwitches[p];
+            }
+        }
+        next &= ~reached;
+        reached |= next;
+        frontier = 0;
+        for (uint8_t p = 0; p < NATIVE_PIN_COUNT; p++) {
+            if (!(next & ((uint64_t)1 << p))) {
+                continue;
+            }
+            if (nativePinModes[p] == OUTPUT) { // Drives its level, passes none on
+                if (!nativePins[p]) {
+                    return true;
+                }
+            } else if (!nativeDiodes) {
+                frontier |= (uint64_t)1 << p;
+            }
+        }
+    }
+    return false;
+}
+
+inline uint32_t micros() { return nativeMicros; }
+inline uint32_t millis() { return nativeMicros / 1000; }
+inline void delayMicroseconds(uint32_t us) { nativeMicros += us; }
+inline void delay(uint32_t ms) { nativeMicros += ms * 1000; }
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= NATIVE_PIN_COUNT) {
+        return;
+    }
+    nativePinModes[pin] = mode;
+    if (mode == INPUT_PULLUP) {
+        nativePins[pin] = HIGH;
+    }
+}
+inline int digitalRead(uint8_t pin) {
+    if (pin >= NATIVE_PIN_COUNT) {
+        return LOW;
+    }
+    if (nativePinModes[pin] != OUTPUT && nativeSwitches[pin] != 0 && nativePulledLow(pin)) {
+        return LOW;
+    }
+    return nativePins[pin] ? HIGH : LOW;
+}
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+    if (pin < NATIVE_PIN_COUNT) {
+        nativePins[pin] = level != LOW;
+    }
+}
+
+class String {
+  public:
+    String(const char* text = "") : text_(text) {}
+    const char* c_str() const { return text_.c_str(); }
+    unsigned int length() const { return text_.length(); }
+
+  private:
+    std::string text_;
+};
+
+#endif // NATIVE_ARDUINO_H
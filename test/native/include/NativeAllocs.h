@@ -0,0 +1,43 @@
+/*
+================================================================================
+= NativeAllocs.h (native)                                                      =
+=                                                                              =
+= Counts heap allocations in a native test, the PC's side of HeapGuard.h:      =
+= malloc, calloc and realloc are replaced for the whole test program, on every =
+= thread, and pass on to glibc. operator new allocates through malloc, so it   =
+= is counted too. Include it from one source file of the test only, since it   =
+= defines the functions.                                                       =
+================================================================================
+*/
+
+#ifndef NATIVE_ALLOCS_H
+#define NATIVE_ALLOCS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+inline std::atomic<uint32_t> nativeAllocCount{0};
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) noexcept {
+    nativeAllocCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    nativeAllocCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) noexcept {
+    nativeAllocCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+
+#endif // NATIVE_ALLOCS_H
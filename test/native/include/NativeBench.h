@@ -0,0 +1,50 @@
+/*
+================================================================================
+= NativeBench.h (native)                                                       =
+=                                                                              =
+= Timing for the benchmarks in the native test build. An operation is run in   =
+= batches, each batch timed with std::chrono::steady_clock: a single operation =
+= is too short for the clock. The fastest batch is the operation's own cost;   =
+= the average also holds whatever else the PC was doing, so only the fastest   =
+= is worth comparing between runs.                                             =
+================================================================================
+*/
+
+#ifndef NATIVE_BENCH_H
+#define NATIVE_BENCH_H
+
+#include <stdint.h>
+#include <chrono>
+
+// Written with each operation's result, so the compiler cannot drop the work.
+inline volatile uint32_t nativeBenchSink = 0;
+
+struct BenchResult {
+    double minNs; // Per operation, in the fastest batch
+    double avgNs; // Per operation, over every batch
+};
+
+/**
+ * @brief Runs operation(i) for i = 0..ops-1, timed batchSize at a time.
+ * ops should be a multiple of batchSize.
+ */
+template <typename Operation>
+BenchResult measureBench(uint32_t ops, uint32_t batchSize, Operation&& operation) {
+    using Clock = std::chrono::steady_clock;
+    double fewestNs = 1e300;
+    double totalNs = 0;
+    for (uint32_t first = 0; first < ops; first += batchSize) {
+        const Clock::time_point start = Clock::now();
+        for (uint32_t i = first; i < first + batchSize; i++) {
+            operation(i);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        totalNs += ns;
+        if (ns < fewestNs) {
+            fewestNs = ns;
+        }
+    }
+    return {fewestNs / batchSize, totalNs / ops};
+}
+
+#endif // NATIVE_BENCH_H
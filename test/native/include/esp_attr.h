@@ -0,0 +1,18 @@
+/*
+================================================================================
+= esp_attr.h (native)                                                          =
+=                                                                              =
+= Stand-in for the ESP-IDF header in the native test build: on a PC there is   =
+= no IRAM or DRAM to place code and data in, so the placement attributes       =
+= expand to nothing.                                                           =
+================================================================================
+*/
+
+#ifndef NATIVE_ESP_ATTR_H
+#define NATIVE_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif // NATIVE_ESP_ATTR_H
@@ -0,0 +1,24 @@
+/*
+================================================================================
+= esp_system.h (native)                                                        =
+=                                                                              =
+= Stand-in for the ESP-IDF header in the native test build: a test process     =
+= always starts from power-on, so no RTC memory outlives it.                   =
+================================================================================
+*/
+
+#ifndef NATIVE_ESP_SYSTEM_H
+#define NATIVE_ESP_SYSTEM_H
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+} esp_reset_reason_t;
+
+inline esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+#endif // NATIVE_ESP_SYSTEM_H
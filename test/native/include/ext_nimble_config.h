@@ -0,0 +1,21 @@
+/*
+================================================================================
+= ext_nimble_config.h (native)                                                 =
+=                                                                              =
+= NimBLE's configuration hook for builds that are not ESP-IDF: nimconfig.h and =
+= syscfg.h include it first. On the PC the host runs against SimController (a  =
+= controller in the same process, test/native/lib), not against a radio, so   =
+= NimBLE's own link layer is left out. The rest of the options come from the  =
+= build flags, the same as the firmware's (platformio.ini).                    =
+================================================================================
+*/
+
+#ifndef NATIVE_EXT_NIMBLE_CONFIG_H
+#define NATIVE_EXT_NIMBLE_CONFIG_H
+
+#define CONFIG_BT_CONTROLLER_ENABLED 0
+
+// modlog.h prints what is at or above this level; the host's, as on the ESP32.
+#define MYNEWT_VAL_LOG_LEVEL (CONFIG_BT_NIMBLE_LOG_LEVEL)
+
+#endif // NATIVE_EXT_NIMBLE_CONFIG_H
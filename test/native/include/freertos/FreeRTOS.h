@@ -0,0 +1,35 @@
+/*
+================================================================================
+= freertos/FreeRTOS.h (native)                                                 =
+=                                                                              =
+= Stand-in for the FreeRTOS header in the native test build, for the critical  =
+= sections only: a portMUX is a spinlock here, as it is between the ESP32's    =
+= two cores, taken by whichever thread (the test's or NimBLE's host thread)    =
+= enters first. Not recursive, which the firmware never relies on.            =
+================================================================================
+*/
+
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+inline void nativeEnterCritical(portMUX_TYPE* mux) {
+    while (__atomic_exchange_n(&mux->owner, 1, __ATOMIC_ACQUIRE) != 0) {
+    }
+}
+
+inline void nativeExitCritical(portMUX_TYPE* mux) {
+    __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+#define portENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) nativeExitCritical(mux)
+
+#endif // NATIVE_FREERTOS_H
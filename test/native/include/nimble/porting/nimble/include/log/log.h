@@ -0,0 +1,37 @@
+/*
+================================================================================
+= log/log.h (native)                                                           =
+=                                                                              =
+= Stand-in for Mynewt's log package, which NimBLE's logging headers include   =
+= but NimBLE-Arduino does not ship: the Arduino cores provide it. The host    =
+= logs through modlog.h with printf; nothing here writes to a log.            =
+================================================================================
+*/
+
+#ifndef NATIVE_NIMBLE_LOG_H
+#define NATIVE_NIMBLE_LOG_H
+
+#include "nimble/porting/nimble/include/log_common/log_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct log {
+};
+
+static inline void log_dummy(void* log, ...) {
+    (void)log;
+}
+
+#define LOG_DEBUG(_log, _mod, ...) log_dummy(_log, ##__VA_ARGS__)
+#define LOG_INFO(_log, _mod, ...) log_dummy(_log, ##__VA_ARGS__)
+#define LOG_WARN(_log, _mod, ...) log_dummy(_log, ##__VA_ARGS__)
+#define LOG_ERROR(_log, _mod, ...) log_dummy(_log, ##__VA_ARGS__)
+#define LOG_CRITICAL(_log, _mod, ...) log_dummy(_log, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NATIVE_NIMBLE_LOG_H
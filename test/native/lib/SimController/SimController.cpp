@@ -0,0 +1,429 @@
+/*
+================================================================================
+= SimController.cpp (native)                                                   =
+= The controller the host sees on the PC. See SimController.h.                 =
+================================================================================
+*/
+
+#include "SimController.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "nimble/nimble/include/nimble/hci_common.h"
+#include "nimble/nimble/transport/include/nimble/transport.h"
+#include "nimble/nimble/transport/include/nimble/transport_impl.h"
+#include "nimble/porting/nimble/include/nimble/nimble_port.h"
+#include "nimble/porting/nimble/include/os/os_mbuf.h"
+
+static const uint8_t ATT_CID = 0x04;
+// ATT opcodes (Core spec, Vol 3, Part F, 3.4.8)
+static const uint8_t ATT_OP_MTU_REQ = 0x02;
+static const uint8_t ATT_OP_MTU_RSP = 0x03;
+static const uint8_t ATT_OP_WRITE_REQ = 0x12;
+static const uint8_t ATT_OP_WRITE_RSP = 0x13;
+static const uint8_t ATT_OP_NOTIFY = 0x1B;
+static const uint8_t CENTRAL_ADDR[6] = {0x01, 0x02, 0x03, 0x04, 0x05, 0xC0};
+static const uint8_t CONTROLLER_ADDR[6] = {0x11, 0x12, 0x13, 0x14, 0x15, 0x16};
+
+static void putLe16(uint8_t* to, uint16_t value) {
+    to[0] = value & 0xFF;
+    to[1] = value >> 8;
+}
+
+static uint16_t getLe16(const uint8_t* from) {
+    return from[0] | (from[1] << 8);
+}
+
+SimController& SimController::instance() {
+    static SimController controller;
+    return controller;
+}
+
+SimController::Connection* SimController::findConnection(uint16_t connHandle) {
+    if (connHandle < CONN_HANDLE || connHandle >= CONN_HANDLE + MAX_CONNECTIONS) {
+        return nullptr;
+    }
+    return &connections[connHandle - CONN_HANDLE];
+}
+
+bool SimController::connect(uint16_t connHandle) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Connection* connection = findConnection(connHandle);
+        if (!advertising || connection == nullptr || connection->connected) {
+            return false;
+        }
+        // Advertising stops when a connection is made (Core spec, Vol 6, Part B, 4.4.2).
+        advertising = false;
+        connection->connected = true;
+        connection->bufferedPackets = 0;
+    }
+    struct ble_hci_ev_le_subev_conn_complete event = {};
+    event.subev_code = BLE_HCI_LE_SUBEV_CONN_COMPLETE;
+    event.conn_handle = htole16(connHandle);
+    event.role = BLE_HCI_LE_CONN_COMPLETE_ROLE_SLAVE;
+    event.peer_addr_type = BLE_HCI_CONN_PEER_ADDR_RANDOM;
+    memcpy(event.peer_addr, CENTRAL_ADDR, sizeof(CENTRAL_ADDR));
+    event.peer_addr[0] += connHandle - CONN_HANDLE; // One address per central
+    event.conn_itvl = htole16(6); // 7.5 ms, the shortest a host will grant
+    event.supervision_timeout = htole16(200);
+    sendEvent(BLE_HCI_EVCODE_LE_META, &event, sizeof(event));
+    return true;
+}
+
+void SimController::sendAtt(const uint8_t* pdu, uint16_t length, uint16_t connHandle) {
+    uint8_t header[8];
+    putLe16(header, connHandle | (BLE_HCI_PB_FIRST_FLUSH << 12));
+    putLe16(header + 2, length + 4);
+    putLe16(header + 4, length);
+    putLe16(header + 6, ATT_CID);
+
+    struct os_mbuf* om = ble_transport_alloc_acl_from_ll();
+    if (om == nullptr || os_mbuf_append(om, header, sizeof(header)) != 0 || os_mbuf_append(om, pdu, length) != 0) {
+        fprintf(stderr, "SimController: no buffer for an ACL packet to the host\n");
+        os_mbuf_free_chain(om);
+        return;
+    }
+    ble_transport_to_hs_acl(om);
+}
+
+bool SimController::exchangeMtu(uint16_t mtu, uint32_t timeoutMs, uint16_t connHandle) {
+    uint8_t request[3] = {ATT_OP_MTU_REQ};
+    putLe16(request + 1, mtu);
+    sendAtt(request, sizeof(request), connHandle);
+    uint8_t response[MAX_PDU];
+    return waitForAtt(ATT_OP_MTU_RSP, response, timeoutMs) == 3;
+}
+
+bool SimController::subscribe(uint16_t cccdHandle, uint32_t timeoutMs, uint16_t connHandle) {
+    uint8_t request[5] = {ATT_OP_WRITE_REQ};
+    putLe16(request + 1, cccdHandle);
+    putLe16(request + 3, 0x0001); // Notifications
+    sendAtt(request, sizeof(request), connHandle);
+    uint8_t response[MAX_PDU];
+    return waitForAtt(ATT_OP_WRITE_RSP, response, timeoutMs) == 1;
+}
+
+uint8_t SimController::connectionEvent() {
+    uint8_t event[1 + 4 * MAX_CONNECTIONS];
+    uint8_t handles = 0;
+    uint8_t sent = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+            Connection& connection = connections[i];
+            const uint8_t packets =
+                connection.bufferedPackets < PACKETS_PER_EVENT ? connection.bufferedPackets : PACKETS_PER_EVENT;
+            if (!connection.connected || packets == 0) {
+                continue;
+            }
+            connection.bufferedPackets -= packets;
+            bufferedPackets -= packets;
+            putLe16(event + 1 + 4 * handles, CONN_HANDLE + i);
+            putLe16(event + 3 + 4 * handles, packets);
+            handles++;
+            sent += packets;
+        }
+    }
+    if (sent > 0) {
+        event[0] = handles;
+        sendEvent(BLE_HCI_EVCODE_NUM_COMP_PKTS, event, 1 + 4 * handles);
+        waitForHost();
+    }
+    return sent;
+}
+
+/**
+ * @brief The host handles events on its own thread, from its event queue.
+ * An event of our own, put behind them, runs once the host has handled those
+ * before it: by then it has its credits back and has sent what it held.
+ */
+void SimController::waitForHost() {
+    struct ble_npl_event marker;
+    bool handled = false;
+    ble_npl_event_init(&marker, [](struct ble_npl_event* event) {
+        SimController& controller = SimController::instance();
+        std::lock_guard<std::mutex> guard(controller.lock);
+        *static_cast<bool*>(ble_npl_event_get_arg(event)) = true;
+        controller.hostCaughtUp.notify_all();
+    }, &handled);
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &marker);
+
+    std::unique_lock<std::mutex> guard(lock);
+    hostCaughtUp.wait(guard, [&] { return handled; });
+}
+
+uint16_t SimController::waitForAtt(uint8_t opcode, uint8_t* pdu, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!attArrived.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                             [&] { return attCount[opcode] > attTaken[opcode]; })) {
+        return 0;
+    }
+    attTaken[opcode] = attCount[opcode];
+    memcpy(pdu, lastAtt[opcode], lastAttLength[opcode]);
+    return lastAttLength[opcode];
+}
+
+bool SimController::waitForNotifications(uint32_t count, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(lock);
+    return attArrived.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                               [&] { return attCount[ATT_OP_NOTIFY] >= count; });
+}
+
+bool SimController::isAdvertising() {
+    std::lock_guard<std::mutex> guard(lock);
+    return advertising;
+}
+
+bool SimController::isConnected(uint16_t connHandle) {
+    std::lock_guard<std::mutex> guard(lock);
+    const Connection* connection = findConnection(connHandle);
+    return connection != nullptr && connection->connected;
+}
+
+uint32_t SimController::getNotificationCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return attCount[ATT_OP_NOTIFY];
+}
+
+uint32_t SimController::getNotificationCount(uint16_t connHandle) {
+    std::lock_guard<std::mutex> guard(lock);
+    const Connection* connection = findConnection(connHandle);
+    return connection != nullptr ? connection->notifications : 0;
+}
+
+uint16_t SimController::getNotificationConnHandle(uint32_t number) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (number >= attCount[ATT_OP_NOTIFY] || attCount[ATT_OP_NOTIFY] - number > NOTIFICATION_LOG) {
+        return 0;
+    }
+    return notificationLog[number % NOTIFICATION_LOG];
+}
+
+uint16_t SimController::getLastNotification(uint16_t* attrHandle, uint8_t* value) {
+    std::lock_guard<std::mutex> guard(lock);
+    const uint16_t length = lastAttLength[ATT_OP_NOTIFY];
+    if (length < 3) {
+        return 0;
+    }
+    *attrHandle = getLe16(lastAtt[ATT_OP_NOTIFY] + 1);
+    memcpy(value, lastAtt[ATT_OP_NOTIFY] + 3, length - 3);
+    return length - 3;
+}
+
+uint32_t SimController::getOverflowCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return overflows;
+}
+
+/**
+ * @brief Answers a command as a controller with BLE 4.2, the LE features the
+ * host needs and ACL_BUFFERS buffers would. Commands not listed succeed with
+ * no return parameters, which is what the host expects of the rest it sends.
+ */
+void SimController::receiveCommand(const uint8_t* command) {
+    const uint16_t opcode = getLe16(command);
+    const uint8_t* params = command + 3;
+
+    switch (opcode) {
+    case BLE_HCI_OP(BLE_HCI_OGF_INFO_PARAMS, BLE_HCI_OCF_IP_RD_LOCAL_VER): {
+        struct ble_hci_ip_rd_local_ver_rp rsp = {};
+        rsp.hci_ver = BLE_HCI_VER_BCS_4_2;
+        rsp.lmp_ver = BLE_HCI_VER_BCS_4_2;
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_INFO_PARAMS, BLE_HCI_OCF_IP_RD_LOC_SUPP_CMD): {
+        struct ble_hci_ip_rd_loc_supp_cmd_rp rsp = {};
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_INFO_PARAMS, BLE_HCI_OCF_IP_RD_LOC_SUPP_FEAT): {
+        struct ble_hci_ip_rd_loc_supp_feat_rp rsp = {};
+        rsp.features = htole64(0x0000006000000000); // LE Supported (Controller), no BR/EDR
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_INFO_PARAMS, BLE_HCI_OCF_IP_RD_BD_ADDR): {
+        struct ble_hci_ip_rd_bd_addr_rp rsp;
+        memcpy(rsp.addr, CONTROLLER_ADDR, sizeof(CONTROLLER_ADDR));
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_RD_BUF_SIZE): {
+        struct ble_hci_le_rd_buf_size_rp rsp;
+        rsp.data_len = htole16(ACL_DATA_LENGTH);
+        rsp.data_packets = ACL_BUFFERS;
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_RD_LOC_SUPP_FEAT): {
+        struct ble_hci_le_rd_loc_supp_feat_rp rsp = {};
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_RD_ADV_CHAN_TXPWR): {
+        struct ble_hci_le_rd_adv_chan_txpwr_rp rsp = {};
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_RAND): {
+        struct ble_hci_le_rand_rp rsp;
+        rsp.random_number = htole64(0x0123456789ABCDEF);
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_SET_DATA_LEN): {
+        struct ble_hci_le_set_data_len_rp rsp;
+        rsp.conn_handle = htole16(getLe16(params));
+        commandComplete(opcode, &rsp, sizeof(rsp));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_SET_ADV_ENABLE): {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            advertising = params[0] != 0;
+        }
+        commandComplete(opcode, nullptr, 0);
+        break;
+    }
+    // A peripheral's host reads the central's version, then its features, and
+    // only then reports the connection to the application.
+    case BLE_HCI_OP(BLE_HCI_OGF_LINK_CTRL, BLE_HCI_OCF_RD_REM_VER_INFO): {
+        commandStatus(opcode);
+        struct ble_hci_ev_rd_rem_ver_info_cmp event = {};
+        event.conn_handle = htole16(getLe16(params));
+        event.version = BLE_HCI_VER_BCS_4_2;
+        sendEvent(BLE_HCI_EVCODE_RD_REM_VER_INFO_CMP, &event, sizeof(event));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LE, BLE_HCI_OCF_LE_RD_REM_FEAT): {
+        commandStatus(opcode);
+        struct ble_hci_ev_le_subev_rd_rem_used_feat event = {};
+        event.subev_code = BLE_HCI_LE_SUBEV_RD_REM_USED_FEAT;
+        event.conn_handle = htole16(getLe16(params));
+        sendEvent(BLE_HCI_EVCODE_LE_META, &event, sizeof(event));
+        break;
+    }
+    case BLE_HCI_OP(BLE_HCI_OGF_LINK_CTRL, BLE_HCI_OCF_DISCONNECT_CMD): {
+        commandStatus(opcode);
+        const uint16_t connHandle = getLe16(params);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            Connection* connection = findConnection(connHandle);
+            if (connection != nullptr) {
+                bufferedPackets -= connection->bufferedPackets;
+                *connection = Connection{};
+            }
+        }
+        struct ble_hci_ev_disconn_cmp event;
+        event.status = 0;
+        event.conn_handle = htole16(connHandle);
+        event.reason = BLE_ERR_CONN_TERM_LOCAL;
+        sendEvent(BLE_HCI_EVCODE_DISCONN_CMP, &event, sizeof(event));
+        break;
+    }
+    default:
+        commandComplete(opcode, nullptr, 0);
+        break;
+    }
+}
+
+/**
+ * @brief Takes a packet from the host into an ACL buffer and, if it is a
+ * whole ATT PDU, records it for the test.
+ */
+void SimController::receiveAcl(const uint8_t* packet, uint16_t length) {
+    std::lock_guard<std::mutex> guard(lock);
+    Connection* connection = length >= 4 ? findConnection(getLe16(packet) & 0x0FFF) : nullptr;
+    if (connection == nullptr || !connection->connected) {
+        return; // As a controller drops data for a handle it does not have
+    }
+    if (bufferedPackets == ACL_BUFFERS) {
+        overflows++;
+        return;
+    }
+    connection->bufferedPackets++;
+    bufferedPackets++;
+
+    if (length < 8 || getLe16(packet + 6) != ATT_CID) {
+        return;
+    }
+    const uint16_t pduLength = length - 8 < MAX_PDU ? length - 8 : MAX_PDU;
+    const uint8_t opcode = packet[8];
+    memcpy(lastAtt[opcode], packet + 8, pduLength);
+    lastAttLength[opcode] = pduLength;
+    if (opcode == ATT_OP_NOTIFY) {
+        notificationLog[attCount[opcode] % NOTIFICATION_LOG] = getLe16(packet) & 0x0FFF;
+        connection->notifications++;
+    }
+    attCount[opcode]++;
+    attArrived.notify_all();
+}
+
+void SimController::commandComplete(uint16_t opcode, const void* params, uint8_t length) {
+    uint8_t event[4 + 255];
+    event[0] = 1; // Commands the host may send
+    putLe16(event + 1, opcode);
+    event[3] = BLE_ERR_SUCCESS;
+    if (length > 0) {
+        memcpy(event + 4, params, length);
+    }
+    sendEvent(BLE_HCI_EVCODE_COMMAND_COMPLETE, event, 4 + length);
+}
+
+void SimController::commandStatus(uint16_t opcode) {
+    uint8_t event[4];
+    event[0] = BLE_ERR_SUCCESS;
+    event[1] = 1; // Commands the host may send
+    putLe16(event + 2, opcode);
+    sendEvent(BLE_HCI_EVCODE_COMMAND_STATUS, event, sizeof(event));
+}
+
+void SimController::sendEvent(uint8_t code, const void* params, uint8_t length) {
+    uint8_t* event = static_cast<uint8_t*>(ble_transport_alloc_evt(0));
+    if (event == nullptr) {
+        fprintf(stderr, "SimController: no buffer for HCI event 0x%02x\n", code);
+        return;
+    }
+    event[0] = code;
+    event[1] = length;
+    memcpy(event + 2, params, length);
+    ble_transport_to_hs_evt(event);
+}
+
+// The host's side of the transport ends here, in place of NimBLE's link layer.
+
+extern "C" int ble_transport_to_ll_cmd_impl(void* buf) {
+    SimController::instance().receiveCommand(static_cast<const uint8_t*>(buf));
+    ble_transport_free(buf);
+    return 0;
+}
+
+extern "C" int ble_transport_to_ll_acl_impl(struct os_mbuf* om) {
+    uint8_t packet[4 + SimController::ACL_DATA_LENGTH];
+    const uint16_t length = OS_MBUF_PKTLEN(om) < sizeof(packet) ? OS_MBUF_PKTLEN(om) : sizeof(packet);
+    os_mbuf_copydata(om, 0, length, packet);
+    os_mbuf_free_chain(om);
+    SimController::instance().receiveAcl(packet, length);
+    return 0;
+}
+
+extern "C" int ble_transport_to_ll_iso_impl(struct os_mbuf* om) {
+    os_mbuf_free_chain(om);
+    return 0;
+}
+
+// NimBLEDevice sets the radio's power through the PHY when there is no ESP32
+// controller; the simulated one has no power to set.
+static int txPowerDbm = 0;
+
+extern "C" int ble_phy_tx_power_set(int dbm) {
+    txPowerDbm = dbm;
+    return 0;
+}
+
+extern "C" int ble_phy_tx_power_get(void) {
+    return txPowerDbm;
+}
@@ -0,0 +1,146 @@
+/*
+================================================================================
+= SimController.h (native)                                                     =
+=                                                                              =
+= A Bluetooth LE controller simulated in the test process, for the NimBLE host =
+= running on Linux. It sits under the host's HCI transport: it answers the     =
+= commands the host sends at startup, advertising and disconnection, accepts   =
+= connections from up to MAX_CONNECTIONS simulated centrals, carries ATT PDUs  =
+= both ways and models connection events. Nothing goes over a radio or a       =
+= socket.                                                                      =
+=                                                                              =
+= Packets the host sends stay in the controller's ACL buffers until a          =
+= connection event transmits them, PACKETS_PER_EVENT at most; the host then    =
+= gets its credits back in a Number Of Completed Packets event, as it would    =
+= from the ESP32's controller. The test thread drives the connection events,   =
+= so the flow control the notify path meets is the test's to choose. The       =
+= buffers are shared by the connections, as a controller's LE buffers are.     =
+=                                                                              =
+= There is one controller per process: the transport hooks are C functions.   =
+================================================================================
+*/
+
+#ifndef SIM_CONTROLLER_H
+#define SIM_CONTROLLER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+
+class SimController {
+public:
+    static const uint16_t CONN_HANDLE = 1; // The first central's; the next one's is 2
+    static const uint8_t MAX_CONNECTIONS = 2;
+    static const uint8_t ACL_BUFFERS = 12;      // As many as the host's ACL pool
+    static const uint16_t ACL_DATA_LENGTH = 251; // LE Data Length Extension
+    static const uint8_t PACKETS_PER_EVENT = 6;
+    static const uint16_t MAX_PDU = 256;
+
+    static SimController& instance();
+
+    /**
+     * @brief A simulated central connects with this connection handle, while
+     * the host advertises. Each central has its own address.
+     * @return False if the host is not advertising, the handle is not one of
+     * the MAX_CONNECTIONS from CONN_HANDLE or it is already connected.
+     */
+    bool connect(uint16_t connHandle = CONN_HANDLE);
+
+    /**
+     * @brief A central sends an ATT PDU to the host (L2CAP channel 4).
+     */
+    void sendAtt(const uint8_t* pdu, uint16_t length, uint16_t connHandle = CONN_HANDLE);
+
+    /**
+     * @brief A central exchanges the ATT MTU with the host.
+     * @return False if the host did not answer within timeoutMs.
+     */
+    bool exchangeMtu(uint16_t mtu, uint32_t timeoutMs, uint16_t connHandle = CONN_HANDLE);
+
+    /**
+     * @brief A central subscribes to notifications of a characteristic by
+     * writing its Client Characteristic Configuration descriptor.
+     * @return False if the host did not answer within timeoutMs.
+     */
+    bool subscribe(uint16_t cccdHandle, uint32_t timeoutMs, uint16_t connHandle = CONN_HANDLE);
+
+    /**
+     * @brief Runs one connection event on every connection: transmits up to
+     * PACKETS_PER_EVENT of the packets the host has buffered for each and
+     * reports them completed. Returns once the host has taken its credits
+     * back.
+     * @return The number of packets transmitted.
+     */
+    uint8_t connectionEvent();
+
+    /**
+     * @brief Waits until the host sends an ATT PDU with this opcode that no
+     * earlier wait has taken, and copies it to pdu (MAX_PDU bytes).
+     * @return Its length, or 0 on timeout.
+     */
+    uint16_t waitForAtt(uint8_t opcode, uint8_t* pdu, uint32_t timeoutMs);
+
+    /**
+     * @brief Waits until the host has sent count notifications in all.
+     * @return False on timeout.
+     */
+    bool waitForNotifications(uint32_t count, uint32_t timeoutMs);
+
+    bool isAdvertising();
+    bool isConnected(uint16_t connHandle = CONN_HANDLE);
+
+    // Handle Value Notifications from the host, and the last one's payload.
+    uint32_t getNotificationCount();
+    uint32_t getNotificationCount(uint16_t connHandle);
+    uint16_t getLastNotification(uint16_t* attrHandle, uint8_t* value);
+
+    /**
+     * @brief The connection the notification with this number (0 for the
+     * first the host sent) went out on, in the order the host sent them.
+     * @return 0 if it is not among the last NOTIFICATION_LOG.
+     */
+    uint16_t getNotificationConnHandle(uint32_t number);
+
+    // Packets the host sent that no buffer was free for: a flow-control bug.
+    uint32_t getOverflowCount();
+
+    // Called by the transport hooks, on whichever thread the host sends from.
+    void receiveCommand(const uint8_t* command);
+    void receiveAcl(const uint8_t* packet, uint16_t length);
+
+private:
+    SimController() = default;
+
+    void commandComplete(uint16_t opcode, const void* params, uint8_t length);
+    void commandStatus(uint16_t opcode);
+    void sendEvent(uint8_t code, const void* params, uint8_t length);
+    void waitForHost();
+
+    struct Connection {
+        bool connected = false;
+        uint8_t bufferedPackets = 0;
+        uint32_t notifications = 0;
+    };
+
+    static const uint32_t NOTIFICATION_LOG = 64;
+
+    // nullptr if the handle is not one of the MAX_CONNECTIONS.
+    Connection* findConnection(uint16_t connHandle);
+
+    std::mutex lock;
+    std::condition_variable attArrived;
+    std::condition_variable hostCaughtUp;
+
+    bool advertising = false;
+    Connection connections[MAX_CONNECTIONS];
+    uint8_t bufferedPackets = 0; // Of all connections
+    uint32_t overflows = 0;
+    uint16_t notificationLog[NOTIFICATION_LOG] = {};
+
+    uint32_t attCount[256] = {};
+    uint32_t attTaken[256] = {};
+    uint8_t lastAtt[256][MAX_PDU] = {};
+    uint16_t lastAttLength[256] = {};
+};
+
+#endif // SIM_CONTROLLER_H
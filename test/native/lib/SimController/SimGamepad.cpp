@@ -0,0 +1,50 @@
+/*
+================================================================================
+= SimGamepad.cpp (native)                                                      =
+= The stick's GATT server and its simulated centrals. See SimGamepad.h.        =
+================================================================================
+*/
+
+#include "SimGamepad.h"
+
+#include <NimBLEHIDDevice.h>
+
+NimBLEServer* SimGamepad::server = nullptr;
+NimBLECharacteristic* SimGamepad::inputReport = nullptr;
+
+NimBLECharacteristic* SimGamepad::begin(const uint8_t* reportMap, uint16_t reportMapSize, uint8_t reportId,
+                                        NimBLECharacteristicCallbacks* callbacks) {
+    if (inputReport != nullptr) {
+        return inputReport;
+    }
+    NimBLEDevice::init("Arcade Stick");
+    server = NimBLEDevice::createServer();
+    NimBLEHIDDevice* hid = new NimBLEHIDDevice(server);
+    inputReport = hid->getInputReport(reportId);
+    if (callbacks != nullptr) {
+        inputReport->setCallbacks(callbacks);
+    }
+    hid->setReportMap(const_cast<uint8_t*>(reportMap), reportMapSize);
+    hid->startServices();
+    NimBLEDevice::getAdvertising()->addServiceUUID(hid->getHidService()->getUUID());
+    return inputReport;
+}
+
+bool SimGamepad::connectAndSubscribe(uint16_t connHandle) {
+    SimController& controller = SimController::instance();
+    if (controller.isConnected(connHandle)) {
+        return true;
+    }
+    // Advertising stopped when the last central connected.
+    if (!controller.isAdvertising() && !NimBLEDevice::getAdvertising()->start()) {
+        return false;
+    }
+    const size_t connected = server->getConnectedCount();
+    if (!controller.connect(connHandle) ||
+        !waitUntil([&] { return server->getConnectedCount() == connected + 1; })) {
+        return false;
+    }
+    // The Client Characteristic Configuration descriptor follows the value.
+    return controller.exchangeMtu(CENTRAL_MTU, TIMEOUT_MS, connHandle) &&
+           controller.subscribe(inputReport->getHandle() + 1, TIMEOUT_MS, connHandle);
+}
@@ -0,0 +1,68 @@
+/*
+================================================================================
+= SimGamepad.h (native)                                                        =
+=                                                                              =
+= The test fixture shared by the suites that run the NimBLE host against       =
+= SimController: the stick's GATT server, brought up as BleHidGamepad does,    =
+= and simulated centrals that connect, exchange the MTU and subscribe to its   =
+= input report. The host cannot be stopped on Linux, so it is started once per =
+= process and every step is a no-op when already done.                        =
+================================================================================
+*/
+
+#ifndef SIM_GAMEPAD_H
+#define SIM_GAMEPAD_H
+
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <NimBLEDevice.h>
+#include "SimController.h"
+
+class SimGamepad {
+public:
+    static const uint32_t TIMEOUT_MS = 2000;
+    static const uint16_t CENTRAL_MTU = 247;
+
+    /**
+     * @brief Starts the host with a HID service carrying this report map, and
+     * the mbuf pools with it. Only the first call does anything.
+     * @param callbacks Set on the input report; may be nullptr.
+     * @return The input report characteristic.
+     */
+    static NimBLECharacteristic* begin(const uint8_t* reportMap, uint16_t reportMapSize, uint8_t reportId,
+                                       NimBLECharacteristicCallbacks* callbacks = nullptr);
+
+    /**
+     * @brief Advertises, has a central connect with this connection handle,
+     * exchange the MTU and subscribe to the input report. Call after begin().
+     * @return False if a step failed or timed out; true at once if that
+     * central is already connected.
+     */
+    static bool connectAndSubscribe(uint16_t connHandle = SimController::CONN_HANDLE);
+
+    static NimBLEServer* getServer() { return server; }
+    static NimBLECharacteristic* getInputReport() { return inputReport; }
+
+    /**
+     * @brief Polls a condition every millisecond, for the host's thread to
+     * get there.
+     * @return False if it still did not hold after timeoutMs.
+     */
+    template <typename Condition>
+    static bool waitUntil(Condition&& condition, uint32_t timeoutMs = TIMEOUT_MS) {
+        for (uint32_t ms = 0; ms < timeoutMs; ms++) {
+            if (condition()) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return condition();
+    }
+
+private:
+    static NimBLEServer* server;
+    static NimBLECharacteristic* inputReport;
+};
+
+#endif // SIM_GAMEPAD_H
@@ -0,0 +1,111 @@
+/*
+================================================================================
+= test_chatter_stats                                                           =
+=                                                                              =
+= Burst detection in ChatterStats, and the interval AdaptiveBounce adapts to.  =
+= Levels are fed one scan at a time, as the input task does.                   =
+================================================================================
+*/
+
+#include <unity.h>
+#include "AdaptiveBounce.h"
+
+static const uint32_t SCAN_US = 1000;
+
+static ChatterStats stats;
+
+void setUp() {
+    stats = ChatterStats();
+}
+
+void tearDown() {}
+
+// Feeds the level on every scan from fromUs up to, not including, toUs.
+static void hold(uint32_t fromUs, uint32_t toUs, bool level) {
+    for (uint32_t t = fromUs; t < toUs; t += SCAN_US) {
+        stats.sample(t, level);
+    }
+}
+
+void test_clean_press_is_one_clean_burst() {
+    hold(0, 10000, HIGH);
+    hold(10000, 40000, LOW);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBursts());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBucket(0));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getMaxBounceUs());
+}
+
+void test_bounce_is_measured_from_first_to_last_edge() {
+    stats.sample(0, HIGH);
+    stats.sample(1000, LOW);
+    stats.sample(1300, HIGH);
+    stats.sample(1600, LOW);
+    hold(2000, 10000, LOW);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBursts());
+    TEST_ASSERT_EQUAL_UINT32(600, stats.getMaxBounceUs());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBucket(2)); // (500, 1000] us
+}
+
+// A tap held for 8 ms is a press and a release, not 8 ms of bounce.
+void test_fast_tap_is_two_clean_bursts() {
+    hold(0, 5000, HIGH);
+    hold(5000, 13000, LOW);
+    hold(13000, 30000, HIGH);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.getBursts());
+    TEST_ASSERT_EQUAL_UINT32(2, stats.getBucket(0));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.percentile99Us());
+}
+
+void test_edge_after_settle_starts_new_burst_without_quiet_sample() {
+    stats.sample(0, HIGH);
+    stats.sample(1000, LOW);
+    TEST_ASSERT_TRUE(stats.sample(1000 + ChatterStats::SETTLE_US, HIGH)); // First burst ends
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBursts());
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getMaxBounceUs());
+}
+
+void test_chatter_with_short_gaps_stays_one_burst() {
+    stats.sample(0, HIGH);
+    uint32_t t = 1000;
+    bool level = LOW;
+    for (int edge = 0; edge < 5; edge++) { // An edge every 2 ms: a worn switch
+        stats.sample(t, level);
+        level = !level;
+        t += 2000;
+    }
+    hold(t, t + 10000, !level);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.getBursts());
+    TEST_ASSERT_EQUAL_UINT32(8000, stats.getMaxBounceUs());
+}
+
+// Fast clean taps keep a fresh switch at the minimum interval.
+void test_adaptive_interval_follows_clean_taps() {
+    AdaptiveBounce debouncer;
+    debouncer.attach(4);
+    debouncer.setMode(DebouncerUs::PROMPT_DETECTION);
+    debouncer.interval(5000);
+    debouncer.enableAdaptive(1000, 10000);
+    uint32_t t = 0;
+    for (uint16_t tap = 0; tap < ChatterStats::MIN_SAMPLES; tap++) {
+        for (uint32_t end = t + 8000; t < end; t += SCAN_US) {
+            debouncer.update(t, LOW);
+        }
+        for (uint32_t end = t + 12000; t < end; t += SCAN_US) {
+            debouncer.update(t, HIGH);
+        }
+    }
+    debouncer.update(t + 10000, HIGH);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(ChatterStats::MIN_SAMPLES, debouncer.getStats().getBursts());
+    TEST_ASSERT_EQUAL_UINT32(1000, debouncer.getInterval());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_press_is_one_clean_burst);
+    RUN_TEST(test_bounce_is_measured_from_first_to_last_edge);
+    RUN_TEST(test_fast_tap_is_two_clean_bursts);
+    RUN_TEST(test_edge_after_settle_starts_new_burst_without_quiet_sample);
+    RUN_TEST(test_chatter_with_short_gaps_stays_one_burst);
+    RUN_TEST(test_adaptive_interval_follows_clean_taps);
+    return UNITY_END();
+}
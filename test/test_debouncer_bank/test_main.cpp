@@ -0,0 +1,114 @@
+/*
+================================================================================
+= test_debouncer_bank                                                          =
+=                                                                              =
+= DebouncerBank from the vendored Bounce2, fed through BufferSource: each      =
+= debounce mode, and banks as wide as their mask (32 and 64 inputs), where     =
+= every bit is an input.                                                       =
+================================================================================
+*/
+
+#include <unity.h>
+#include <DebouncerBank.h>
+
+static const uint32_t INTERVAL_US = 5000;
+
+void setUp() {}
+
+void tearDown() {}
+
+template <uint8_t N>
+static void startReleased(DebouncerBank<N, BufferSource>& bank, DebouncerUs::Mode mode) {
+    bank.source().set(~(typename BankMask<N>::type)0); // Pull-ups: released is HIGH
+    bank.setMode(mode);
+    bank.interval(INTERVAL_US);
+    bank.begin(0);
+}
+
+// --- Width ---
+
+void test_narrow_bank_ignores_bits_past_its_inputs() {
+    DebouncerBank<12, BufferSource> bank;
+    startReleased(bank, DebouncerUs::PROMPT_DETECTION);
+    TEST_ASSERT_EQUAL_HEX32(0xFFF, bank.read());
+    TEST_ASSERT_EQUAL_HEX32(0xFFF, bank.raw());
+}
+
+void test_32_input_bank_uses_every_bit() {
+    DebouncerBank<32, BufferSource> bank;
+    startReleased(bank, DebouncerUs::PROMPT_DETECTION);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, bank.read());
+
+    bank.source().set(31, LOW);
+    const DebouncerBank<32, BufferSource>::Changes& changes = bank.update(10000);
+    TEST_ASSERT_EQUAL_HEX32(0x80000000, changes.fell);
+    TEST_ASSERT_FALSE(bank.read(31));
+    TEST_ASSERT_TRUE(bank.read(0));
+}
+
+void test_64_input_bank_uses_every_bit() {
+    DebouncerBank<64, BufferSource> bank;
+    startReleased(bank, DebouncerUs::PROMPT_DETECTION);
+    TEST_ASSERT_TRUE(bank.read() == ~(uint64_t)0);
+
+    bank.source().set(63, LOW);
+    TEST_ASSERT_TRUE(bank.update(10000).fell == (uint64_t)1 << 63);
+    TEST_ASSERT_FALSE(bank.read(63));
+}
+
+// --- Modes ---
+
+void test_prompt_detection_reports_first_edge_and_skips_bounce() {
+    DebouncerBank<8, BufferSource> bank;
+    startReleased(bank, DebouncerUs::PROMPT_DETECTION);
+    bank.source().set(2, LOW);
+    TEST_ASSERT_TRUE(bank.update(10000).changed == 1 << 2); // At once
+    bank.source().set(2, HIGH);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(10300).changed); // Bounce
+    bank.source().set(2, LOW);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(10600).changed);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(20000).changed);
+    TEST_ASSERT_FALSE(bank.read(2));
+}
+
+void test_stable_interval_waits_for_a_quiet_interval() {
+    DebouncerBank<8, BufferSource> bank;
+    startReleased(bank, DebouncerUs::STABLE_INTERVAL);
+    bank.source().set(5, LOW);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(10000).changed);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(14999).changed);
+    TEST_ASSERT_TRUE(bank.update(15000).fell == 1 << 5);
+}
+
+void test_lock_out_ignores_edges_within_the_interval() {
+    DebouncerBank<8, BufferSource> bank;
+    startReleased(bank, DebouncerUs::LOCK_OUT);
+    bank.source().set(0, LOW);
+    TEST_ASSERT_TRUE(bank.update(100).fell == 1);
+    bank.source().set(0, HIGH);
+    TEST_ASSERT_EQUAL_HEX32(0, bank.update(4000).changed);
+    TEST_ASSERT_TRUE(bank.update(5100).rose == 1);
+}
+
+void test_inputs_keep_their_own_mode_and_interval() {
+    DebouncerBank<8, BufferSource> bank;
+    startReleased(bank, DebouncerUs::PROMPT_DETECTION);
+    bank.setMode(1, DebouncerUs::STABLE_INTERVAL);
+    bank.interval(1, 2000);
+    bank.source().set(0xFCu); // Inputs 0 and 1 pressed
+    TEST_ASSERT_TRUE(bank.update(10000).fell == 1 << 0);
+    TEST_ASSERT_TRUE(bank.update(12000).fell == 1 << 1);
+    TEST_ASSERT_EQUAL_UINT32(2000, bank.currentDuration(0));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_narrow_bank_ignores_bits_past_its_inputs);
+    RUN_TEST(test_32_input_bank_uses_every_bit);
+    RUN_TEST(test_64_input_bank_uses_every_bit);
+    RUN_TEST(test_prompt_detection_reports_first_edge_and_skips_bounce);
+    RUN_TEST(test_stable_interval_waits_for_a_quiet_interval);
+    RUN_TEST(test_lock_out_ignores_edges_within_the_interval);
+    RUN_TEST(test_inputs_keep_their_own_mode_and_interval);
+    return UNITY_END();
+}
@@ -0,0 +1,164 @@
+/*
+================================================================================
+= test_edge_bounce                                                             =
+=                                                                              =
+= EdgeBounce from the vendored Bounce2, the debouncer fed by a pin interrupt.  =
+= The tests call ingest() as the interrupt would, with the edge's timestamp   =
+= and level, and update() as the input task would, every POLL_US.             =
+================================================================================
+*/
+
+#include <unity.h>
+#include <Bounce2.h>
+
+static const uint8_t PIN = 13;
+static const uint32_t INTERVAL_US = 5000;
+static const uint32_t POLL_US = 1000;
+
+struct Edge {
+    uint32_t timestampUs;
+    bool level;
+};
+
+// A press that bounces, a clean hold, a release that bounces, and a glitch
+// shorter than the interval, which only STABLE_INTERVAL filters out.
+static const Edge BOUNCY_PRESSES[] = {
+    {10000, LOW},  {10150, HIGH}, {10300, LOW},  {10420, HIGH}, {10600, LOW},
+    {40000, HIGH}, {40080, LOW},  {40200, HIGH}, {70000, LOW},  {70050, HIGH},
+};
+
+void setUp() {
+    nativeMicros = 0;
+    nativePins[PIN] = HIGH; // Pull-up: released
+}
+
+void tearDown() {}
+
+static void attach(EdgeBounce& bounce, DebouncerUs::Mode mode) {
+    bounce.setMode(mode);
+    bounce.interval(INTERVAL_US);
+    bounce.attach(PIN);
+}
+
+// --- Replay ---
+
+// update() replays each queued edge at its own timestamp, so EdgeBounce
+// decides exactly what a DebouncerUs updated at every edge and every poll
+// decides, in each mode, though it only runs once per poll.
+static void replaysLikeDebouncerUs(DebouncerUs::Mode mode, uint8_t expectedChanges) {
+    EdgeBounce edges;
+    attach(edges, mode);
+    BounceUs reference;
+    reference.setMode(mode);
+    reference.interval(INTERVAL_US);
+    reference.attach(PIN);
+
+    uint8_t changes = 0;
+    size_t next = 0;
+    for (uint32_t now = POLL_US; now <= 100000; now += POLL_US) {
+        for (; next < sizeof(BOUNCY_PRESSES) / sizeof(BOUNCY_PRESSES[0]) &&
+               BOUNCY_PRESSES[next].timestampUs <= now;
+             next++) {
+            const Edge& edge = BOUNCY_PRESSES[next];
+            edges.ingest(edge.timestampUs, edge.level);
+            nativePins[PIN] = edge.level;
+            reference.update(edge.timestampUs);
+        }
+        const bool referenceChanged = reference.update(now);
+        const bool changed = edges.update(now);
+
+        TEST_ASSERT_EQUAL(reference.read(), edges.read());
+        TEST_ASSERT_EQUAL_UINT32(reference.previousDuration(), edges.previousDuration());
+        TEST_ASSERT_EQUAL_UINT32(reference.currentDuration(), edges.currentDuration());
+        if (changed) {
+            changes++;
+        }
+        // The reference may have changed at an edge, before this poll.
+        TEST_ASSERT_TRUE(!referenceChanged || changed);
+    }
+    TEST_ASSERT_EQUAL_UINT8(expectedChanges, changes);
+    TEST_ASSERT_EQUAL_UINT32(0, edges.getDroppedEdges());
+}
+
+void test_replay_matches_debouncer_us_stable_interval() {
+    replaysLikeDebouncerUs(DebouncerUs::STABLE_INTERVAL, 2);
+}
+
+void test_replay_matches_debouncer_us_lock_out() {
+    replaysLikeDebouncerUs(DebouncerUs::LOCK_OUT, 4);
+}
+
+void test_replay_matches_debouncer_us_prompt_detection() {
+    replaysLikeDebouncerUs(DebouncerUs::PROMPT_DETECTION, 4);
+}
+
+// --- Edges ---
+
+// After a burst, fell() and rose() hold for the one update() that saw it, and
+// the durations run from the interrupt's timestamps, not from the polls.
+void test_edges_and_durations_after_bounce_burst() {
+    EdgeBounce bounce;
+    attach(bounce, DebouncerUs::PROMPT_DETECTION);
+
+    const Edge press[] = {{100000, LOW}, {100100, HIGH}, {100200, LOW}, {100350, HIGH}, {100500, LOW}};
+    for (const Edge& edge : press) {
+        bounce.ingest(edge.timestampUs, edge.level);
+    }
+    TEST_ASSERT_TRUE(bounce.update(100600));
+    TEST_ASSERT_TRUE(bounce.fell());
+    TEST_ASSERT_FALSE(bounce.rose());
+    TEST_ASSERT_FALSE(bounce.read());
+    TEST_ASSERT_EQUAL_UINT32(100000, bounce.previousDuration()); // Released since attach()
+    TEST_ASSERT_EQUAL_UINT32(600, bounce.currentDuration());
+
+    TEST_ASSERT_FALSE(bounce.update(101600));
+    TEST_ASSERT_FALSE(bounce.fell());
+
+    const Edge release[] = {{200000, HIGH}, {200080, LOW}, {200160, HIGH}};
+    for (const Edge& edge : release) {
+        bounce.ingest(edge.timestampUs, edge.level);
+    }
+    TEST_ASSERT_TRUE(bounce.update(200500));
+    TEST_ASSERT_TRUE(bounce.rose());
+    TEST_ASSERT_FALSE(bounce.fell());
+    TEST_ASSERT_EQUAL_UINT32(100000, bounce.previousDuration()); // Held from the first edge
+    TEST_ASSERT_EQUAL_UINT32(500, bounce.currentDuration());
+    TEST_ASSERT_EQUAL_UINT32(0, bounce.getDroppedEdges());
+}
+
+// --- Overflow ---
+
+// A burst longer than the queue drops the edges past it. The queue alone
+// ends pressed, but the last edge the interrupt saw was a release: update()
+// trusts that, so no press is reported, and later edges debounce as usual.
+void test_overflow_resyncs_to_live_level() {
+    EdgeBounce bounce;
+    attach(bounce, DebouncerUs::STABLE_INTERVAL);
+
+    const uint8_t burst = 20;
+    for (uint8_t i = 0; i < burst; i++) {
+        bounce.ingest(1000 + 10 * i, i % 2 == 1); // LOW first, HIGH last
+    }
+    // One slot stays empty to tell a full queue from an empty one.
+    TEST_ASSERT_EQUAL_UINT32(burst - (EdgeBounce::QUEUE_SIZE - 1), bounce.getDroppedEdges());
+
+    TEST_ASSERT_FALSE(bounce.update(20000));
+    TEST_ASSERT_TRUE(bounce.read());
+    TEST_ASSERT_FALSE(bounce.update(30000));
+    TEST_ASSERT_TRUE(bounce.read());
+
+    bounce.ingest(40000, LOW);
+    TEST_ASSERT_FALSE(bounce.update(41000));
+    TEST_ASSERT_TRUE(bounce.update(45000));
+    TEST_ASSERT_TRUE(bounce.fell());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_matches_debouncer_us_stable_interval);
+    RUN_TEST(test_replay_matches_debouncer_us_lock_out);
+    RUN_TEST(test_replay_matches_debouncer_us_prompt_detection);
+    RUN_TEST(test_edges_and_durations_after_bounce_burst);
+    RUN_TEST(test_overflow_resyncs_to_live_level);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+/*
+================================================================================
+= test_flash_writes                                                            =
+=                                                                              =
+= When the firmware writes its settings to flash: PendingWrites, the change    =
+= count of the host slot table and of the bond store, and FlashWriteWindow,   =
+= the FLASH_WRITE_IDLE_MS gate manageFlashWrites() applies. The stall a write  =
+= causes is measured on the stick ('n'); these check that it cannot happen    =
+= while the input is in use.                                                   =
+================================================================================
+*/
+
+#include <unity.h>
+#include "FlashWrites.h"
+
+static const uint32_t IDLE_MS = 2000; // FLASH_WRITE_IDLE_MS
+static const uint32_t IDLE_US = IDLE_MS * 1000;
+static const uint32_t SCAN_US = 1000;
+static const uint32_t LOOP_US = 10000;
+
+void setUp() {}
+
+void tearDown() {}
+
+// --- Pending Writes ---
+
+void test_changes_pending_until_saved() {
+    PendingWrites writes;
+    TEST_ASSERT_FALSE(writes.isDirty());
+
+    writes.markChanged();
+    writes.markChanged();
+    TEST_ASSERT_TRUE(writes.isDirty());
+    writes.markSaved(writes.snapshot());
+    TEST_ASSERT_FALSE(writes.isDirty());
+}
+
+// A change made between the snapshot and the end of the write (the BLE host
+// task bonding a host meanwhile) is not covered by it.
+void test_change_during_write_stays_pending() {
+    PendingWrites writes;
+    writes.markChanged();
+
+    const uint32_t changes = writes.snapshot();
+    writes.markChanged();
+    writes.markSaved(changes);
+    TEST_ASSERT_TRUE(writes.isDirty());
+
+    writes.markSaved(writes.snapshot());
+    TEST_ASSERT_FALSE(writes.isDirty());
+}
+
+// --- Idle Window ---
+
+// The window opens IDLE_MS after the last activity, not a microsecond
+// sooner, and only with something to write and nothing blocking it.
+void test_window_opens_after_idle_time() {
+    FlashWriteWindow window(IDLE_MS);
+    const uint32_t pressUs = 5000000;
+    window.recordActivity(pressUs);
+
+    for (uint32_t nowUs = pressUs; nowUs < pressUs + IDLE_US; nowUs += LOOP_US) {
+        TEST_ASSERT_FALSE(window.shouldFlush(nowUs, true, false));
+    }
+    TEST_ASSERT_FALSE(window.shouldFlush(pressUs + IDLE_US - 1, true, false));
+    TEST_ASSERT_TRUE(window.shouldFlush(pressUs + IDLE_US, true, false));
+
+    TEST_ASSERT_FALSE(window.shouldFlush(pressUs + IDLE_US, false, false)); // Nothing pending
+    TEST_ASSERT_FALSE(window.shouldFlush(pressUs + IDLE_US, true, true));   // Benchmark running
+}
+
+// The loop reads the clock, then the input task stamps a scan a little later:
+// that scan is recent, not 2^32 us old.
+void test_scan_stamped_after_loop_clock_is_recent() {
+    FlashWriteWindow window(IDLE_MS);
+    const uint32_t loopUs = 9000000;
+    window.recordActivity(loopUs + 40);
+    TEST_ASSERT_FALSE(window.isIdle(loopUs));
+    TEST_ASSERT_FALSE(window.isIdle(loopUs + IDLE_US));
+    TEST_ASSERT_TRUE(window.isIdle(loopUs + 40 + IDLE_US));
+}
+
+// micros() wraps every 71 minutes; the age is taken across the wrap.
+void test_window_across_clock_wrap() {
+    FlashWriteWindow window(IDLE_MS);
+    const uint32_t pressUs = UINT32_MAX - 500000;
+    window.recordActivity(pressUs);
+    TEST_ASSERT_FALSE(window.isIdle(pressUs + IDLE_US / 2)); // Past the wrap
+    TEST_ASSERT_TRUE(window.isIdle(pressUs + IDLE_US));
+}
+
+// --- Play ---
+
+// Taps every 1.5 s, with a host bonding in the middle of them: a scan every
+// SCAN_US, the loop every LOOP_US flushing whenever the window says so. No
+// write lands within IDLE_MS of a press, and the one pending is written once
+// the taps stop.
+void test_no_write_while_playing() {
+    FlashWriteWindow window(IDLE_MS);
+    PendingWrites writes;
+    const uint32_t startUs = 1000000;
+    const uint32_t stopUs = startUs + 12000000;
+    uint32_t lastPressUs = 0;
+    uint32_t flushes = 0;
+
+    for (uint32_t nowUs = startUs; nowUs < stopUs + 2 * IDLE_US; nowUs += SCAN_US) {
+        const bool held = nowUs < stopUs && (nowUs - startUs) % 1500000 < 80000; // 80 ms taps
+        if (held) {
+            window.recordActivity(nowUs);
+            lastPressUs = nowUs;
+        }
+        if (nowUs == startUs + 4000000) {
+            writes.markChanged(); // A host pairs
+        }
+        if (nowUs % LOOP_US == 0 && window.shouldFlush(nowUs, writes.isDirty(), false)) {
+            TEST_ASSERT_TRUE(nowUs - lastPressUs >= IDLE_US);
+            writes.markSaved(writes.snapshot());
+            flushes++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, flushes);
+    TEST_ASSERT_FALSE(writes.isDirty());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_changes_pending_until_saved);
+    RUN_TEST(test_change_during_write_stays_pending);
+    RUN_TEST(test_window_opens_after_idle_time);
+    RUN_TEST(test_scan_stamped_after_loop_clock_is_recent);
+    RUN_TEST(test_window_across_clock_wrap);
+    RUN_TEST(test_no_write_while_playing);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+/*
+================================================================================
+= test_macro_engine                                                            =
+=                                                                              =
+= MacroEngine timing on the host: the engine only sees the scan timestamps it  =
+= is given, so every case drives it with a hand-made sequence of scans.        =
+================================================================================
+*/
+
+#include <unity.h>
+#include "MacroEngine.h"
+
+static const uint32_t SCAN_US = 1000;
+static const uint16_t BUTTON_1 = 1 << 0;
+
+static MacroEngine engine;
+
+void setUp() {
+    engine = MacroEngine();
+}
+
+void tearDown() {}
+
+static GamepadReport held(uint16_t buttons) {
+    GamepadReport report = EMPTY_GAMEPAD_REPORT;
+    report.buttons = buttons;
+    return report;
+}
+
+static uint16_t scan(uint32_t nowUs, uint16_t physical = 0) {
+    return engine.process(nowUs, held(physical)).buttons;
+}
+
+// --- Turbo ---
+
+// 10 Hz: on for 50 ms, off for 50 ms, counted from the press, not from a grid.
+void test_turbo_phase_follows_press() {
+    engine.setTurbo(0, 10);
+    const uint32_t pressUs = 1234567;
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs + 49999, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(0, scan(pressUs + 50000, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(0, scan(pressUs + 99999, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs + 100000, BUTTON_1));
+}
+
+void test_turbo_new_press_restarts_phase() {
+    engine.setTurbo(0, 10);
+    scan(0, BUTTON_1);
+    TEST_ASSERT_EQUAL_UINT16(0, scan(60000, BUTTON_1)); // Off half
+    scan(61000, 0);                                      // Released
+    const uint32_t pressUs = 62345;
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs + 49999, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(0, scan(pressUs + 50000, BUTTON_1));
+}
+
+void test_turbo_leaves_other_buttons_alone() {
+    engine.setTurbo(0, 10);
+    const uint16_t both = BUTTON_1 | (1 << 3);
+    scan(0, both);
+    TEST_ASSERT_EQUAL_UINT16(1 << 3, scan(50000, both));
+    engine.setTurbo(0, 0);
+    TEST_ASSERT_EQUAL_UINT16(both, scan(51000, both));
+}
+
+// --- Macro playback ---
+
+static const MacroStep SEQUENCE[] = {
+    {1 << 0, HAT_CENTERED, 10000},
+    {1 << 1, HAT_CENTERED, 10000},
+    {1 << 2, HAT_DOWN, 10000},
+};
+
+void test_macro_steps_start_on_their_deadlines() {
+    TEST_ASSERT_TRUE(engine.loadSequence(SEQUENCE, 3));
+    const uint32_t startUs = 500;
+    engine.play(startUs);
+    for (uint32_t t = startUs; t < startUs + 40000; t += SCAN_US) {
+        const uint32_t elapsed = t - startUs;
+        const uint16_t expected = elapsed < 30000 ? SEQUENCE[elapsed / 10000].buttons : 0;
+        TEST_ASSERT_EQUAL_UINT16(expected, scan(t));
+    }
+    TEST_ASSERT_FALSE(engine.isPlaying());
+}
+
+void test_macro_hat_step_overrides_hat() {
+    engine.loadSequence(SEQUENCE, 3);
+    engine.play(0);
+    TEST_ASSERT_EQUAL_UINT8(HAT_CENTERED, engine.process(15000, EMPTY_GAMEPAD_REPORT).hat);
+    TEST_ASSERT_EQUAL_UINT8(HAT_DOWN, engine.process(25000, EMPTY_GAMEPAD_REPORT).hat);
+}
+
+// A late scan shows the step it lands in, and does not push back the ones
+// after it: deadlines chain from the previous deadline, not from the scan.
+void test_macro_late_scan_does_not_shift_later_steps() {
+    engine.loadSequence(SEQUENCE, 3);
+    engine.play(0);
+    TEST_ASSERT_EQUAL_UINT16(1 << 0, scan(9000));
+    TEST_ASSERT_EQUAL_UINT16(1 << 1, scan(13700)); // 3.7 ms late
+    TEST_ASSERT_EQUAL_UINT16(1 << 1, scan(19999));
+    TEST_ASSERT_EQUAL_UINT16(1 << 2, scan(20000));
+}
+
+void test_macro_late_scan_skips_whole_steps() {
+    engine.loadSequence(SEQUENCE, 3);
+    engine.play(0);
+    scan(1000);
+    TEST_ASSERT_EQUAL_UINT16(1 << 2, scan(21000)); // Step 2 missed entirely
+    TEST_ASSERT_TRUE(engine.isPlaying());
+    TEST_ASSERT_EQUAL_UINT16(0, scan(45000));
+    TEST_ASSERT_FALSE(engine.isPlaying());
+}
+
+// --- micros() wraparound (every 71.6 minutes) ---
+
+void test_macro_deadlines_across_wraparound() {
+    engine.loadSequence(SEQUENCE, 3);
+    const uint32_t startUs = 0xFFFFFFFFUL - 15000;
+    engine.play(startUs);
+    TEST_ASSERT_EQUAL_UINT16(1 << 0, scan(startUs + 9999));
+    TEST_ASSERT_EQUAL_UINT16(1 << 1, scan(startUs + 10000));
+    TEST_ASSERT_EQUAL_UINT16(1 << 1, scan(startUs + 19999)); // Wrapped past 0
+    TEST_ASSERT_EQUAL_UINT16(1 << 2, scan(startUs + 20000));
+    TEST_ASSERT_EQUAL_UINT16(0, scan(startUs + 30000));
+    TEST_ASSERT_FALSE(engine.isPlaying());
+}
+
+void test_turbo_phase_across_wraparound() {
+    engine.setTurbo(0, 10);
+    const uint32_t pressUs = 0xFFFFFFFFUL - 20000;
+    scan(pressUs, BUTTON_1);
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs + 49999, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(0, scan(pressUs + 50000, BUTTON_1));
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, scan(pressUs + 100000, BUTTON_1));
+}
+
+// --- Recording ---
+
+void test_recording_drops_idle_head_and_tail() {
+    engine.startRecording(0);
+    scan(5000);
+    scan(10000, BUTTON_1);
+    scan(30000, 1 << 1);
+    scan(45000);
+    engine.stopRecording(90000);
+    TEST_ASSERT_EQUAL_UINT8(2, engine.getStepCount());
+    TEST_ASSERT_EQUAL_UINT16(BUTTON_1, engine.getStep(0).buttons);
+    TEST_ASSERT_EQUAL_UINT32(20000, engine.getStep(0).durationUs);
+    TEST_ASSERT_EQUAL_UINT16(1 << 1, engine.getStep(1).buttons);
+    TEST_ASSERT_EQUAL_UINT32(15000, engine.getStep(1).durationUs);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_turbo_phase_follows_press);
+    RUN_TEST(test_turbo_new_press_restarts_phase);
+    RUN_TEST(test_turbo_leaves_other_buttons_alone);
+    RUN_TEST(test_macro_steps_start_on_their_deadlines);
+    RUN_TEST(test_macro_hat_step_overrides_hat);
+    RUN_TEST(test_macro_late_scan_does_not_shift_later_steps);
+    RUN_TEST(test_macro_late_scan_skips_whole_steps);
+    RUN_TEST(test_macro_deadlines_across_wraparound);
+    RUN_TEST(test_turbo_phase_across_wraparound);
+    RUN_TEST(test_recording_drops_idle_head_and_tail);
+    return UNITY_END();
+}
@@ -0,0 +1,112 @@
+/*
+================================================================================
+= test_matrix_source                                                           =
+=                                                                              =
+= MatrixSource from the vendored Bounce2, through its pinMode()/digitalWrite()/ =
+= digitalRead() scan: the native Arduino stand-in couples a row to a column    =
+= while the key between them is pressed, with or without a diode per key.      =
+================================================================================
+*/
+
+#include <unity.h>
+#include <DebouncerBank.h>
+
+static const uint8_t ROWS = 3;
+static const uint8_t COLUMNS = 4;
+static const uint8_t ROW_PINS[ROWS] = {16, 17, 18};
+static const uint8_t COLUMN_PINS[COLUMNS] = {25, 26, 27, 32};
+
+typedef MatrixSource<ROWS * COLUMNS> Matrix;
+
+void setUp() {
+    memset(nativeSwitches, 0, sizeof(nativeSwitches));
+    nativeDiodes = false;
+}
+
+void tearDown() {}
+
+static void press(uint8_t row, uint8_t column, bool pressed = true) {
+    nativeSetSwitch(ROW_PINS[row], COLUMN_PINS[column], pressed);
+}
+
+// Input i is row i / COLUMNS, column i % COLUMNS; LOW (0) while pressed.
+static Matrix::Mask key(uint8_t row, uint8_t column) {
+    return (Matrix::Mask)1 << (row * COLUMNS + column);
+}
+
+// --- Layout ---
+
+// Each pressed key clears its own bit of the word, and nothing else; every
+// row is released again after the scan.
+void test_packed_word_follows_gpio_layout() {
+    nativeDiodes = true;
+    Matrix matrix;
+    matrix.attach(ROW_PINS, ROWS, COLUMN_PINS, COLUMNS);
+    TEST_ASSERT_EQUAL_HEX32(~(Matrix::Mask)0, matrix.read());
+
+    press(0, 1);
+    press(1, 3); // Column on a GPIO above 31
+    press(2, 0);
+    TEST_ASSERT_EQUAL_HEX32(~(key(0, 1) | key(1, 3) | key(2, 0)), matrix.read());
+    for (uint8_t r = 0; r < ROWS; r++) {
+        TEST_ASSERT_EQUAL_UINT8(INPUT, nativePinModes[ROW_PINS[r]]);
+    }
+
+    press(1, 3, false);
+    TEST_ASSERT_EQUAL_HEX32(~(key(0, 1) | key(2, 0)), matrix.read());
+    TEST_ASSERT_EQUAL_HEX32(0, matrix.ghosted());
+}
+
+// --- Ghosting ---
+
+// Without diodes, a third key on the corners of a rectangle makes the fourth
+// read pressed too. The whole rectangle keeps its previous levels until it
+// breaks up.
+void test_rectangle_without_diodes_holds_previous_level() {
+    Matrix matrix;
+    matrix.attach(ROW_PINS, ROWS, COLUMN_PINS, COLUMNS, false);
+
+    press(0, 0);
+    press(1, 0);
+    const Matrix::Mask before = ~(key(0, 0) | key(1, 0));
+    TEST_ASSERT_EQUAL_HEX32(before, matrix.read());
+    TEST_ASSERT_EQUAL_HEX32(0, matrix.ghosted());
+
+    press(0, 1);
+    const Matrix::Mask rectangle = key(0, 0) | key(0, 1) | key(1, 0) | key(1, 1);
+    TEST_ASSERT_EQUAL_HEX32(before, matrix.read()); // Neither (0, 1) nor the ghost (1, 1)
+    TEST_ASSERT_EQUAL_HEX32(rectangle, matrix.ghosted());
+    TEST_ASSERT_EQUAL_UINT32(1, matrix.ghostedScans());
+
+    press(1, 0, false);
+    TEST_ASSERT_EQUAL_HEX32(~(key(0, 0) | key(0, 1)), matrix.read());
+    TEST_ASSERT_EQUAL_HEX32(0, matrix.ghosted());
+    TEST_ASSERT_EQUAL_UINT32(1, matrix.ghostedScans());
+}
+
+// With a diode per key the fourth corner reads released, and a matrix
+// attached with diodes never holds an input back.
+void test_diode_matrix_never_ghosts() {
+    nativeDiodes = true;
+    Matrix matrix;
+    matrix.attach(ROW_PINS, ROWS, COLUMN_PINS, COLUMNS);
+
+    press(0, 0);
+    press(1, 0);
+    press(0, 1);
+    TEST_ASSERT_EQUAL_HEX32(~(key(0, 0) | key(0, 1) | key(1, 0)), matrix.read());
+    TEST_ASSERT_EQUAL_HEX32(0, matrix.ghosted());
+
+    press(1, 1); // A real fourth key: all four pressed
+    TEST_ASSERT_EQUAL_HEX32(~(key(0, 0) | key(0, 1) | key(1, 0) | key(1, 1)), matrix.read());
+    TEST_ASSERT_EQUAL_HEX32(0, matrix.ghosted());
+    TEST_ASSERT_EQUAL_UINT32(0, matrix.ghostedScans());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_packed_word_follows_gpio_layout);
+    RUN_TEST(test_rectangle_without_diodes_holds_previous_level);
+    RUN_TEST(test_diode_matrix_never_ghosts);
+    return UNITY_END();
+}
@@ -0,0 +1,215 @@
+/*
+================================================================================
+= test_microbench                                                              =
+=                                                                              =
+= The input and Bluetooth hot paths on the PC, one operation at a time: the   =
+= debouncers, SOCD, report build, the NimBLE mbuf calls a notification makes  =
+= and the notification itself, sent to SimController (test/native/lib). Each  =
+= operation prints one JSON line with its ns and heap allocations per op,     =
+= between a "suite" line and a "suite_end" line, for tools/microbench.py to   =
+= compare between builds. The times are the PC's, not the ESP32's; the        =
+= allocations count the same on both.                                          =
+================================================================================
+*/
+
+#include <stdio.h>
+#include <unity.h>
+#include <Bounce2.h>
+#include <DebouncerBank.h>
+#include <NativeAllocs.h>
+#include <NativeBench.h>
+#include <NimBLEDevice.h>
+#include <SimController.h>
+#include <SimGamepad.h>
+#include "InputStages.h"
+
+static const uint32_t BENCHMARK_OPS = 500000;
+static const uint32_t BATCH_OPS = 50; // One PatternScanStage press and release
+static const uint32_t NOTIFY_OPS = 60000;
+static const uint32_t NOTIFY_BATCH_OPS = 60; // Ten connection events
+
+static const uint8_t BUTTON_PIN = 13; // The firmware's button 1
+static const int BUTTON_MAP[TOTAL_BUTTONS] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+static SimController& controller = SimController::instance();
+static NimBLECharacteristic* inputReport = nullptr;
+static uint8_t benchmarks = 0;
+
+/**
+ * @brief Runs an operation BENCHMARK_OPS times (or ops) and prints its line.
+ * The time includes making the operation's input, such as the pattern scan;
+ * allocations include those of the host's thread meanwhile.
+ */
+template <typename Operation>
+static void measure(const char* name, uint32_t ops, uint32_t batchSize, Operation&& operation) {
+    const uint32_t allocsBefore = nativeAllocCount.load();
+    const BenchResult result = measureBench(ops, batchSize, operation);
+    const uint32_t allocs = nativeAllocCount.load() - allocsBefore;
+    printf("{\"bench\":\"%s\",\"ops\":%lu,\"min_ns\":%.2f,\"avg_ns\":%.2f,\"allocs_per_op\":%.3f}\n", name,
+           (unsigned long)ops, result.minNs, result.avgNs, (double)allocs / ops);
+    benchmarks++;
+    TEST_ASSERT_TRUE(result.minNs > 0);
+}
+
+template <typename Operation>
+static void measure(const char* name, Operation&& operation) {
+    measure(name, BENCHMARK_OPS, BATCH_OPS, operation);
+}
+
+/**
+ * @brief Starts the host with the stick's HID service and has the central
+ * connect and subscribe to the input report, the first time. The mbuf pools
+ * exist from here on too.
+ */
+static void connectAndSubscribe() {
+    inputReport = SimGamepad::begin(StickReportLayout::descriptor.data(), StickReportLayout::descriptor.size(),
+                                    GAMEPAD_REPORT_ID);
+    TEST_ASSERT_TRUE(SimGamepad::connectAndSubscribe());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// --- Input ---
+
+void test_bounce2_update() {
+    Bounce bounce;
+    bounce.attach(BUTTON_PIN, INPUT_PULLUP);
+    bounce.interval(5);
+    PatternScanStage pattern{BUTTON_PIN, 0};
+    InputFrame frame = {};
+    measure("bounce2_update", [&](uint32_t i) {
+        pattern.process(frame);
+        nativePins[BUTTON_PIN] = (frame.levels >> BUTTON_PIN) & 1;
+        nativeMicros = i * 1000;
+        nativeBenchSink = bounce.update();
+    });
+}
+
+void test_adaptive_bounce_update() {
+    AdaptiveBounce debouncer;
+    debouncer.attach(BUTTON_PIN, INPUT_PULLUP);
+    debouncer.setMode(DebouncerUs::PROMPT_DETECTION);
+    debouncer.interval(5000);
+    PatternScanStage pattern{BUTTON_PIN, 0};
+    InputFrame frame = {};
+    measure("adaptive_bounce_update", [&](uint32_t i) {
+        pattern.process(frame);
+        nativeBenchSink = debouncer.update(i * 1000, (frame.levels >> BUTTON_PIN) & 1);
+    });
+}
+
+// Every ESP32 GPIO in one bank, fed the scanned levels as they are.
+void test_debouncer_bank_update() {
+    DebouncerBank<40, BufferSource> bank;
+    bank.source().set(~(uint64_t)0);
+    bank.setMode(DebouncerUs::PROMPT_DETECTION);
+    bank.interval(5000);
+    bank.begin(0);
+    PatternScanStage pattern{BUTTON_PIN, 0};
+    InputFrame frame = {};
+    measure("debouncer_bank_update", [&](uint32_t i) {
+        pattern.process(frame);
+        bank.source().set(frame.levels);
+        nativeBenchSink = (uint32_t)bank.update(i * 1000).changed;
+    });
+}
+
+void test_socd_resolve() {
+    SocdStage socd{SOCD_UP_LEFT_PRIORITY, 0, 0, 0};
+    InputFrame frame = {};
+    measure("socd_resolve", [&](uint32_t i) {
+        frame.directions = (i >> 2) & 0x0F; // Every combination, opposing ones included
+        socd.process(frame);
+        nativeBenchSink = frame.physical.hat;
+    });
+}
+
+void test_report_build() {
+    Pipeline<RemapStage, ReportBuildStage> build(RemapStage{BUTTON_MAP}, ReportBuildStage());
+    InputFrame frame = {};
+    frame.report = EMPTY_GAMEPAD_REPORT;
+    measure("report_build", [&](uint32_t i) {
+        frame.report.buttons = i & ((1 << TOTAL_BUTTONS) - 1);
+        frame.report.hat = i % 9;
+        build.run(frame);
+        nativeBenchSink = frame.packed.bytes[0];
+    });
+}
+
+// --- Bluetooth ---
+
+// The report appended to an mbuf that is emptied again in place, so every
+// append starts from the same state.
+void test_os_mbuf_append() {
+    connectAndSubscribe();
+    const StickReportLayout::Report report;
+    struct os_mbuf* om = os_msys_get_pkthdr(sizeof(report.bytes), 0);
+    TEST_ASSERT_NOT_NULL(om);
+    measure("os_mbuf_append", [&](uint32_t i) {
+        om->om_len = 0;
+        OS_MBUF_PKTHDR(om)->omp_len = 0;
+        nativeBenchSink = os_mbuf_append(om, report.bytes, sizeof(report.bytes));
+    });
+    TEST_ASSERT_EQUAL_UINT16(sizeof(report.bytes), OS_MBUF_PKTLEN(om));
+    os_mbuf_free_chain(om);
+}
+
+void test_os_mbuf_copydata() {
+    connectAndSubscribe();
+    const StickReportLayout::Report report;
+    struct os_mbuf* om = ble_hs_mbuf_from_flat(report.bytes, sizeof(report.bytes));
+    TEST_ASSERT_NOT_NULL(om);
+    uint8_t copy[sizeof(report.bytes)];
+    measure("os_mbuf_copydata", [&](uint32_t i) {
+        nativeBenchSink = os_mbuf_copydata(om, 0, sizeof(copy), copy);
+    });
+    os_mbuf_free_chain(om);
+}
+
+// With the os_mbuf_free_chain() that gives the mbuf back; notify() frees it
+// once sent.
+void test_ble_hs_mbuf_from_flat() {
+    connectAndSubscribe();
+    const StickReportLayout::Report report;
+    measure("ble_hs_mbuf_from_flat", [&](uint32_t i) {
+        struct os_mbuf* om = ble_hs_mbuf_from_flat(report.bytes, sizeof(report.bytes));
+        nativeBenchSink = om != nullptr;
+        os_mbuf_free_chain(om);
+    });
+}
+
+// NimBLECharacteristic::notify() down to the controller, with a connection
+// event every PACKETS_PER_EVENT notifications, as the central would run them.
+void test_notify() {
+    connectAndSubscribe();
+    StickReportLayout::Report report;
+    const uint32_t before = controller.getNotificationCount();
+    uint32_t failed = 0;
+    measure("notify", NOTIFY_OPS, NOTIFY_BATCH_OPS, [&](uint32_t i) {
+        report.set<REPORT_FIELD_BUTTONS>(i);
+        failed += !inputReport->notify(report.bytes, sizeof(report.bytes), SimController::CONN_HANDLE);
+        if ((i + 1) % SimController::PACKETS_PER_EVENT == 0) {
+            controller.connectionEvent();
+        }
+    });
+    TEST_ASSERT_EQUAL_UINT32(0, failed);
+    TEST_ASSERT_EQUAL_UINT32(before + NOTIFY_OPS, controller.getNotificationCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    printf("{\"suite\":\"microbench\",\"version\":2,\"platform\":\"native\"}\n");
+    RUN_TEST(test_bounce2_update);
+    RUN_TEST(test_adaptive_bounce_update);
+    RUN_TEST(test_debouncer_bank_update);
+    RUN_TEST(test_socd_resolve);
+    RUN_TEST(test_report_build);
+    RUN_TEST(test_os_mbuf_append);
+    RUN_TEST(test_os_mbuf_copydata);
+    RUN_TEST(test_ble_hs_mbuf_from_flat);
+    RUN_TEST(test_notify);
+    printf("{\"suite_end\":%u}\n", benchmarks);
+    return UNITY_END();
+}
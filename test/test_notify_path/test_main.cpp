@@ -0,0 +1,250 @@
+/*
+================================================================================
+= test_notify_path                                                             =
+=                                                                              =
+= The gamepad's notify path on the PC: the NimBLE host, NimBLE-Arduino and the =
+= HID service run on Linux against SimController, a controller simulated in    =
+= this process. A simulated central connects, exchanges the MTU and subscribes =
+= to the input report; the tests check what reaches it. A second central then  =
+= connects as the mirror host, and the firmware's fan-out, ReportLinks, sends  =
+= to both: the tests check the order, the mbuf reserve and the per-link        =
+= statistics. The benchmark prints notifications per second, CPU time per      =
+= notification (every thread of the process: the caller's and the host's) and  =
+= heap allocations per notification. The times are the PC's, not the ESP32's:  =
+= compare them between builds. Allocations count the same on both.             =
+================================================================================
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <chrono>
+#include <unity.h>
+#include <NativeAllocs.h>
+#include <NimBLEDevice.h>
+#include <SimController.h>
+#include <SimGamepad.h>
+#include "InputStages.h"
+#include "ReportLinks.h"
+
+static const uint32_t BENCHMARK_NOTIFICATIONS = 100000;
+
+// The mirror central's connection, and the host slots of the two centrals.
+static const uint16_t MIRROR_CONN_HANDLE = SimController::CONN_HANDLE + 1;
+static const uint8_t ACTIVE_SLOT = 0;
+static const uint8_t MIRROR_SLOT = 2;
+
+static SimController& controller = SimController::instance();
+static NimBLECharacteristic* inputReport = nullptr;
+static uint16_t subscribedValue = 0;
+
+/**
+ * @brief Records what the central subscribed to.
+ */
+class SubscribeCallbacks : public NimBLECharacteristicCallbacks {
+    void onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) override {
+        subscribedValue = subValue;
+    }
+};
+
+static SubscribeCallbacks subscribeCallbacks;
+
+/**
+ * @brief Has a second central connect and subscribe, as the mirror slot's
+ * host reconnecting, and links both centrals in a ReportLinks as
+ * onAuthenticationComplete() and onSubscribe() would: the mirror first, so
+ * the table's order is not the order reports go out in.
+ */
+static void linkMirror(ReportLinks& links) {
+    TEST_ASSERT_TRUE(SimGamepad::connectAndSubscribe(MIRROR_CONN_HANDLE));
+    links.add(MIRROR_CONN_HANDLE, MIRROR_SLOT);
+    links.add(SimController::CONN_HANDLE, ACTIVE_SLOT);
+    links.setSubscribed(MIRROR_CONN_HANDLE, true);
+    links.setSubscribed(SimController::CONN_HANDLE, true);
+}
+
+/**
+ * @brief Runs connection events until the host has sent total notifications
+ * and the controller has transmitted them all.
+ */
+static void drain(uint32_t total) {
+    SimGamepad::waitUntil([&] {
+        while (controller.connectionEvent() > 0) {
+        }
+        return controller.getNotificationCount() >= total && controller.connectionEvent() == 0;
+    });
+}
+
+static double processCpuNs() {
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// The first test connects the central for the rest.
+void setUp() {
+    inputReport = SimGamepad::begin(StickReportLayout::descriptor.data(), StickReportLayout::descriptor.size(),
+                                    GAMEPAD_REPORT_ID, &subscribeCallbacks);
+    TEST_ASSERT_TRUE(SimGamepad::connectAndSubscribe());
+}
+
+void tearDown() {}
+
+void test_central_connects_and_subscribes() {
+    TEST_ASSERT_TRUE(controller.isConnected());
+    TEST_ASSERT_EQUAL_UINT16(1, subscribedValue); // Notifications
+}
+
+// A report the stick sends reaches the central as a notification of the
+// input report's value, byte for byte.
+void test_notify_delivers_the_report() {
+    StickReportLayout::Report report;
+    report.set<REPORT_FIELD_BUTTONS>(0x0201);
+    report.set<REPORT_FIELD_HAT>(HAT_LEFT);
+    const uint32_t before = controller.getNotificationCount();
+
+    TEST_ASSERT_TRUE(inputReport->notify(report.bytes, sizeof(report.bytes), SimController::CONN_HANDLE));
+    drain(before + 1);
+
+    uint16_t handle = 0;
+    uint8_t value[SimController::MAX_PDU];
+    TEST_ASSERT_EQUAL_UINT32(before + 1, controller.getNotificationCount());
+    TEST_ASSERT_EQUAL_UINT16(sizeof(report.bytes), controller.getLastNotification(&handle, value));
+    TEST_ASSERT_EQUAL_UINT16(inputReport->getHandle(), handle);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(report.bytes, value, sizeof(report.bytes));
+}
+
+// With the controller's buffers full the host holds notifications back, and
+// sends them as connection events free the buffers; none is lost.
+void test_notifications_wait_for_controller_buffers() {
+    const uint32_t before = controller.getNotificationCount();
+    const uint8_t report[StickReportLayout::REPORT_SIZE] = {};
+    const uint32_t count = SimController::ACL_BUFFERS + SimController::PACKETS_PER_EVENT;
+
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(inputReport->notify(report, sizeof(report), SimController::CONN_HANDLE));
+    }
+    TEST_ASSERT_EQUAL_UINT32(before + SimController::ACL_BUFFERS, controller.getNotificationCount());
+
+    drain(before + count);
+    TEST_ASSERT_EQUAL_UINT32(before + count, controller.getNotificationCount());
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getOverflowCount());
+}
+
+// --- Mirroring ---
+
+// Each report goes to the active slot's host first, then to the mirror's,
+// whichever order they joined in; making the mirror's slot active swaps them.
+void test_mirror_notified_after_active_host() {
+    ReportLinks links;
+    linkMirror(links);
+    const uint8_t report[StickReportLayout::REPORT_SIZE] = {};
+
+    const uint32_t before = controller.getNotificationCount();
+    TEST_ASSERT_TRUE(links.send(inputReport, report, sizeof(report), 0, ACTIVE_SLOT, nullptr));
+    TEST_ASSERT_TRUE(links.send(inputReport, report, sizeof(report), 0, MIRROR_SLOT, nullptr));
+    drain(before + 4);
+
+    TEST_ASSERT_EQUAL_UINT32(before + 4, controller.getNotificationCount());
+    TEST_ASSERT_EQUAL_UINT16(SimController::CONN_HANDLE, controller.getNotificationConnHandle(before));
+    TEST_ASSERT_EQUAL_UINT16(MIRROR_CONN_HANDLE, controller.getNotificationConnHandle(before + 1));
+    TEST_ASSERT_EQUAL_UINT16(MIRROR_CONN_HANDLE, controller.getNotificationConnHandle(before + 2));
+    TEST_ASSERT_EQUAL_UINT16(SimController::CONN_HANDLE, controller.getNotificationConnHandle(before + 3));
+}
+
+// With fewer than MIRROR_MBUF_RESERVE mbufs free the mirror's report is
+// skipped and counted so; the active host still gets its own. Sent reports
+// count their delay from the scan.
+void test_mirror_skipped_below_mbuf_reserve() {
+    ReportLinks links;
+    linkMirror(links);
+    const uint8_t report[StickReportLayout::REPORT_SIZE] = {};
+
+    // Leave the active host fewer mbufs than the reserve, but one to send in.
+    struct os_mbuf* held[64];
+    uint8_t heldCount = 0;
+    while (os_msys_num_free() >= ReportLinks::MIRROR_MBUF_RESERVE && heldCount < 64) {
+        held[heldCount++] = os_msys_get_pkthdr(0, 0);
+    }
+    TEST_ASSERT_EQUAL(ReportLinks::MIRROR_MBUF_RESERVE - 1, os_msys_num_free());
+
+    const uint32_t activeBefore = controller.getNotificationCount(SimController::CONN_HANDLE);
+    const uint32_t mirrorBefore = controller.getNotificationCount(MIRROR_CONN_HANDLE);
+    nativeMicros = 1500;
+    TEST_ASSERT_TRUE(links.send(inputReport, report, sizeof(report), 1000, ACTIVE_SLOT, nullptr));
+    for (uint8_t i = 0; i < heldCount; i++) {
+        os_mbuf_free_chain(held[i]);
+    }
+    nativeMicros = 2200;
+    TEST_ASSERT_TRUE(links.send(inputReport, report, sizeof(report), 2000, ACTIVE_SLOT, nullptr));
+    drain(controller.getNotificationCount() + 3);
+
+    TEST_ASSERT_EQUAL_UINT32(activeBefore + 2, controller.getNotificationCount(SimController::CONN_HANDLE));
+    TEST_ASSERT_EQUAL_UINT32(mirrorBefore + 1, controller.getNotificationCount(MIRROR_CONN_HANDLE));
+
+    ReportLinks::Stats mirror;
+    TEST_ASSERT_TRUE(links.getStats(0, ACTIVE_SLOT, mirror));
+    TEST_ASSERT_EQUAL_UINT16(MIRROR_CONN_HANDLE, mirror.connHandle);
+    TEST_ASSERT_FALSE(mirror.primary);
+    TEST_ASSERT_EQUAL_UINT32(1, mirror.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, mirror.skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, mirror.failed);
+    TEST_ASSERT_EQUAL_UINT32(200, mirror.maxDelayUs);
+
+    ReportLinks::Stats active;
+    TEST_ASSERT_TRUE(links.getStats(1, ACTIVE_SLOT, active));
+    TEST_ASSERT_EQUAL_UINT16(SimController::CONN_HANDLE, active.connHandle);
+    TEST_ASSERT_TRUE(active.primary);
+    TEST_ASSERT_EQUAL_UINT32(2, active.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, active.skipped);
+    TEST_ASSERT_EQUAL_UINT32(500, active.maxDelayUs);
+    TEST_ASSERT_EQUAL_UINT32(700, (uint32_t)active.totalDelayUs);
+    nativeMicros = 0;
+}
+
+// The stick notifies once per changed scan; the central's connection events
+// take PACKETS_PER_EVENT at a time. The caller keeps at most one event's worth
+// of notifications waiting in the host, as the firmware's report queue does.
+void test_benchmark_notify() {
+    const uint32_t before = controller.getNotificationCount();
+    StickReportLayout::Report report;
+    uint32_t failed = 0;
+
+    const uint32_t allocsBefore = nativeAllocCount.load();
+    const double cpuBefore = processCpuNs();
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCHMARK_NOTIFICATIONS; i++) {
+        report.set<REPORT_FIELD_BUTTONS>(i);
+        failed += !inputReport->notify(report.bytes, sizeof(report.bytes), SimController::CONN_HANDLE);
+        if ((i + 1) % SimController::PACKETS_PER_EVENT == 0) {
+            controller.connectionEvent();
+            const uint32_t held = SimController::PACKETS_PER_EVENT;
+            controller.waitForNotifications(before + i + 1 - held, SimGamepad::TIMEOUT_MS);
+        }
+    }
+    drain(before + BENCHMARK_NOTIFICATIONS);
+    const double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    const double cpuNs = processCpuNs() - cpuBefore;
+    const uint32_t allocs = nativeAllocCount.load() - allocsBefore;
+
+    printf("\nNotify path, %lu notifications of %u bytes, %u per connection event\n",
+           (unsigned long)BENCHMARK_NOTIFICATIONS, (unsigned)sizeof(report.bytes),
+           (unsigned)SimController::PACKETS_PER_EVENT);
+    printf("%-24s %12.0f\n", "notifications/s", BENCHMARK_NOTIFICATIONS / (wallNs / 1e9));
+    printf("%-24s %12.1f\n", "CPU ns/notification", cpuNs / BENCHMARK_NOTIFICATIONS);
+    printf("%-24s %12.2f\n", "allocs/notification", (double)allocs / BENCHMARK_NOTIFICATIONS);
+
+    TEST_ASSERT_EQUAL_UINT32(0, failed);
+    TEST_ASSERT_EQUAL_UINT32(before + BENCHMARK_NOTIFICATIONS, controller.getNotificationCount());
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getOverflowCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_central_connects_and_subscribes);
+    RUN_TEST(test_notify_delivers_the_report);
+    RUN_TEST(test_notifications_wait_for_controller_buffers);
+    RUN_TEST(test_mirror_notified_after_active_host);
+    RUN_TEST(test_mirror_skipped_below_mbuf_reserve);
+    RUN_TEST(test_benchmark_notify);
+    return UNITY_END();
+}
@@ -0,0 +1,142 @@
+/*
+================================================================================
+= test_pipeline_benchmark                                                      =
+=                                                                              =
+= The input pipeline on the PC, stage by stage: each configuration adds one    =
+= stage from InputStages.h to the one before, all fed by PatternScanStage, and =
+= its time per scan is printed as a table. The register scan, hotkeys,         =
+= direction mode and hand-off act on the hardware or the firmware's state, so  =
+= they are not here. The times are the PC's, not the ESP32's: compare them     =
+= between builds, not with the 1 ms scan period.                               =
+================================================================================
+*/
+
+#include <stdio.h>
+#include <unity.h>
+#include <NativeBench.h>
+#include "InputStages.h"
+
+static const uint32_t SCAN_US = 1000;
+static const uint32_t BENCHMARK_SCANS = 500000;
+static const uint32_t PATTERN_SCANS = 50; // One press and release per batch
+
+// The firmware's pins and button map, so the debouncers read the same bits.
+static const uint8_t BUTTON_PINS[TOTAL_BUTTONS] = {13, 12, 14, 27, 26, 25, 33, 32, 15, 4};
+static const uint8_t LEVER_PINS[4] = {19, 18, 5, 17};
+static const int BUTTON_MAP[TOTAL_BUTTONS] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+/**
+ * @brief The state the stages work on, set up as the firmware does.
+ */
+struct Stick {
+    AdaptiveBounce buttons[TOTAL_BUTTONS];
+    AdaptiveBounce lever[4];
+    MacroEngine macros;
+
+    Stick() {
+        for (int i = 0; i < TOTAL_BUTTONS; i++) {
+            setUpSwitch(buttons[i], BUTTON_PINS[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+            setUpSwitch(lever[i], LEVER_PINS[i]);
+        }
+        macros.setTurbo(1, 30);
+    }
+
+    static void setUpSwitch(AdaptiveBounce& debouncer, uint8_t pin) {
+        debouncer.attach(pin, INPUT_PULLUP);
+        debouncer.setMode(DebouncerUs::PROMPT_DETECTION);
+        debouncer.interval(5000);
+    }
+
+    PatternScanStage pattern() const { return PatternScanStage{BUTTON_PINS[0], 0}; }
+    DebounceStage debounce() { return DebounceStage{buttons, lever}; }
+    SocdStage socd() const { return SocdStage{SOCD_UP_LEFT_PRIORITY, 0, 0, 0}; }
+    MacroStage macro() { return MacroStage{&macros}; }
+    RemapStage remap() const { return RemapStage{BUTTON_MAP}; }
+};
+
+/**
+ * @brief Stands in for HotkeyStage with the chord released: what the host
+ * gets starts as the physical inputs.
+ */
+struct NoHotkeyStage {
+    PIPELINE_INLINE void process(InputFrame& frame) {
+        frame.report = frame.physical;
+    }
+};
+
+// The configurations measured, each one stage longer than the one before.
+using PatternOnly = Pipeline<PatternScanStage>;
+using Debounced = Pipeline<PatternScanStage, DebounceStage>;
+using Cleaned = Pipeline<PatternScanStage, DebounceStage, SocdStage>;
+using Macroed = Pipeline<PatternScanStage, DebounceStage, SocdStage, NoHotkeyStage, MacroStage>;
+using Mapped = Pipeline<PatternScanStage, DebounceStage, SocdStage, NoHotkeyStage, MacroStage, RemapStage>;
+using Built = Pipeline<PatternScanStage, DebounceStage, SocdStage, NoHotkeyStage, MacroStage, RemapStage,
+                       ReportBuildStage>;
+
+void setUp() {}
+
+void tearDown() {}
+
+/**
+ * @brief Times BENCHMARK_SCANS scans of a pipeline and prints the fewest and
+ * the average ns per scan. Each configuration gets a Stick of its own, so it
+ * starts from released switches and an idle macro engine.
+ */
+template <typename P, typename... Stages>
+static void measurePipeline(const char* name, const Stages&... stages) {
+    P pipeline(stages...);
+    InputFrame frame = {};
+    const BenchResult result = measureBench(BENCHMARK_SCANS, PATTERN_SCANS, [&](uint32_t i) {
+        frame.scanTimeUs = i * SCAN_US;
+        pipeline.run(frame);
+    });
+    nativeBenchSink = frame.packed.bytes[0] ^ frame.physical.buttons;
+    printf("%-36s %8.1f %8.1f\n", name, result.minNs, result.avgNs);
+    TEST_ASSERT_TRUE(result.minNs > 0);
+}
+
+// The pattern presses button 1 with bounce once per 50 scans: the full
+// pipeline must report exactly one press for each, and nothing else.
+void test_pipeline_reports_each_pattern_press_once() {
+    Stick stick;
+    Built pipeline(stick.pattern(), stick.debounce(), stick.socd(), NoHotkeyStage(), stick.macro(), stick.remap(),
+                   ReportBuildStage());
+    InputFrame frame = {};
+    uint32_t presses = 0;
+    bool held = false;
+    for (uint32_t i = 0; i < 20 * PATTERN_SCANS; i++) {
+        frame.scanTimeUs = i * SCAN_US;
+        pipeline.run(frame);
+        const bool pressed = frame.packed.bytes[0] & 0x01; // HID button 1
+        presses += pressed && !held;
+        held = pressed;
+        TEST_ASSERT_EQUAL_HEX8(0, frame.packed.bytes[0] & ~0x01);
+        TEST_ASSERT_EQUAL_UINT8(HAT_CENTERED, frame.report.hat);
+    }
+    TEST_ASSERT_EQUAL_UINT32(20, presses);
+}
+
+void test_benchmark_pipeline_stage_by_stage() {
+    printf("\nInput pipeline, %lu scans per line, ns per scan\n", (unsigned long)BENCHMARK_SCANS);
+    printf("%-36s %8s %8s\n", "Stages", "min ns", "avg ns");
+
+    Stick a, b, c, d, e, f;
+    measurePipeline<PatternOnly>("Pattern (benchmark input)", a.pattern());
+    measurePipeline<Debounced>("Pattern + Debounce", b.pattern(), b.debounce());
+    measurePipeline<Cleaned>("Pattern + Debounce + SOCD", c.pattern(), c.debounce(), c.socd());
+    measurePipeline<Macroed>("Pattern + Debounce + SOCD + Macro", d.pattern(), d.debounce(), d.socd(),
+                             NoHotkeyStage(), d.macro());
+    measurePipeline<Mapped>("... + Remap", e.pattern(), e.debounce(), e.socd(), NoHotkeyStage(), e.macro(),
+                            e.remap());
+    measurePipeline<Built>("... + Remap + Report build", f.pattern(), f.debounce(), f.socd(), NoHotkeyStage(),
+                           f.macro(), f.remap(), ReportBuildStage());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pipeline_reports_each_pattern_press_once);
+    RUN_TEST(test_benchmark_pipeline_stage_by_stage);
+    return UNITY_END();
+}
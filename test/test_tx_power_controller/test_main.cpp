@@ -0,0 +1,100 @@
+/*
+================================================================================
+= test_tx_power_controller                                                     =
+=                                                                              =
+= TxPowerController on the host: it only sees the times, RSSI samples and      =
+= failure counts it is given, so every case feeds it a hand-made sequence of   =
+= updates, one a second as the firmware does (TX_POWER_UPDATE_MS).             =
+================================================================================
+*/
+
+#include <unity.h>
+#include "TxPowerController.h"
+
+static const uint32_t UPDATE_MS = 1000;
+
+// Heard at -60 dBm at full power, the host gets about -51 dBm: above the
+// window, with room for a step down.
+static const int8_t STRONG_RSSI_DBM = -60;
+
+static TxPowerController controller;
+
+void setUp() {
+    controller = TxPowerController();
+    controller.reset(0);
+}
+
+void tearDown() {}
+
+/**
+ * @brief Feeds STRONG_RSSI_DBM until the controller steps down once.
+ * @return When it did.
+ */
+static uint32_t stepDownOnce(uint32_t fromMs) {
+    for (uint32_t nowMs = fromMs; nowMs < fromMs + 60000; nowMs += UPDATE_MS) {
+        if (controller.update(nowMs, STRONG_RSSI_DBM, 0).reason == TxPowerController::REASON_MARGIN_HIGH) {
+            return nowMs;
+        }
+    }
+    TEST_FAIL_MESSAGE("never stepped down");
+    return 0;
+}
+
+// The estimate is above the window from the first update, but the power only
+// drops once it has stayed there STEP_DOWN_AFTER_MS and HOLD_OFF_MS has
+// passed since the last change; then one step at a time.
+void test_steps_down_only_after_the_window_and_hold_off() {
+    for (uint32_t nowMs = UPDATE_MS; nowMs < TxPowerController::HOLD_OFF_MS; nowMs += UPDATE_MS) {
+        TEST_ASSERT_EQUAL(TxPowerController::REASON_NONE, controller.update(nowMs, STRONG_RSSI_DBM, 0).reason);
+    }
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM, controller.getPowerDbm());
+
+    const TxPowerController::Decision first = controller.update(TxPowerController::HOLD_OFF_MS, STRONG_RSSI_DBM, 0);
+    TEST_ASSERT_EQUAL(TxPowerController::REASON_MARGIN_HIGH, first.reason);
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM, first.fromDbm);
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM - TxPowerController::STEP_DBM, first.toDbm);
+
+    // The next step waits out the hold-off from the first one.
+    const uint32_t nextMs = TxPowerController::HOLD_OFF_MS * 2;
+    for (uint32_t nowMs = TxPowerController::HOLD_OFF_MS + UPDATE_MS; nowMs < nextMs; nowMs += UPDATE_MS) {
+        TEST_ASSERT_EQUAL(TxPowerController::REASON_NONE, controller.update(nowMs, STRONG_RSSI_DBM, 0).reason);
+    }
+    TEST_ASSERT_EQUAL(TxPowerController::REASON_MARGIN_HIGH, controller.update(nextMs, STRONG_RSSI_DBM, 0).reason);
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM - 2 * TxPowerController::STEP_DBM, controller.getPowerDbm());
+}
+
+// One sample that puts the host below the window steps up at once, though
+// the averaged estimate is still inside it, and no hold-off applies.
+void test_steps_up_at_once_on_a_raw_rssi_dip() {
+    const uint32_t steppedMs = stepDownOnce(UPDATE_MS);
+    const int8_t lowered = controller.getPowerDbm();
+
+    const int8_t dipDbm = TxPowerController::TARGET_LOW_DBM - lowered - 5;
+    const TxPowerController::Decision decision = controller.update(steppedMs + UPDATE_MS, dipDbm, 0);
+    TEST_ASSERT_EQUAL(TxPowerController::REASON_MARGIN_LOW, decision.reason);
+    TEST_ASSERT_EQUAL_INT8(lowered + TxPowerController::STEP_DBM, decision.toDbm);
+    TEST_ASSERT_TRUE(decision.estimateDbm >= TxPowerController::TARGET_LOW_DBM);
+}
+
+// A failed report goes straight to full power, whatever the RSSI says.
+void test_jumps_to_full_power_on_failures() {
+    uint32_t nowMs = stepDownOnce(UPDATE_MS);
+    nowMs = stepDownOnce(nowMs + UPDATE_MS);
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM - 2 * TxPowerController::STEP_DBM, controller.getPowerDbm());
+
+    const TxPowerController::Decision decision = controller.update(nowMs + UPDATE_MS, STRONG_RSSI_DBM, 1);
+    TEST_ASSERT_EQUAL(TxPowerController::REASON_FAILURES, decision.reason);
+    TEST_ASSERT_EQUAL_INT8(TxPowerController::MAX_DBM, decision.toDbm);
+
+    // Already at full power, more failures change nothing.
+    TEST_ASSERT_EQUAL(TxPowerController::REASON_NONE,
+                      controller.update(nowMs + 2 * UPDATE_MS, STRONG_RSSI_DBM, 3).reason);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_steps_down_only_after_the_window_and_hold_off);
+    RUN_TEST(test_steps_up_at_once_on_a_raw_rssi_dip);
+    RUN_TEST(test_jumps_to_full_power_on_failures);
+    return UNITY_END();
+}
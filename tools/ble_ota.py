@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+"""
+Firmware update client for the stick's BLE OTA service (see include/OtaService.h).
+
+    python tools/ble_ota.py .pio/build/esp32dev/firmware.bin
+    python tools/ble_ota.py firmware.bin --address AA:BB:CC:DD:EE:FF 11:22:33:44:55:66
+    python tools/ble_ota.py firmware.bin --benchmark 3
+
+The host must be paired with the stick (the OTA characteristics need an
+encrypted link). With several --address values the sticks are updated one
+after the other. An interrupted upload is resumed where it stopped.
+
+--benchmark N uploads the image N times and aborts each upload instead of
+committing it, then prints the throughput of every run; the stick keeps its
+current firmware.
+
+Requires bleak (pip install bleak).
+"""
+
+import argparse
+import asyncio
+import json
+import struct
+import sys
+import time
+import zlib
+
+from bleak import BleakClient, BleakScanner
+from bleak.exc import BleakError
+
+CONTROL_UUID = "6e1f0102-3c5a-4b8e-9d2f-a17c52e4b0d1"
+DATA_UUID = "6e1f0103-3c5a-4b8e-9d2f-a17c52e4b0d1"
+DEFAULT_NAME = "ArcadeStickESP32"
+
+CMD_BEGIN, CMD_COMMIT, CMD_ABORT, CMD_STATUS = 0x01, 0x02, 0x03, 0x04
+STATUS_READY, STATUS_PROGRESS, STATUS_RESEND, STATUS_DONE, STATUS_ERROR, STATUS_IDLE = range(1, 7)
+ERRORS = {
+    1: "image too large for the OTA partition",
+    2: "image incomplete",
+    3: "image CRC mismatch",
+    4: "flash erase/write failed",
+    5: "image rejected by the bootloader checks",
+    6: "stick busy, retry",
+    7: "no OTA partition",
+}
+
+# ATT notification/write header, plus the chunk's offset and CRC.
+ATT_HEADER = 3
+CHUNK_OVERHEAD = 8
+# The stick erases and writes its flash in sectors of this size.
+SECTOR_SIZE = 4096
+
+
+class OtaError(Exception):
+    pass
+
+
+class Upload:
+    """One upload session to one connected stick."""
+
+    def __init__(self, client, image, chunk_size, window):
+        self.client = client
+        self.image = image
+        self.crc = zlib.crc32(image) & 0xFFFFFFFF
+        self.chunk_size = chunk_size
+        self.window = window
+        self.next_offset = 0  # Next byte to send
+        self.flash_offset = 0  # Everything below is in flash
+        self.status = None
+        self.changed = asyncio.Event()
+
+    def on_notify(self, _sender, value: bytearray):
+        status, window, max_data, offset = struct.unpack("<BBHI", bytes(value[:8]))
+        if status == STATUS_ERROR:
+            self.status = (status, offset)
+        elif status == STATUS_READY:
+            self.status = (status, offset)
+            self.window = min(self.window, window) if self.window else window
+            self.chunk_size = min(self.chunk_size, max_data)
+            self.next_offset = offset
+        elif status == STATUS_PROGRESS:
+            self.flash_offset = max(self.flash_offset, offset)
+        elif status == STATUS_RESEND:
+            self.next_offset = min(self.next_offset, offset)
+        else:
+            self.status = (status, offset)
+        self.changed.set()
+
+    async def wait_for(self, statuses, timeout=10.0):
+        deadline = time.monotonic() + timeout
+        while True:
+            if self.status is not None:
+                status, value = self.status
+                if status == STATUS_ERROR:
+                    raise OtaError(ERRORS.get(value, f"error {value}"))
+                if status in statuses:
+                    self.status = None
+                    return value
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise OtaError("no answer from the stick")
+            self.changed.clear()
+            try:
+                await asyncio.wait_for(self.changed.wait(), remaining)
+            except asyncio.TimeoutError:
+                pass
+
+    async def begin(self):
+        await self.client.start_notify(CONTROL_UUID, self.on_notify)
+        self.status = None
+        await self.client.write_gatt_char(
+            CONTROL_UUID, struct.pack("<BII", CMD_BEGIN, len(self.image), self.crc), response=True)
+        return await self.wait_for({STATUS_READY})
+
+    async def wait_for_change(self):
+        """Waits for the next notification; on a stall, asks the stick where it is."""
+        try:
+            await asyncio.wait_for(self.changed.wait(), 5.0)
+        except asyncio.TimeoutError:
+            await self.client.write_gatt_char(CONTROL_UUID, bytes([CMD_STATUS]), response=True)
+            self.next_offset = min(self.next_offset, await self.wait_for({STATUS_READY}))
+
+    async def send_all(self, progress):
+        size = len(self.image)
+        while self.next_offset < size:
+            self.changed.clear()  # Before looking, so no notification is missed
+            if self.status is not None and self.status[0] == STATUS_ERROR:
+                await self.wait_for(set())  # Raises
+            in_flight = (self.next_offset - self.flash_offset) // self.chunk_size
+            if in_flight >= self.window:
+                await self.wait_for_change()  # Window full: let the flash catch up
+                continue
+            offset = self.next_offset
+            data = self.image[offset:offset + self.chunk_size]
+            packet = struct.pack("<I", offset) + data + struct.pack("<I", zlib.crc32(data) & 0xFFFFFFFF)
+            await self.client.write_gatt_char(DATA_UUID, packet, response=False)
+            self.next_offset = offset + len(data)
+            progress(self.flash_offset, size)
+
+        # Every full sector is written as it completes; the last, partial one
+        # only on COMMIT.
+        last_full_sector = size - size % SECTOR_SIZE
+        while self.flash_offset < last_full_sector:
+            self.changed.clear()
+            if self.flash_offset >= last_full_sector:
+                break
+            await self.wait_for_change()
+            if self.next_offset < size:
+                await self.send_all(progress)  # The stick asked for a resend
+                return
+        progress(size, size)
+
+    async def finish(self, commit):
+        if commit:
+            await self.client.write_gatt_char(CONTROL_UUID, bytes([CMD_COMMIT]), response=True)
+            await self.wait_for({STATUS_DONE}, timeout=30.0)
+        else:
+            await self.client.write_gatt_char(CONTROL_UUID, bytes([CMD_ABORT]), response=True)
+            await self.wait_for({STATUS_IDLE})
+
+
+async def find_address(name):
+    device = await BleakScanner.find_device_by_name(name, timeout=10.0)
+    if device is None:
+        raise OtaError(f"no device named {name!r} found")
+    return device.address
+
+
+def print_progress(done, total):
+    sys.stdout.write(f"\r  {done * 100 // total:3d}%  {done}/{total} bytes")
+    sys.stdout.flush()
+
+
+async def upload(address, image, commit, args):
+    """Uploads the image to one stick, reconnecting and resuming on disconnect.
+    Returns the seconds spent transferring, excluding reconnects."""
+    attempts = 0
+    elapsed = 0.0
+    while True:
+        try:
+            async with BleakClient(address, timeout=20.0) as client:
+                try:
+                    await client.pair()
+                except (BleakError, NotImplementedError):
+                    pass  # Already bonded, or pairing is left to the OS
+                mtu = getattr(client, "mtu_size", 23) or 23
+                chunk = args.chunk or (mtu - ATT_HEADER - CHUNK_OVERHEAD)
+                session = Upload(client, image, chunk, args.window)
+                resume = await session.begin()
+                if resume:
+                    print(f"  resuming at {resume} bytes")
+                started = time.monotonic()
+                await session.send_all(print_progress)
+                await session.finish(commit)
+                elapsed += time.monotonic() - started
+                print()
+                return elapsed
+        except (BleakError, asyncio.TimeoutError, OSError) as error:
+            attempts += 1
+            print(f"\n  link lost ({error}); reconnecting ({attempts}/{args.retries})")
+            if attempts >= args.retries:
+                raise OtaError("too many reconnects") from error
+            await asyncio.sleep(1.0)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("firmware", help="firmware image (.bin) to upload")
+    parser.add_argument("--address", nargs="+", help="stick address(es); default: scan for --name")
+    parser.add_argument("--name", default=DEFAULT_NAME, help="advertised name to scan for")
+    parser.add_argument("--chunk", type=int, help="chunk payload in bytes (default: from the MTU)")
+    parser.add_argument("--window", type=int, default=0, help="chunks in flight (default: the stick's)")
+    parser.add_argument("--retries", type=int, default=5, help="reconnects per stick before giving up")
+    parser.add_argument("--benchmark", type=int, metavar="N", help="upload N times without committing")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+    addresses = args.address or [await find_address(args.name)]
+    runs = args.benchmark or 1
+    results = []
+    for address in addresses:
+        for run in range(runs):
+            print(f"{address}: {'benchmark run ' + str(run + 1) if args.benchmark else 'updating'}"
+                  f" ({len(image)} bytes)")
+            seconds = await upload(address, image, commit=not args.benchmark, args=args)
+            rate = len(image) / seconds / 1024
+            print(f"  {seconds:.1f} s, {rate:.1f} KiB/s")
+            results.append({"address": address, "bytes": len(image), "seconds": round(seconds, 3),
+                            "kib_per_s": round(rate, 2), "committed": not args.benchmark})
+    if args.json:
+        print(json.dumps(results, indent=2))
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except OtaError as error:
+        sys.exit(f"error: {error}")
@@ -0,0 +1,510 @@
+#!/usr/bin/env python3
+"""
+End-to-end latency of the stick, as seen by a Linux host (see the clock sync
+and REPORT frames in include/TelemetryService.h).
+
+    python tools/latency_analyzer.py --device /dev/input/event17 --seconds 60
+    python tools/latency_analyzer.py --device /dev/input/event17 --address AA:BB:CC:DD:EE:FF --json
+    python tools/latency_analyzer.py --simulate
+
+The stick's own timestamps stop where it hands a report to the Bluetooth
+stack. This tool connects to the stick's telemetry service, pings its clock
+to estimate the offset and drift between the stick's clock and the host's
+(NTP-style, keeping the pings with the shortest round trip), and collects
+the REPORT frames: the scan time and submission time of every report sent.
+At the same time it reads the stick's input device (evdev), timestamped by
+the host kernel when the report arrived. Each received report is paired
+with the report the stick sent, and the scan time, mapped onto the host's
+clock, gives the true latency from scan to host: scan, pipeline, radio and
+the host's Bluetooth and HID stack.
+
+Press buttons on the stick while it runs. Pairing is by order, using the
+report sequence to step over REPORT frames the stick dropped; a received
+report more than --max-latency ms after the sent one is not paired.
+
+--simulate runs the same clock estimation and pairing against a simulated
+stick with a known clock offset and drift, connection-event timing and
+dropped REPORT frames, and compares the result with the true latencies. It
+exits with status 1 if any latency is off by more than --tolerance ms.
+
+The host must be paired with the stick. Live mode requires bleak and evdev
+(pip install bleak evdev) and read access to the input device.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import struct
+import sys
+import time
+
+SERVICE_UUID = "6e1f0001-3c5a-4b8e-9d2f-a17c52e4b0d1"
+STREAM_UUID = "6e1f0002-3c5a-4b8e-9d2f-a17c52e4b0d1"
+CONTROL_UUID = "6e1f0003-3c5a-4b8e-9d2f-a17c52e4b0d1"
+CLOCK_UUID = "6e1f0004-3c5a-4b8e-9d2f-a17c52e4b0d1"
+DEFAULT_NAME = "ArcadeStickESP32"
+
+FRAME_KEY, FRAME_DELTA, FRAME_COUNTERS, FRAME_HEAP, FRAME_STACK, FRAME_POOL, FRAME_REPORT = range(1, 8)
+
+# Pings kept per window: the one with the shortest round trip.
+PING_WINDOW = 8
+
+
+# --- Stream decoding ---
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def decode_frames(data):
+    """Yields (type, fields) for every frame of one stream notification."""
+    pos = 0
+    while pos < len(data):
+        kind = data[pos]
+        pos += 1
+        if kind == FRAME_KEY:
+            yield kind, {}
+            pos += 18
+        elif kind == FRAME_DELTA:
+            _step, pos = read_varint(data, pos)
+            _time_step, pos = read_varint(data, pos)
+            mask = data[pos]
+            pos += 1 + (2 if mask & 1 else 0) + (1 if mask & 2 else 0) + (2 if mask & 4 else 0)
+            pos += (1 if mask & 8 else 0) + (4 if mask & 16 else 0)
+            yield kind, {}
+        elif kind == FRAME_COUNTERS:
+            yield kind, {}
+            pos += 18
+        elif kind == FRAME_HEAP:
+            yield kind, {}
+            pos += 12
+        elif kind == FRAME_STACK:
+            pos += 5
+            pos += 1 + data[pos]
+            yield kind, {}
+        elif kind == FRAME_POOL:
+            yield kind, {}
+            pos += 9
+        elif kind == FRAME_REPORT:
+            sequence, scan_us, submitted_us, length = struct.unpack_from("<IIIB", data, pos)
+            pos += 13
+            report = bytes(data[pos : pos + length])
+            pos += length
+            yield kind, {"sequence": sequence, "scan_us": scan_us, "submitted_us": submitted_us, "report": report}
+        else:
+            raise ValueError(f"unknown telemetry frame type 0x{kind:02x}")
+
+
+class Unwrapper:
+    """Turns the stick's 32-bit micros() into a count that does not wrap.
+    Values must arrive less than half a wrap (35 minutes) apart."""
+
+    def __init__(self):
+        self.last = None
+
+    def __call__(self, value):
+        if self.last is None:
+            self.last = value
+        else:
+            step = (value - self.last) & 0xFFFFFFFF
+            self.last += step - (1 << 32) if step >= 1 << 31 else step
+        return self.last
+
+
+# --- Clock model ---
+
+
+class ClockModel:
+    """Offset and drift of the stick's clock against the host's, from pings.
+
+    Each ping gives t1 (host sent), t2 (stick received), t3 (stick replied)
+    and t4 (host received). The reply always waits one connection interval
+    for the next connection event, so that is taken off t4 first. Assuming
+    the rest of the way there and back take equally long, the stick's clock
+    is ahead by ((t2 - t1) + (t3 - t4)) / 2, to within half the round trip
+    (t4 - t1) - (t3 - t2). The way there also waits for a connection event,
+    anywhere up to an interval, so only the ping with the shortest round trip
+    of each window is kept; a line fitted through those gives offset and
+    drift. Host times are in seconds, stick times in microseconds."""
+
+    def __init__(self):
+        self.pings = []
+
+    def add(self, t1, t2, t3, t4, interval_s):
+        self.pings.append((t1, t2, t3, t4 - interval_s))
+
+    def fit(self):
+        if len(self.pings) < 2:
+            raise ValueError("at least two clock pings are needed")
+        best = []
+        for start in range(0, len(self.pings), PING_WINDOW):
+            window = self.pings[start : start + PING_WINDOW]
+            best.append(min(window, key=lambda p: (p[3] - p[0]) * 1e6 - (p[2] - p[1])))
+        if len(best) < 2:
+            best = sorted(self.pings, key=lambda p: (p[3] - p[0]) * 1e6 - (p[2] - p[1]))[:2]
+        points = [((t1 + t4) / 2, ((t2 - t1 * 1e6) + (t3 - t4 * 1e6)) / 2) for t1, t2, t3, t4 in best]
+        self.round_trip_us = min((t4 - t1) * 1e6 - (t3 - t2) for t1, t2, t3, t4 in best)
+        n = len(points)
+        mean_t = sum(t for t, _ in points) / n
+        mean_o = sum(o for _, o in points) / n
+        var_t = sum((t - mean_t) ** 2 for t, _ in points)
+        # Offset (us) = offset_at_zero + drift * host time (s); drift in us/s = ppm.
+        self.drift_ppm = sum((t - mean_t) * (o - mean_o) for t, o in points) / var_t if var_t > 0 else 0.0
+        self.offset_at_zero = mean_o - self.drift_ppm * mean_t
+        self.samples_used = n
+        return self
+
+    def offset_us(self, host_s):
+        return self.offset_at_zero + self.drift_ppm * host_s
+
+    def to_host(self, stick_us):
+        """The host time (s) at which the stick's clock read stick_us."""
+        # stick_us = host_s * 1e6 + offset_at_zero + drift_ppm * host_s
+        return (stick_us - self.offset_at_zero) / (1e6 + self.drift_ppm)
+
+
+# --- Pairing and statistics ---
+
+
+def pair_reports(reports, host_events, clock, max_latency_ms, slack_ms=1.0):
+    """Pairs sent reports (dicts from REPORT frames, unwrapped) with host
+    receive times, in order. Returns a list of (sequence, latency in ms)."""
+    reports = sorted(reports, key=lambda r: r["sequence"])
+    events = sorted(host_events)
+    pairs = []
+    j = 0
+    previous = None
+    for report in reports:
+        if previous is not None and report["sequence"] > previous + 1:
+            # REPORT frames the stick dropped: their reports still reached the host.
+            j += report["sequence"] - previous - 1
+        previous = report["sequence"]
+        scan = clock.to_host(report["scan_us"])
+        submitted = clock.to_host(report["submitted_us"])
+        # A host event before this report was sent belongs to an earlier one.
+        while j < len(events) and events[j] < submitted - slack_ms / 1000:
+            j += 1
+        if j >= len(events):
+            break
+        latency_ms = (events[j] - scan) * 1000
+        if latency_ms > max_latency_ms:
+            continue  # Never seen by the host
+        pairs.append((report["sequence"], latency_ms))
+        j += 1
+    return pairs
+
+
+def percentile(sorted_values, fraction):
+    index = min(len(sorted_values) - 1, max(0, int(round(fraction * (len(sorted_values) - 1)))))
+    return sorted_values[index]
+
+
+def summarize(latencies_ms):
+    values = sorted(latencies_ms)
+    if not values:
+        return {"count": 0}
+    return {
+        "count": len(values),
+        "min_ms": round(values[0], 3),
+        "mean_ms": round(sum(values) / len(values), 3),
+        "p50_ms": round(percentile(values, 0.50), 3),
+        "p90_ms": round(percentile(values, 0.90), 3),
+        "p99_ms": round(percentile(values, 0.99), 3),
+        "max_ms": round(values[-1], 3),
+    }
+
+
+def histogram(latencies_ms, bucket_ms=1.0):
+    buckets = {}
+    for value in latencies_ms:
+        bucket = int(value // bucket_ms)
+        buckets[bucket] = buckets.get(bucket, 0) + 1
+    return [(b * bucket_ms, buckets[b]) for b in sorted(buckets)]
+
+
+# --- Simulated stick ---
+
+
+class SimulatedStick:
+    """A stick and its Bluetooth link, in host time (seconds). Its clock runs
+    offset and drifting against the host's and wraps like micros(). Radio
+    traffic only moves at connection events; the host's stack adds a random
+    delay on top."""
+
+    SCAN_PERIOD_US = 1000
+
+    def __init__(self, rng, offset_s, drift_ppm, interval_ms, drop_rate):
+        self.rng = rng
+        # Starts 20 s before micros() wraps, so the run crosses the wrap.
+        self.clock_zero_us = (1 << 32) - 20_000_000 + offset_s * 1e6
+        self.drift_ppm = drift_ppm
+        self.interval = interval_ms / 1000
+        self.phase = rng.uniform(0, self.interval)
+        self.drop_rate = drop_rate
+        self.last_received = 0.0
+
+    def stick_us(self, host_s):
+        return self.clock_zero_us + host_s * (1e6 + self.drift_ppm)
+
+    def host_s(self, stick_us):
+        return (stick_us - self.clock_zero_us) / (1e6 + self.drift_ppm)
+
+    def wrapped(self, stick_us):
+        return int(stick_us) & 0xFFFFFFFF
+
+    def next_event(self, host_s):
+        """The first connection event at or after host_s."""
+        k = -(-(host_s - self.phase) // self.interval)
+        return self.phase + k * self.interval
+
+    def ping(self, t1):
+        # Host stack to the controller, then the next connection event.
+        arrival = self.next_event(t1 + self.rng.uniform(0.0002, 0.0012))
+        t2 = self.stick_us(arrival + self.rng.uniform(0.0001, 0.0004))
+        t3 = t2 + self.rng.uniform(20, 80)
+        # Reply at the next connection event, then up the host's stack.
+        back = self.next_event(self.host_s(t3) + 0.0002)
+        t4 = back + self.rng.uniform(0.0002, 0.0012)
+        return t2, t3, t4, self.interval
+
+    def press(self, host_s, sequence):
+        """One report: scanned on the stick's 1 ms grid, handed to the stack,
+        sent at the next connection event and received by the host kernel."""
+        scan_us = -(-self.stick_us(host_s) // self.SCAN_PERIOD_US) * self.SCAN_PERIOD_US
+        submitted_us = scan_us + self.rng.uniform(40, 300)
+        sent = self.next_event(self.host_s(submitted_us) + 0.0001)
+        # The host handles reports in the order they came.
+        received = max(sent + self.rng.uniform(0.0003, 0.0015), self.last_received)
+        self.last_received = received
+        frame = None
+        if self.rng.random() >= self.drop_rate:
+            frame = {
+                "sequence": sequence,
+                "scan_us": self.wrapped(scan_us),
+                "submitted_us": self.wrapped(submitted_us),
+                "report": b"",
+            }
+        return frame, received, (received - self.host_s(scan_us)) * 1000
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    stick = SimulatedStick(rng, args.sim_offset, args.sim_drift, args.sim_interval, args.sim_drop)
+    clock = ClockModel()
+    unwrap_ping = Unwrapper()
+    frames, events, truth = [], [], {}
+
+    t = 0.0
+    next_ping = 0.0
+    sequence = 0
+    while t < args.seconds:
+        t += rng.expovariate(1 / 0.08)  # A press or release every 80 ms on average
+        while next_ping < t:
+            t2, t3, t4, interval = stick.ping(next_ping)
+            clock.add(next_ping, unwrap_ping(stick.wrapped(t2)), unwrap_ping(stick.wrapped(t3)), t4, interval)
+            next_ping += args.ping_interval
+        frame, received, latency_ms = stick.press(t, sequence)
+        if frame is not None:
+            frames.append(frame)
+        events.append(received)
+        truth[sequence] = latency_ms
+        sequence += 1
+
+    result = analyze(clock, frames, events, args.max_latency)
+    errors = [abs(latency - truth[seq]) for seq, latency in result["pairs"]]
+    true_stats = summarize(list(truth.values()))
+    worst_error = max(errors) if errors else float("inf")
+    report = {
+        "mode": "simulate",
+        "seed": args.seed,
+        "true_offset_s": args.sim_offset,
+        "true_drift_ppm": args.sim_drift,
+        "estimated_drift_ppm": round(result["clock"]["drift_ppm"], 3),
+        "clock": result["clock"],
+        "reports_sent": sequence,
+        "report_frames_dropped": sequence - len(frames),
+        "paired": len(result["pairs"]),
+        "worst_error_ms": round(worst_error, 3),
+        "tolerance_ms": args.tolerance,
+        "measured": result["stats"],
+        "true": true_stats,
+        "passed": worst_error <= args.tolerance and len(result["pairs"]) >= 0.9 * len(frames),
+    }
+    print_result(report, result["latencies"], args)
+    return 0 if report["passed"] else 1
+
+
+def analyze(clock, frames, events, max_latency_ms):
+    clock.fit()
+    unwrap_scan = Unwrapper()
+    reports = []
+    for frame in sorted(frames, key=lambda f: f["sequence"]):
+        scan = unwrap_scan(frame["scan_us"])
+        submitted = scan + ((frame["submitted_us"] - frame["scan_us"]) & 0xFFFFFFFF)
+        reports.append({**frame, "scan_us": scan, "submitted_us": submitted})
+    pairs = pair_reports(reports, events, clock, max_latency_ms)
+    latencies = [latency for _, latency in pairs]
+    return {
+        "clock": {
+            "drift_ppm": clock.drift_ppm,
+            "best_round_trip_ms": round(clock.round_trip_us / 1000, 3),
+            "pings": len(clock.pings),
+            "pings_used": clock.samples_used,
+        },
+        "pairs": pairs,
+        "latencies": latencies,
+        "stats": summarize(latencies),
+    }
+
+
+def print_result(report, latencies, args):
+    if args.json:
+        print(json.dumps({**report, "latencies_ms": [round(v, 3) for v in latencies]}, indent=2))
+        return
+    clock = report["clock"]
+    print(f"Clock: drift {clock['drift_ppm']:+.2f} ppm, best round trip {clock['best_round_trip_ms']} ms "
+          f"({clock['pings_used']} of {clock['pings']} pings used); latencies are good to about half of that")
+    if report["mode"] == "simulate":
+        print(f"Simulated: drift {report['true_drift_ppm']:+.2f} ppm, {report['reports_sent']} reports, "
+              f"{report['report_frames_dropped']} REPORT frames dropped")
+    print(f"Paired {report['paired']} reports")
+    columns = ["count", "min_ms", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms"]
+    print("| | " + " | ".join(columns) + " |")
+    print("| --- " * (len(columns) + 1) + "|")
+    rows = [("Measured", report["measured"])]
+    if report["mode"] == "simulate":
+        rows.append(("True", report["true"]))
+    for label, stats in rows:
+        print(f"| {label} | " + " | ".join(str(stats.get(c, "-")) for c in columns) + " |")
+    print()
+    for start_ms, count in histogram(latencies):
+        print(f"{start_ms:5.0f} ms {count:6d} {'#' * min(60, count)}")
+    if report["mode"] == "simulate":
+        verdict = "PASS" if report["passed"] else "FAIL"
+        print(f"\n{verdict}: worst latency error {report['worst_error_ms']} ms (tolerance {report['tolerance_ms']} ms)")
+
+
+# --- Live measurement ---
+
+
+async def find_stick(args):
+    from bleak import BleakScanner
+
+    if args.address:
+        return args.address
+    print(f"Scanning for {args.name}...", file=sys.stderr)
+    device = await BleakScanner.find_device_by_name(args.name, timeout=10.0)
+    if device is None:
+        sys.exit(f"error: {args.name} not found; pass --address")
+    return device.address
+
+
+async def read_host_events(device, events, stop):
+    from evdev import ecodes
+
+    changed = False
+    async for event in device.async_read_loop():
+        if event.type in (ecodes.EV_KEY, ecodes.EV_ABS):
+            changed = True
+        elif event.type == ecodes.EV_SYN and event.code == ecodes.SYN_REPORT:
+            if changed:
+                events.append(event.timestamp())  # CLOCK_REALTIME, like time.time()
+            changed = False
+        if stop.is_set():
+            return
+
+
+async def live(args):
+    import evdev
+    from bleak import BleakClient
+
+    device = evdev.InputDevice(args.device)
+    address = await find_stick(args)
+    clock = ClockModel()
+    unwrap_ping = Unwrapper()
+    frames, events = [], []
+    sent_pings = {}
+    stop = asyncio.Event()
+
+    def on_stream(_sender, data):
+        for kind, fields in decode_frames(data):
+            if kind == FRAME_REPORT:
+                frames.append(fields)
+
+    def on_clock(_sender, data):
+        t4 = time.time()
+        ping_id, t2, t3, interval = struct.unpack("<IIIH", bytes(data[:14]))
+        t1 = sent_pings.pop(ping_id, None)
+        if t1 is not None:
+            clock.add(t1, unwrap_ping(t2), unwrap_ping(t3), t4, interval * 0.00125)
+
+    reader = asyncio.ensure_future(read_host_events(device, events, stop))
+    async with BleakClient(address) as client:
+        await client.start_notify(CLOCK_UUID, on_clock)
+        await client.start_notify(STREAM_UUID, on_stream)
+        print(f"Measuring for {args.seconds} s; press buttons on the stick...", file=sys.stderr)
+        deadline = time.monotonic() + args.seconds
+        ping_id = 0
+        while time.monotonic() < deadline:
+            sent_pings[ping_id] = time.time()
+            await client.write_gatt_char(CLOCK_UUID, struct.pack("<I", ping_id), response=False)
+            ping_id += 1
+            await asyncio.sleep(args.ping_interval)
+        await asyncio.sleep(0.5)  # The last REPORT frames wait for their batch
+        await client.stop_notify(STREAM_UUID)
+        await client.stop_notify(CLOCK_UUID)
+    stop.set()
+    reader.cancel()
+
+    if not frames:
+        sys.exit("error: no REPORT frames received (is the telemetry rate 0?)")
+    result = analyze(clock, frames, events, args.max_latency)
+    report = {
+        "mode": "live",
+        "clock": result["clock"],
+        "report_frames": len(frames),
+        "host_events": len(events),
+        "paired": len(result["pairs"]),
+        "measured": result["stats"],
+    }
+    print_result(report, result["latencies"], args)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--device", help="evdev node of the stick, e.g. /dev/input/event17 (live mode)")
+    parser.add_argument("--address", help="Bluetooth address of the stick (default: scan for --name)")
+    parser.add_argument("--name", default=DEFAULT_NAME, help="advertised name to scan for")
+    parser.add_argument("--seconds", type=float, default=60.0, help="length of the measurement")
+    parser.add_argument("--ping-interval", type=float, default=0.25, help="seconds between clock pings")
+    parser.add_argument("--max-latency", type=float, default=100.0, help="longest latency paired, in ms")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    sim = parser.add_argument_group("simulation")
+    sim.add_argument("--simulate", action="store_true", help="measure a simulated stick instead")
+    sim.add_argument("--seed", type=int, default=1, help="random seed of the simulation")
+    sim.add_argument("--sim-offset", type=float, default=1234.5678, help="stick clock offset, in s")
+    sim.add_argument("--sim-drift", type=float, default=35.0, help="stick clock drift, in ppm")
+    sim.add_argument("--sim-interval", type=float, default=7.5, help="connection interval, in ms")
+    sim.add_argument("--sim-drop", type=float, default=0.02, help="fraction of REPORT frames dropped")
+    sim.add_argument("--tolerance", type=float, default=2.0, help="largest latency error that passes, in ms")
+    args = parser.parse_args()
+
+    if args.simulate:
+        sys.exit(simulate(args))
+    if not args.device:
+        parser.error("--device is required unless --simulate is given")
+    sys.exit(asyncio.run(live(args)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Runs the native microbenchmark suite and compares it with a baseline.
+
+    python tools/microbench.py --output bench.json
+    python tools/microbench.py --baseline bench.json
+    python tools/microbench.py --log test_output.txt --baseline bench.json
+
+Runs `pio test -e native -f test_microbench -v` (test/test_microbench), which
+times each hot-path operation on the PC (Bounce2 update(), the adaptive
+debouncer, DebouncerBank, SOCD resolution, report build, os_mbuf_append,
+os_mbuf_copydata, ble_hs_mbuf_from_flat and the notification into the
+simulated controller) and prints one JSON line per operation. --log reads
+those lines from a saved test output instead.
+
+The results are printed as a table, or as JSON with --json, and saved with
+--output. With --baseline, each operation's fewest ns per op (the stable
+figure; the average also holds whatever else the PC was doing) is compared
+with the baseline's. The exit status is 1 if any operation got slower than
+--threshold percent or started allocating. Compare runs from the same PC.
+"""
+
+import argparse
+import json
+import subprocess
+import sys
+
+
+def parse(lines):
+    """The suite's header and results from the lines of the test output."""
+    suite, results = None, []
+    for line in lines:
+        start = line.find("{")  # Unity may share the line
+        if start < 0:
+            continue
+        try:
+            record = json.loads(line[start:].strip())
+        except json.JSONDecodeError:
+            continue
+        if "suite" in record:
+            suite, results = record, []  # Only the last run counts
+        elif "bench" in record and suite is not None:
+            results.append(record)
+        elif "suite_end" in record and suite is not None:
+            if record["suite_end"] != len(results):
+                sys.exit(f"error: expected {record['suite_end']} results, got {len(results)}")
+            return {"suite": suite, "results": results}
+    sys.exit("error: no complete microbenchmark suite found")
+
+
+def run(environment):
+    command = ["pio", "test", "-e", environment, "-f", "test_microbench", "-v"]
+    try:
+        output = subprocess.run(command, capture_output=True, text=True, check=False)
+    except FileNotFoundError:
+        sys.exit("error: pio not found; install PlatformIO or pass --log")
+    if output.returncode != 0:
+        sys.stderr.write(output.stdout + output.stderr)
+        sys.exit(f"error: {' '.join(command)} failed")
+    return parse(output.stdout.splitlines())
+
+
+def compare(baseline, current, threshold):
+    """One row per operation, and whether any of them regressed."""
+    before = {result["bench"]: result for result in baseline["results"]}
+    rows, regressed = [], False
+    for result in current["results"]:
+        old = before.get(result["bench"])
+        if old is None:
+            rows.append((result, "new"))
+            continue
+        change = (result["min_ns"] - old["min_ns"]) * 100 / old["min_ns"] if old["min_ns"] else 0.0
+        note = f"{change:+.1f}%"
+        if change > threshold:
+            note += " SLOWER"
+            regressed = True
+        if result["allocs_per_op"] > old["allocs_per_op"]:
+            note += " ALLOCATES"
+            regressed = True
+        rows.append((result, note))
+    return rows, regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--log", help="saved test output to read the suite from, instead of running it")
+    parser.add_argument("--environment", default="native", help="PlatformIO environment to test in")
+    parser.add_argument("--output", help="file to save the results to, as a later baseline")
+    parser.add_argument("--baseline", help="results saved by an earlier --output")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent slower that counts as a regression")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, encoding="utf-8", errors="replace") as log:
+            current = parse(log)
+    else:
+        current = run(args.environment)
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as output:
+            json.dump(current, output, indent=2)
+
+    rows, regressed = [(result, "") for result in current["results"]], False
+    if args.baseline:
+        with open(args.baseline, encoding="utf-8") as baseline:
+            rows, regressed = compare(json.load(baseline), current, args.threshold)
+
+    if args.json:
+        print(json.dumps({**current, "regressed": regressed}, indent=2))
+    else:
+        print(f"{'Operation':<24} {'min ns':>10} {'avg ns':>10} {'allocs/op':>10}  Change")
+        for result, note in rows:
+            print(f"{result['bench']:<24} {result['min_ns']:>10.2f} {result['avg_ns']:>10.2f} "
+                  f"{result['allocs_per_op']:>10.3f}  {note}")
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Before/after report of the NimBLE gamepad profile (see platformio.ini).
+
+    python tools/nimble_profile_report.py
+    python tools/nimble_profile_report.py --port COM4
+    python tools/nimble_profile_report.py --port /dev/ttyUSB0 --json
+
+Builds the esp32dev environment (gamepad profile) and the
+esp32dev_nimble_full environment (NimBLE defaults), and reports the flash
+and static RAM of each from PlatformIO's size summary. With --port, each
+build is also uploaded and the stick is reset. The report then also
+includes the free heap and the time from boot to advertising, as printed
+by the firmware at boot. The stick must start in wireless mode for that.
+
+Run it from the repository root. Requires PlatformIO; --port also needs
+pyserial (pip install pyserial), which PlatformIO already ships.
+"""
+
+import argparse
+import json
+import re
+import subprocess
+import sys
+import time
+
+ENVIRONMENTS = [("esp32dev_nimble_full", "NimBLE defaults"), ("esp32dev", "Gamepad profile")]
+
+SIZE_LINE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.MULTILINE)
+BOOT_LINE = re.compile(r"Bluetooth advertising (\d+) ms after boot, free heap (\d+) bytes")
+
+
+def pio(*args):
+    result = subprocess.run(["pio", *args], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    if result.returncode != 0:
+        sys.stdout.write(result.stdout)
+        sys.exit(f"error: pio {' '.join(args)} failed")
+    return result.stdout
+
+
+def build(env):
+    sizes = {kind.lower(): int(used) for kind, used, _total in SIZE_LINE.findall(pio("run", "-e", env))}
+    if "ram" not in sizes or "flash" not in sizes:
+        sys.exit(f"error: no size summary in the output of the {env} build")
+    return sizes
+
+
+def measure_boot(env, port, timeout):
+    import serial  # Only needed with --port
+
+    pio("run", "-e", env, "-t", "upload", "--upload-port", port)
+    with serial.Serial(port, 115200, timeout=0.5) as link:
+        # EN is wired to RTS on the usual dev boards: pulse it to reset.
+        link.dtr = False
+        link.rts = True
+        time.sleep(0.1)
+        link.rts = False
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            match = BOOT_LINE.search(link.readline().decode(errors="replace"))
+            if match:
+                return {"advertise_ms": int(match.group(1)), "free_heap": int(match.group(2))}
+    sys.exit(f"error: no boot report from {env} within {timeout} s (is the stick in wireless mode?)")
+
+
+def change(before, after):
+    return f"{after - before:+d} ({(after - before) * 100 / before:+.1f}%)" if before else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", help="serial port of a stick, to also measure heap and boot time")
+    parser.add_argument("--timeout", type=float, default=15.0, help="seconds to wait for the boot report")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    results = []
+    for env, label in ENVIRONMENTS:
+        print(f"Building {env}...", file=sys.stderr)
+        result = {"env": env, "profile": label, **build(env)}
+        if args.port:
+            print(f"Uploading {env} and waiting for the boot report...", file=sys.stderr)
+            result.update(measure_boot(env, args.port, args.timeout))
+        results.append(result)
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+        return
+
+    columns = [("flash", "Flash (bytes)"), ("ram", "Static RAM (bytes)")]
+    if args.port:
+        columns += [("free_heap", "Free heap after init (bytes)"), ("advertise_ms", "Boot to advertising (ms)")]
+    print("| Build | " + " | ".join(title for _key, title in columns) + " |")
+    print("| --- " * (len(columns) + 1) + "|")
+    for result in results:
+        print(f"| {result['profile']} | " + " | ".join(str(result[key]) for key, _title in columns) + " |")
+    before, after = results
+    print("| Change | " + " | ".join(change(before[key], after[key]) for key, _title in columns) + " |")
+
+
+if __name__ == "__main__":
+    main()